@@ -18,34 +18,41 @@ struct test
     char name[64];
     void (*fn)(void);
     int optional;
+    int bench;
     struct test *next;
 };
 static struct test test_suite_sentinel = { .next = &test_suite_sentinel };
 static struct test *test_suite_tail = &test_suite_sentinel;
 static struct test test_sentinel = { .next = &test_sentinel };
 static struct test *test_tail = &test_sentinel;
-static void add_test_to_list(const char *name, void (*fn)(void), int optional, struct test **tail)
+static void add_test_to_list(const char *name, void (*fn)(void), int optional, int bench,
+    struct test **tail)
 {
     struct test *test = calloc(1, sizeof *test);
     strncpy(test->name, name, sizeof test->name - 1);
     test->name[sizeof test->name - 1] = '\0';
     test->fn = fn;
     test->optional = optional;
+    test->bench = bench;
     test->next = (*tail)->next;
     (*tail)->next = test;
     (*tail) = test;
 }
 void tlib_add_test_suite(const char *name, void (*fn)(void))
 {
-    add_test_to_list(name, fn, 0, &test_suite_tail);
+    add_test_to_list(name, fn, 0, 0, &test_suite_tail);
 }
 void tlib_add_test(const char *name, void (*fn)(void))
 {
-    add_test_to_list(name, fn, 0, &test_tail);
+    add_test_to_list(name, fn, 0, 0, &test_tail);
 }
 void tlib_add_test_opt(const char *name, void (*fn)(void))
 {
-    add_test_to_list(name, fn, 1, &test_tail);
+    add_test_to_list(name, fn, 1, 0, &test_tail);
+}
+void tlib_add_test_bench(const char *name, void (*fn)(void))
+{
+    add_test_to_list(name, fn, 1, 1, &test_tail);
 }
 
 static FILE *tlib_out, *tlib_err;
@@ -68,6 +75,108 @@ static double run_test(struct test *test)
     return difftime(t1, t0);
 #endif
 }
+#define BENCH_MAXREPEAT                 100
+static unsigned long bench_warmup = 1, bench_repeat = 5;
+static double bench_tolerance = 10.0;
+static const char *bench_baseline_file, *bench_record_file;
+static int bench_all, bench_failures;
+static double bench_wall(void)
+{
+#if defined(_WIN64) || defined(_WIN32)
+    int __stdcall QueryPerformanceCounter(long long *);
+    int __stdcall QueryPerformanceFrequency(long long *);
+    long long c, f;
+    QueryPerformanceCounter(&c);
+    QueryPerformanceFrequency(&f);
+    return (double)c / (double)f;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1000000000.0;
+#endif
+}
+static double bench_cpu(void)
+{
+#if defined(_WIN64) || defined(_WIN32)
+    void *__stdcall GetCurrentProcess(void);
+    int __stdcall GetProcessTimes(void *,
+        unsigned long long *, unsigned long long *, unsigned long long *, unsigned long long *);
+    unsigned long long creat, exit_, kern, user;
+    GetProcessTimes(GetCurrentProcess(), &creat, &exit_, &kern, &user);
+    return (kern + user) / 10000000.0;
+#else
+    return (double)clock() / CLOCKS_PER_SEC;
+#endif
+}
+static int bench_timecmp(const void *x, const void *y)
+{
+    double a = *(const double *)x, b = *(const double *)y;
+    return a < b ? -1 : a > b ? +1 : 0;
+}
+static int bench_baseline_lookup(const char *name, double *pvalue)
+{
+    FILE *f;
+    char line[256], lname[64];
+    double v;
+    int found = 0;
+    if (0 == bench_baseline_file)
+        return 0;
+    f = fopen(bench_baseline_file, "r");
+    if (0 == f)
+        return 0;
+    while (0 != fgets(line, sizeof line, f))
+        if (2 == sscanf(line, "%63s %lf", lname, &v) && 0 == strcmp(lname, name))
+        {
+            *pvalue = v;
+            found = 1;
+            break;
+        }
+    fclose(f);
+    return found;
+}
+static void bench_record(const char *name, double value)
+{
+    static FILE *f;
+    if (0 == bench_record_file)
+        return;
+    if (0 == f)
+        f = fopen(bench_record_file, "w");
+    if (0 == f)
+        return;
+    fprintf(f, "%s %.6f\n", name, value);
+    fflush(f);
+}
+static int run_bench(struct test *test, char *info, size_t infosize)
+{
+    double times[BENCH_MAXREPEAT];
+    double wall0, cpu0, cpu1, median, cpu, baseline;
+    for (unsigned long i = 0; bench_warmup > i; i++)
+        test->fn();
+    cpu0 = bench_cpu();
+    for (unsigned long i = 0; bench_repeat > i; i++)
+    {
+        wall0 = bench_wall();
+        test->fn();
+        times[i] = bench_wall() - wall0;
+    }
+    cpu1 = bench_cpu();
+    qsort(times, bench_repeat, sizeof times[0], bench_timecmp);
+    median = times[bench_repeat / 2];
+    cpu = (cpu1 - cpu0) / bench_repeat;
+    snprintf(info, infosize, "bench median %.3fs min %.3fs max %.3fs cpu %.3fs",
+        median, times[0], times[bench_repeat - 1], cpu);
+    bench_record(test->name, median);
+    if (bench_baseline_lookup(test->name, &baseline) &&
+        median > baseline * (1 + bench_tolerance / 100))
+    {
+        size_t l = strlen(info);
+        snprintf(info + l, infosize - l, " REGRESSED from %.3fs (tolerance %.0f%%)",
+            baseline, bench_tolerance);
+        bench_failures++;
+        return 1;
+    }
+    return 0;
+}
 static void do_test_default(struct test *test, int testno)
 {
     if (0 != test)
@@ -81,8 +190,17 @@ static void do_test_default(struct test *test, int testno)
         memset(dispname + displen, '.', sizeof dispname - 1 - displen);
         dispname[sizeof dispname - 1] = '\0';
         test_printf("%s ", dispname);
-        double d = run_test(test);
-        test_printf("OK %.2fs\n", d);
+        if (test->bench)
+        {
+            char info[192];
+            int regressed = run_bench(test, info, sizeof info);
+            test_printf("%s %s\n", regressed ? "KO" : "OK", info);
+        }
+        else
+        {
+            double d = run_test(test);
+            test_printf("OK %.2fs\n", d);
+        }
     }
     else
         test_printf("--- COMPLETE ---\n");
@@ -97,8 +215,17 @@ static void do_test_tap(struct test *test, int testno)
     if (0 != test)
     {
         snprintf(assert_buf, sizeof assert_buf, "not ok %d %s\n# ", testno + 1, test->name);
-        run_test(test);
-        test_printf("ok %d %s\n", testno + 1, test->name);
+        if (test->bench)
+        {
+            char info[192];
+            int regressed = run_bench(test, info, sizeof info);
+            test_printf("%s %d %s # %s\n", regressed ? "not ok" : "ok", testno + 1, test->name, info);
+        }
+        else
+        {
+            run_test(test);
+            test_printf("ok %d %s\n", testno + 1, test->name);
+        }
     }
     else
         test_printf("1..%d\n", testno);
@@ -140,6 +267,24 @@ void tlib_run_tests(int argc, char *argv[])
                 no_abort = 1;
             else if (0 == strcmp("--repeat-forever", a))
                 repeat = ULONG_MAX;
+            else if (0 == strcmp("--bench", a))
+                bench_all = 1;
+            else if (0 == strncmp("--bench-warmup=", a, 15))
+                bench_warmup = strtoul(a + 15, 0, 10);
+            else if (0 == strncmp("--bench-repeat=", a, 15))
+            {
+                bench_repeat = strtoul(a + 15, 0, 10);
+                if (0 == bench_repeat)
+                    bench_repeat = 1;
+                else if (BENCH_MAXREPEAT < bench_repeat)
+                    bench_repeat = BENCH_MAXREPEAT;
+            }
+            else if (0 == strncmp("--bench-record=", a, 15))
+                bench_record_file = a + 15;
+            else if (0 == strncmp("--bench-baseline=", a, 17))
+                bench_baseline_file = a + 17;
+            else if (0 == strncmp("--bench-tolerance=", a, 18))
+                bench_tolerance = strtod(a + 18, 0);
             else if ('-' == a[1])
             {
                 fprintf(stderr, "tlib_run_tests: unknown option %s\n", a);
@@ -156,7 +301,7 @@ void tlib_run_tests(int argc, char *argv[])
         int testno = 0;
         for (struct test *test = test_tail->next->next; 0 != test->fn; test = test->next)
         {
-            int match_arg = match_any && !test->optional;
+            int match_arg = match_any && (!test->optional || (bench_all && test->bench));
             for (char **ap = argv, **aendp = ap + argc; aendp > ap; aendp--)
             {
                 const char *a = aendp[-1];
@@ -198,6 +343,8 @@ void tlib_run_tests(int argc, char *argv[])
         }
         do_test(0, testno);
     }
+    if (0 != bench_failures)
+        exit(1);
 }
 void tlib__assert(const char *func, const char *file, int line, const char *expr)
 {
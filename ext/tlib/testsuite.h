@@ -61,9 +61,27 @@
         tlib_add_test_opt(#fn, fn);\
     } while (0)
 
+/**
+ * Register a benchmark test case for execution.
+ *
+ * Benchmark test cases are simple functions with prototype <code>void testcase()</code>.
+ * Benchmark tests are not executed by default; execute them with --bench or by naming
+ * them with +TESTNAME. A benchmark test is repeated (see --bench-warmup, --bench-repeat)
+ * and its wall/CPU times are reported with median/min/max. With --bench-baseline a
+ * benchmark fails if its median regresses beyond the tolerance against the stored
+ * baseline value.
+ */
+#define TEST_BENCH(fn)\
+    do\
+    {\
+        void fn(void);\
+        tlib_add_test_bench(#fn, fn);\
+    } while (0)
+
 void tlib_add_test_suite(const char *name, void (*fn)(void));
 void tlib_add_test(const char *name, void (*fn)(void));
 void tlib_add_test_opt(const char *name, void (*fn)(void));
+void tlib_add_test_bench(const char *name, void (*fn)(void));
 
 /**
  * Printf function.
@@ -83,7 +101,10 @@ void tlib_printf(const char *fmt, ...);
  * register any test cases. It will then execute all registered test cases according to the
  * command line arguments passed in argv. The command line syntax is a follows:
  *
- * Usage: testprog [--list][[--tap][--no-abort][--repeat-forever] [[+-]TESTNAME...]
+ * Usage: testprog [--list][[--tap][--no-abort][--repeat-forever]
+ *     [--bench][--bench-warmup=N][--bench-repeat=N]
+ *     [--bench-record=FILE][--bench-baseline=FILE][--bench-tolerance=PERCENT]
+ *     [[+-]TESTNAME...]
  *
  * <ul>
  * <li>--list - list tests only</li>
@@ -91,6 +112,12 @@ void tlib_printf(const char *fmt, ...);
  * <li>--no-abort - do not abort all tests when an ASSERT fails
  * (only the current test is aborted)</li>
  * <li>--repeat-forever - repeat tests forever</li>
+ * <li>--bench - also execute benchmark test cases</li>
+ * <li>--bench-warmup=N - untimed runs before measuring (default 1)</li>
+ * <li>--bench-repeat=N - timed runs per benchmark (default 5)</li>
+ * <li>--bench-record=FILE - write benchmark medians to FILE</li>
+ * <li>--bench-baseline=FILE - fail benchmarks that regress against FILE</li>
+ * <li>--bench-tolerance=PERCENT - allowed regression (default 10)</li>
  * </ul>
  *
  * By default all test cases are executed unless specific test cases are named. By default optional
@@ -719,6 +719,7 @@ static void do_unmount(void)
     int fusefd = -1;
     int mnt_id;
     WSLFUSE_IOCTL_LXMOUNT_ARG LxMountArg;
+    WSLFUSE_IOCTL_UNMOUNT_ARG UnmountArg;
 
     /*
      * Open the /dev/fuse device.
@@ -763,14 +764,15 @@ static void do_unmount(void)
     }
 
     /*
-     * Disassociate the WSL mnt_id from the /dev/fuse fd.
+     * Tear down the mount in a single call: disassociate the WSL mnt_id and
+     * release the Windows mount point without waiting for the file system
+     * to close its /dev/fuse fd.
      */
-    memset(&LxMountArg, 0, sizeof LxMountArg);
-    LxMountArg.Operation = '-';
-    LxMountArg.LxMountId = (UINT64)mnt_id;
-    if (-1 == ioctl(fusefd, WSLFUSE_IOCTL_LXMOUNT, &LxMountArg) && ENOENT != errno)
+    memset(&UnmountArg, 0, sizeof UnmountArg);
+    UnmountArg.LxMountId = (UINT64)mnt_id;
+    if (-1 == ioctl(fusefd, WSLFUSE_IOCTL_UNMOUNT, &UnmountArg) && ENOENT != errno)
     {
-        warn("unmount: cannot ioctl(m) /dev/fuse: %s", strerror(errno));
+        warn("unmount: cannot ioctl(t) /dev/fuse: %s", strerror(errno));
         goto exit;
     }
 
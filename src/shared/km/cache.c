@@ -20,6 +20,9 @@
  */
 
 #include <shared/km/shared.h>
+#if defined(_M_X64)
+#include <emmintrin.h>
+#endif
 
 /*
  * FUSE "entry" cache
@@ -33,6 +36,10 @@
  * (1) Entries have an expiration time after which they may no longer be valid.
  * Entries that have expired must not be returned to users of this class and must eventually
  * be "forgotten" (i.e. a FUSE FORGET message must be sent to the user mode file system).
+ * The FUSE protocol reports two validities per entry: entry_valid bounds the name to
+ * inode mapping and governs residency in this cache, while attr_valid bounds the
+ * attributes and is tracked separately, so that a file system may mark a name as long
+ * lived while requiring frequent attribute revalidation (or vice versa).
  *
  * (2) Entries may be in use when they become expired/invalid. In this case the
  * corresponding FORGET message must be delayed to ensure that the user mode file system
@@ -57,9 +64,50 @@
  *
  * These two primary complications together with the fact that the implementation must
  * deal with failures and re-setting existing entries make the code rather complicated.
+ *
+ * The cache also supports negative entries: a cached entry with nodeid == 0 records
+ * that a name is known NOT to exist, so that repeated lookups of non-existent names
+ * (a very common Windows access pattern) do not have to go to the user mode file
+ * system. Negative entries are not LOOKUP'ed and are freed without FORGET; they are
+ * invalidated by FuseCacheRemoveEntry or displaced when a real entry is set.
+ *
+ * To avoid serializing all cache users on a single lock the hash table is sharded:
+ * every hash chain belongs to exactly one shard and each shard has its own lock,
+ * LRU list, "forget list" and item count. Concurrent lookups of entries that hash
+ * to different shards do not contend. The generation list remains global under its
+ * own lock, because generations order FORGET's across the whole cache.
+ *
+ * The cache additionally maintains a full-path index: a resolved path maps to the
+ * ordered array of (referenced) cache items for its components, so that a hot path
+ * can be resolved with a single hash probe instead of one probe per component. A
+ * path mapping is valid only while every component item is still current (fresh,
+ * not explicitly invalidated and still chained parent to child), which makes a hit
+ * exactly as trustworthy as walking the per-component entries.
+ *
+ * A secondary index keyed by inode number spans the same items, so that handle-based
+ * operations that know only an ino (fstat-style queries on open files) can consult
+ * cached attributes without knowing the (parent, name) tuple. The index is maintained
+ * at the same two points where items enter and leave the hash table and is protected
+ * by its own lock, which nests inside the shard locks. Hard links may chain multiple
+ * items for the same ino; any fresh one serves. See FuseCacheGetAttrByIno.
+ *
+ * Finally the cache keeps a small number of directory listing buffers, keyed by
+ * (Ino, offset): raw READDIR(PLUS) response buffers that allow repeated directory
+ * enumerations to be served without a round trip to the user mode file system.
+ * Listing buffers honor the directory's entry timeout and are invalidated when an
+ * entry is created, removed or renamed under the directory.
+ *
+ * Expiration is driven by a periodic timer, but the periodic sweep is gated by a
+ * next-due watermark (the earliest expiration time inserted) and a sweep-pending
+ * flag (set when forget or quick-expire work is produced), so that idle caches do
+ * no per-tick work at all. See FuseCacheScheduleExpiration. Independently of the
+ * timer, a forget backlog that crosses a threshold is posted immediately (see
+ * FuseCacheFlushForgotten), so that mass deletes do not accumulate unbounded
+ * forget work between ticks.
  */
 
-NTSTATUS FuseCacheCreate(ULONG Capacity, BOOLEAN CaseInsensitive, FUSE_CACHE **PCache);
+NTSTATUS FuseCacheCreate(ULONG Capacity, BOOLEAN CaseInsensitive,
+    FUSE_INSTANCE *Instance, FUSE_CACHE **PCache);
 VOID FuseCacheDelete(FUSE_CACHE *Cache);
 VOID FuseCacheExpirationRoutine(FUSE_CACHE *Cache,
     FUSE_INSTANCE *Instance, UINT64 ExpirationTime);
@@ -69,12 +117,31 @@ BOOLEAN FuseCacheGetEntry(FUSE_CACHE *Cache, UINT64 ParentIno, PSTRING Name,
     FUSE_PROTO_ENTRY *Entry, PVOID *PItem);
 VOID FuseCacheSetEntry(FUSE_CACHE *Cache, UINT64 ParentIno, PSTRING Name,
     FUSE_PROTO_ENTRY *Entry, PVOID *PItem);
+VOID FuseCacheSetNegativeEntry(FUSE_CACHE *Cache, UINT64 ParentIno, PSTRING Name);
 VOID FuseCacheRemoveEntry(FUSE_CACHE *Cache, UINT64 ParentIno, PSTRING Name);
+BOOLEAN FuseCacheGetAttrByIno(FUSE_CACHE *Cache, UINT64 Ino, FUSE_PROTO_ATTR *Attr);
+BOOLEAN FuseCacheGetPath(FUSE_CACHE *Cache, PSTRING Path,
+    FUSE_CACHE_PATH_ATTR *Attrs, PULONG PCount,
+    FUSE_PROTO_ATTR *Attr, PVOID *PItem);
+VOID FuseCacheSetPath(FUSE_CACHE *Cache, PSTRING Path, PVOID *Items, ULONG Count);
+UINT64 FuseCacheItemTimeout(PVOID Item);
+BOOLEAN FuseCacheGetDirBuffer(FUSE_CACHE *Cache, UINT64 Ino, UINT64 Offset,
+    PVOID *PBuffer, PULONG PLength);
+VOID FuseCacheSetDirBuffer(FUSE_CACHE *Cache, UINT64 Ino, UINT64 Offset,
+    PVOID Buffer, ULONG Length, UINT64 Timeout);
+VOID FuseCacheRemoveDirBuffers(FUSE_CACHE *Cache, UINT64 Ino);
+BOOLEAN FuseCacheGetDataBuffer(FUSE_CACHE *Cache, UINT64 Ino, UINT64 Offset,
+    PVOID Buffer, ULONG Length, PULONG PBytesTransferred);
+VOID FuseCacheSetDataBuffer(FUSE_CACHE *Cache, UINT64 Ino, UINT64 Offset,
+    PVOID Buffer, ULONG Length, BOOLEAN Eof, UINT64 Timeout);
+VOID FuseCacheRemoveDataBuffers(FUSE_CACHE *Cache, UINT64 Ino);
 VOID FuseCacheReferenceItem(FUSE_CACHE *Cache, PVOID Item);
 VOID FuseCacheDereferenceItem(FUSE_CACHE *Cache, PVOID Item);
 VOID FuseCacheQuickExpireItem(FUSE_CACHE *Cache, PVOID Item);
 VOID FuseCacheDeleteForgotten(PLIST_ENTRY ForgetList);
 BOOLEAN FuseCacheForgetOne(PLIST_ENTRY ForgetList, FUSE_PROTO_FORGET_ONE *PForgetOne);
+VOID FuseCacheGetStatistics(FUSE_CACHE *Cache, FUSE_STATISTICS *Statistics);
+static VOID FuseCacheFlushForgotten(FUSE_CACHE *Cache);
 
 #ifdef ALLOC_PRAGMA
 #pragma alloc_text(PAGE, FuseCacheCreate)
@@ -84,25 +151,125 @@ BOOLEAN FuseCacheForgetOne(PLIST_ENTRY ForgetList, FUSE_PROTO_FORGET_ONE *PForge
 #pragma alloc_text(PAGE, FuseCacheDereferenceGen)
 #pragma alloc_text(PAGE, FuseCacheGetEntry)
 #pragma alloc_text(PAGE, FuseCacheSetEntry)
+#pragma alloc_text(PAGE, FuseCacheSetNegativeEntry)
 #pragma alloc_text(PAGE, FuseCacheRemoveEntry)
+#pragma alloc_text(PAGE, FuseCacheGetAttrByIno)
+#pragma alloc_text(PAGE, FuseCacheGetPath)
+#pragma alloc_text(PAGE, FuseCacheSetPath)
+#pragma alloc_text(PAGE, FuseCacheItemTimeout)
+#pragma alloc_text(PAGE, FuseCacheGetDirBuffer)
+#pragma alloc_text(PAGE, FuseCacheSetDirBuffer)
+#pragma alloc_text(PAGE, FuseCacheRemoveDirBuffers)
+#pragma alloc_text(PAGE, FuseCacheGetDataBuffer)
+#pragma alloc_text(PAGE, FuseCacheSetDataBuffer)
+#pragma alloc_text(PAGE, FuseCacheRemoveDataBuffers)
 #pragma alloc_text(PAGE, FuseCacheReferenceItem)
 #pragma alloc_text(PAGE, FuseCacheDereferenceItem)
 #pragma alloc_text(PAGE, FuseCacheQuickExpireItem)
 #pragma alloc_text(PAGE, FuseCacheDeleteForgotten)
 #pragma alloc_text(PAGE, FuseCacheForgetOne)
+#pragma alloc_text(PAGE, FuseCacheGetStatistics)
+#pragma alloc_text(PAGE, FuseCacheFlushForgotten)
 #endif
 
+/* how long a negative entry remains valid (in 100ns units) */
+#define FUSE_CACHE_NEGATIVE_TIMEOUT     (1 * 10000000ULL)
+
+#define FUSE_CACHE_SHARD_COUNT          16
+
+/* how many directory listing buffers to keep (they can be large) */
+#define FUSE_CACHE_DIR_CAPACITY         64
+
+/* how many file data blocks to keep (they can be large) */
+#define FUSE_CACHE_DATA_CAPACITY        256
+
+/* how many full-path mappings to keep */
+#define FUSE_CACHE_PATH_CAPACITY        256
+#define FUSE_CACHE_PATH_BUCKET_COUNT    256
+
+/* post accumulated forgets without waiting for the next sweep past this many items */
+#define FUSE_CACHE_FORGET_FLUSH_THRESHOLD 256
+
+/* names up to this length get case folded on case-insensitive volumes;
+longer names are keyed as-is (a case-mismatched probe then misses and falls
+back to LOOKUP, which remains correct) */
+#define FUSE_CACHE_FOLD_SIZEMAX         256
+/* a folded UTF-8 name is at most 3/2 the size of the original
+(2-byte sequences may fold to 3-byte sequences; ASCII never grows) */
+#define FUSE_CACHE_FOLD_BUFSIZE         (FUSE_CACHE_FOLD_SIZEMAX * 3 / 2)
+
+/* when a shard reaches capacity, evict LRU items down to the low watermark */
+#define FUSE_CACHE_LOWATER(C)           ((C) - (C) / 4)
+/* when the system is low on memory, shed LRU items down to half capacity */
+#define FUSE_CACHE_LOWMEM_LOWATER(C)    ((C) / 2)
+
 typedef struct _FUSE_CACHE_ITEM FUSE_CACHE_ITEM;
 
-struct _FUSE_CACHE
+typedef struct _FUSE_CACHE_SHARD
 {
-    ULONG Capacity;
-    BOOLEAN CaseInsensitive;
     FAST_MUTEX Mutex;
-    LIST_ENTRY GenList;
     LIST_ENTRY ItemList;
     LIST_ENTRY ForgetList;
     ULONG ItemCount;
+    UINT64 GetEntryHits, GetEntryMisses; /* protected by the shard mutex */
+} FUSE_CACHE_SHARD;
+
+typedef struct _FUSE_CACHE_DIR_ITEM
+{
+    LIST_ENTRY ListEntry;
+    UINT64 Ino;
+    UINT64 Offset;
+    UINT64 ExpirationTime;
+    ULONG Length;
+    UINT8 Buffer[];
+} FUSE_CACHE_DIR_ITEM;
+
+typedef struct _FUSE_CACHE_DATA_ITEM
+{
+    LIST_ENTRY ListEntry;
+    UINT64 Ino;
+    UINT64 Offset;
+    UINT64 ExpirationTime;
+    ULONG Length;
+    BOOLEAN Eof;                        /* the block extends to the end of the file */
+    UINT8 Buffer[];
+} FUSE_CACHE_DATA_ITEM;
+
+typedef struct _FUSE_CACHE_PATH_ITEM
+{
+    struct _FUSE_CACHE_PATH_ITEM *DictNext;
+    LIST_ENTRY ListEntry;
+    ULONG Hash;
+    STRING Path;
+    ULONG ComponentCount;
+    FUSE_CACHE_ITEM *Components[];      /* referenced; path buffer follows */
+} FUSE_CACHE_PATH_ITEM;
+
+struct _FUSE_CACHE
+{
+    FUSE_INSTANCE *Instance;
+    ULONG Capacity;                     /* per shard */
+    BOOLEAN CaseInsensitive;
+    PKEVENT LowMemoryEvent;
+    INT64 NextExpirationTime;           /* earliest time a sweep may find work (see FuseCacheScheduleExpiration) */
+    LONG SweepPending;                  /* forget/quick-expire work awaits a sweep */
+    LONG ForgetCount;                   /* items across all shards' "forget lists" */
+    LONG ForgetFlushPending;            /* ForgetCount crossed the flush threshold */
+    FAST_MUTEX GenMutex;
+    LIST_ENTRY GenList;
+    FAST_MUTEX DirMutex;
+    LIST_ENTRY DirList;                 /* in most-recently used order */
+    ULONG DirItemCount;
+    FAST_MUTEX DataMutex;
+    LIST_ENTRY DataList;                /* in most-recently used order */
+    ULONG DataItemCount;
+    FAST_MUTEX PathMutex;
+    LIST_ENTRY PathList;                /* in most-recently used order */
+    ULONG PathItemCount;
+    FUSE_CACHE_PATH_ITEM *PathBuckets[FUSE_CACHE_PATH_BUCKET_COUNT];
+    FAST_MUTEX InoMutex;                /* secondary by-ino index; nests inside the shard mutexes */
+    PVOID *InoBuckets;                  /* ItemBucketCount entries */
+    FUSE_CACHE_SHARD Shards[FUSE_CACHE_SHARD_COUNT];
     ULONG ItemBucketCount;
     PVOID ItemBuckets[];
 };
@@ -117,21 +284,38 @@ struct _FUSE_CACHE_GEN
 struct _FUSE_CACHE_ITEM
 {
     struct _FUSE_CACHE_ITEM *DictNext;
+    struct _FUSE_CACHE_ITEM *InoDictNext;
     LIST_ENTRY ListEntry;
     BOOLEAN NoForget;
     ULONG Hash;
     UINT64 ParentIno;
     STRING Name;
+    STRING FoldedName;                  /* lookup key: case folded copy of Name on
+                                        case-insensitive volumes, aliases Name otherwise */
     UINT64 NLookup;
-    UINT64 ExpirationTime;
+    UINT64 ExpirationTime;              /* entry (name to inode) validity */
+    UINT64 AttrExpirationTime;          /* attribute validity; may differ from entry validity */
     UINT64 LastUsedTime;
     FUSE_PROTO_ENTRY Entry;
     LONG QuickExpiry;
     LONG RefCount;
-    CHAR NameBuf[];
+    CHAR NameBuf[];                     /* Name bytes followed by FoldedName bytes (if distinct) */
 };
 
+typedef struct _FUSE_CACHE_FOLD
+{
+    STRING Name;
+    CHAR Buf[FUSE_CACHE_FOLD_BUFSIZE];
+} FUSE_CACHE_FOLD;
+
+static inline FUSE_CACHE_SHARD *FuseCacheHashShard(FUSE_CACHE *Cache, ULONG Hash)
+{
+    /* every hash chain maps to exactly one shard */
+    return &Cache->Shards[Hash % Cache->ItemBucketCount % FUSE_CACHE_SHARD_COUNT];
+}
+
 static inline UINT64 FuseCacheForgetTime(FUSE_CACHE *Cache, UINT64 InterruptTime)
+    /* must be called with the GenMutex held */
 {
     if (!IsListEmpty(&Cache->GenList))
     {
@@ -142,23 +326,92 @@ static inline UINT64 FuseCacheForgetTime(FUSE_CACHE *Cache, UINT64 InterruptTime
     return InterruptTime;
 }
 
-static inline BOOLEAN FuseCacheForgetNextItem(FUSE_CACHE *Cache,
-    UINT64 ExpirationTime, PLIST_ENTRY ForgetList)
+static inline VOID FuseCacheScheduleExpiration(FUSE_CACHE *Cache, UINT64 ExpirationTime)
+    /*
+     * Lower the cache's next-due watermark. The expiration routine skips its sweep
+     * entirely while the watermark lies in the future and no forget/quick-expire
+     * work is pending, so that idle caches cost nothing per timer tick. The
+     * watermark is conservative: it may overshoot for items that are not at their
+     * shard's LRU head, but such items are never served stale (all get paths check
+     * expiry on access) and are reaped at the next due sweep.
+     */
+{
+    for (;;)
+    {
+        INT64 NextTime = InterlockedCompareExchange64(&Cache->NextExpirationTime, 0, 0);
+        if ((UINT64)NextTime <= ExpirationTime)
+            break;
+        if (NextTime == InterlockedCompareExchange64(
+                &Cache->NextExpirationTime, (INT64)ExpirationTime, NextTime))
+            break;
+    }
+}
+
+static inline VOID FuseCacheCountForgottenItem(FUSE_CACHE *Cache)
+    /*
+     * Account for an item that entered a shard's "forget list". Mass deletes
+     * produce forgets far faster than the periodic sweep consumes them; when
+     * the backlog crosses the flush threshold, note that an immediate flush
+     * is due (performed by FuseCacheFlushForgotten at the next opportunity)
+     * so that forget traffic is posted in large batches instead of piling up
+     * until the next timer tick.
+     */
+{
+    InterlockedExchange(&Cache->SweepPending, 1);
+    if (FUSE_CACHE_FORGET_FLUSH_THRESHOLD == InterlockedIncrement(&Cache->ForgetCount))
+        InterlockedExchange(&Cache->ForgetFlushPending, 1);
+}
+
+static inline BOOLEAN FuseCacheForgetNextItem(FUSE_CACHE *Cache, FUSE_CACHE_SHARD *Shard,
+    UINT64 ForgetTime, PLIST_ENTRY ForgetList)
 {
-    if (!IsListEmpty(&Cache->ForgetList))
+    if (!IsListEmpty(&Shard->ForgetList))
     {
-        FUSE_CACHE_ITEM *Item = CONTAINING_RECORD(Cache->ForgetList.Flink, FUSE_CACHE_ITEM, ListEntry);
-        if (FuseCacheForgetTime(Cache, ExpirationTime) >= Item->LastUsedTime)
+        FUSE_CACHE_ITEM *Item = CONTAINING_RECORD(Shard->ForgetList.Flink, FUSE_CACHE_ITEM, ListEntry);
+        if (ForgetTime >= Item->LastUsedTime)
         {
             RemoveEntryList(&Item->ListEntry);
             InsertTailList(ForgetList, &Item->ListEntry);
+            InterlockedDecrement(&Cache->ForgetCount);
             return TRUE;
         }
     }
     return FALSE;
 }
 
-static inline BOOLEAN FuseCacheExpireItem(FUSE_CACHE *Cache,
+static inline VOID FuseCacheAddInoItem(FUSE_CACHE *Cache, FUSE_CACHE_ITEM *Item)
+    /*
+     * Link an item into the secondary by-ino index. Must be called with the
+     * owning shard's mutex held; the InoMutex nests inside it. Negative
+     * entries have no inode and are not indexed.
+     */
+{
+    if (0 == Item->Entry.nodeid)
+        return;
+    ULONG HashIndex = (ULONG)FuseHashMix64(Item->Entry.nodeid) % Cache->ItemBucketCount;
+    ExAcquireFastMutex(&Cache->InoMutex);
+    Item->InoDictNext = (PVOID)Cache->InoBuckets[HashIndex];
+    Cache->InoBuckets[HashIndex] = Item;
+    ExReleaseFastMutex(&Cache->InoMutex);
+}
+
+static inline VOID FuseCacheRemoveInoItem(FUSE_CACHE *Cache, FUSE_CACHE_ITEM *Item)
+    /* must be called with the owning shard's mutex held */
+{
+    if (0 == Item->Entry.nodeid)
+        return;
+    ULONG HashIndex = (ULONG)FuseHashMix64(Item->Entry.nodeid) % Cache->ItemBucketCount;
+    ExAcquireFastMutex(&Cache->InoMutex);
+    for (FUSE_CACHE_ITEM **P = (PVOID)&Cache->InoBuckets[HashIndex]; *P; P = &(*P)->InoDictNext)
+        if (*P == Item)
+        {
+            *P = (*P)->InoDictNext;
+            break;
+        }
+    ExReleaseFastMutex(&Cache->InoMutex);
+}
+
+static inline BOOLEAN FuseCacheExpireItem(FUSE_CACHE *Cache, FUSE_CACHE_SHARD *Shard,
     FUSE_CACHE_ITEM *Item)
 {
     ULONG HashIndex = Item->Hash % Cache->ItemBucketCount;
@@ -166,62 +419,295 @@ static inline BOOLEAN FuseCacheExpireItem(FUSE_CACHE *Cache,
         if (*P == Item)
         {
             *P = (*P)->DictNext;
+            FuseCacheRemoveInoItem(Cache, Item);
             RemoveEntryList(&Item->ListEntry);
-            Cache->ItemCount--;
+            Shard->ItemCount--;
             if (0 == InterlockedDecrement(&Item->RefCount))
-                InsertTailList(&Cache->ForgetList, &Item->ListEntry);
+            {
+                InsertTailList(&Shard->ForgetList, &Item->ListEntry);
+                FuseCacheCountForgottenItem(Cache);
+            }
             return TRUE;
         }
     return FALSE;
 }
 
-static inline BOOLEAN FuseCacheExpireNextItem(FUSE_CACHE *Cache,
+static inline BOOLEAN FuseCacheExpireNextItem(FUSE_CACHE *Cache, FUSE_CACHE_SHARD *Shard,
     UINT64 ExpirationTime)
 {
-    if (!IsListEmpty(&Cache->ItemList))
+    if (!IsListEmpty(&Shard->ItemList))
     {
-        FUSE_CACHE_ITEM *Item = CONTAINING_RECORD(Cache->ItemList.Flink, FUSE_CACHE_ITEM, ListEntry);
+        FUSE_CACHE_ITEM *Item = CONTAINING_RECORD(Shard->ItemList.Flink, FUSE_CACHE_ITEM, ListEntry);
         if (ExpirationTime >= Item->ExpirationTime ||
             InterlockedCompareExchange(&Item->QuickExpiry, 1, 1))
-            return FuseCacheExpireItem(Cache, Item);
+            return FuseCacheExpireItem(Cache, Shard, Item);
     }
     return FALSE;
 }
 
-static inline size_t hash_chars(const char *s, size_t length)
+static VOID FuseCacheFlushForgotten(FUSE_CACHE *Cache)
+    /*
+     * Post forgets that have accumulated past the flush threshold without
+     * waiting for the next periodic sweep. Generation gating applies exactly
+     * as in the sweep: items last used during a generation that is still
+     * referenced stay in their shards' "forget lists" and the sweep (already
+     * pending) picks them up once the generation drains.
+     */
 {
-    /* djb2: see http://www.cse.yorku.ca/~oz/hash.html */
-    size_t h = 5381;
-    for (const char *t = s + length; t > s; ++s)
-        h = 33 * h + *s;
+    PAGED_CODE();
+
+    LIST_ENTRY ForgetList;
+    UINT64 ForgetTime;
+
+    if (!InterlockedExchange(&Cache->ForgetFlushPending, 0))
+        return;
+
+    InitializeListHead(&ForgetList);
+
+    ExAcquireFastMutex(&Cache->GenMutex);
+    ForgetTime = FuseCacheForgetTime(Cache, KeQueryInterruptTime());
+    ExReleaseFastMutex(&Cache->GenMutex);
+
+    for (ULONG I = 0; FUSE_CACHE_SHARD_COUNT > I; I++)
+    {
+        FUSE_CACHE_SHARD *Shard = &Cache->Shards[I];
+
+        ExAcquireFastMutex(&Shard->Mutex);
+        while (FuseCacheForgetNextItem(Cache, Shard, ForgetTime, &ForgetList))
+            ;
+        ExReleaseFastMutex(&Shard->Mutex);
+    }
+
+    for (PLIST_ENTRY Entry = ForgetList.Flink; &ForgetList != Entry;)
+    {
+        FUSE_CACHE_ITEM *Item = CONTAINING_RECORD(Entry, FUSE_CACHE_ITEM, ListEntry);
+        Entry = Entry->Flink;
+        if (Item->NoForget)
+        {
+            RemoveEntryList(&Item->ListEntry);
+            FuseFree(Item);
+        }
+    }
+
+    if (!IsListEmpty(&ForgetList))
+    {
+        BOOLEAN Success = DEBUGTEST(90) &&
+            NT_SUCCESS(FuseProtoPostForget(Cache->Instance, &ForgetList));
+        if (!Success)
+        {
+            ASSERT(!IsListEmpty(&ForgetList));
+
+            /* re-add forgotten items in their shards' "forget lists"; iterate backwards
+            and insert at the head so that per-shard ordering is preserved */
+            for (PLIST_ENTRY Entry = ForgetList.Blink; &ForgetList != Entry;)
+            {
+                FUSE_CACHE_ITEM *Item = CONTAINING_RECORD(Entry, FUSE_CACHE_ITEM, ListEntry);
+                FUSE_CACHE_SHARD *Shard = FuseCacheHashShard(Cache, Item->Hash);
+                Entry = Entry->Blink;
+
+                ExAcquireFastMutex(&Shard->Mutex);
+                InsertHeadList(&Shard->ForgetList, &Item->ListEntry);
+                ExReleaseFastMutex(&Shard->Mutex);
+
+                InterlockedIncrement(&Cache->ForgetCount);
+            }
+
+            InterlockedExchange(&Cache->SweepPending, 1);
+        }
+    }
+}
+
+static inline UINT64 hash_mix64(UINT64 h, UINT64 k)
+{
+    /* MurmurHash3 x64 block mix */
+    k *= 0x87c37b91114253d5ULL;
+    k = (k << 31) | (k >> 33);
+    k *= 0x4cf5ad432745937fULL;
+    h ^= k;
+    h = (h << 27) | (h >> 37);
+    h = 5 * h + 0x52dce729;
     return h;
 }
 
-static inline size_t hash_upper_chars(const char *s, size_t length)
+static inline UINT64 hash_fin64(UINT64 h)
 {
-    /* djb2: see http://www.cse.yorku.ca/~oz/hash.html */
-    size_t h = 5381;
-    for (const char *t = s + length; t > s; ++s)
-        h = 33 * h + RtlUpperChar(*s);
+    /* MurmurHash3 x64 finalizer */
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
     return h;
 }
 
-static inline ULONG FuseCacheHash(UINT64 ParentIno, PSTRING Name, BOOLEAN CaseInsensitive)
+static inline size_t hash_chars(const char *s, size_t length)
+{
+    /* block hash over 8-byte words (MurmurHash3: see https://github.com/aappleby/smhasher)
+    rather than a per-character loop; the hash is internal to the cache, so only
+    self-consistency matters */
+    UINT64 h = (UINT64)length;
+    for (; 8 <= length; s += 8, length -= 8)
+        h = hash_mix64(h, *(UINT64 UNALIGNED *)s);
+    if (0 != length)
+    {
+        UINT64 k = 0;
+        RtlCopyMemory(&k, s, length);
+        h = hash_mix64(h, k);
+    }
+    return (size_t)hash_fin64(h);
+}
+
+static inline size_t hash_upper_chars(const char *s, size_t length)
+{
+    /* as hash_chars, but over the RtlUpperChar image of the input; ASCII-only
+    16-byte blocks are uppercased with SSE2 on x64 */
+    UINT64 h = (UINT64)length;
+    while (16 <= length)
+    {
+        CHAR Buf[16];
+#if defined(_M_X64)
+        __m128i Block = _mm_loadu_si128((const __m128i *)s);
+        if (0 == _mm_movemask_epi8(Block))
+        {
+            /* ASCII: uppercase 'a'..'z' by clearing bit 5 (RtlUpperChar agrees) */
+            __m128i IsLower = _mm_and_si128(
+                _mm_cmpgt_epi8(Block, _mm_set1_epi8('a' - 1)),
+                _mm_cmplt_epi8(Block, _mm_set1_epi8('z' + 1)));
+            Block = _mm_andnot_si128(
+                _mm_and_si128(IsLower, _mm_set1_epi8(0x20)), Block);
+            _mm_storeu_si128((__m128i *)Buf, Block);
+        }
+        else
+#endif
+        {
+            for (ULONG I = 0; 16 > I; I++)
+                Buf[I] = RtlUpperChar(s[I]);
+        }
+        h = hash_mix64(h, *(UINT64 UNALIGNED *)&Buf[0]);
+        h = hash_mix64(h, *(UINT64 UNALIGNED *)&Buf[8]);
+        s += 16;
+        length -= 16;
+    }
+    if (0 != length)
+    {
+        UINT64 k[2] = { 0, 0 };
+        for (ULONG I = 0; length > I; I++)
+            ((CHAR *)k)[I] = RtlUpperChar(s[I]);
+        h = hash_mix64(h, k[0]);
+        if (8 < length)
+            h = hash_mix64(h, k[1]);
+    }
+    return (size_t)hash_fin64(h);
+}
+
+static inline USHORT FuseCacheFoldChars(const CHAR *s, USHORT Length, CHAR *Buf)
+    /*
+     * Case fold a UTF-8 name into Buf and return the folded length
+     * (at most 3/2 Length; see FUSE_CACHE_FOLD_BUFSIZE). Folding uses the
+     * OS lowercase table via RtlDowncaseUnicodeChar, so it covers the full
+     * BMP rather than ASCII only. Invalid sequences and supplementary plane
+     * characters pass through unchanged; folding is deterministic, so keys
+     * computed at insert and probe time always agree.
+     */
+{
+    USHORT n = 0;
+    for (USHORT i = 0; Length > i;)
+    {
+        UCHAR c = s[i];
+        ULONG cp;
+        USHORT cl;
+        if (0x80 > c)
+        {
+            Buf[n++] = 'A' <= c && 'Z' >= c ? c | 0x20 : c;
+            i++;
+            continue;
+        }
+        else if (0xc2 <= c && 0xdf >= c)
+            cl = 2, cp = c & 0x1f;
+        else if (0xe0 <= c && 0xef >= c)
+            cl = 3, cp = c & 0x0f;
+        else if (0xf0 <= c && 0xf4 >= c)
+            cl = 4, cp = 0;
+        else
+            cl = 0, cp = 0;
+        if (0 == cl || Length - i < cl)
+            goto invalid;
+        for (USHORT j = 1; cl > j; j++)
+        {
+            if (0x80 != (s[i + j] & 0xc0))
+                goto invalid;
+            cp = (cp << 6) | (s[i + j] & 0x3f);
+        }
+        if (4 == cl)
+        {
+            /* supplementary plane: no folding; copy the sequence unchanged */
+            for (USHORT j = 0; cl > j; j++)
+                Buf[n++] = s[i + j];
+            i += cl;
+            continue;
+        }
+        cp = RtlDowncaseUnicodeChar((WCHAR)cp);
+        if (0x80 > cp)
+            Buf[n++] = (CHAR)cp;
+        else if (0x800 > cp)
+        {
+            Buf[n++] = (CHAR)(0xc0 | (cp >> 6));
+            Buf[n++] = (CHAR)(0x80 | (cp & 0x3f));
+        }
+        else
+        {
+            Buf[n++] = (CHAR)(0xe0 | (cp >> 12));
+            Buf[n++] = (CHAR)(0x80 | ((cp >> 6) & 0x3f));
+            Buf[n++] = (CHAR)(0x80 | (cp & 0x3f));
+        }
+        i += cl;
+        continue;
+
+    invalid:
+        Buf[n++] = s[i];
+        i++;
+    }
+    return n;
+}
+
+static inline VOID FuseCacheFoldName(FUSE_CACHE *Cache, PSTRING Name, FUSE_CACHE_FOLD *Fold)
+    /*
+     * Compute the lookup key for a name: the case folded name on case-insensitive
+     * volumes, the name itself otherwise. The key is computed once per probe;
+     * hash chain comparisons are then exact (folded-to-folded) and never
+     * re-case names.
+     */
+{
+    if (!Cache->CaseInsensitive || FUSE_CACHE_FOLD_SIZEMAX < Name->Length)
+        Fold->Name = *Name;
+    else
+    {
+        Fold->Name.Length = Fold->Name.MaximumLength =
+            FuseCacheFoldChars(Name->Buffer, Name->Length, Fold->Buf);
+        Fold->Name.Buffer = Fold->Buf;
+        if (Fold->Name.Length == Name->Length &&
+            RtlEqualMemory(Fold->Buf, Name->Buffer, Name->Length))
+            /* already folded (the common case): alias the name so that
+            FuseCacheSetEntry does not store a redundant key copy */
+            Fold->Name = *Name;
+    }
+}
+
+static inline ULONG FuseCacheHash(UINT64 ParentIno, PSTRING FoldedName)
 {
     return (ULONG)FuseHashMix64(ParentIno) ^
-        (0 != Name ? (ULONG)(CaseInsensitive ?
-            hash_upper_chars(Name->Buffer, Name->Length) : hash_chars(Name->Buffer, Name->Length)) : 0);
+        (0 != FoldedName ? (ULONG)hash_chars(FoldedName->Buffer, FoldedName->Length) : 0);
 }
 
 static inline FUSE_CACHE_ITEM *FuseCacheLookupHashedItem(FUSE_CACHE *Cache,
-    ULONG Hash, UINT64 ParentIno, PSTRING Name)
+    ULONG Hash, UINT64 ParentIno, PSTRING FoldedName)
 {
     FUSE_CACHE_ITEM *Item = 0;
     ULONG HashIndex = Hash % Cache->ItemBucketCount;
     for (FUSE_CACHE_ITEM *ItemX = Cache->ItemBuckets[HashIndex]; ItemX; ItemX = ItemX->DictNext)
         if (ItemX->Hash == Hash &&
             ItemX->ParentIno == ParentIno &&
-            RtlEqualString(&ItemX->Name, Name, Cache->CaseInsensitive))
+            RtlEqualString(&ItemX->FoldedName, FoldedName, FALSE))
         {
             Item = ItemX;
             break;
@@ -229,7 +715,7 @@ static inline FUSE_CACHE_ITEM *FuseCacheLookupHashedItem(FUSE_CACHE *Cache,
     return Item;
 }
 
-static inline VOID FuseCacheAddItem(FUSE_CACHE *Cache,
+static inline VOID FuseCacheAddItem(FUSE_CACHE *Cache, FUSE_CACHE_SHARD *Shard,
     FUSE_CACHE_ITEM *Item)
 {
     ULONG HashIndex = Item->Hash % Cache->ItemBucketCount;
@@ -237,47 +723,116 @@ static inline VOID FuseCacheAddItem(FUSE_CACHE *Cache,
     for (FUSE_CACHE_ITEM *ItemX = Cache->ItemBuckets[HashIndex]; ItemX; ItemX = ItemX->DictNext)
         if (ItemX->Hash == Item->Hash &&
             ItemX->ParentIno == Item->ParentIno &&
-            RtlEqualString(&ItemX->Name, &Item->Name, Cache->CaseInsensitive))
+            RtlEqualString(&ItemX->FoldedName, &Item->FoldedName, FALSE))
         {
             ASSERT(0);
         }
 #endif
     Item->DictNext = Cache->ItemBuckets[HashIndex];
     Cache->ItemBuckets[HashIndex] = Item;
+    FuseCacheAddInoItem(Cache, Item);
     /* mark as most-recently used */
-    InsertTailList(&Cache->ItemList, &Item->ListEntry);
-    Cache->ItemCount++;
+    InsertTailList(&Shard->ItemList, &Item->ListEntry);
+    Shard->ItemCount++;
 }
 
-static inline FUSE_CACHE_ITEM *FuseCacheUpdateHashedItem(FUSE_CACHE *Cache,
-    ULONG Hash, UINT64 ParentIno, PSTRING Name,
-    UINT64 ExpirationTime, UINT64 LastUsedTime, FUSE_PROTO_ENTRY *Entry)
+static inline FUSE_CACHE_ITEM *FuseCacheUpdateHashedItem(FUSE_CACHE *Cache, FUSE_CACHE_SHARD *Shard,
+    ULONG Hash, UINT64 ParentIno, PSTRING FoldedName,
+    UINT64 ExpirationTime, UINT64 AttrExpirationTime, UINT64 LastUsedTime, FUSE_PROTO_ENTRY *Entry)
 {
-    FUSE_CACHE_ITEM *Item = FuseCacheLookupHashedItem(Cache, Hash, ParentIno, Name);
+    FUSE_CACHE_ITEM *Item = FuseCacheLookupHashedItem(Cache, Hash, ParentIno, FoldedName);
     if (0 != Item)
     {
         if (Entry->nodeid == Item->Entry.nodeid &&
             !InterlockedCompareExchange(&Item->QuickExpiry, 1, 1))
         {
             Item->NLookup++;
+            /* the by-ino index reads times and Entry under the InoMutex only;
+            update under it so that FuseCacheGetAttrByIno never sees a torn attr
+            (the nodeid guard above ensures the item's index bucket stays valid) */
+            ExAcquireFastMutex(&Cache->InoMutex);
             Item->ExpirationTime = ExpirationTime;
+            Item->AttrExpirationTime = AttrExpirationTime;
             Item->LastUsedTime = LastUsedTime;
             RtlCopyMemory(&Item->Entry, Entry, sizeof Item->Entry);
+            ExReleaseFastMutex(&Cache->InoMutex);
 
             /* mark as most-recently used */
             RemoveEntryList(&Item->ListEntry);
-            InsertTailList(&Cache->ItemList, &Item->ListEntry);
+            InsertTailList(&Shard->ItemList, &Item->ListEntry);
         }
         else
         {
-            FuseCacheExpireItem(Cache, Item);
+            FuseCacheExpireItem(Cache, Shard, Item);
             Item = 0;
         }
     }
     return Item;
 }
 
-NTSTATUS FuseCacheCreate(ULONG Capacity, BOOLEAN CaseInsensitive, FUSE_CACHE **PCache)
+static inline ULONG FuseCachePathHash(FUSE_CACHE *Cache, PSTRING Path)
+{
+    return (ULONG)(Cache->CaseInsensitive ?
+        hash_upper_chars(Path->Buffer, Path->Length) : hash_chars(Path->Buffer, Path->Length));
+}
+
+static inline FUSE_CACHE_PATH_ITEM *FuseCacheLookupPathItem(FUSE_CACHE *Cache,
+    ULONG Hash, PSTRING Path)
+{
+    ULONG HashIndex = Hash % FUSE_CACHE_PATH_BUCKET_COUNT;
+    for (FUSE_CACHE_PATH_ITEM *ItemX = Cache->PathBuckets[HashIndex]; ItemX; ItemX = ItemX->DictNext)
+        if (ItemX->Hash == Hash &&
+            RtlEqualString(&ItemX->Path, Path, Cache->CaseInsensitive))
+            return ItemX;
+    return 0;
+}
+
+static inline VOID FuseCacheRemovePathItem(FUSE_CACHE *Cache, FUSE_CACHE_PATH_ITEM *PathItem)
+    /* must be called with the PathMutex held */
+{
+    ULONG HashIndex = PathItem->Hash % FUSE_CACHE_PATH_BUCKET_COUNT;
+    for (FUSE_CACHE_PATH_ITEM **P = &Cache->PathBuckets[HashIndex]; *P; P = &(*P)->DictNext)
+        if (*P == PathItem)
+        {
+            *P = (*P)->DictNext;
+            break;
+        }
+    RemoveEntryList(&PathItem->ListEntry);
+    Cache->PathItemCount--;
+}
+
+static inline VOID FuseCacheFreePathItem(FUSE_CACHE *Cache, FUSE_CACHE_PATH_ITEM *PathItem)
+    /* must be called without the PathMutex held (dereferencing items acquires shard locks) */
+{
+    for (ULONG I = 0; PathItem->ComponentCount > I; I++)
+        FuseCacheDereferenceItem(Cache, PathItem->Components[I]);
+    FuseFree(PathItem);
+}
+
+static inline BOOLEAN FuseCacheValidatePathItem(FUSE_CACHE_PATH_ITEM *PathItem, UINT64 InterruptTime)
+    /*
+     * A path mapping is valid only while every component item is fresh, has not been
+     * explicitly invalidated and is still chained parent to child.
+     */
+{
+    UINT64 ParentIno = PathItem->Components[0]->ParentIno;
+    for (ULONG I = 0; PathItem->ComponentCount > I; I++)
+    {
+        FUSE_CACHE_ITEM *Item = PathItem->Components[I];
+        if (InterruptTime >= Item->ExpirationTime ||
+            InterruptTime >= Item->AttrExpirationTime ||
+                /* path attrs feed access checks; stale attributes invalidate the mapping */
+            InterlockedCompareExchange(&Item->QuickExpiry, 1, 1) ||
+            ParentIno != Item->ParentIno ||
+            0 == Item->Entry.nodeid)
+            return FALSE;
+        ParentIno = Item->Entry.nodeid;
+    }
+    return TRUE;
+}
+
+NTSTATUS FuseCacheCreate(ULONG Capacity, BOOLEAN CaseInsensitive,
+    FUSE_INSTANCE *Instance, FUSE_CACHE **PCache)
 {
     PAGED_CODE();
 
@@ -298,14 +853,52 @@ NTSTATUS FuseCacheCreate(ULONG Capacity, BOOLEAN CaseInsensitive, FUSE_CACHE **P
         return STATUS_INSUFFICIENT_RESOURCES;
 
     RtlZeroMemory(Cache, CacheSize);
-    Cache->Capacity = Capacity;
+    Cache->Instance = Instance;
+    Cache->Capacity = (Capacity + FUSE_CACHE_SHARD_COUNT - 1) / FUSE_CACHE_SHARD_COUNT;
     Cache->CaseInsensitive = CaseInsensitive;
-    ExInitializeFastMutex(&Cache->Mutex);
+    ExInitializeFastMutex(&Cache->GenMutex);
     InitializeListHead(&Cache->GenList);
-    InitializeListHead(&Cache->ItemList);
-    InitializeListHead(&Cache->ForgetList);
+    ExInitializeFastMutex(&Cache->DirMutex);
+    InitializeListHead(&Cache->DirList);
+    ExInitializeFastMutex(&Cache->DataMutex);
+    InitializeListHead(&Cache->DataList);
+    ExInitializeFastMutex(&Cache->PathMutex);
+    InitializeListHead(&Cache->PathList);
+    for (ULONG I = 0; FUSE_CACHE_SHARD_COUNT > I; I++)
+    {
+        FUSE_CACHE_SHARD *Shard = &Cache->Shards[I];
+        ExInitializeFastMutex(&Shard->Mutex);
+        InitializeListHead(&Shard->ItemList);
+        InitializeListHead(&Shard->ForgetList);
+    }
     Cache->ItemBucketCount = (CacheSize - sizeof *Cache) / sizeof Cache->ItemBuckets[0];
 
+    ExInitializeFastMutex(&Cache->InoMutex);
+    Cache->InoBuckets = FuseAlloc(Cache->ItemBucketCount * sizeof Cache->InoBuckets[0]);
+    if (0 == Cache->InoBuckets)
+    {
+        FuseFree(Cache);
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+    RtlZeroMemory(Cache->InoBuckets, Cache->ItemBucketCount * sizeof Cache->InoBuckets[0]);
+
+    /* watch the system low-memory condition so that the expiration routine can shrink
+    the cache under memory pressure; the cache works without it if the open fails */
+    {
+        UNICODE_STRING EventName = RTL_CONSTANT_STRING(L"\\KernelObjects\\LowMemoryCondition");
+        OBJECT_ATTRIBUTES ObjectAttributes;
+        HANDLE EventHandle;
+
+        InitializeObjectAttributes(&ObjectAttributes, &EventName, OBJ_KERNEL_HANDLE, 0, 0);
+        if (NT_SUCCESS(ZwOpenEvent(&EventHandle, EVENT_QUERY_STATE, &ObjectAttributes)))
+        {
+            if (!NT_SUCCESS(ObReferenceObjectByHandle(EventHandle, EVENT_QUERY_STATE,
+                *ExEventObjectType, KernelMode, &Cache->LowMemoryEvent, 0)))
+                Cache->LowMemoryEvent = 0;
+            ZwClose(EventHandle);
+        }
+    }
+
     *PCache = Cache;
 
     return STATUS_SUCCESS;
@@ -322,9 +915,39 @@ VOID FuseCacheDelete(FUSE_CACHE *Cache)
         FuseFree(Gen);
     }
 
-    FuseCacheDeleteForgotten(&Cache->ItemList);
-    FuseCacheDeleteForgotten(&Cache->ForgetList);
+    /* dereference path mapping components before deleting the shard lists */
+    for (PLIST_ENTRY Entry = Cache->PathList.Flink; &Cache->PathList != Entry;)
+    {
+        FUSE_CACHE_PATH_ITEM *PathItem = CONTAINING_RECORD(Entry, FUSE_CACHE_PATH_ITEM, ListEntry);
+        Entry = Entry->Flink;
+        FuseCacheFreePathItem(Cache, PathItem);
+    }
 
+    for (ULONG I = 0; FUSE_CACHE_SHARD_COUNT > I; I++)
+    {
+        FUSE_CACHE_SHARD *Shard = &Cache->Shards[I];
+        FuseCacheDeleteForgotten(&Shard->ItemList);
+        FuseCacheDeleteForgotten(&Shard->ForgetList);
+    }
+
+    for (PLIST_ENTRY Entry = Cache->DirList.Flink; &Cache->DirList != Entry;)
+    {
+        FUSE_CACHE_DIR_ITEM *DirItem = CONTAINING_RECORD(Entry, FUSE_CACHE_DIR_ITEM, ListEntry);
+        Entry = Entry->Flink;
+        FuseFree(DirItem);
+    }
+
+    for (PLIST_ENTRY Entry = Cache->DataList.Flink; &Cache->DataList != Entry;)
+    {
+        FUSE_CACHE_DATA_ITEM *DataItem = CONTAINING_RECORD(Entry, FUSE_CACHE_DATA_ITEM, ListEntry);
+        Entry = Entry->Flink;
+        FuseFree(DataItem);
+    }
+
+    if (0 != Cache->LowMemoryEvent)
+        ObDereferenceObject(Cache->LowMemoryEvent);
+
+    FuseFree(Cache->InoBuckets);
     FuseFree(Cache);
 }
 
@@ -334,18 +957,123 @@ VOID FuseCacheExpirationRoutine(FUSE_CACHE *Cache,
     PAGED_CODE();
 
     LIST_ENTRY ForgetList;
+    UINT64 ForgetTime;
+    UINT64 NextExpirationTime = (UINT64)-1LL;
+    BOOLEAN LowMemory, SweepPending = FALSE;
+
+    LowMemory = 0 != Cache->LowMemoryEvent &&
+        0 != KeReadStateEvent(Cache->LowMemoryEvent);
+
+    /* when nothing can be due yet and no forget/quick-expire work awaits,
+    skip the sweep entirely: idle caches cost nothing per timer tick */
+    if (!LowMemory &&
+        0 == InterlockedCompareExchange(&Cache->SweepPending, 0, 0) &&
+        ExpirationTime < (UINT64)InterlockedCompareExchange64(&Cache->NextExpirationTime, 0, 0))
+        return;
+
+    InterlockedExchange(&Cache->SweepPending, 0);
+    InterlockedExchange64(&Cache->NextExpirationTime, -1LL);
 
     InitializeListHead(&ForgetList);
 
-    ExAcquireFastMutex(&Cache->Mutex);
+    ExAcquireFastMutex(&Cache->GenMutex);
+    ForgetTime = FuseCacheForgetTime(Cache, ExpirationTime);
+    ExReleaseFastMutex(&Cache->GenMutex);
 
-    while (FuseCacheExpireNextItem(Cache, ExpirationTime))
-        ;
+    /* drop stale path mappings first so that their component references are released
+    before the shard sweep below computes what can be forgotten */
+    {
+        LIST_ENTRY FreeList;
+        InitializeListHead(&FreeList);
+
+        ExAcquireFastMutex(&Cache->PathMutex);
+        for (PLIST_ENTRY Entry = Cache->PathList.Flink; &Cache->PathList != Entry;)
+        {
+            FUSE_CACHE_PATH_ITEM *PathItem = CONTAINING_RECORD(Entry, FUSE_CACHE_PATH_ITEM, ListEntry);
+            Entry = Entry->Flink;
+            if (LowMemory || !FuseCacheValidatePathItem(PathItem, ExpirationTime))
+            {
+                FuseCacheRemovePathItem(Cache, PathItem);
+                InsertTailList(&FreeList, &PathItem->ListEntry);
+            }
+            else
+                /* a path mapping goes stale when its earliest component expires */
+                for (ULONG I = 0; PathItem->ComponentCount > I; I++)
+                    if (NextExpirationTime > PathItem->Components[I]->ExpirationTime)
+                        NextExpirationTime = PathItem->Components[I]->ExpirationTime;
+        }
+        ExReleaseFastMutex(&Cache->PathMutex);
+
+        for (PLIST_ENTRY Entry = FreeList.Flink; &FreeList != Entry;)
+        {
+            FUSE_CACHE_PATH_ITEM *PathItem = CONTAINING_RECORD(Entry, FUSE_CACHE_PATH_ITEM, ListEntry);
+            Entry = Entry->Flink;
+            FuseCacheFreePathItem(Cache, PathItem);
+        }
+    }
+
+    for (ULONG I = 0; FUSE_CACHE_SHARD_COUNT > I; I++)
+    {
+        FUSE_CACHE_SHARD *Shard = &Cache->Shards[I];
+
+        ExAcquireFastMutex(&Shard->Mutex);
+
+        while (FuseCacheExpireNextItem(Cache, Shard, ExpirationTime))
+            ;
+
+        if (LowMemory)
+            /* the system is under memory pressure: shed LRU items regardless of expiry */
+            while (FUSE_CACHE_LOWMEM_LOWATER(Cache->Capacity) < Shard->ItemCount &&
+                FuseCacheExpireNextItem(Cache, Shard, (UINT64)-1LL))
+                ;
 
-    while (FuseCacheForgetNextItem(Cache, ExpirationTime, &ForgetList))
-        ;
+        while (FuseCacheForgetNextItem(Cache, Shard, ForgetTime, &ForgetList))
+            ;
 
-    ExReleaseFastMutex(&Cache->Mutex);
+        if (!IsListEmpty(&Shard->ItemList))
+        {
+            FUSE_CACHE_ITEM *Item = CONTAINING_RECORD(Shard->ItemList.Flink, FUSE_CACHE_ITEM, ListEntry);
+            if (NextExpirationTime > Item->ExpirationTime)
+                NextExpirationTime = Item->ExpirationTime;
+        }
+        if (!IsListEmpty(&Shard->ForgetList))
+            /* forgets gated on live generations: keep sweeping until they drain */
+            SweepPending = TRUE;
+
+        ExReleaseFastMutex(&Shard->Mutex);
+    }
+
+    ExAcquireFastMutex(&Cache->DirMutex);
+    for (PLIST_ENTRY Entry = Cache->DirList.Flink; &Cache->DirList != Entry;)
+    {
+        FUSE_CACHE_DIR_ITEM *DirItem = CONTAINING_RECORD(Entry, FUSE_CACHE_DIR_ITEM, ListEntry);
+        Entry = Entry->Flink;
+        if (LowMemory || ExpirationTime >= DirItem->ExpirationTime)
+        {
+            RemoveEntryList(&DirItem->ListEntry);
+            Cache->DirItemCount--;
+            FuseFree(DirItem);
+        }
+        else if (NextExpirationTime > DirItem->ExpirationTime)
+            NextExpirationTime = DirItem->ExpirationTime;
+    }
+    ExReleaseFastMutex(&Cache->DirMutex);
+
+    ExAcquireFastMutex(&Cache->DataMutex);
+    for (PLIST_ENTRY Entry = Cache->DataList.Flink; &Cache->DataList != Entry;)
+    {
+        FUSE_CACHE_DATA_ITEM *DataItem = CONTAINING_RECORD(Entry, FUSE_CACHE_DATA_ITEM, ListEntry);
+        Entry = Entry->Flink;
+        if (LowMemory || ExpirationTime >= DataItem->ExpirationTime)
+        {
+            RemoveEntryList(&DataItem->ListEntry);
+            Cache->DataItemCount--;
+            FuseFree(DataItem);
+        }
+        else if (NextExpirationTime > DataItem->ExpirationTime)
+            NextExpirationTime = DataItem->ExpirationTime;
+    }
+    ExReleaseFastMutex(&Cache->DataMutex);
 
     for (PLIST_ENTRY Entry = ForgetList.Flink; &ForgetList != Entry;)
     {
@@ -366,28 +1094,29 @@ VOID FuseCacheExpirationRoutine(FUSE_CACHE *Cache,
         {
             ASSERT(!IsListEmpty(&ForgetList));
 
-            ExAcquireFastMutex(&Cache->Mutex);
-
-            /* re-add forgotten items in the "forget list" */
-            RemoveEntryList(&ForgetList);
-                /* see AppendTailList comments */
-#if 0
-            /* append */
-            AppendTailList(&Cache->ForgetList, &ForgetList);
-#else
-            /* prepend */
-            PLIST_ENTRY ListToPrepend = ForgetList.Flink;
-            PLIST_ENTRY ListHead = &Cache->ForgetList;
-            PLIST_ENTRY ListBegin = ListHead->Flink;
-            ListBegin->Blink = ListToPrepend->Blink;
-            ListHead->Flink = ListToPrepend;
-            ListToPrepend->Blink->Flink = ListBegin;
-            ListToPrepend->Blink = ListHead;
-#endif
+            /* re-add forgotten items in their shards' "forget lists"; iterate backwards
+            and insert at the head so that per-shard ordering is preserved */
+            for (PLIST_ENTRY Entry = ForgetList.Blink; &ForgetList != Entry;)
+            {
+                FUSE_CACHE_ITEM *Item = CONTAINING_RECORD(Entry, FUSE_CACHE_ITEM, ListEntry);
+                FUSE_CACHE_SHARD *Shard = FuseCacheHashShard(Cache, Item->Hash);
+                Entry = Entry->Blink;
+
+                ExAcquireFastMutex(&Shard->Mutex);
+                InsertHeadList(&Shard->ForgetList, &Item->ListEntry);
+                ExReleaseFastMutex(&Shard->Mutex);
 
-            ExReleaseFastMutex(&Cache->Mutex);
+                InterlockedIncrement(&Cache->ForgetCount);
+            }
+
+            SweepPending = TRUE;
         }
     }
+
+    /* re-arm the watermark from what remains; inserts during the sweep lower it further */
+    FuseCacheScheduleExpiration(Cache, NextExpirationTime);
+    if (SweepPending)
+        InterlockedExchange(&Cache->SweepPending, 1);
 }
 
 NTSTATUS FuseCacheReferenceGen(FUSE_CACHE *Cache, PVOID *PGen)
@@ -399,7 +1128,7 @@ NTSTATUS FuseCacheReferenceGen(FUSE_CACHE *Cache, PVOID *PGen)
 
     *PGen = 0;
 
-    ExAcquireFastMutex(&Cache->Mutex);
+    ExAcquireFastMutex(&Cache->GenMutex);
 
     if (!IsListEmpty(&Cache->GenList))
     {
@@ -410,7 +1139,7 @@ NTSTATUS FuseCacheReferenceGen(FUSE_CACHE *Cache, PVOID *PGen)
             Gen = 0;
     }
 
-    ExReleaseFastMutex(&Cache->Mutex);
+    ExReleaseFastMutex(&Cache->GenMutex);
 
     if (0 == Gen)
     {
@@ -422,7 +1151,7 @@ NTSTATUS FuseCacheReferenceGen(FUSE_CACHE *Cache, PVOID *PGen)
         NewGen->RefCount = 1;
         NewGen->InterruptTime = InterruptTime;
 
-        ExAcquireFastMutex(&Cache->Mutex);
+        ExAcquireFastMutex(&Cache->GenMutex);
 
         if (!IsListEmpty(&Cache->GenList))
         {
@@ -440,7 +1169,7 @@ NTSTATUS FuseCacheReferenceGen(FUSE_CACHE *Cache, PVOID *PGen)
             NewGen = 0;
         }
 
-        ExReleaseFastMutex(&Cache->Mutex);
+        ExReleaseFastMutex(&Cache->GenMutex);
     }
 
     *PGen = Gen;
@@ -461,11 +1190,11 @@ VOID FuseCacheDereferenceGen(FUSE_CACHE *Cache, PVOID Gen0)
     if (0 == Gen)
         return;
 
-    ExAcquireFastMutex(&Cache->Mutex);
+    ExAcquireFastMutex(&Cache->GenMutex);
     RefCount = --Gen->RefCount;
     if (0 == RefCount)
         RemoveEntryList(&Gen->ListEntry);
-    ExReleaseFastMutex(&Cache->Mutex);
+    ExReleaseFastMutex(&Cache->GenMutex);
 
     if (0 == RefCount)
         FuseFree(Gen);
@@ -478,31 +1207,44 @@ BOOLEAN FuseCacheGetEntry(FUSE_CACHE *Cache, UINT64 ParentIno, PSTRING Name,
 
     UINT64 InterruptTime = KeQueryInterruptTime();
     FUSE_CACHE_ITEM *Item;
-    ULONG Hash = FuseCacheHash(ParentIno, Name, Cache->CaseInsensitive);
+    FUSE_CACHE_FOLD Fold;
+    FuseCacheFoldName(Cache, Name, &Fold);
+    ULONG Hash = FuseCacheHash(ParentIno, &Fold.Name);
+    FUSE_CACHE_SHARD *Shard = FuseCacheHashShard(Cache, Hash);
 
-    ExAcquireFastMutex(&Cache->Mutex);
+    ExAcquireFastMutex(&Shard->Mutex);
 
-    Item = FuseCacheLookupHashedItem(Cache, Hash, ParentIno, Name);
+    Item = FuseCacheLookupHashedItem(Cache, Hash, ParentIno, &Fold.Name);
     if (0 != Item)
     {
-        if (InterruptTime < Item->ExpirationTime &&
-            !InterlockedCompareExchange(&Item->QuickExpiry, 1, 1))
+        if (InterruptTime >= Item->ExpirationTime ||
+            InterlockedCompareExchange(&Item->QuickExpiry, 1, 1))
+        {
+            FuseCacheExpireItem(Cache, Shard, Item);
+            Item = 0;
+        }
+        else if (InterruptTime >= Item->AttrExpirationTime)
+            /* the entry mapping is still valid but its attributes expired: report a
+            miss without evicting, so that the caller refreshes with a LOOKUP and
+            FuseCacheSetEntry re-arms both timeouts on the existing item */
+            Item = 0;
+        else
         {
             Item->LastUsedTime = InterruptTime;
             RtlCopyMemory(Entry, &Item->Entry, sizeof Item->Entry);
 
             /* mark as most-recently used */
             RemoveEntryList(&Item->ListEntry);
-            InsertTailList(&Cache->ItemList, &Item->ListEntry);
-        }
-        else
-        {
-            FuseCacheExpireItem(Cache, Item);
-            Item = 0;
+            InsertTailList(&Shard->ItemList, &Item->ListEntry);
         }
     }
 
-    ExReleaseFastMutex(&Cache->Mutex);
+    if (0 != Item)
+        Shard->GetEntryHits++;
+    else
+        Shard->GetEntryMisses++;
+
+    ExReleaseFastMutex(&Shard->Mutex);
 
     *PItem = Item;
     return 0 != Item;
@@ -516,75 +1258,582 @@ VOID FuseCacheSetEntry(FUSE_CACHE *Cache, UINT64 ParentIno, PSTRING Name,
     UINT64 InterruptTime = KeQueryInterruptTime();
     UINT64 EntryTimeout = Entry->entry_valid * 10000000 + Entry->entry_valid_nsec / 100;
     UINT64 AttrTimeout = Entry->attr_valid * 10000000 + Entry->attr_valid_nsec / 100;
-    UINT64 ExpirationTime = InterruptTime +
-        (EntryTimeout < AttrTimeout ? EntryTimeout : AttrTimeout);
+    UINT64 ExpirationTime = InterruptTime + EntryTimeout;
+    UINT64 AttrExpirationTime = InterruptTime + AttrTimeout;
     FUSE_CACHE_ITEM *Item = 0, *NewItem = 0;
-    ULONG Hash = FuseCacheHash(ParentIno, Name, Cache->CaseInsensitive);
+    FUSE_CACHE_FOLD Fold;
+    FuseCacheFoldName(Cache, Name, &Fold);
+    ULONG Hash = FuseCacheHash(ParentIno, &Fold.Name);
+    FUSE_CACHE_SHARD *Shard = FuseCacheHashShard(Cache, Hash);
 
-    ExAcquireFastMutex(&Cache->Mutex);
+    ExAcquireFastMutex(&Shard->Mutex);
 
-    Item = FuseCacheUpdateHashedItem(Cache,
-        Hash, ParentIno, Name, ExpirationTime, InterruptTime, Entry);
+    Item = FuseCacheUpdateHashedItem(Cache, Shard,
+        Hash, ParentIno, &Fold.Name, ExpirationTime, AttrExpirationTime, InterruptTime, Entry);
 
-    ExReleaseFastMutex(&Cache->Mutex);
+    ExReleaseFastMutex(&Shard->Mutex);
 
     if (0 == Item)
     {
-        NewItem = FuseAllocMustSucceed(FIELD_OFFSET(FUSE_CACHE_ITEM, NameBuf) + Name->Length);
+        /* store the folded key with the item (only when it differs from the name);
+        hash chain comparisons are then exact and never re-case names */
+        USHORT FoldedLength = Fold.Name.Buffer == Fold.Buf ? Fold.Name.Length : 0;
+        NewItem = FuseAllocMustSucceed(
+            FIELD_OFFSET(FUSE_CACHE_ITEM, NameBuf) + Name->Length + FoldedLength);
 
         RtlZeroMemory(NewItem, FIELD_OFFSET(FUSE_CACHE_ITEM, NameBuf));
         NewItem->NoForget =
-            /* the root is not LOOKUP'ed; free without FORGET */
-            ParentIno == FUSE_PROTO_ROOT_INO && 1 == Name->Length && '/' == Name->Buffer[0];
+            /* the root is not LOOKUP'ed and negative entries have no inode; free without FORGET */
+            (ParentIno == FUSE_PROTO_ROOT_INO && 1 == Name->Length && '/' == Name->Buffer[0]) ||
+            0 == Entry->nodeid;
         NewItem->Hash = Hash;
         NewItem->ParentIno = ParentIno;
         NewItem->Name.Length = NewItem->Name.MaximumLength = Name->Length;
         NewItem->Name.Buffer = NewItem->NameBuf;
+        if (0 != FoldedLength)
+        {
+            NewItem->FoldedName.Length = NewItem->FoldedName.MaximumLength = FoldedLength;
+            NewItem->FoldedName.Buffer = NewItem->NameBuf + Name->Length;
+            RtlCopyMemory(NewItem->FoldedName.Buffer, Fold.Buf, FoldedLength);
+        }
+        else
+            NewItem->FoldedName = NewItem->Name;
         NewItem->NLookup = 1;
         NewItem->ExpirationTime = ExpirationTime;
+        NewItem->AttrExpirationTime = AttrExpirationTime;
         NewItem->LastUsedTime = InterruptTime;
         NewItem->RefCount = 1;
         RtlCopyMemory(&NewItem->Entry, Entry, sizeof NewItem->Entry);
         RtlCopyMemory(&NewItem->NameBuf, Name->Buffer, Name->Length);
 
-        ExAcquireFastMutex(&Cache->Mutex);
+        ExAcquireFastMutex(&Shard->Mutex);
 
-        Item = FuseCacheUpdateHashedItem(Cache,
-            Hash, ParentIno, Name, ExpirationTime, InterruptTime, Entry);
+        Item = FuseCacheUpdateHashedItem(Cache, Shard,
+            Hash, ParentIno, &Fold.Name, ExpirationTime, AttrExpirationTime, InterruptTime, Entry);
         if (0 == Item)
         {
-            if (Cache->ItemCount >= Cache->Capacity)
-                FuseCacheExpireNextItem(Cache, (UINT64)-1LL);
+            if (Shard->ItemCount >= Cache->Capacity)
+                /* evict LRU items down to the low watermark to amortize eviction cost */
+                while (FUSE_CACHE_LOWATER(Cache->Capacity) < Shard->ItemCount &&
+                    FuseCacheExpireNextItem(Cache, Shard, (UINT64)-1LL))
+                    ;
 
-            FuseCacheAddItem(Cache, NewItem);
+            FuseCacheAddItem(Cache, Shard, NewItem);
 
             Item = NewItem;
             NewItem = 0;
         }
 
-        ExReleaseFastMutex(&Cache->Mutex);
+        ExReleaseFastMutex(&Shard->Mutex);
     }
 
     if (0 != NewItem)
         FuseFree(NewItem);
 
+    FuseCacheScheduleExpiration(Cache, ExpirationTime);
+    FuseCacheFlushForgotten(Cache);
+
     *PItem = Item;
 }
 
+VOID FuseCacheSetNegativeEntry(FUSE_CACHE *Cache, UINT64 ParentIno, PSTRING Name)
+{
+    PAGED_CODE();
+
+    FUSE_PROTO_ENTRY EntryBuf;
+    PVOID Item;
+
+    /* a zeroed entry (nodeid == 0) records that the name does not exist */
+    RtlZeroMemory(&EntryBuf, sizeof EntryBuf);
+    EntryBuf.entry_valid = FUSE_CACHE_NEGATIVE_TIMEOUT / 10000000;
+    EntryBuf.attr_valid = EntryBuf.entry_valid;
+
+    FuseCacheSetEntry(Cache, ParentIno, Name, &EntryBuf, &Item);
+}
+
 VOID FuseCacheRemoveEntry(FUSE_CACHE *Cache, UINT64 ParentIno, PSTRING Name)
 {
     PAGED_CODE();
 
     FUSE_CACHE_ITEM *Item;
-    ULONG Hash = FuseCacheHash(ParentIno, Name, Cache->CaseInsensitive);
+    FUSE_CACHE_FOLD Fold;
+    FuseCacheFoldName(Cache, Name, &Fold);
+    ULONG Hash = FuseCacheHash(ParentIno, &Fold.Name);
+    FUSE_CACHE_SHARD *Shard = FuseCacheHashShard(Cache, Hash);
 
-    ExAcquireFastMutex(&Cache->Mutex);
+    ExAcquireFastMutex(&Shard->Mutex);
 
-    Item = FuseCacheLookupHashedItem(Cache, Hash, ParentIno, Name);
+    Item = FuseCacheLookupHashedItem(Cache, Hash, ParentIno, &Fold.Name);
     if (0 != Item)
-        FuseCacheExpireItem(Cache, Item);
+    {
+        /* explicit invalidation must also reach path mappings and referenced users */
+        InterlockedExchange(&Item->QuickExpiry, 1);
+        InterlockedExchange(&Cache->SweepPending, 1);
+        FuseCacheExpireItem(Cache, Shard, Item);
+    }
+
+    ExReleaseFastMutex(&Shard->Mutex);
+
+    FuseCacheFlushForgotten(Cache);
+}
+
+BOOLEAN FuseCacheGetAttrByIno(FUSE_CACHE *Cache, UINT64 Ino, FUSE_PROTO_ATTR *Attr)
+    /*
+     * Serve cached attributes for a file known only by its inode number, as with
+     * handle-based operations on open files. Freshness checks are the same as in
+     * FuseCacheGetEntry: the entry and attr validities must both be current and
+     * the item must not have been quick-expired (local mutations quick-expire
+     * their cache item, so the index never reports attributes that a local write
+     * or setattr invalidated). The item is NOT marked most-recently used: the
+     * InoMutex nests inside the shard mutexes and the LRU list cannot be touched
+     * here; a hot handle keeps its item warm through the name index anyway.
+     */
+{
+    PAGED_CODE();
+
+    UINT64 InterruptTime = KeQueryInterruptTime();
+    BOOLEAN Result = FALSE;
+    ULONG HashIndex = (ULONG)FuseHashMix64(Ino) % Cache->ItemBucketCount;
+
+    ExAcquireFastMutex(&Cache->InoMutex);
+
+    for (FUSE_CACHE_ITEM *Item = (PVOID)Cache->InoBuckets[HashIndex];
+        0 != Item; Item = Item->InoDictNext)
+        if (Ino == Item->Entry.nodeid &&
+            InterruptTime < Item->ExpirationTime &&
+            InterruptTime < Item->AttrExpirationTime &&
+            !InterlockedCompareExchange(&Item->QuickExpiry, 1, 1))
+        {
+            RtlCopyMemory(Attr, &Item->Entry.attr, sizeof Item->Entry.attr);
+            Result = TRUE;
+            break;
+        }
+
+    ExReleaseFastMutex(&Cache->InoMutex);
+
+    return Result;
+}
+
+BOOLEAN FuseCacheGetPath(FUSE_CACHE *Cache, PSTRING Path,
+    FUSE_CACHE_PATH_ATTR *Attrs, PULONG PCount,
+    FUSE_PROTO_ATTR *Attr, PVOID *PItem)
+    /*
+     * Resolve a full path with a single hash probe. On success *PCount receives the
+     * number of path components and Attrs receives the (ino, uid, gid, mode) of every
+     * component, so that the caller can replay its access checks; Attr receives the
+     * attributes of the final component and *PItem its (unreferenced) cache item,
+     * protected by the caller's generation reference as with FuseCacheGetEntry.
+     * On entry *PCount contains the capacity of the Attrs array.
+     */
+{
+    PAGED_CODE();
+
+    UINT64 InterruptTime = KeQueryInterruptTime();
+    ULONG Hash = FuseCachePathHash(Cache, Path);
+    FUSE_CACHE_PATH_ITEM *PathItem;
+    BOOLEAN Result = FALSE;
+
+    *PItem = 0;
+
+    ExAcquireFastMutex(&Cache->PathMutex);
+
+    PathItem = FuseCacheLookupPathItem(Cache, Hash, Path);
+    if (0 != PathItem)
+    {
+        if (PathItem->ComponentCount <= *PCount &&
+            FuseCacheValidatePathItem(PathItem, InterruptTime))
+        {
+            for (ULONG I = 0; PathItem->ComponentCount > I; I++)
+            {
+                FUSE_CACHE_ITEM *Item = PathItem->Components[I];
+                /* keep the item out of FORGET's reach while the caller's generation
+                is referenced; the component reference keeps the write safe here */
+                Item->LastUsedTime = InterruptTime;
+                Attrs[I].Ino = Item->Entry.nodeid;
+                Attrs[I].Uid = Item->Entry.attr.uid;
+                Attrs[I].Gid = Item->Entry.attr.gid;
+                Attrs[I].Mode = Item->Entry.attr.mode;
+            }
+            *PCount = PathItem->ComponentCount;
+            RtlCopyMemory(Attr,
+                &PathItem->Components[PathItem->ComponentCount - 1]->Entry.attr, sizeof *Attr);
+            *PItem = PathItem->Components[PathItem->ComponentCount - 1];
+
+            /* mark as most-recently used */
+            RemoveEntryList(&PathItem->ListEntry);
+            InsertHeadList(&Cache->PathList, &PathItem->ListEntry);
+
+            Result = TRUE;
+            PathItem = 0;
+        }
+        else
+            FuseCacheRemovePathItem(Cache, PathItem);
+    }
 
-    ExReleaseFastMutex(&Cache->Mutex);
+    ExReleaseFastMutex(&Cache->PathMutex);
+
+    if (0 != PathItem)
+        FuseCacheFreePathItem(Cache, PathItem);
+
+    return Result;
+}
+
+VOID FuseCacheSetPath(FUSE_CACHE *Cache, PSTRING Path, PVOID *Items, ULONG Count)
+    /*
+     * Map a resolved path to the cache items of its components. The items must be
+     * protected by the caller's generation reference; they are referenced here and
+     * dereferenced when the mapping is removed.
+     */
+{
+    PAGED_CODE();
+
+    UINT64 InterruptTime = KeQueryInterruptTime();
+    ULONG Hash = FuseCachePathHash(Cache, Path);
+    FUSE_CACHE_PATH_ITEM *PathItem, *OldItem = 0, *EvictItem = 0;
+    ULONG HashIndex;
+
+    for (ULONG I = 0; Count > I; I++)
+    {
+        FUSE_CACHE_ITEM *Item = Items[I];
+        if (0 == Item ||
+            InterruptTime >= Item->ExpirationTime ||
+            InterlockedCompareExchange(&Item->QuickExpiry, 1, 1) ||
+            0 == Item->Entry.nodeid)
+            return;
+    }
+
+    PathItem = FuseAlloc(FIELD_OFFSET(FUSE_CACHE_PATH_ITEM, Components) +
+        Count * sizeof PathItem->Components[0] + Path->Length);
+    if (0 == PathItem)
+        return;
+
+    PathItem->Hash = Hash;
+    PathItem->Path.Length = PathItem->Path.MaximumLength = Path->Length;
+    PathItem->Path.Buffer = (PCHAR)&PathItem->Components[Count];
+    PathItem->ComponentCount = Count;
+    RtlCopyMemory(PathItem->Path.Buffer, Path->Buffer, Path->Length);
+    for (ULONG I = 0; Count > I; I++)
+    {
+        PathItem->Components[I] = Items[I];
+        FuseCacheReferenceItem(Cache, Items[I]);
+    }
+
+    ExAcquireFastMutex(&Cache->PathMutex);
+
+    /* remove a previous mapping for the same path */
+    OldItem = FuseCacheLookupPathItem(Cache, Hash, Path);
+    if (0 != OldItem)
+        FuseCacheRemovePathItem(Cache, OldItem);
+
+    if (FUSE_CACHE_PATH_CAPACITY <= Cache->PathItemCount)
+    {
+        /* evict the least-recently used mapping */
+        EvictItem = CONTAINING_RECORD(Cache->PathList.Blink, FUSE_CACHE_PATH_ITEM, ListEntry);
+        FuseCacheRemovePathItem(Cache, EvictItem);
+    }
+
+    HashIndex = Hash % FUSE_CACHE_PATH_BUCKET_COUNT;
+    PathItem->DictNext = Cache->PathBuckets[HashIndex];
+    Cache->PathBuckets[HashIndex] = PathItem;
+    InsertHeadList(&Cache->PathList, &PathItem->ListEntry);
+    Cache->PathItemCount++;
+
+    ExReleaseFastMutex(&Cache->PathMutex);
+
+    if (0 != OldItem)
+        FuseCacheFreePathItem(Cache, OldItem);
+    if (0 != EvictItem)
+        FuseCacheFreePathItem(Cache, EvictItem);
+}
+
+UINT64 FuseCacheItemTimeout(PVOID Item0)
+    /*
+     * Return the remaining attribute validity of a cache item (in 100ns units) or 0
+     * if the item is expired or absent. Callers use this to bound the freshness of
+     * attribute-derived state (data blocks, directory listings, readahead), which
+     * follows attr_valid rather than entry_valid.
+     */
+{
+    PAGED_CODE();
+
+    FUSE_CACHE_ITEM *Item = Item0;
+    UINT64 InterruptTime;
+
+    if (0 == Item || 0 != Item->QuickExpiry)
+        return 0;
+
+    InterruptTime = KeQueryInterruptTime();
+    return InterruptTime < Item->AttrExpirationTime ? Item->AttrExpirationTime - InterruptTime : 0;
+}
+
+BOOLEAN FuseCacheGetDirBuffer(FUSE_CACHE *Cache, UINT64 Ino, UINT64 Offset,
+    PVOID *PBuffer, PULONG PLength)
+    /*
+     * Get a copy of a cached directory listing buffer. The copy is allocated with
+     * FuseAlloc and is owned by the caller.
+     */
+{
+    PAGED_CODE();
+
+    FUSE_CACHE_DIR_ITEM *DirItem = 0;
+    UINT64 InterruptTime = KeQueryInterruptTime();
+    PVOID Buffer = 0;
+
+    *PBuffer = 0;
+    *PLength = 0;
+
+    ExAcquireFastMutex(&Cache->DirMutex);
+
+    for (PLIST_ENTRY Entry = Cache->DirList.Flink; &Cache->DirList != Entry; Entry = Entry->Flink)
+    {
+        FUSE_CACHE_DIR_ITEM *ItemX = CONTAINING_RECORD(Entry, FUSE_CACHE_DIR_ITEM, ListEntry);
+        if (Ino == ItemX->Ino && Offset == ItemX->Offset)
+        {
+            if (InterruptTime < ItemX->ExpirationTime)
+            {
+                DirItem = ItemX;
+
+                /* mark as most-recently used */
+                RemoveEntryList(&DirItem->ListEntry);
+                InsertHeadList(&Cache->DirList, &DirItem->ListEntry);
+            }
+            else
+            {
+                RemoveEntryList(&ItemX->ListEntry);
+                Cache->DirItemCount--;
+                FuseFree(ItemX);
+            }
+            break;
+        }
+    }
+
+    if (0 != DirItem)
+    {
+        Buffer = FuseAlloc(DirItem->Length);
+        if (0 != Buffer)
+        {
+            RtlCopyMemory(Buffer, DirItem->Buffer, DirItem->Length);
+            *PBuffer = Buffer;
+            *PLength = DirItem->Length;
+        }
+    }
+
+    ExReleaseFastMutex(&Cache->DirMutex);
+
+    return 0 != Buffer;
+}
+
+VOID FuseCacheSetDirBuffer(FUSE_CACHE *Cache, UINT64 Ino, UINT64 Offset,
+    PVOID Buffer, ULONG Length, UINT64 Timeout)
+{
+    PAGED_CODE();
+
+    FUSE_CACHE_DIR_ITEM *DirItem;
+
+    if (0 == Timeout)
+        /* the file system wants every enumeration revalidated; do not cache */
+        return;
+
+    DirItem = FuseAlloc(FIELD_OFFSET(FUSE_CACHE_DIR_ITEM, Buffer) + Length);
+    if (0 == DirItem)
+        return;
+
+    DirItem->Ino = Ino;
+    DirItem->Offset = Offset;
+    DirItem->ExpirationTime = KeQueryInterruptTime() + Timeout;
+    DirItem->Length = Length;
+    RtlCopyMemory(DirItem->Buffer, Buffer, Length);
+
+    FuseCacheScheduleExpiration(Cache, DirItem->ExpirationTime);
+
+    ExAcquireFastMutex(&Cache->DirMutex);
+
+    /* remove a previous buffer for the same (Ino, Offset) */
+    for (PLIST_ENTRY Entry = Cache->DirList.Flink; &Cache->DirList != Entry; Entry = Entry->Flink)
+    {
+        FUSE_CACHE_DIR_ITEM *ItemX = CONTAINING_RECORD(Entry, FUSE_CACHE_DIR_ITEM, ListEntry);
+        if (Ino == ItemX->Ino && Offset == ItemX->Offset)
+        {
+            RemoveEntryList(&ItemX->ListEntry);
+            Cache->DirItemCount--;
+            FuseFree(ItemX);
+            break;
+        }
+    }
+
+    if (FUSE_CACHE_DIR_CAPACITY <= Cache->DirItemCount)
+    {
+        /* evict the least-recently used buffer */
+        FUSE_CACHE_DIR_ITEM *ItemX = CONTAINING_RECORD(
+            Cache->DirList.Blink, FUSE_CACHE_DIR_ITEM, ListEntry);
+        RemoveEntryList(&ItemX->ListEntry);
+        Cache->DirItemCount--;
+        FuseFree(ItemX);
+    }
+
+    InsertHeadList(&Cache->DirList, &DirItem->ListEntry);
+    Cache->DirItemCount++;
+
+    ExReleaseFastMutex(&Cache->DirMutex);
+}
+
+VOID FuseCacheRemoveDirBuffers(FUSE_CACHE *Cache, UINT64 Ino)
+{
+    PAGED_CODE();
+
+    ExAcquireFastMutex(&Cache->DirMutex);
+
+    for (PLIST_ENTRY Entry = Cache->DirList.Flink; &Cache->DirList != Entry;)
+    {
+        FUSE_CACHE_DIR_ITEM *DirItem = CONTAINING_RECORD(Entry, FUSE_CACHE_DIR_ITEM, ListEntry);
+        Entry = Entry->Flink;
+        if (Ino == DirItem->Ino)
+        {
+            RemoveEntryList(&DirItem->ListEntry);
+            Cache->DirItemCount--;
+            FuseFree(DirItem);
+        }
+    }
+
+    ExReleaseFastMutex(&Cache->DirMutex);
+}
+
+BOOLEAN FuseCacheGetDataBuffer(FUSE_CACHE *Cache, UINT64 Ino, UINT64 Offset,
+    PVOID Buffer, ULONG Length, PULONG PBytesTransferred)
+    /*
+     * Copy cached file data into the caller's buffer. The cached block must start at
+     * Offset exactly; it satisfies the request if it covers Length bytes or if it is
+     * known to extend to the end of the file (the read is then reported short).
+     */
+{
+    PAGED_CODE();
+
+    FUSE_CACHE_DATA_ITEM *DataItem = 0;
+    UINT64 InterruptTime = KeQueryInterruptTime();
+    BOOLEAN Result = FALSE;
+
+    *PBytesTransferred = 0;
+
+    ExAcquireFastMutex(&Cache->DataMutex);
+
+    for (PLIST_ENTRY Entry = Cache->DataList.Flink; &Cache->DataList != Entry; Entry = Entry->Flink)
+    {
+        FUSE_CACHE_DATA_ITEM *ItemX = CONTAINING_RECORD(Entry, FUSE_CACHE_DATA_ITEM, ListEntry);
+        if (Ino == ItemX->Ino && Offset == ItemX->Offset)
+        {
+            if (InterruptTime < ItemX->ExpirationTime)
+            {
+                DataItem = ItemX;
+
+                /* mark as most-recently used */
+                RemoveEntryList(&DataItem->ListEntry);
+                InsertHeadList(&Cache->DataList, &DataItem->ListEntry);
+            }
+            else
+            {
+                RemoveEntryList(&ItemX->ListEntry);
+                Cache->DataItemCount--;
+                FuseFree(ItemX);
+            }
+            break;
+        }
+    }
+
+    if (0 != DataItem &&
+        (Length <= DataItem->Length || DataItem->Eof))
+    {
+        if (Length > DataItem->Length)
+            Length = DataItem->Length;
+        if (NT_SUCCESS(FuseSafeCopyMemory(Buffer, DataItem->Buffer, Length)))
+        {
+            *PBytesTransferred = Length;
+            Result = TRUE;
+        }
+    }
+
+    ExReleaseFastMutex(&Cache->DataMutex);
+
+    return Result;
+}
+
+VOID FuseCacheSetDataBuffer(FUSE_CACHE *Cache, UINT64 Ino, UINT64 Offset,
+    PVOID Buffer, ULONG Length, BOOLEAN Eof, UINT64 Timeout)
+{
+    PAGED_CODE();
+
+    FUSE_CACHE_DATA_ITEM *DataItem;
+
+    if (0 == Timeout)
+        /* the file system wants every read revalidated; do not cache */
+        return;
+
+    DataItem = FuseAlloc(FIELD_OFFSET(FUSE_CACHE_DATA_ITEM, Buffer) + Length);
+    if (0 == DataItem)
+        return;
+
+    DataItem->Ino = Ino;
+    DataItem->Offset = Offset;
+    DataItem->ExpirationTime = KeQueryInterruptTime() + Timeout;
+    DataItem->Length = Length;
+    DataItem->Eof = Eof;
+
+    FuseCacheScheduleExpiration(Cache, DataItem->ExpirationTime);
+    if (!NT_SUCCESS(FuseSafeCopyMemory(DataItem->Buffer, Buffer, Length)))
+    {
+        FuseFree(DataItem);
+        return;
+    }
+
+    ExAcquireFastMutex(&Cache->DataMutex);
+
+    /* remove a previous buffer for the same (Ino, Offset) */
+    for (PLIST_ENTRY Entry = Cache->DataList.Flink; &Cache->DataList != Entry; Entry = Entry->Flink)
+    {
+        FUSE_CACHE_DATA_ITEM *ItemX = CONTAINING_RECORD(Entry, FUSE_CACHE_DATA_ITEM, ListEntry);
+        if (Ino == ItemX->Ino && Offset == ItemX->Offset)
+        {
+            RemoveEntryList(&ItemX->ListEntry);
+            Cache->DataItemCount--;
+            FuseFree(ItemX);
+            break;
+        }
+    }
+
+    if (FUSE_CACHE_DATA_CAPACITY <= Cache->DataItemCount)
+    {
+        /* evict the least-recently used buffer */
+        FUSE_CACHE_DATA_ITEM *ItemX = CONTAINING_RECORD(
+            Cache->DataList.Blink, FUSE_CACHE_DATA_ITEM, ListEntry);
+        RemoveEntryList(&ItemX->ListEntry);
+        Cache->DataItemCount--;
+        FuseFree(ItemX);
+    }
+
+    InsertHeadList(&Cache->DataList, &DataItem->ListEntry);
+    Cache->DataItemCount++;
+
+    ExReleaseFastMutex(&Cache->DataMutex);
+}
+
+VOID FuseCacheRemoveDataBuffers(FUSE_CACHE *Cache, UINT64 Ino)
+{
+    PAGED_CODE();
+
+    ExAcquireFastMutex(&Cache->DataMutex);
+
+    for (PLIST_ENTRY Entry = Cache->DataList.Flink; &Cache->DataList != Entry;)
+    {
+        FUSE_CACHE_DATA_ITEM *DataItem = CONTAINING_RECORD(Entry, FUSE_CACHE_DATA_ITEM, ListEntry);
+        Entry = Entry->Flink;
+        if (Ino == DataItem->Ino)
+        {
+            RemoveEntryList(&DataItem->ListEntry);
+            Cache->DataItemCount--;
+            FuseFree(DataItem);
+        }
+    }
+
+    ExReleaseFastMutex(&Cache->DataMutex);
 }
 
 VOID FuseCacheReferenceItem(FUSE_CACHE *Cache, PVOID Item0)
@@ -609,9 +1858,14 @@ VOID FuseCacheDereferenceItem(FUSE_CACHE *Cache, PVOID Item0)
     RefCount = InterlockedDecrement(&Item->RefCount);
     if (0 == RefCount)
     {
-        ExAcquireFastMutex(&Cache->Mutex);
-        InsertTailList(&Cache->ForgetList, &Item->ListEntry);
-        ExReleaseFastMutex(&Cache->Mutex);
+        FUSE_CACHE_SHARD *Shard = FuseCacheHashShard(Cache, Item->Hash);
+
+        ExAcquireFastMutex(&Shard->Mutex);
+        InsertTailList(&Shard->ForgetList, &Item->ListEntry);
+        ExReleaseFastMutex(&Shard->Mutex);
+
+        FuseCacheCountForgottenItem(Cache);
+        FuseCacheFlushForgotten(Cache);
     }
 }
 
@@ -622,6 +1876,7 @@ VOID FuseCacheQuickExpireItem(FUSE_CACHE *Cache, PVOID Item0)
     FUSE_CACHE_ITEM *Item = Item0;
 
     InterlockedExchange(&Item->QuickExpiry, 1);
+    InterlockedExchange(&Cache->SweepPending, 1);
 }
 
 VOID FuseCacheDeleteForgotten(PLIST_ENTRY ForgetList)
@@ -636,6 +1891,26 @@ VOID FuseCacheDeleteForgotten(PLIST_ENTRY ForgetList)
     }
 }
 
+VOID FuseCacheGetStatistics(FUSE_CACHE *Cache, FUSE_STATISTICS *Statistics)
+{
+    PAGED_CODE();
+
+    UINT64 Hits = 0, Misses = 0;
+
+    for (ULONG I = 0; FUSE_CACHE_SHARD_COUNT > I; I++)
+    {
+        FUSE_CACHE_SHARD *Shard = &Cache->Shards[I];
+
+        ExAcquireFastMutex(&Shard->Mutex);
+        Hits += Shard->GetEntryHits;
+        Misses += Shard->GetEntryMisses;
+        ExReleaseFastMutex(&Shard->Mutex);
+    }
+
+    Statistics->CacheEntryHits = Hits;
+    Statistics->CacheEntryMisses = Misses;
+}
+
 BOOLEAN FuseCacheForgetOne(PLIST_ENTRY ForgetList, FUSE_PROTO_FORGET_ONE *PForgetOne)
 {
     PAGED_CODE();
@@ -21,15 +21,74 @@
 
 #include <shared/km/shared.h>
 
+VOID FuseContextInitialize(VOID);
 VOID FuseContextCreate(FUSE_CONTEXT **PContext,
     FUSE_INSTANCE *Instance, FSP_FSCTL_TRANSACT_REQ *InternalRequest);
 VOID FuseContextDelete(FUSE_CONTEXT *Context);
 
 #ifdef ALLOC_PRAGMA
+#pragma alloc_text(INIT, FuseContextInitialize)
 #pragma alloc_text(PAGE, FuseContextCreate)
 #pragma alloc_text(PAGE, FuseContextDelete)
 #endif
 
+/*
+ * Contexts are allocated from a lookaside list rather than directly from the
+ * pool, because every FUSE operation creates and deletes one; in steady state
+ * the hot path does no pool calls.
+ *
+ * A small per-processor cache of warm contexts sits in front of the lookaside
+ * list. A context freed through it records the extent that was actually
+ * dirtied, so that reuse zeroes only that extent instead of the full
+ * structure: frequent occupants confine their writes to the head fields and a
+ * single member of the trailing union.
+ */
+static PAGED_LOOKASIDE_LIST FuseContextLookaside;
+#define FUSE_CONTEXT_WARMSLOT_COUNT     64
+static PVOID FuseContextWarmSlots[FUSE_CONTEXT_WARMSLOT_COUNT];
+
+static inline UINT32 FuseContextDirtySize(FUSE_CONTEXT *Context)
+    /*
+     * Compute an upper bound of the extent dirtied by this context. The head
+     * fields are always dirty. Reserved operations and READ/WRITE confine
+     * their union writes to a single member (see FuseOpReserved, FuseOpRead,
+     * FuseOpWrite); all other operations are assumed to dirty the full
+     * structure.
+     */
+{
+    if (0 == Context->InternalRequest)
+        switch (Context->InternalResponse->Hint)
+        {
+        case FUSE_PROTO_OPCODE_INIT:
+        case FUSE_PROTO_OPCODE_DESTROY:
+        case FUSE_PROTO_OPCODE_RELEASE:
+            return FIELD_OFFSET(FUSE_CONTEXT, Lookup);
+        case FUSE_PROTO_OPCODE_FORGET:
+        case FUSE_PROTO_OPCODE_BATCH_FORGET:
+            return RTL_SIZEOF_THROUGH_FIELD(FUSE_CONTEXT, Forget);
+        case FUSE_PROTO_OPCODE_READ:
+        case FUSE_PROTO_OPCODE_WRITE:
+            return RTL_SIZEOF_THROUGH_FIELD(FUSE_CONTEXT, Read.CacheTimeout);
+        default:
+            return sizeof(FUSE_CONTEXT);
+        }
+    else
+        switch (Context->InternalRequest->Kind)
+        {
+        case FspFsctlTransactReadKind:
+        case FspFsctlTransactWriteKind:
+            return RTL_SIZEOF_THROUGH_FIELD(FUSE_CONTEXT, Read.CacheTimeout);
+        default:
+            return sizeof(FUSE_CONTEXT);
+        }
+}
+
+VOID FuseContextInitialize(VOID)
+{
+    ExInitializePagedLookasideList(&FuseContextLookaside,
+        0, 0, 0, sizeof(FUSE_CONTEXT), FUSE_ALLOC_TAG, 0);
+}
+
 VOID FuseContextCreate(FUSE_CONTEXT **PContext,
     FUSE_INSTANCE *Instance, FSP_FSCTL_TRANSACT_REQ *InternalRequest)
 {
@@ -46,14 +105,23 @@ VOID FuseContextCreate(FUSE_CONTEXT **PContext,
         return;
     }
 
-    Context = FuseAlloc(sizeof *Context);
-    if (0 == Context)
+    Context = InterlockedExchangePointer(
+        &FuseContextWarmSlots[KeGetCurrentProcessorNumberEx(0) % FUSE_CONTEXT_WARMSLOT_COUNT], 0);
+    if (0 != Context)
+        /* a recycled context is zero beyond the extent its last occupant dirtied */
+        RtlZeroMemory(Context, Context->DirtySize);
+    else
     {
-        *PContext = FuseContextStatus(STATUS_INSUFFICIENT_RESOURCES);
-        return;
+        Context = ExAllocateFromPagedLookasideList(&FuseContextLookaside);
+        if (0 == Context)
+        {
+            *PContext = FuseContextStatus(STATUS_INSUFFICIENT_RESOURCES);
+            return;
+        }
+
+        RtlZeroMemory(Context, sizeof *Context);
     }
 
-    RtlZeroMemory(Context, sizeof *Context);
     Context->Instance = Instance;
     Context->InternalRequest = InternalRequest;
     Context->InternalResponse = (PVOID)&Context->InternalResponseBuf;
@@ -67,6 +135,9 @@ VOID FuseContextDelete(FUSE_CONTEXT *Context)
 {
     PAGED_CODE();
 
+    /* compute before the releases below; they only dirty extents already counted */
+    UINT32 DirtySize = FuseContextDirtySize(Context);
+
     if (FuseOpGuardTrue == Context->OpGuardResult)
     {
         UINT32 Kind = 0 == Context->InternalRequest ?
@@ -74,6 +145,16 @@ VOID FuseContextDelete(FUSE_CONTEXT *Context)
         FuseOperations[Kind].Guard(Context, FALSE);
     }
 
+    if (0 != Context->CoroResumeCount || 0 != Context->CoroSuspendCount)
+    {
+        /* fold the coroutine activity of this context into the statistics */
+        FUSE_STATISTICS *Statistics = &Context->Instance->Statistics;
+        InterlockedExchangeAdd64((LONG64 *)&Statistics->CoroResumeCount,
+            (LONG64)Context->CoroResumeCount);
+        InterlockedExchangeAdd64((LONG64 *)&Statistics->CoroSuspendCount,
+            (LONG64)Context->CoroSuspendCount);
+    }
+
     if (0 != Context->Fini)
         Context->Fini(Context);
     if (0 != Context->InternalRequest)
@@ -82,5 +163,14 @@ VOID FuseContextDelete(FUSE_CONTEXT *Context)
         FuseFree(Context->InternalResponse);
 
     DEBUGFILL(Context, sizeof *Context);
-    FuseFree(Context);
+#if DBG
+    DirtySize = sizeof *Context;        /* DEBUGFILL dirties the whole context */
+#endif
+    Context->DirtySize = DirtySize;
+
+    Context = InterlockedExchangePointer(
+        &FuseContextWarmSlots[KeGetCurrentProcessorNumberEx(0) % FUSE_CONTEXT_WARMSLOT_COUNT],
+        Context);
+    if (0 != Context)
+        ExFreeToPagedLookasideList(&FuseContextLookaside, Context);
 }
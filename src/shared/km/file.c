@@ -36,6 +36,8 @@ VOID FuseFileInstanceFini(FUSE_INSTANCE *Instance)
         File = CONTAINING_RECORD(Entry, FUSE_FILE, ListEntry);
         Entry = Entry->Flink;
         FuseCacheDereferenceItem(Instance->Cache, File->CacheItem);
+        if (0 != File->CoalesceBuf)
+            FuseFree(File->CoalesceBuf);
         FuseFree(File);
     }
 }
@@ -53,6 +55,7 @@ NTSTATUS FuseFileCreate(FUSE_INSTANCE *Instance, FUSE_FILE **PFile)
         return STATUS_INSUFFICIENT_RESOURCES;
 
     RtlZeroMemory(File, sizeof *File);
+    ExInitializeFastMutex(&File->CoalesceMutex);
 
     KeAcquireSpinLock(&Instance->FileListLock, &Irql);
     InsertTailList(&Instance->FileList, &File->ListEntry);
@@ -73,6 +76,9 @@ VOID FuseFileDelete(FUSE_INSTANCE *Instance, FUSE_FILE *File)
 
     FuseCacheDereferenceItem(Instance->Cache, File->CacheItem);
 
+    if (0 != File->CoalesceBuf)
+        FuseFree(File->CoalesceBuf);
+
     DEBUGFILL(File, sizeof *File);
     FuseFree(File);
 }
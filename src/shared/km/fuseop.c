@@ -24,7 +24,14 @@
 static BOOLEAN FuseOpReserved_Init(FUSE_CONTEXT *Context);
 static BOOLEAN FuseOpReserved_Destroy(FUSE_CONTEXT *Context);
 static BOOLEAN FuseOpReserved_Forget(FUSE_CONTEXT *Context);
+static BOOLEAN FuseOpReserved_Release(FUSE_CONTEXT *Context);
+static BOOLEAN FuseOpReserved_IoChunk(FUSE_CONTEXT *Context);
+static BOOLEAN FuseOpReserved_ReadAhead(FUSE_CONTEXT *Context);
+static BOOLEAN FuseOpReserved_RenameCheck(FUSE_CONTEXT *Context);
 static BOOLEAN FuseOpReserved(FUSE_CONTEXT *Context);
+static BOOLEAN FuseLookupFlightBegin(FUSE_CONTEXT *Context);
+static VOID FuseLookupFlightEnd(FUSE_CONTEXT *Context);
+static VOID FuseLookupFlight_ContextFini(FUSE_CONTEXT *Context);
 static VOID FuseLookup(FUSE_CONTEXT *Context);
 static NTSTATUS FuseAccessCheck(
     UINT32 FileUid, UINT32 FileGid, UINT32 FileMode,
@@ -39,6 +46,8 @@ static VOID FuseOpenCheck(FUSE_CONTEXT *Context);
 static VOID FuseOverwriteCheck(FUSE_CONTEXT *Context);
 static VOID FuseOpenTargetDirectoryCheck(FUSE_CONTEXT *Context);
 static VOID FuseRenameCheck(FUSE_CONTEXT *Context);
+static BOOLEAN FuseRenameCheckStart(FUSE_CONTEXT *Context);
+static VOID FuseRenameCheck_ContextFini(FUSE_CONTEXT *Context);
 static VOID FuseCreate(FUSE_CONTEXT *Context);
 static VOID FuseOpen(FUSE_CONTEXT *Context);
 static VOID FuseOpCreate_FileCreate(FUSE_CONTEXT *Context);
@@ -54,6 +63,17 @@ static BOOLEAN FuseOpCleanup(FUSE_CONTEXT *Context);
 static INT FuseOgCleanup(FUSE_CONTEXT *Context, BOOLEAN Acquire);
 static BOOLEAN FuseOpClose(FUSE_CONTEXT *Context);
 static VOID FuseOpClose_ContextFini(FUSE_CONTEXT *Context);
+static VOID FuseMapData(FUSE_CONTEXT *Context, UINT64 Address, UINT32 Length);
+static VOID FuseMapData_ContextFini(FUSE_CONTEXT *Context);
+static BOOLEAN FuseCoalesceWrite(FUSE_CONTEXT *Context);
+static VOID FuseCoalesceFlush(FUSE_CONTEXT *Context);
+static VOID FuseCoalesceFlush_ContextFini(FUSE_CONTEXT *Context);
+static VOID FuseCoalesceDiscard(FUSE_CONTEXT *Context);
+static VOID FuseCoalesceInvalidate(FUSE_CONTEXT *Context);
+static BOOLEAN FusePipelineStart(FUSE_CONTEXT *Context, UINT32 Opcode);
+static VOID FusePipelineChunk_ContextFini(FUSE_CONTEXT *Context);
+static VOID FuseReadAhead(FUSE_CONTEXT *Context);
+static VOID FuseReadAhead_ContextFini(FUSE_CONTEXT *Context);
 static BOOLEAN FuseOpRead(FUSE_CONTEXT *Context);
 static BOOLEAN FuseOpWrite(FUSE_CONTEXT *Context);
 static BOOLEAN FuseOpQueryInformation(FUSE_CONTEXT *Context);
@@ -86,7 +106,14 @@ static VOID FuseSecurity_ContextFini(FUSE_CONTEXT *Context);
 #pragma alloc_text(PAGE, FuseOpReserved_Init)
 #pragma alloc_text(PAGE, FuseOpReserved_Destroy)
 #pragma alloc_text(PAGE, FuseOpReserved_Forget)
+#pragma alloc_text(PAGE, FuseOpReserved_Release)
+#pragma alloc_text(PAGE, FuseOpReserved_IoChunk)
+#pragma alloc_text(PAGE, FuseOpReserved_ReadAhead)
+#pragma alloc_text(PAGE, FuseOpReserved_RenameCheck)
 #pragma alloc_text(PAGE, FuseOpReserved)
+#pragma alloc_text(PAGE, FuseLookupFlightBegin)
+#pragma alloc_text(PAGE, FuseLookupFlightEnd)
+#pragma alloc_text(PAGE, FuseLookupFlight_ContextFini)
 #pragma alloc_text(PAGE, FuseLookup)
 #pragma alloc_text(PAGE, FuseAccessCheck)
 #pragma alloc_text(PAGE, FusePrepareLookupPath)
@@ -98,6 +125,8 @@ static VOID FuseSecurity_ContextFini(FUSE_CONTEXT *Context);
 #pragma alloc_text(PAGE, FuseOverwriteCheck)
 #pragma alloc_text(PAGE, FuseOpenTargetDirectoryCheck)
 #pragma alloc_text(PAGE, FuseRenameCheck)
+#pragma alloc_text(PAGE, FuseRenameCheckStart)
+#pragma alloc_text(PAGE, FuseRenameCheck_ContextFini)
 #pragma alloc_text(PAGE, FuseCreate)
 #pragma alloc_text(PAGE, FuseOpen)
 #pragma alloc_text(PAGE, FuseOpCreate_FileCreate)
@@ -113,6 +142,17 @@ static VOID FuseSecurity_ContextFini(FUSE_CONTEXT *Context);
 #pragma alloc_text(PAGE, FuseOgCleanup)
 #pragma alloc_text(PAGE, FuseOpClose)
 #pragma alloc_text(PAGE, FuseOpClose_ContextFini)
+#pragma alloc_text(PAGE, FuseMapData)
+#pragma alloc_text(PAGE, FuseMapData_ContextFini)
+#pragma alloc_text(PAGE, FuseCoalesceWrite)
+#pragma alloc_text(PAGE, FuseCoalesceFlush)
+#pragma alloc_text(PAGE, FuseCoalesceFlush_ContextFini)
+#pragma alloc_text(PAGE, FuseCoalesceDiscard)
+#pragma alloc_text(PAGE, FuseCoalesceInvalidate)
+#pragma alloc_text(PAGE, FusePipelineStart)
+#pragma alloc_text(PAGE, FusePipelineChunk_ContextFini)
+#pragma alloc_text(PAGE, FuseReadAhead)
+#pragma alloc_text(PAGE, FuseReadAhead_ContextFini)
 #pragma alloc_text(PAGE, FuseOpRead)
 #pragma alloc_text(PAGE, FuseOpWrite)
 #pragma alloc_text(PAGE, FuseOpQueryInformation)
@@ -162,8 +202,27 @@ static BOOLEAN FuseOpReserved_Init(FUSE_CONTEXT *Context)
 
         Instance->VersionMajor = Context->FuseResponse->rsp.init.major;
         Instance->VersionMinor = Context->FuseResponse->rsp.init.minor;
+        Instance->InitFlags = Context->FuseResponse->rsp.init.flags;
+        Instance->MaxWrite = Context->FuseResponse->rsp.init.max_write;
+        Instance->MaxReadahead = Context->FuseResponse->rsp.init.max_readahead;
+        /* MAX_PAGES is available since FUSE 7.28; without it the classic 32-page
+        request ceiling applies, and max_write cannot exceed the request size */
+        Instance->MaxPages = FUSE_PROTO_MAX_PAGES_DEFAULT;
+        if (28 <= Instance->VersionMinor &&
+            0 != (Instance->InitFlags & FUSE_PROTO_INIT_MAX_PAGES) &&
+            0 != Context->FuseResponse->rsp.init.max_pages)
+        {
+            Instance->MaxPages = Context->FuseResponse->rsp.init.max_pages;
+            if (FUSE_PROTO_MAX_PAGES_MAX < Instance->MaxPages)
+                Instance->MaxPages = FUSE_PROTO_MAX_PAGES_MAX;
+        }
+        if (Instance->MaxWrite > Instance->MaxPages * PAGE_SIZE)
+            Instance->MaxWrite = Instance->MaxPages * PAGE_SIZE;
         // !!!: REVISIT
         KeSetEvent(&Instance->InitEvent, 1, FALSE);
+        if (0 != Instance->NotifyEvent)
+            /* wake doorbell waiters: the instance can now accept file system traffic */
+            KeSetEvent(Instance->NotifyEvent, EVENT_INCREMENT, FALSE);
 
         Context->InternalResponse->IoStatus.Status = STATUS_SUCCESS;
     }
@@ -202,6 +261,162 @@ static BOOLEAN FuseOpReserved_Forget(FUSE_CONTEXT *Context)
     return FALSE;
 }
 
+static BOOLEAN FuseOpReserved_Release(FUSE_CONTEXT *Context)
+    /*
+     * Process a RELEASE/RELEASEDIR posted by FuseProtoPostRelease. No application is
+     * waiting on the result; the file is deleted by the context's Fini routine.
+     */
+{
+    PAGED_CODE();
+
+    coro_block (Context->CoroState)
+    {
+        if (Context->File->IsDirectory)
+            coro_await (FuseProtoSendReleasedir(Context));
+        else
+            coro_await (FuseProtoSendRelease(Context));
+
+        Context->InternalResponse->IoStatus.Status = STATUS_SUCCESS;
+    }
+
+    return coro_active();
+}
+
+static BOOLEAN FuseOpReserved_IoChunk(FUSE_CONTEXT *Context)
+    /*
+     * Process one chunk of a pipelined READ/WRITE (see FusePipelineStart).
+     * The chunk transfers to/from the originating context's mapped data region;
+     * results are accumulated into the originating context's Read/Write fields
+     * with interlocked operations (the Read and Write fields alias each other;
+     * Read is used throughout).
+     */
+{
+    PAGED_CODE();
+
+    coro_block (Context->CoroState)
+    {
+        if (FUSE_PROTO_OPCODE_READ == Context->InternalResponse->Hint)
+            coro_await (FuseProtoSendRead(Context));
+        else
+            coro_await (FuseProtoSendWrite(Context));
+
+        FUSE_CONTEXT *Parent = Context->PipeParent;
+        if (!NT_SUCCESS(Context->InternalResponse->IoStatus.Status))
+        {
+            /* the first failure wins */
+            InterlockedCompareExchange(&Parent->Read.PipeStatus,
+                (LONG)Context->InternalResponse->IoStatus.Status, 0);
+            coro_break;
+        }
+
+        /* data went directly into the mapped region;
+        the response reports the transferred size only */
+        UINT32 BytesTransferred = Context->FuseResponse->rsp.write.size;
+        if (Context->Read.Length < BytesTransferred)
+        {
+            InterlockedCompareExchange(&Parent->Read.PipeStatus,
+                (LONG)(UINT32)STATUS_INTERNAL_ERROR, 0);
+            coro_break;
+        }
+
+        if (Context->Read.Length > BytesTransferred)
+        {
+            /* short transfer: clip the overall result at the lowest short chunk */
+            LONG ShortEnd = (LONG)(Context->Read.Offset + BytesTransferred);
+            for (LONG Found = InterlockedCompareExchange(&Parent->Read.PipeShortEnd, 0, 0);
+                ShortEnd < Found;)
+            {
+                LONG Current = Found;
+                Found = InterlockedCompareExchange(&Parent->Read.PipeShortEnd, ShortEnd, Current);
+                if (Found == Current)
+                    break;
+            }
+        }
+    }
+
+    return coro_active();
+}
+
+static BOOLEAN FuseOpReserved_ReadAhead(FUSE_CONTEXT *Context)
+    /*
+     * Process a speculative READ posted by FuseReadAhead. The result goes into the
+     * data cache only; no application is waiting and errors are simply dropped.
+     */
+{
+    PAGED_CODE();
+
+    coro_block (Context->CoroState)
+    {
+        ASSERT(FUSE_PROTO_OPCODE_READ == Context->InternalResponse->Hint);
+
+        coro_await (FuseProtoSendRead(Context));
+        if (!NT_SUCCESS(Context->InternalResponse->IoStatus.Status))
+            coro_break;
+
+        UINT32 BytesTransferred = Context->FuseResponse->len - FUSE_PROTO_RSP_HEADER_SIZE;
+        if (Context->Read.Length < BytesTransferred)
+            coro_break;
+
+        if (0 != BytesTransferred)
+            FuseCacheSetDataBuffer(Context->Instance->Cache,
+                Context->File->Ino, Context->Read.StartOffset,
+                (PUINT8)Context->FuseResponse + FUSE_PROTO_RSP_HEADER_SIZE, BytesTransferred,
+                BytesTransferred < Context->Read.Length/* a short read has seen the end of the file */,
+                Context->Read.CacheTimeout);
+
+        Context->InternalResponse->IoStatus.Status = STATUS_SUCCESS;
+    }
+
+    return coro_active();
+}
+
+static BOOLEAN FuseOpReserved_RenameCheck(FUSE_CONTEXT *Context)
+    /*
+     * Resolve a rename's target (new file name) on behalf of an originating
+     * rename context that concurrently resolves its source path (see
+     * FuseRenameCheckStart). This is the work of FuseRenameCheck performed on
+     * the helper's own LookupPath state; the results are posted into the
+     * originating context by the Fini routine, which runs on every deletion
+     * path. The path buffer and cache generation are owned by the originating
+     * context, which joins before completing.
+     */
+{
+    PAGED_CODE();
+
+    coro_block (Context->CoroState)
+    {
+        Context->LookupPath.DesiredAccess = 0;
+
+        FusePosixPathSuffix(&Context->LookupPath.OrigPath, &Context->LookupPath.Remain, 0);
+        coro_await (FuseLookupPath(Context));
+        if (!NT_SUCCESS(Context->InternalResponse->IoStatus.Status))
+            coro_break;
+
+        /* the final lookup below overwrites Ino; capture the target directory now */
+        Context->LookupPath.Ino2 = Context->LookupPath.Ino;
+
+        FusePosixPathSuffix(&Context->LookupPath.OrigPath, 0, &Context->LookupPath.Name);
+        coro_await (FuseLookup(Context));
+        if (NT_SUCCESS(Context->InternalResponse->IoStatus.Status))
+        {
+            if (Context->LookupPath.RenameCheckAccess)
+            {
+                Context->InternalResponse->IoStatus.Status = FuseAccessCheck(
+                    Context->LookupPath.Attr.uid, Context->LookupPath.Attr.gid,
+                    Context->LookupPath.Attr.mode,
+                    Context->OrigUid, Context->OrigGid,
+                    DELETE, &Context->LookupPath.GrantedAccess);
+                if (!NT_SUCCESS(Context->InternalResponse->IoStatus.Status))
+                    coro_break;
+            }
+
+            Context->InternalResponse->IoStatus.Status = STATUS_SUCCESS;
+        }
+    }
+
+    return coro_active();
+}
+
 static BOOLEAN FuseOpReserved(FUSE_CONTEXT *Context)
 {
     PAGED_CODE();
@@ -215,11 +430,115 @@ static BOOLEAN FuseOpReserved(FUSE_CONTEXT *Context)
     case FUSE_PROTO_OPCODE_FORGET:
     case FUSE_PROTO_OPCODE_BATCH_FORGET:
         return FuseOpReserved_Forget(Context);
+    case FUSE_PROTO_OPCODE_RELEASE:
+        return FuseOpReserved_Release(Context);
+    case FUSE_PROTO_OPCODE_READ:
+    case FUSE_PROTO_OPCODE_WRITE:
+        if (0 != Context->PipeParent)
+            return FuseOpReserved_IoChunk(Context);
+        return FuseOpReserved_ReadAhead(Context);
+    case FUSE_PROTO_OPCODE_RENAME:
+        return FuseOpReserved_RenameCheck(Context);
     default:
         return FALSE;
     }
 }
 
+static BOOLEAN FuseLookupFlightBegin(FUSE_CONTEXT *Context)
+    /*
+     * Join the singleflight for (Lookup.Ino, Lookup.Name). Returns TRUE if this
+     * context is the winner that must issue the LOOKUP and call FuseLookupFlightEnd.
+     * Otherwise the context has been enqueued on the winner and must park (yield);
+     * it is reposted when the winner completes and should then retry the cache.
+     */
+{
+    PAGED_CODE();
+
+    FUSE_INSTANCE *Instance = Context->Instance;
+    FUSE_CONTEXT *Winner = 0;
+
+    ExAcquireFastMutex(&Instance->FlightMutex);
+
+    for (PLIST_ENTRY Entry = Instance->FlightList.Flink; &Instance->FlightList != Entry;
+        Entry = Entry->Flink)
+    {
+        FUSE_CONTEXT *ContextX = CONTAINING_RECORD(Entry, FUSE_CONTEXT, FlightListEntry);
+        if (Context->Lookup.Ino == ContextX->Lookup.Ino &&
+            RtlEqualString(&Context->Lookup.Name, &ContextX->Lookup.Name, FALSE))
+        {
+            Winner = ContextX;
+            break;
+        }
+    }
+
+    if (0 == Winner)
+    {
+        InsertTailList(&Instance->FlightList, &Context->FlightListEntry);
+
+        /* the flight must be ended even if the context is deleted mid-LOOKUP
+        (ioq teardown), or its waiters would stay parked forever */
+        Context->FlightSavedFini = Context->Fini;
+        Context->Fini = FuseLookupFlight_ContextFini;
+    }
+    else
+    {
+        /* park on the winner: one reference for the flight and one for ourselves,
+        released by FuseInstanceParkContext after the ioq insertion */
+        InterlockedExchange(&Context->PipeOutstanding, 2);
+        Context->Parked = TRUE;
+        Context->FlightNext = Winner->FlightWaiters;
+        Winner->FlightWaiters = Context;
+    }
+
+    ExReleaseFastMutex(&Instance->FlightMutex);
+
+    return 0 == Winner;
+}
+
+static VOID FuseLookupFlightEnd(FUSE_CONTEXT *Context)
+{
+    PAGED_CODE();
+
+    FUSE_INSTANCE *Instance = Context->Instance;
+    FUSE_CONTEXT *Waiters;
+
+    ExAcquireFastMutex(&Instance->FlightMutex);
+    RemoveEntryList(&Context->FlightListEntry);
+    Waiters = Context->FlightWaiters;
+    Context->FlightWaiters = 0;
+    ExReleaseFastMutex(&Instance->FlightMutex);
+
+    Context->Fini = Context->FlightSavedFini;
+    Context->FlightSavedFini = 0;
+
+    while (0 != Waiters)
+    {
+        FUSE_CONTEXT *Waiter = Waiters;
+        Waiters = Waiter->FlightNext;
+        Waiter->FlightNext = 0;
+            /* after the decrement below the waiter may resume at any time */
+        if (0 == InterlockedDecrement(&Waiter->PipeOutstanding))
+        {
+            /* claim the parked waiter and post it to retry the cache */
+            Waiter = FuseIoqEndProcessing(Instance->Ioq, (UINT64)(UINT_PTR)Waiter);
+            if (0 != Waiter)
+                FuseIoqPostPending(Instance->Ioq, Waiter);
+        }
+    }
+}
+
+static VOID FuseLookupFlight_ContextFini(FUSE_CONTEXT *Context)
+{
+    PAGED_CODE();
+
+    VOID (*SavedFini)(FUSE_CONTEXT *) = Context->FlightSavedFini;
+
+    FuseLookupFlightEnd(Context);
+
+    if (0 != SavedFini)
+        SavedFini(Context);
+}
+
 static VOID FuseLookup(FUSE_CONTEXT *Context)
 {
     PAGED_CODE();
@@ -229,7 +548,7 @@ static VOID FuseLookup(FUSE_CONTEXT *Context)
 
     coro_block (Context->CoroState)
     {
-        if (!FuseCacheGetEntry(Context->Instance->Cache,
+        while (!FuseCacheGetEntry(Context->Instance->Cache,
             Context->Lookup.Ino, &Context->Lookup.Name, Entry, &CacheItem))
         {
             if (FUSE_PROTO_ROOT_INO == Context->Lookup.Ino &&
@@ -249,9 +568,23 @@ static VOID FuseLookup(FUSE_CONTEXT *Context)
             }
             else
             {
+                if (!FuseLookupFlightBegin(Context))
+                {
+                    /* an identical LOOKUP is in flight; park until it completes
+                    and then retry the cache */
+                    coro_yield;
+                    continue;
+                }
+
                 coro_await (FuseProtoSendLookup(Context));
                 if (!NT_SUCCESS(Context->InternalResponse->IoStatus.Status))
+                {
+                    if (STATUS_OBJECT_NAME_NOT_FOUND == Context->InternalResponse->IoStatus.Status)
+                        FuseCacheSetNegativeEntry(Context->Instance->Cache,
+                            Context->Lookup.Ino, &Context->Lookup.Name);
+                    FuseLookupFlightEnd(Context);
                     coro_break;
+                }
 
                 Entry = &Context->FuseResponse->rsp.lookup.entry;
             }
@@ -259,6 +592,18 @@ static VOID FuseLookup(FUSE_CONTEXT *Context)
             FuseCacheSetEntry(
                 Context->Instance->Cache,
                 Context->Lookup.Ino, &Context->Lookup.Name, Entry, &CacheItem);
+
+            if (&EntryBuf != Entry)
+                FuseLookupFlightEnd(Context);
+
+            break;
+        }
+
+        if (0 == Entry->nodeid)
+        {
+            /* negative entry: the name is known not to exist */
+            Context->InternalResponse->IoStatus.Status = (UINT32)STATUS_OBJECT_NAME_NOT_FOUND;
+            coro_break;
         }
 
         Context->Lookup.CacheItem = CacheItem;
@@ -385,13 +730,8 @@ static VOID FusePrepareLookupPath(FUSE_CONTEXT *Context)
         if (!NT_SUCCESS(Context->InternalResponse->IoStatus.Status))
             goto exit;
 
-        Context->InternalResponse->IoStatus.Status = FuseGetTokenUid(
-            AccessTokenObject, TokenUser, &Uid);
-        if (!NT_SUCCESS(Context->InternalResponse->IoStatus.Status))
-            goto exit;
-
-        Context->InternalResponse->IoStatus.Status = FuseGetTokenUid(
-            AccessTokenObject, TokenPrimaryGroup, &Gid);
+        Context->InternalResponse->IoStatus.Status = FuseGetTokenUidGid(
+            AccessTokenObject, &Uid, &Gid);
         if (!NT_SUCCESS(Context->InternalResponse->IoStatus.Status))
             goto exit;
 
@@ -491,10 +831,68 @@ static VOID FuseLookupPath(FUSE_CONTEXT *Context)
 
     PAGED_CODE();
 
+    FUSE_CACHE_PATH_ATTR PathAttrs[FUSE_CACHE_PATH_COMPONENT_MAX];
+    ULONG PathAttrCount;
+    FUSE_PROTO_ENTRY EntryBuf;
+    PVOID CacheItem;
+
     coro_block (Context->CoroState)
     {
         Context->LookupPath.Ino = FUSE_PROTO_ROOT_INO;
         DEBUGFILL(&Context->Lookup.Attr, sizeof Context->Lookup.Attr);
+
+        /*
+         * First try to resolve the full path with a single hash probe. The cached
+         * mapping records the (uid, gid, mode) of every component, so the traverse
+         * and access checks of the component-by-component walk below are replayed
+         * here from the cached attributes; a hit grants exactly what the walk
+         * would grant.
+         */
+        Context->LookupPath.Path = Context->LookupPath.Remain;
+        Context->LookupPath.PathItemCount = 0;
+        PathAttrCount = FUSE_CACHE_PATH_COMPONENT_MAX;
+        if (FuseCacheGetPath(Context->Instance->Cache, &Context->LookupPath.Path,
+            PathAttrs, &PathAttrCount, &Context->LookupPath.Attr, &CacheItem))
+        {
+            if (UserMode)
+                for (ULONG I = 0; PathAttrCount > I; I++)
+                    if (PathAttrCount - 1 > I)
+                    {
+                        if (!TravPriv)
+                        {
+                            Context->InternalResponse->IoStatus.Status = FuseAccessCheck(
+                                PathAttrs[I].Uid, PathAttrs[I].Gid, PathAttrs[I].Mode,
+                                Context->OrigUid, Context->OrigGid,
+                                FILE_TRAVERSE, 0);
+                            if (!NT_SUCCESS(Context->InternalResponse->IoStatus.Status))
+                                coro_break;
+                        }
+                    }
+                    else
+                    {
+                        Context->InternalResponse->IoStatus.Status = FuseAccessCheck(
+                            PathAttrs[I].Uid, PathAttrs[I].Gid, PathAttrs[I].Mode,
+                            Context->OrigUid, Context->OrigGid,
+                            Context->LookupPath.DesiredAccess, &Context->LookupPath.GrantedAccess);
+                        if (!NT_SUCCESS(Context->InternalResponse->IoStatus.Status))
+                            coro_break;
+                    }
+
+            FusePosixPathSuffix(&Context->LookupPath.Path, 0, &Context->LookupPath.Name);
+            if (0 == Context->LookupPath.Name.Length)
+                /* the path was the root */
+                Context->LookupPath.Name = Context->LookupPath.Path;
+            Context->LookupPath.Remain.Buffer =
+                Context->LookupPath.Path.Buffer + Context->LookupPath.Path.Length;
+            Context->LookupPath.Remain.Length = Context->LookupPath.Remain.MaximumLength = 0;
+            Context->LookupPath.Ino = PathAttrs[PathAttrCount - 1].Ino;
+            Context->LookupPath.CacheItem = CacheItem;
+            ASSERT(DEBUGGOOD(&Context->Lookup.Attr, sizeof Context->Lookup.Attr));
+
+            Context->InternalResponse->IoStatus.Status = STATUS_SUCCESS;
+            coro_break;
+        }
+
         while (1) /* for (;;) produces "warning C4702: unreachable code" */
         {
             FusePosixPathPrefix(&Context->LookupPath.Remain, &Context->LookupPath.Name, &Context->LookupPath.Remain);
@@ -525,6 +923,13 @@ static VOID FuseLookupPath(FUSE_CONTEXT *Context)
                 if (!NT_SUCCESS(Context->InternalResponse->IoStatus.Status))
                     coro_break;
 
+                /* record the component items so that the path mapping can be set */
+                if (FUSE_CACHE_PATH_COMPONENT_MAX > Context->LookupPath.PathItemCount)
+                    Context->LookupPath.PathItems[Context->LookupPath.PathItemCount++] =
+                        Context->Lookup.CacheItem;
+                else
+                    Context->LookupPath.PathItemCount = FUSE_CACHE_PATH_COMPONENT_MAX + 1;
+
                 if (UserMode)
                 {
                     if (!LastName && !TravPriv)
@@ -550,6 +955,14 @@ static VOID FuseLookupPath(FUSE_CONTEXT *Context)
                 }
             }
 
+            else if (FuseCacheGetEntry(Context->Instance->Cache,
+                Context->LookupPath.Ino, &Context->LookupPath.Name, &EntryBuf, &CacheItem))
+                /* the root was not LOOKUP'ed; probe the cache so that the recorded
+                mapping covers every component and access checks can be replayed */
+                Context->LookupPath.PathItems[Context->LookupPath.PathItemCount++] = CacheItem;
+            else
+                Context->LookupPath.PathItemCount = FUSE_CACHE_PATH_COMPONENT_MAX + 1;
+
             if (LastName)
             {
                 ASSERT(DEBUGGOOD(&Context->Lookup.Attr, sizeof Context->Lookup.Attr));
@@ -557,6 +970,11 @@ static VOID FuseLookupPath(FUSE_CONTEXT *Context)
             }
         }
 
+        if (0 < Context->LookupPath.PathItemCount &&
+            FUSE_CACHE_PATH_COMPONENT_MAX >= Context->LookupPath.PathItemCount)
+            FuseCacheSetPath(Context->Instance->Cache, &Context->LookupPath.Path,
+                Context->LookupPath.PathItems, Context->LookupPath.PathItemCount);
+
         Context->InternalResponse->IoStatus.Status = STATUS_SUCCESS;
     }
 
@@ -770,6 +1188,91 @@ static VOID FuseRenameCheck(FUSE_CONTEXT *Context)
     }
 }
 
+static BOOLEAN FuseRenameCheckStart(FUSE_CONTEXT *Context)
+    /*
+     * Hand the rename check (resolution of the new file name) to a helper
+     * reserved context, so that it overlaps the originating context's source
+     * path resolution instead of running before it; both resolutions are full
+     * component walks with possible round trips to the user mode file system.
+     * The helper is tracked through the ioq process table with its own unique,
+     * as with pipelined I/O chunks. After a successful call the originating
+     * context must join (see FusePipelineWait) before reading the results or
+     * completing; it may issue its own FUSE requests before the join.
+     *
+     * On failure no helper runs and the caller falls back to the sequential
+     * FuseRenameCheck.
+     */
+{
+    PAGED_CODE();
+
+    FUSE_INSTANCE *Instance = Context->Instance;
+    FUSE_CONTEXT *Helper;
+
+    FuseContextCreate(&Helper, Instance, 0);
+    ASSERT(0 != Helper);
+    if (FuseContextIsStatus(Helper))
+        return FALSE;
+
+    /* the helper resolves the new file name; move it aside to make room for the
+    source path (FusePrepareLookupPath2 expects this arrangement) */
+    Context->LookupPath.OrigPath2 = Context->LookupPath.OrigPath;
+    Context->LookupPath.OrigPath.Length = Context->LookupPath.OrigPath.MaximumLength = 0;
+    Context->LookupPath.OrigPath.Buffer = 0;
+
+    Helper->InternalResponse->Hint = FUSE_PROTO_OPCODE_RENAME;
+    Helper->Fini = FuseRenameCheck_ContextFini;
+    Helper->OrigUid = Context->OrigUid;
+    Helper->OrigGid = Context->OrigGid;
+    Helper->OrigPid = Context->OrigPid;
+    Helper->PipeParent = Context;
+    /* the path buffer is owned by the originating context and its cache
+    generation reference covers the helper's lookups */
+    Helper->LookupPath.OrigPath = Context->LookupPath.OrigPath2;
+    Helper->LookupPath.UserMode = Context->LookupPath.UserMode;
+    Helper->LookupPath.HasTraversePrivilege = Context->LookupPath.HasTraversePrivilege;
+    Helper->LookupPath.RenameCheckAccess =
+        0 != Context->InternalRequest->Req.SetInformation.Info.Rename.AccessToken;
+
+    /* PipeOutstanding is NOT claimed here: the source walk may park this context
+    as a LOOKUP singleflight waiter, which takes over that count. The join
+    handshakes through RenameCheckDone instead and counts the park only */
+
+    FuseIoqPostPending(Instance->Ioq, Helper);
+
+    return TRUE;
+}
+
+static VOID FuseRenameCheck_ContextFini(FUSE_CONTEXT *Context)
+    /*
+     * This runs on every helper deletion path (normal completion, ioq
+     * stop/drain, ioq deletion), so the results are posted and the handshake
+     * with the originating context is performed exactly once.
+     */
+{
+    PAGED_CODE();
+
+    FUSE_IOQ *Ioq = Context->Instance->Ioq;
+    FUSE_CONTEXT *Parent = Context->PipeParent;
+
+    /* post the results before the handshake below; the originating context
+    reads them only after it has joined */
+    Parent->LookupPath.Ino2 = Context->LookupPath.Ino2;
+    Parent->LookupPath.RenameCheckMode = Context->LookupPath.Attr.mode;
+    Parent->LookupPath.RenameCheckStatus = (LONG)Context->InternalResponse->IoStatus.Status;
+
+    if (0 != InterlockedExchange(&Parent->LookupPath.RenameCheckDone, 1))
+    {
+        /* the originating context parked itself awaiting these results;
+        claim it and post it for completion */
+        if (0 == InterlockedDecrement(&Parent->PipeOutstanding))
+        {
+            Parent = FuseIoqEndProcessing(Ioq, (UINT64)(UINT_PTR)Parent);
+            if (0 != Parent)
+                FuseIoqPostPending(Ioq, Parent);
+        }
+    }
+}
+
 static VOID FuseCreate(FUSE_CONTEXT *Context)
 {
     PAGED_CODE();
@@ -807,6 +1310,7 @@ static VOID FuseCreate(FUSE_CONTEXT *Context)
             if (!NT_SUCCESS(Context->InternalResponse->IoStatus.Status))
                 coro_break;
 
+            FuseCacheRemoveDirBuffers(Context->Instance->Cache, Context->LookupPath.Ino);
             FuseCacheSetEntry(
                 Context->Instance->Cache,
                 Context->LookupPath.Ino, &Context->LookupPath.Name,
@@ -835,6 +1339,7 @@ static VOID FuseCreate(FUSE_CONTEXT *Context)
             coro_await (FuseProtoSendCreate(Context));
             if (NT_SUCCESS(Context->InternalResponse->IoStatus.Status))
             {
+                FuseCacheRemoveDirBuffers(Context->Instance->Cache, Context->LookupPath.Ino);
                 FuseCacheSetEntry(
                     Context->Instance->Cache,
                     Context->LookupPath.Ino, &Context->LookupPath.Name,
@@ -861,6 +1366,7 @@ static VOID FuseCreate(FUSE_CONTEXT *Context)
                 if (!NT_SUCCESS(Context->InternalResponse->IoStatus.Status))
                     coro_break;
 
+                FuseCacheRemoveDirBuffers(Context->Instance->Cache, Context->LookupPath.Ino);
                 FuseCacheSetEntry(
                     Context->Instance->Cache,
                     Context->LookupPath.Ino, &Context->LookupPath.Name,
@@ -885,6 +1391,8 @@ static VOID FuseCreate(FUSE_CONTEXT *Context)
             }
         }
 
+        Context->File->DisableCache = Context->LookupPath.DisableCache;
+
         Context->InternalResponse->Rsp.Create.Opened.UserContext2 =
             (UINT64)(UINT_PTR)Context->File;
         FuseAttrToFileInfo(Context->Instance, &Context->LookupPath.Attr,
@@ -1010,6 +1518,7 @@ static VOID FuseOpen(FUSE_CONTEXT *Context)
             Context->File->Fh = Context->FuseResponse->rsp.open.fh;
         }
 
+        Context->File->DisableCache = Context->LookupPath.DisableCache;
         Context->File->CacheItem = Context->LookupPath.CacheItem;
         FuseCacheReferenceItem(Context->Instance->Cache,
             Context->File->CacheItem);
@@ -1201,10 +1710,11 @@ static INT FuseOgCreate(FUSE_CONTEXT *Context, BOOLEAN Acquire)
     if (Acquire)
     {
         INT Result;
+        UINT32 StripeMask = FuseOpGuardStripeMaskFromFileName(Context->InternalRequest);
         if (FILE_OPEN != ((Context->InternalRequest->Req.Create.CreateOptions >> 24) & 0xff))
-            Result = FuseOpGuardAcquireExclusive(Context);
+            Result = FuseOpGuardAcquireExclusive(Context, StripeMask);
         else
-            Result = FuseOpGuardAcquireShared(Context);
+            Result = FuseOpGuardAcquireShared(Context, StripeMask);
 #if DBG
         /*
          * In debug builds we add an artificial delay to our opens to test alertable locks.
@@ -1244,6 +1754,9 @@ static BOOLEAN FuseOpOverwrite(FUSE_CONTEXT *Context)
     {
         Context->File = (PVOID)(UINT_PTR)Context->InternalRequest->Req.Overwrite.UserContext2;
 
+        /* discard coalesced writes: the truncation below would cut them anyway */
+        FuseCoalesceDiscard(Context);
+
         //Context->Setattr.Attr.size = 0;
         coro_await (FuseProtoSendFtruncate(Context));
         if (!NT_SUCCESS(Context->InternalResponse->IoStatus.Status))
@@ -1255,6 +1768,7 @@ static BOOLEAN FuseOpOverwrite(FUSE_CONTEXT *Context)
 
         FuseCacheQuickExpireItem(Context->Instance->Cache,
             Context->File->CacheItem);
+        FuseCacheRemoveDataBuffers(Context->Instance->Cache, Context->File->Ino);
 
         FuseAttrToFileInfo(Context->Instance, &Context->FuseResponse->rsp.getattr.attr,
             &Context->InternalResponse->Rsp.Overwrite.FileInfo);
@@ -1271,12 +1785,19 @@ static BOOLEAN FuseOpCleanup(FUSE_CONTEXT *Context)
 
     coro_block (Context->CoroState)
     {
-        if (Context->InternalRequest->Req.Cleanup.Delete)
-        {
-            /* NOTE: CLEANUP cannot report failure! */
+        /* NOTE: CLEANUP cannot report failure! */
+
+        Context->File = (PVOID)(UINT_PTR)Context->InternalRequest->Req.Cleanup.UserContext2;
 
-            Context->File = (PVOID)(UINT_PTR)Context->InternalRequest->Req.Cleanup.UserContext2;
+        /* barrier: flush coalesced writes before the handle goes away */
+        if (0 != Context->File)
+        {
+            coro_await (FuseCoalesceFlush(Context));
+            Context->InternalResponse->IoStatus.Status = STATUS_SUCCESS;
+        }
 
+        if (Context->InternalRequest->Req.Cleanup.Delete)
+        {
             FusePrepareLookupPath(Context);
             if (!NT_SUCCESS(Context->InternalResponse->IoStatus.Status))
                 coro_break;
@@ -1295,6 +1816,8 @@ static BOOLEAN FuseOpCleanup(FUSE_CONTEXT *Context)
             FuseCacheRemoveEntry(
                 Context->Instance->Cache,
                 Context->Lookup.Ino, &Context->Lookup.Name);
+            FuseCacheRemoveDirBuffers(Context->Instance->Cache, Context->Lookup.Ino);
+            FuseCacheRemoveDataBuffers(Context->Instance->Cache, Context->File->Ino);
 
             Context->InternalResponse->IoStatus.Status = STATUS_SUCCESS;
         }
@@ -1310,7 +1833,8 @@ static INT FuseOgCleanup(FUSE_CONTEXT *Context, BOOLEAN Acquire)
     if (Acquire)
     {
         if (Context->InternalRequest->Req.Cleanup.Delete)
-            return FuseOpGuardAcquireExclusive(Context);
+            return FuseOpGuardAcquireExclusive(Context,
+                FuseOpGuardStripeMaskFromFileName(Context->InternalRequest));
         else
             return FuseOpGuardFalse;
     }
@@ -1336,10 +1860,17 @@ static BOOLEAN FuseOpClose(FUSE_CONTEXT *Context)
 
         if (Context->File->IsReparsePoint)
             /* reparse points are not opened; ignore */;
-        else if (Context->File->IsDirectory)
-            coro_await (FuseProtoSendReleasedir(Context));
         else
-            coro_await (FuseProtoSendRelease(Context));
+        {
+            /* post RELEASE fire-and-forget (like FORGET) so that close does not wait
+            on user space; on success the posted context takes over the file */
+            if (NT_SUCCESS(FuseProtoPostRelease(Context->Instance, Context->File)))
+                Context->File = 0;
+            else if (Context->File->IsDirectory)
+                coro_await (FuseProtoSendReleasedir(Context));
+            else
+                coro_await (FuseProtoSendRelease(Context));
+        }
     }
 
     return coro_active();
@@ -1353,49 +1884,579 @@ static VOID FuseOpClose_ContextFini(FUSE_CONTEXT *Context)
         FuseFileDelete(Context->Instance, Context->File);
 }
 
-static BOOLEAN FuseOpRead(FUSE_CONTEXT *Context)
+#define FUSE_MAPDATA_THRESHOLD          65536
+
+static VOID FuseMapData(FUSE_CONTEXT *Context, UINT64 Address, UINT32 Length)
+    /*
+     * Map the originating I/O's data region into the file system process, so that
+     * bulk data bypasses the transact buffers. Address is the system address that
+     * the FSD provides for the originating I/O's locked pages; it is therefore
+     * safe to describe it with an MDL and remap it. This function must be called
+     * in the context of the file system process (i.e. during transact processing).
+     *
+     * Mapping is negotiated via FUSE_PROTO_INIT_MAPDATA and is attempted for
+     * large transfers only; on any failure the copying data path is used instead.
+     *
+     * The Read and Write context fields alias each other; Read is used throughout.
+     */
 {
     PAGED_CODE();
 
-    coro_block (Context->CoroState)
-    {
-        Context->File = (PVOID)(UINT_PTR)Context->InternalRequest->Req.Read.UserContext2;
+    ASSERT(0 == Context->Read.DataUserAddress);
 
-        Context->Read.StartOffset = Context->InternalRequest->Req.Read.Offset;
-        Context->Read.Remain = Context->InternalRequest->Req.Read.Length;
+    if (0 == (Context->Instance->InitFlags & FUSE_PROTO_INIT_MAPDATA) ||
+        FUSE_MAPDATA_THRESHOLD > Length)
+        return;
 
-        Context->Read.Offset = 0;
-        while (0 != Context->Read.Remain)
-        {
-            Context->Read.Length = Context->Read.Remain;
-#if DBG
-            if (DEBUGTEST(10) && Context->Read.Length > 512)
-                Context->Read.Length = 512;
-#endif
-#if 0
-            FUSE_DEVICE_EXTENSION *Instance = FuseDeviceExtension(Context->DeviceObject);
-            if (Context->Read.Length > Instance->VolumeParams.MaxRead)
-                Context->Read.Length = Instance->VolumeParams.MaxRead;
-#endif
+    PMDL Mdl;
+    PVOID UserAddress;
 
-            coro_await (FuseProtoSendRead(Context));
-            if (!NT_SUCCESS(Context->InternalResponse->IoStatus.Status))
-                coro_break;
+    Mdl = IoAllocateMdl((PVOID)(UINT_PTR)Address, Length, FALSE, FALSE, 0);
+    if (0 == Mdl)
+        return;
+    MmBuildMdlForNonPagedPool(Mdl);
 
-            UINT32 BytesTransferred = Context->FuseResponse->len - FUSE_PROTO_RSP_HEADER_SIZE;
-            if (Context->Read.Length < BytesTransferred)
+    try
+    {
+        UserAddress = MmMapLockedPagesSpecifyCache(
+            Mdl, UserMode, MmCached, 0, FALSE, NormalPagePriority);
+    }
+    except (EXCEPTION_EXECUTE_HANDLER)
+    {
+        UserAddress = 0;
+    }
+    if (0 == UserAddress)
+    {
+        IoFreeMdl(Mdl);
+        return;
+    }
+
+    ObReferenceObject(PsGetCurrentProcess());
+
+    Context->Read.DataMdl = Mdl;
+    Context->Read.DataUserAddress = UserAddress;
+    Context->Read.DataProcess = PsGetCurrentProcess();
+    Context->Fini = FuseMapData_ContextFini;
+}
+
+static VOID FuseMapData_ContextFini(FUSE_CONTEXT *Context)
+{
+    PAGED_CODE();
+
+    KAPC_STATE ApcState;
+    BOOLEAN Attach;
+
+    /* the user mode mapping can only be undone in the file system process */
+    Attach = PsGetCurrentProcess() != Context->Read.DataProcess;
+    if (Attach)
+        KeStackAttachProcess(Context->Read.DataProcess, &ApcState);
+    MmUnmapLockedPages(Context->Read.DataUserAddress, Context->Read.DataMdl);
+    if (Attach)
+        KeUnstackDetachProcess(&ApcState);
+
+    IoFreeMdl(Context->Read.DataMdl);
+    ObDereferenceObject(Context->Read.DataProcess);
+}
+
+#define FUSE_COALESCE_BUFFER_MAX        (1024 * 1024)
+
+static BOOLEAN FuseCoalesceWrite(FUSE_CONTEXT *Context)
+    /*
+     * Coalesce a small write into the file's write buffer, merging adjacent
+     * writes into single WRITE requests of up to the negotiated max_write.
+     * Returns TRUE when the write was absorbed into the buffer; in that case
+     * the response has been fully prepared and no messages need to be sent.
+     * Buffered data is written out at the next flush barrier (FLUSH/FSYNC,
+     * CLEANUP, reads, attribute queries) or when a non-adjacent write arrives
+     * (see FuseCoalesceFlush).
+     *
+     * Coalescing requires a tracked file attr (recorded by the first
+     * non-coalesced write), because the response must report FileInfo without
+     * a GETATTR round-trip. Data is only buffered for one file handle; it
+     * becomes visible to other handles of the same file at the next flush
+     * barrier on the writing handle.
+     */
+{
+    PAGED_CODE();
+
+    FUSE_FILE *File = Context->File;
+    FUSE_INSTANCE *Instance = Context->Instance;
+    UINT64 WriteOffset = Context->InternalRequest->Req.Write.Offset;
+    UINT32 Length = Context->InternalRequest->Req.Write.Length;
+    UINT32 BufferSize = Instance->MaxWrite;
+    BOOLEAN Success = FALSE;
+
+    if (FUSE_COALESCE_BUFFER_MAX < BufferSize)
+        BufferSize = FUSE_COALESCE_BUFFER_MAX;
+
+    if (0 == BufferSize || 0 == Length || Length > BufferSize ||
+        Context->InternalRequest->Req.Write.ConstrainedIo)
+        return FALSE;
+
+    ExAcquireFastMutex(&File->CoalesceMutex);
+
+    if (File->CoalesceAttrValid)
+    {
+        if ((UINT64)-1LL == WriteOffset)
+            /* append: resolve against the tracked file size */
+            WriteOffset = File->CoalesceAttr.size;
+
+        if (0 == File->CoalesceBuf)
+            File->CoalesceBuf = FuseAlloc(BufferSize);
+
+        if (0 != File->CoalesceBuf &&
+            (0 == File->CoalesceLength ||
+                File->CoalesceOffset + File->CoalesceLength == WriteOffset) &&
+            BufferSize - File->CoalesceLength >= Length &&
+            NT_SUCCESS(FuseSafeCopyMemory(
+                File->CoalesceBuf + File->CoalesceLength,
+                (PVOID)(UINT_PTR)Context->InternalRequest->Req.Write.Address,
+                Length)))
+        {
+            if (0 == File->CoalesceLength)
+                File->CoalesceOffset = WriteOffset;
+            File->CoalesceLength += Length;
+            if (File->CoalesceAttr.size < WriteOffset + Length)
+                File->CoalesceAttr.size = WriteOffset + Length;
+
+            FuseAttrToFileInfo(Instance, &File->CoalesceAttr,
+                &Context->InternalResponse->Rsp.Write.FileInfo);
+            Context->InternalResponse->IoStatus.Status = STATUS_SUCCESS;
+            Context->InternalResponse->IoStatus.Information = Length;
+            Success = TRUE;
+        }
+    }
+
+    ExReleaseFastMutex(&File->CoalesceMutex);
+
+    if (Success)
+    {
+        FuseCacheQuickExpireItem(Instance->Cache, File->CacheItem);
+        FuseCacheRemoveDataBuffers(Instance->Cache, File->Ino);
+    }
+
+    return Success;
+}
+
+static VOID FuseCoalesceFlush(FUSE_CONTEXT *Context)
+    /*
+     * Flush the file's coalesced write buffer; a barrier for operations that
+     * must observe previously buffered writes. Sets IoStatus.Status to
+     * STATUS_SUCCESS when the buffer was flushed or there was nothing to flush.
+     * On failure buffered data is lost and the error is reported through
+     * IoStatus.Status; this mirrors the deferred error reporting of other
+     * write-behind schemes.
+     */
+{
+    PAGED_CODE();
+
+    coro_block (Context->CoroState)
+    {
+        FUSE_FILE *File = Context->File;
+
+        ExAcquireFastMutex(&File->CoalesceMutex);
+        if (0 == File->CoalesceLength)
+        {
+            ExReleaseFastMutex(&File->CoalesceMutex);
+            Context->InternalResponse->IoStatus.Status = STATUS_SUCCESS;
+            coro_break;
+        }
+        /* detach the buffer: the flush proceeds without the mutex and
+        concurrent writes start a fresh buffer */
+        Context->Write.CoalesceBuf = File->CoalesceBuf;
+        Context->Write.StartOffset = File->CoalesceOffset;
+        Context->Write.Remain = File->CoalesceLength;
+        Context->Write.Offset = 0;
+        File->CoalesceBuf = 0;
+        File->CoalesceLength = 0;
+        ExReleaseFastMutex(&File->CoalesceMutex);
+
+        ASSERT(0 == Context->Fini);
+        Context->Fini = FuseCoalesceFlush_ContextFini;
+
+        while (0 != Context->Write.Remain)
+        {
+            FuseContextWaitRequest(Context);
+
+            Context->Write.Length = Context->Write.Remain;
+#if DBG
+            if (DEBUGTEST(10) && Context->Write.Length > 512)
+                Context->Write.Length = 512;
+#endif
+            if (Context->Write.Length > Context->FuseRequestLength - FUSE_PROTO_REQ_SIZE(write))
+                Context->Write.Length = Context->FuseRequestLength - FUSE_PROTO_REQ_SIZE(write);
+
+            /* FuseProtoSendWrite copies from CoalesceBuf into the staged request */
+            coro_await (FuseProtoSendWrite(Context));
+            if (!NT_SUCCESS(Context->InternalResponse->IoStatus.Status))
+                break;
+
+            UINT32 BytesTransferred = Context->FuseResponse->rsp.write.size;
+            if (0 == BytesTransferred || Context->Write.Length < BytesTransferred)
             {
                 Context->InternalResponse->IoStatus.Status = (UINT32)STATUS_INTERNAL_ERROR;
+                break;
+            }
+
+            Context->Write.Remain -= BytesTransferred;
+            Context->Write.Offset += BytesTransferred;
+        }
+
+        FuseFree(Context->Write.CoalesceBuf);
+        Context->Write.CoalesceBuf = 0;
+        Context->Fini = 0;
+
+        if (0 == Context->Write.Remain)
+            Context->InternalResponse->IoStatus.Status = STATUS_SUCCESS;
+    }
+}
+
+static VOID FuseCoalesceFlush_ContextFini(FUSE_CONTEXT *Context)
+{
+    PAGED_CODE();
+
+    if (0 != Context->Write.CoalesceBuf)
+        FuseFree(Context->Write.CoalesceBuf);
+}
+
+static VOID FuseCoalesceDiscard(FUSE_CONTEXT *Context)
+    /*
+     * Discard buffered writes and the tracked attr (overwrite/truncate-to-zero:
+     * the buffered data would be truncated away anyway).
+     */
+{
+    PAGED_CODE();
+
+    FUSE_FILE *File = Context->File;
+
+    ExAcquireFastMutex(&File->CoalesceMutex);
+    File->CoalesceLength = 0;
+    File->CoalesceAttrValid = 0;
+    ExReleaseFastMutex(&File->CoalesceMutex);
+}
+
+static VOID FuseCoalesceInvalidate(FUSE_CONTEXT *Context)
+    /*
+     * Invalidate the tracked attr after an operation that changes it behind
+     * our back (truncation); the next write records it anew.
+     */
+{
+    PAGED_CODE();
+
+    FUSE_FILE *File = Context->File;
+
+    ExAcquireFastMutex(&File->CoalesceMutex);
+    File->CoalesceAttrValid = 0;
+    ExReleaseFastMutex(&File->CoalesceMutex);
+}
+
+#define FUSE_PIPELINE_CHUNK             (128 * 1024)
+#define FUSE_PIPELINE_DEPTH             8
+
+static BOOLEAN FusePipelineStart(FUSE_CONTEXT *Context, UINT32 Opcode)
+    /*
+     * Split a large mapped-data transfer into chunks that are processed as
+     * separate reserved contexts, so that the per-chunk file system round-trips
+     * overlap instead of accumulating. Chunks are tracked through the ioq process
+     * table with their own uniques (their context pointers); the originating
+     * context parks itself (see FusePipelineWait) and is claimed back and
+     * reposted by the last chunk to complete.
+     *
+     * Pipelining is only done on the mapped-data path, where chunks transfer
+     * directly to/from the mapped region and responses carry no bulk data.
+     *
+     * After a successful call the caller must invoke FusePipelineWait and
+     * may not issue any FUSE request before the wait completes.
+     *
+     * The Read and Write context fields alias each other; Read is used throughout.
+     */
+{
+    PAGED_CODE();
+
+    FUSE_CONTEXT *Chunks[FUSE_PIPELINE_DEPTH];
+    FUSE_INSTANCE *Instance = Context->Instance;
+    UINT32 Total = Context->Read.Remain;
+    UINT32 ChunkLength, Offset, Length;
+    ULONG ChunkCount, I;
+
+    if (0 == Context->Read.DataUserAddress)
+        return FALSE;
+
+    ChunkCount = (Total + FUSE_PIPELINE_CHUNK - 1) / FUSE_PIPELINE_CHUNK;
+    if (FUSE_PIPELINE_DEPTH < ChunkCount)
+        ChunkCount = FUSE_PIPELINE_DEPTH;
+    if (2 > ChunkCount)
+        return FALSE;
+
+    for (I = 0; ChunkCount > I; I++)
+    {
+        FuseContextCreate(&Chunks[I], Instance, 0);
+        ASSERT(0 != Chunks[I]);
+        if (FuseContextIsStatus(Chunks[I]))
+            break;
+    }
+    if (2 > I)
+    {
+        if (1 == I)
+            FuseContextDelete(Chunks[0]);
+        return FALSE;
+    }
+    ChunkCount = I;
+
+    ChunkLength = (UINT32)((Total + ChunkCount - 1) / ChunkCount);
+    Offset = 0;
+    for (I = 0; ChunkCount > I; I++)
+    {
+        FUSE_CONTEXT *Chunk = Chunks[I];
+        Length = Total - Offset < ChunkLength ? Total - Offset : ChunkLength;
+
+        Chunk->InternalResponse->Hint = Opcode;
+        Chunk->Fini = FusePipelineChunk_ContextFini;
+        Chunk->OrigUid = Context->OrigUid;
+        Chunk->OrigGid = Context->OrigGid;
+        Chunk->OrigPid = Context->OrigPid;
+        Chunk->File = Context->File;
+        Chunk->PipeParent = Context;
+        Chunk->Read.StartOffset = Context->Read.StartOffset;
+        Chunk->Read.Offset = Offset;
+        Chunk->Read.Length = Length;
+        /* the mapping is owned (and unmapped) by the originating context */
+        Chunk->Read.DataUserAddress = Context->Read.DataUserAddress;
+
+        Offset += Length;
+    }
+    ASSERT(Offset == Total);
+
+    Context->Read.PipeShortEnd = (LONG)Total;
+    Context->Read.PipeStatus = 0;
+    /* count one reference for the originating context itself;
+    it is released by FuseInstanceParkContext once the context is safely parked */
+    InterlockedExchange(&Context->PipeOutstanding, (LONG)ChunkCount + 1);
+    Context->Parked = TRUE;
+
+    for (I = 0; ChunkCount > I; I++)
+        FuseIoqPostPending(Instance->Ioq, Chunks[I]);
+
+    return TRUE;
+}
+
+static VOID FusePipelineChunk_ContextFini(FUSE_CONTEXT *Context)
+    /*
+     * This runs on every chunk deletion path (normal completion, ioq stop/drain,
+     * ioq deletion), so the originating context's PipeOutstanding count is
+     * decremented exactly once per chunk.
+     */
+{
+    PAGED_CODE();
+
+    FUSE_IOQ *Ioq = Context->Instance->Ioq;
+    FUSE_CONTEXT *Parent = Context->PipeParent;
+
+    if (0 == InterlockedDecrement(&Parent->PipeOutstanding))
+    {
+        /* last chunk: claim the parked originating context and post it for completion */
+        Parent = FuseIoqEndProcessing(Ioq, (UINT64)(UINT_PTR)Parent);
+        if (0 != Parent)
+            FuseIoqPostPending(Ioq, Parent);
+    }
+}
+
+#define FusePipelineWait(Context)       \
+    do                                  \
+    {                                   \
+        coro_yield;                     \
+        while (0 != InterlockedCompareExchange(&(Context)->PipeOutstanding, 0, 0))\
+        {                               \
+            /* spurious wakeup: take a reference and park again */\
+            InterlockedIncrement(&(Context)->PipeOutstanding);\
+            (Context)->Parked = TRUE;   \
+            coro_yield;                 \
+        }                               \
+    } while (0,0)
+
+/* how many back-to-back sequential reads before readahead starts */
+#define FUSE_READAHEAD_TRIGGER          2
+
+static VOID FuseReadAhead(FUSE_CONTEXT *Context)
+    /*
+     * Detect sequential access on the file and post a speculative READ for the block
+     * that the application is expected to request next. The speculative READ is a
+     * reserved context processed by FuseOpReserved_ReadAhead; its result lands in the
+     * data cache where the next FuseOpRead can pick it up without a round trip.
+     */
+{
+    PAGED_CODE();
+
+    FUSE_INSTANCE *Instance = Context->Instance;
+    FUSE_FILE *File = Context->File;
+    UINT64 Offset = Context->InternalRequest->Req.Read.Offset;
+    UINT32 Length = Context->InternalRequest->Req.Read.Length;
+
+    if (!FuseInstanceWritebackCache(Instance) ||
+        File->DisableCache ||
+        0 == Instance->MaxReadahead ||
+        0 == Length || FUSE_MAPDATA_THRESHOLD <= Length)
+        return;
+
+    /* advisory detector: races with concurrent reads only affect the heuristic */
+    if (Offset == File->ReadAheadExpected)
+        File->SequentialReads++;
+    else
+        File->SequentialReads = 0;
+    File->ReadAheadExpected = Offset + Length;
+    if (FUSE_READAHEAD_TRIGGER > File->SequentialReads)
+        return;
+
+    UINT64 AheadOffset = Offset + Length;
+    UINT32 AheadLength = Length;
+    if (AheadLength > Instance->MaxReadahead)
+        AheadLength = Instance->MaxReadahead;
+    if (AheadOffset == File->ReadAheadIssued)
+        /* a speculative READ for this block is in flight or has completed already */
+        return;
+    File->ReadAheadIssued = AheadOffset;
+
+    UINT64 CacheTimeout = FuseCacheItemTimeout(File->CacheItem);
+    if (0 == CacheTimeout)
+        /* the file system wants every read revalidated; readahead would be wasted */
+        return;
+
+    /* the speculative READ may outlive the application's FUSE_FILE; give it a copy */
+    FUSE_FILE *AheadFile = FuseAllocNonPaged(sizeof *AheadFile);
+    if (0 == AheadFile)
+        return;
+    RtlZeroMemory(AheadFile, sizeof *AheadFile);
+    AheadFile->Ino = File->Ino;
+    AheadFile->Fh = File->Fh;
+    AheadFile->OpenFlags = File->OpenFlags;
+
+    FUSE_CONTEXT *AheadContext;
+    FuseContextCreate(&AheadContext, Instance, 0);
+    ASSERT(0 != AheadContext);
+    if (FuseContextIsStatus(AheadContext))
+    {
+        FuseFree(AheadFile);
+        return;
+    }
+
+    AheadContext->Fini = FuseReadAhead_ContextFini;
+    AheadContext->InternalResponse->Hint = FUSE_PROTO_OPCODE_READ;
+    AheadContext->OrigUid = Context->OrigUid;
+    AheadContext->OrigGid = Context->OrigGid;
+    AheadContext->OrigPid = Context->OrigPid;
+    AheadContext->File = AheadFile;
+    AheadContext->Read.StartOffset = AheadOffset;
+    AheadContext->Read.Offset = 0;
+    AheadContext->Read.Length = AheadLength;
+    AheadContext->Read.CacheTimeout = CacheTimeout;
+
+    FuseIoqPostPending(Instance->Ioq, AheadContext);
+}
+
+static VOID FuseReadAhead_ContextFini(FUSE_CONTEXT *Context)
+{
+    PAGED_CODE();
+
+    /* the speculative READ owns its FUSE_FILE copy */
+    if (0 != Context->File)
+        FuseFree(Context->File);
+}
+
+static BOOLEAN FuseOpRead(FUSE_CONTEXT *Context)
+{
+    PAGED_CODE();
+
+    coro_block (Context->CoroState)
+    {
+        Context->File = (PVOID)(UINT_PTR)Context->InternalRequest->Req.Read.UserContext2;
+
+        /* barrier: reads must observe previously coalesced writes */
+        coro_await (FuseCoalesceFlush(Context));
+        if (!NT_SUCCESS(Context->InternalResponse->IoStatus.Status))
+            coro_break;
+
+        Context->Read.StartOffset = Context->InternalRequest->Req.Read.Offset;
+        Context->Read.Remain = Context->InternalRequest->Req.Read.Length;
+
+        FuseReadAhead(Context);
+
+        if (FuseInstanceWritebackCache(Context->Instance) &&
+            !Context->File->DisableCache &&
+            FUSE_MAPDATA_THRESHOLD > Context->Read.Remain)
+        {
+            /* with writeback_cache negotiated small reads may be served from kernel memory */
+            ULONG BytesTransferred;
+            if (FuseCacheGetDataBuffer(Context->Instance->Cache,
+                Context->File->Ino, Context->Read.StartOffset,
+                (PVOID)(UINT_PTR)Context->InternalRequest->Req.Read.Address, Context->Read.Remain,
+                &BytesTransferred))
+            {
+                Context->InternalResponse->IoStatus.Status = STATUS_SUCCESS;
+                Context->InternalResponse->IoStatus.Information = BytesTransferred;
+                if (0 == Context->InternalResponse->IoStatus.Information)
+                    Context->InternalResponse->IoStatus.Status = (UINT32)STATUS_END_OF_FILE;
+                coro_break;
+            }
+        }
+
+        FuseMapData(Context,
+            Context->InternalRequest->Req.Read.Address,
+            Context->InternalRequest->Req.Read.Length);
+
+        Context->Read.Offset = 0;
+        if (FusePipelineStart(Context, FUSE_PROTO_OPCODE_READ))
+        {
+            FusePipelineWait(Context);
+
+            if (0 != Context->Read.PipeStatus)
+            {
+                Context->InternalResponse->IoStatus.Status = (UINT32)Context->Read.PipeStatus;
                 coro_break;
             }
 
-            Context->InternalResponse->IoStatus.Status = FuseSafeCopyMemory(
-                (PUINT8)(UINT_PTR)Context->InternalRequest->Req.Read.Address + Context->Write.Offset,
-                (PUINT8)Context->FuseResponse + FUSE_PROTO_RSP_HEADER_SIZE,
-                BytesTransferred);
+            Context->Read.Offset = (UINT32)Context->Read.PipeShortEnd;
+            Context->Read.Remain -= Context->Read.Offset;
+        }
+        else
+        while (0 != Context->Read.Remain)
+        {
+            Context->Read.Length = Context->Read.Remain;
+#if DBG
+            if (DEBUGTEST(10) && Context->Read.Length > 512)
+                Context->Read.Length = 512;
+#endif
+            if (0 == Context->Read.DataUserAddress &&
+                Context->Read.Length > FuseInstanceMaxTransfer(Context->Instance))
+                /* a non-mapped READ response must fit the file system's read buffer */
+                Context->Read.Length = FuseInstanceMaxTransfer(Context->Instance);
+
+            coro_await (FuseProtoSendRead(Context));
             if (!NT_SUCCESS(Context->InternalResponse->IoStatus.Status))
                 coro_break;
 
+            UINT32 BytesTransferred;
+            if (0 != Context->Read.DataUserAddress)
+                /* data was placed directly into the mapped region;
+                the response reports the transferred size only */
+                BytesTransferred = Context->FuseResponse->rsp.write.size;
+            else
+                BytesTransferred = Context->FuseResponse->len - FUSE_PROTO_RSP_HEADER_SIZE;
+            if (Context->Read.Length < BytesTransferred)
+            {
+                Context->InternalResponse->IoStatus.Status = (UINT32)STATUS_INTERNAL_ERROR;
+                coro_break;
+            }
+
+            if (0 == Context->Read.DataUserAddress)
+            {
+                Context->InternalResponse->IoStatus.Status = FuseSafeCopyMemory(
+                    (PUINT8)(UINT_PTR)Context->InternalRequest->Req.Read.Address + Context->Write.Offset,
+                    (PUINT8)Context->FuseResponse + FUSE_PROTO_RSP_HEADER_SIZE,
+                    BytesTransferred);
+                if (!NT_SUCCESS(Context->InternalResponse->IoStatus.Status))
+                    coro_break;
+            }
+
             Context->Read.Remain -= BytesTransferred;
             Context->Read.Offset += BytesTransferred;
 
@@ -1403,6 +2464,17 @@ static BOOLEAN FuseOpRead(FUSE_CONTEXT *Context)
                 break;
         }
 
+        if (FuseInstanceWritebackCache(Context->Instance) &&
+            !Context->File->DisableCache &&
+            0 == Context->Read.DataUserAddress &&
+            FUSE_MAPDATA_THRESHOLD > Context->InternalRequest->Req.Read.Length &&
+            0 != Context->Read.Offset)
+            FuseCacheSetDataBuffer(Context->Instance->Cache,
+                Context->File->Ino, Context->Read.StartOffset,
+                (PVOID)(UINT_PTR)Context->InternalRequest->Req.Read.Address, Context->Read.Offset,
+                0 != Context->Read.Remain/* a short read has seen the end of the file */,
+                FuseCacheItemTimeout(Context->File->CacheItem));
+
         Context->InternalResponse->IoStatus.Status = STATUS_SUCCESS;
         Context->InternalResponse->IoStatus.Information = Context->Read.Offset;
         if (0 == Context->InternalResponse->IoStatus.Information)
@@ -1420,11 +2492,38 @@ static BOOLEAN FuseOpWrite(FUSE_CONTEXT *Context)
     {
         Context->File = (PVOID)(UINT_PTR)Context->InternalRequest->Req.Write.UserContext2;
 
-        coro_await (FuseProtoSendFgetattr(Context));
+        /* fast path: absorb small adjacent writes into the file's write buffer */
+        if (FuseCoalesceWrite(Context))
+            coro_break;
+
+        /* barrier: flush previously coalesced data before writing out of order */
+        coro_await (FuseCoalesceFlush(Context));
         if (!NT_SUCCESS(Context->InternalResponse->IoStatus.Status))
             coro_break;
 
-        Context->Write.Attr = Context->FuseResponse->rsp.getattr.attr;
+        /* the cache's by-ino index may save the GETATTR round trip */
+        Context->Write.DeferAttr = 0;
+        if (!FuseCacheGetAttrByIno(Context->Instance->Cache, Context->File->Ino,
+            &Context->Write.Attr))
+        {
+            if (0 != (Context->Instance->InitFlags & FUSE_PROTO_INIT_POSTOP_ATTR) &&
+                !Context->InternalRequest->Req.Write.ConstrainedIo &&
+                (UINT64)-1LL != Context->InternalRequest->Req.Write.Offset)
+                /*
+                 * The WRITE response itself will carry the resulting attr; the
+                 * upfront GETATTR is only needed when the current file size
+                 * determines what to send (constrained I/O, append).
+                 */
+                Context->Write.DeferAttr = 1;
+            else
+            {
+                coro_await (FuseProtoSendFgetattr(Context));
+                if (!NT_SUCCESS(Context->InternalResponse->IoStatus.Status))
+                    coro_break;
+
+                Context->Write.Attr = Context->FuseResponse->rsp.getattr.attr;
+            }
+        }
 
         UINT64 EndOffset;
         Context->Write.StartOffset = Context->InternalRequest->Req.Write.Offset;
@@ -1450,7 +2549,25 @@ static BOOLEAN FuseOpWrite(FUSE_CONTEXT *Context)
         }
         Context->Write.Remain = (UINT32)(EndOffset - Context->Write.StartOffset);
 
+        FuseMapData(Context,
+            Context->InternalRequest->Req.Write.Address,
+            Context->Write.Remain);
+
         Context->Write.Offset = 0;
+        if (FusePipelineStart(Context, FUSE_PROTO_OPCODE_WRITE))
+        {
+            FusePipelineWait(Context);
+
+            if (0 != Context->Write.PipeStatus)
+            {
+                Context->InternalResponse->IoStatus.Status = (UINT32)Context->Write.PipeStatus;
+                coro_break;
+            }
+
+            Context->Write.Offset = (UINT32)Context->Write.PipeShortEnd;
+            Context->Write.Remain -= Context->Write.Offset;
+        }
+        else
         while (0 != Context->Write.Remain)
         {
             FuseContextWaitRequest(Context);
@@ -1460,16 +2577,16 @@ static BOOLEAN FuseOpWrite(FUSE_CONTEXT *Context)
             if (DEBUGTEST(10) && Context->Write.Length > 512)
                 Context->Write.Length = 512;
 #endif
-            if (Context->Write.Length > Context->FuseRequestLength - FUSE_PROTO_REQ_SIZE(write))
-                Context->Write.Length = Context->FuseRequestLength - FUSE_PROTO_REQ_SIZE(write);
-
-            Context->InternalResponse->IoStatus.Status = FuseSafeCopyMemory(
-                (PUINT8)Context->FuseRequest + FUSE_PROTO_REQ_SIZE(write),
-                (PUINT8)(UINT_PTR)Context->InternalRequest->Req.Write.Address + Context->Write.Offset,
-                Context->Write.Length);
-            if (!NT_SUCCESS(Context->InternalResponse->IoStatus.Status))
-                coro_break;
+            if (Context->Write.Length > Context->Instance->MaxWrite)
+                /* max_write is clamped to the negotiated request size (see MAX_PAGES) */
+                Context->Write.Length = Context->Instance->MaxWrite;
+            if (0 == Context->Write.DataUserAddress)
+            {
+                if (Context->Write.Length > Context->FuseRequestLength - FUSE_PROTO_REQ_SIZE(write))
+                    Context->Write.Length = Context->FuseRequestLength - FUSE_PROTO_REQ_SIZE(write);
+            }
 
+            /* FuseProtoSendWrite copies the payload into the staged request */
             coro_await (FuseProtoSendWrite(Context));
             if (!NT_SUCCESS(Context->InternalResponse->IoStatus.Status))
                 coro_break;
@@ -1481,6 +2598,14 @@ static BOOLEAN FuseOpWrite(FUSE_CONTEXT *Context)
                 coro_break;
             }
 
+            if (0 != (Context->Instance->InitFlags & FUSE_PROTO_INIT_POSTOP_ATTR) &&
+                FUSE_PROTO_RSP_SIZE(write.attr) <= Context->FuseResponse->len)
+            {
+                /* postop-attr extension: the response carries the resulting attr */
+                Context->Write.Attr = Context->FuseResponse->rsp.write.attr;
+                Context->Write.DeferAttr = 0;
+            }
+
             Context->Write.Remain -= BytesTransferred;
             Context->Write.Offset += BytesTransferred;
 
@@ -1488,11 +2613,28 @@ static BOOLEAN FuseOpWrite(FUSE_CONTEXT *Context)
                 break;
         }
 
+        if (Context->Write.DeferAttr)
+        {
+            /* pipelined path or the file system did not append the postop attr */
+            coro_await (FuseProtoSendFgetattr(Context));
+            if (!NT_SUCCESS(Context->InternalResponse->IoStatus.Status))
+                coro_break;
+
+            Context->Write.Attr = Context->FuseResponse->rsp.getattr.attr;
+        }
+
         if (Context->Write.Attr.size < Context->Write.StartOffset + Context->Write.Offset)
             Context->Write.Attr.size = Context->Write.StartOffset + Context->Write.Offset;
 
+        /* record the resulting attr so that subsequent writes can coalesce */
+        ExAcquireFastMutex(&Context->File->CoalesceMutex);
+        Context->File->CoalesceAttr = Context->Write.Attr;
+        Context->File->CoalesceAttrValid = 1;
+        ExReleaseFastMutex(&Context->File->CoalesceMutex);
+
         FuseCacheQuickExpireItem(Context->Instance->Cache,
             Context->File->CacheItem);
+        FuseCacheRemoveDataBuffers(Context->Instance->Cache, Context->File->Ino);
 
         FuseAttrToFileInfo(Context->Instance, &Context->Write.Attr,
             &Context->InternalResponse->Rsp.Write.FileInfo);
@@ -1512,6 +2654,24 @@ static BOOLEAN FuseOpQueryInformation(FUSE_CONTEXT *Context)
     {
         Context->File = (PVOID)(UINT_PTR)Context->InternalRequest->Req.QueryInformation.UserContext2;
 
+        /* barrier: the reported attr must reflect previously coalesced writes */
+        coro_await (FuseCoalesceFlush(Context));
+        if (!NT_SUCCESS(Context->InternalResponse->IoStatus.Status))
+            coro_break;
+
+        {
+            /* fast path: serve the attr from the cache's by-ino index
+            (local mutations quick-expire the item, so a hit is never locally stale) */
+            FUSE_PROTO_ATTR AttrBuf;
+            if (FuseCacheGetAttrByIno(Context->Instance->Cache, Context->File->Ino, &AttrBuf))
+            {
+                FuseAttrToFileInfo(Context->Instance, &AttrBuf,
+                    &Context->InternalResponse->Rsp.QueryInformation.FileInfo);
+                Context->InternalResponse->IoStatus.Status = STATUS_SUCCESS;
+                coro_break;
+            }
+        }
+
         coro_await (FuseProtoSendFgetattr(Context));
         if (!NT_SUCCESS(Context->InternalResponse->IoStatus.Status))
             coro_break;
@@ -1533,6 +2693,11 @@ static BOOLEAN FuseOpSetInformation_SetBasicInfo(FUSE_CONTEXT *Context)
     {
         Context->File = (PVOID)(UINT_PTR)Context->InternalRequest->Req.SetInformation.UserContext2;
 
+        /* barrier: coalesced writes must not bump the times we are about to set */
+        coro_await (FuseCoalesceFlush(Context));
+        if (!NT_SUCCESS(Context->InternalResponse->IoStatus.Status))
+            coro_break;
+
         if (0 != Context->InternalRequest->Req.SetInformation.Info.Basic.LastAccessTime ||
             0 != Context->InternalRequest->Req.SetInformation.Info.Basic.LastWriteTime)
         {
@@ -1558,6 +2723,7 @@ static BOOLEAN FuseOpSetInformation_SetBasicInfo(FUSE_CONTEXT *Context)
 
         FuseCacheQuickExpireItem(Context->Instance->Cache,
             Context->File->CacheItem);
+        FuseCacheRemoveDataBuffers(Context->Instance->Cache, Context->File->Ino);
 
         FuseAttrToFileInfo(Context->Instance, &Context->FuseResponse->rsp.getattr.attr,
             &Context->InternalResponse->Rsp.SetInformation.FileInfo);
@@ -1576,6 +2742,12 @@ static BOOLEAN FuseOpSetInformation_SetAllocationSize(FUSE_CONTEXT *Context)
     {
         Context->File = (PVOID)(UINT_PTR)Context->InternalRequest->Req.SetInformation.UserContext2;
 
+        /* barrier: flush coalesced writes before truncation and drop the tracked attr */
+        coro_await (FuseCoalesceFlush(Context));
+        if (!NT_SUCCESS(Context->InternalResponse->IoStatus.Status))
+            coro_break;
+        FuseCoalesceInvalidate(Context);
+
         coro_await (FuseProtoSendFgetattr(Context));
         if (!NT_SUCCESS(Context->InternalResponse->IoStatus.Status))
             coro_break;
@@ -1596,6 +2768,7 @@ static BOOLEAN FuseOpSetInformation_SetAllocationSize(FUSE_CONTEXT *Context)
 
         FuseCacheQuickExpireItem(Context->Instance->Cache,
             Context->File->CacheItem);
+        FuseCacheRemoveDataBuffers(Context->Instance->Cache, Context->File->Ino);
 
         FuseAttrToFileInfo(Context->Instance, &Context->FuseResponse->rsp.getattr.attr,
             &Context->InternalResponse->Rsp.SetInformation.FileInfo);
@@ -1614,6 +2787,12 @@ static BOOLEAN FuseOpSetInformation_SetFileSize(FUSE_CONTEXT *Context)
     {
         Context->File = (PVOID)(UINT_PTR)Context->InternalRequest->Req.SetInformation.UserContext2;
 
+        /* barrier: flush coalesced writes before truncation and drop the tracked attr */
+        coro_await (FuseCoalesceFlush(Context));
+        if (!NT_SUCCESS(Context->InternalResponse->IoStatus.Status))
+            coro_break;
+        FuseCoalesceInvalidate(Context);
+
         Context->Setattr.Attr.size =
             Context->InternalRequest->Req.SetInformation.Info.EndOfFile.FileSize;
         coro_await (FuseProtoSendFtruncate(Context));
@@ -1626,6 +2805,7 @@ static BOOLEAN FuseOpSetInformation_SetFileSize(FUSE_CONTEXT *Context)
 
         FuseCacheQuickExpireItem(Context->Instance->Cache,
             Context->File->CacheItem);
+        FuseCacheRemoveDataBuffers(Context->Instance->Cache, Context->File->Ino);
 
         FuseAttrToFileInfo(Context->Instance, &Context->FuseResponse->rsp.getattr.attr,
             &Context->InternalResponse->Rsp.SetInformation.FileInfo);
@@ -1710,26 +2890,71 @@ static BOOLEAN FuseOpSetInformation_Rename(FUSE_CONTEXT *Context)
         if (!NT_SUCCESS(Context->InternalResponse->IoStatus.Status))
             coro_break;
 
-        coro_await (FuseRenameCheck(Context));
-        if (NT_SUCCESS(Context->InternalResponse->IoStatus.Status))
-            Context->LookupPath.RenameIsDirectory = 0040000 == (Context->LookupPath.Attr.mode & 0170000);
-        else
-        if (STATUS_OBJECT_PATH_NOT_FOUND == Context->InternalResponse->IoStatus.Status ||
-            STATUS_OBJECT_NAME_NOT_FOUND == Context->InternalResponse->IoStatus.Status)
-            Context->LookupPath.RenameIsNonExistent = 1;
+        if (FuseRenameCheckStart(Context))
+        {
+            /* resolve the source path while the helper resolves the target path */
+            FusePrepareLookupPath2(Context);
+            if (NT_SUCCESS(Context->InternalResponse->IoStatus.Status))
+            {
+                FusePosixPathSuffix(&Context->LookupPath.OrigPath, &Context->LookupPath.Remain, 0);
+                coro_await (FuseLookupPath(Context));
+            }
+
+            /* join: the helper posts its results into this context as it completes;
+            park only if it has not completed yet (see FuseRenameCheck_ContextFini) */
+            if (0 == InterlockedExchange(&Context->LookupPath.RenameCheckDone, 1))
+            {
+                /* one reference for the helper and one for the park itself;
+                the latter is released by FuseInstanceParkContext */
+                InterlockedExchange(&Context->PipeOutstanding, 2);
+                Context->Parked = TRUE;
+                FusePipelineWait(Context);
+            }
+
+            if (!NT_SUCCESS(Context->InternalResponse->IoStatus.Status))
+                coro_break;
+
+            FusePosixPathSuffix(&Context->LookupPath.OrigPath, 0, &Context->LookupPath.Name);
+            FusePosixPathSuffix(&Context->LookupPath.OrigPath2, 0, &Context->LookupPath.Name2);
+
+            if (NT_SUCCESS((NTSTATUS)Context->LookupPath.RenameCheckStatus))
+                Context->LookupPath.RenameIsDirectory =
+                    0040000 == (Context->LookupPath.RenameCheckMode & 0170000);
+            else
+            if (STATUS_OBJECT_PATH_NOT_FOUND == (NTSTATUS)Context->LookupPath.RenameCheckStatus ||
+                STATUS_OBJECT_NAME_NOT_FOUND == (NTSTATUS)Context->LookupPath.RenameCheckStatus)
+                Context->LookupPath.RenameIsNonExistent = 1;
+            else
+            {
+                Context->InternalResponse->IoStatus.Status =
+                    (UINT32)Context->LookupPath.RenameCheckStatus;
+                coro_break;
+            }
+        }
         else
-            coro_break;
+        {
+            /* no helper context: resolve the target then the source sequentially */
+            coro_await (FuseRenameCheck(Context));
+            if (NT_SUCCESS(Context->InternalResponse->IoStatus.Status))
+                Context->LookupPath.RenameIsDirectory = 0040000 == (Context->LookupPath.Attr.mode & 0170000);
+            else
+            if (STATUS_OBJECT_PATH_NOT_FOUND == Context->InternalResponse->IoStatus.Status ||
+                STATUS_OBJECT_NAME_NOT_FOUND == Context->InternalResponse->IoStatus.Status)
+                Context->LookupPath.RenameIsNonExistent = 1;
+            else
+                coro_break;
 
-        FusePrepareLookupPath2(Context);
-        if (!NT_SUCCESS(Context->InternalResponse->IoStatus.Status))
-            coro_break;
+            FusePrepareLookupPath2(Context);
+            if (!NT_SUCCESS(Context->InternalResponse->IoStatus.Status))
+                coro_break;
 
-        FusePosixPathSuffix(&Context->LookupPath.OrigPath, &Context->LookupPath.Remain, 0);
-        coro_await (FuseLookupPath(Context));
-        if (!NT_SUCCESS(Context->InternalResponse->IoStatus.Status))
-            coro_break;
+            FusePosixPathSuffix(&Context->LookupPath.OrigPath, &Context->LookupPath.Remain, 0);
+            coro_await (FuseLookupPath(Context));
+            if (!NT_SUCCESS(Context->InternalResponse->IoStatus.Status))
+                coro_break;
 
-        FusePosixPathSuffix(&Context->LookupPath.OrigPath, 0, &Context->LookupPath.Name);
+            FusePosixPathSuffix(&Context->LookupPath.OrigPath, 0, &Context->LookupPath.Name);
+        }
 
         if (!Context->LookupPath.RenameIsNonExistent &&
             (Context->Instance->VolumeParams->CaseSensitiveSearch ||
@@ -1756,10 +2981,12 @@ static BOOLEAN FuseOpSetInformation_Rename(FUSE_CONTEXT *Context)
         FuseCacheRemoveEntry(
             Context->Instance->Cache,
             Context->LookupPath.Ino, &Context->LookupPath.Name);
+        FuseCacheRemoveDirBuffers(Context->Instance->Cache, Context->LookupPath.Ino);
 
         FuseCacheRemoveEntry(
             Context->Instance->Cache,
             Context->LookupPath.Ino2, &Context->LookupPath.Name2);
+        FuseCacheRemoveDirBuffers(Context->Instance->Cache, Context->LookupPath.Ino2);
 
         Context->InternalResponse->IoStatus.Status = STATUS_SUCCESS;
     }
@@ -1796,10 +3023,15 @@ static INT FuseOgSetInformation(FUSE_CONTEXT *Context, BOOLEAN Acquire)
     if (Acquire)
     {
         if (FileRenameInformation == Context->InternalRequest->Req.SetInformation.FileInformationClass)
-            return FuseOpGuardAcquireExclusive(Context);
+            /* a rename excludes lookups that cross the source or the target */
+            return FuseOpGuardAcquireExclusive(Context,
+                FuseOpGuardStripeMaskFromFileName(Context->InternalRequest) |
+                FuseOpGuardStripeMaskFromPath((PWSTR)(Context->InternalRequest->Buffer +
+                    Context->InternalRequest->Req.SetInformation.Info.Rename.NewFileName.Offset)));
         else
         if (FileDispositionInformation == Context->InternalRequest->Req.SetInformation.FileInformationClass)
-            return FuseOpGuardAcquireShared(Context);
+            return FuseOpGuardAcquireShared(Context,
+                FuseOpGuardStripeMaskFromFileName(Context->InternalRequest));
         else
             return FuseOpGuardFalse;
     }
@@ -1819,6 +3051,15 @@ static BOOLEAN FuseOpQueryEa(FUSE_CONTEXT *Context)
 {
     PAGED_CODE();
 
+    // !!!: REVISIT
+    /*
+     * EA support (GETXATTR/SETXATTR/LISTXATTR/REMOVEXATTR) is not implemented.
+     * When it is: cache GETXATTR/LISTXATTR results per ino in the entry cache
+     * (invalidated by SETXATTR/REMOVEXATTR and the entry timeout) and remember
+     * per-inode ENODATA/ENOTSUP so that repeated probes for absent EAs do not
+     * leave the kernel; Windows components probe EAs far more often than they
+     * change them.
+     */
     return FALSE;
 }
 
@@ -1844,6 +3085,11 @@ static BOOLEAN FuseOpFlushBuffers(FUSE_CONTEXT *Context)
             coro_break;
         }
 
+        /* barrier: flush coalesced writes before asking for durability */
+        coro_await (FuseCoalesceFlush(Context));
+        if (!NT_SUCCESS(Context->InternalResponse->IoStatus.Status))
+            coro_break;
+
         if (Context->File->IsDirectory)
             coro_await (FuseProtoSendFsyncdir(Context));
         else
@@ -2030,49 +3276,139 @@ static VOID FuseOpQueryDirectory_ReadDirectory(FUSE_CONTEXT *Context)
          * We now approximate the FUSE READDIR buffer size required to fit N entries:
          *
          * read.size = FUSE_PROTO_RSP_HEADER_SIZE + N * (sizeof(FUSE_PROTO_DIRENT) + 24)
+         *
+         * (READDIRPLUS records carry an additional FUSE_PROTO_ENTRY per entry.)
          */
+        Context->QueryDirectory.PlusOffset = FuseInstanceReaddirPlus(Context->Instance) ?
+            FIELD_OFFSET(FUSE_PROTO_DIRENTPLUS, dirent) : 0;
         UINT32 N = Context->InternalRequest->Req.QueryDirectory.Length /
             (sizeof(FSP_FSCTL_DIR_INFO) + (24 * sizeof(WCHAR)));
-        Context->QueryDirectory.Length = N * (sizeof(FUSE_PROTO_DIRENT) + 24);
-
-        coro_await (FuseProtoSendReaddir(Context));
-        if (!NT_SUCCESS(Context->InternalResponse->IoStatus.Status))
-            coro_break;
+        Context->QueryDirectory.Length = N *
+            (Context->QueryDirectory.PlusOffset + sizeof(FUSE_PROTO_DIRENT) + 24);
 
-        if (FUSE_PROTO_RSP_HEADER_SIZE + Context->QueryDirectory.Length < Context->FuseResponse->len)
+        ULONG DirBufferLength;
+        if (FuseCacheGetDirBuffer(Context->Instance->Cache,
+            Context->File->Ino, Context->QueryDirectory.NextOffset,
+            (PVOID *)&Context->QueryDirectory.Buffer, &DirBufferLength))
         {
-            Context->InternalResponse->IoStatus.Status = (UINT32)STATUS_INTERNAL_ERROR;
-            coro_break;
+            /* the listing has not changed; serve it from kernel memory */
+            Context->QueryDirectory.BufferEndP = Context->QueryDirectory.Buffer + DirBufferLength;
+            Context->QueryDirectory.BufferP = Context->QueryDirectory.Buffer + FUSE_PROTO_RSP_HEADER_SIZE;
         }
-
-        if (FUSE_PROTO_RSP_HEADER_SIZE < Context->FuseResponse->len)
+        else
         {
-            Context->QueryDirectory.Buffer = FuseAlloc(Context->FuseResponse->len);
-            if (0 == Context->QueryDirectory.Buffer)
+            coro_await (FuseProtoSendReaddir(Context));
+            if (!NT_SUCCESS(Context->InternalResponse->IoStatus.Status))
+                coro_break;
+
+            if (FUSE_PROTO_RSP_HEADER_SIZE + Context->QueryDirectory.Length < Context->FuseResponse->len)
             {
-                Context->InternalResponse->IoStatus.Status = (UINT32)STATUS_INSUFFICIENT_RESOURCES;
+                Context->InternalResponse->IoStatus.Status = (UINT32)STATUS_INTERNAL_ERROR;
                 coro_break;
             }
 
-            RtlCopyMemory(Context->QueryDirectory.Buffer, Context->FuseResponse, Context->FuseResponse->len);
-        }
+            /*
+             * Stream the translation directly from the transact response when possible.
+             * The transact record does not survive a coroutine suspension, so this
+             * requires that no record need a nested GETATTR ("." and "..") or LOOKUP
+             * (missing READDIRPLUS attributes) during translation. Scan the records up
+             * front: chunks that pass (with READDIRPLUS every chunk but the first)
+             * translate without the intermediate kernel copy; the rest go through a
+             * copied buffer that is stable across suspensions.
+             */
+            BOOLEAN Direct = 0 != Context->QueryDirectory.PlusOffset &&
+                FUSE_PROTO_RSP_HEADER_SIZE < Context->FuseResponse->len;
+            if (Direct)
+            {
+                PUINT8 StartP = (PUINT8)Context->FuseResponse + FUSE_PROTO_RSP_HEADER_SIZE;
+                PUINT8 EndP = (PUINT8)Context->FuseResponse + Context->FuseResponse->len;
+                PUINT8 P = StartP;
+                for (;;)
+                {
+                    if (EndP < P + Context->QueryDirectory.PlusOffset +
+                            FIELD_OFFSET(FUSE_PROTO_DIRENT, name))
+                        break;
+                    FUSE_PROTO_DIRENT *Dirent = (FUSE_PROTO_DIRENT *)
+                        (P + Context->QueryDirectory.PlusOffset);
+                    if (EndP < P + Context->QueryDirectory.PlusOffset +
+                            FIELD_OFFSET(FUSE_PROTO_DIRENT, name) + Dirent->namelen)
+                        break;
+                    if ((1 == Dirent->namelen &&
+                        '.' == Dirent->name[0]) ||
+                        (2 == Dirent->namelen &&
+                        '.' == Dirent->name[0] &&
+                        '.' == Dirent->name[1]) ||
+                        0 == ((FUSE_PROTO_DIRENTPLUS *)P)->entry.nodeid)
+                    {
+                        Direct = FALSE;
+                        break;
+                    }
+                    P += FSP_FSCTL_ALIGN_UP(
+                        Context->QueryDirectory.PlusOffset +
+                        FIELD_OFFSET(FUSE_PROTO_DIRENT, name) + Dirent->namelen,
+                        8);
+                }
+                if (P == StartP)
+                    /* no complete record: keep the copied-buffer path and its
+                    end-of-directory handling */
+                    Direct = FALSE;
+            }
+
+            if (Direct)
+            {
+                /* the cache keeps its own copy of the listing */
+                FuseCacheSetDirBuffer(Context->Instance->Cache,
+                    Context->File->Ino, Context->QueryDirectory.NextOffset,
+                    Context->FuseResponse, Context->FuseResponse->len,
+                    FuseCacheItemTimeout(Context->File->CacheItem));
+
+                Context->QueryDirectory.BufferEndP =
+                    (PUINT8)Context->FuseResponse + Context->FuseResponse->len;
+                Context->QueryDirectory.BufferP =
+                    (PUINT8)Context->FuseResponse + FUSE_PROTO_RSP_HEADER_SIZE;
+            }
+            else
+            {
+                if (FUSE_PROTO_RSP_HEADER_SIZE < Context->FuseResponse->len)
+                {
+                    Context->QueryDirectory.Buffer = FuseAlloc(Context->FuseResponse->len);
+                    if (0 == Context->QueryDirectory.Buffer)
+                    {
+                        Context->InternalResponse->IoStatus.Status = (UINT32)STATUS_INSUFFICIENT_RESOURCES;
+                        coro_break;
+                    }
+
+                    RtlCopyMemory(Context->QueryDirectory.Buffer, Context->FuseResponse, Context->FuseResponse->len);
 
-        Context->QueryDirectory.BufferEndP = Context->QueryDirectory.Buffer + Context->FuseResponse->len;
-        Context->QueryDirectory.BufferP = Context->QueryDirectory.Buffer + FUSE_PROTO_RSP_HEADER_SIZE;
+                    FuseCacheSetDirBuffer(Context->Instance->Cache,
+                        Context->File->Ino, Context->QueryDirectory.NextOffset,
+                        Context->QueryDirectory.Buffer, Context->FuseResponse->len,
+                        FuseCacheItemTimeout(Context->File->CacheItem));
+                }
+
+                Context->QueryDirectory.BufferEndP = Context->QueryDirectory.Buffer + Context->FuseResponse->len;
+                Context->QueryDirectory.BufferP = Context->QueryDirectory.Buffer + FUSE_PROTO_RSP_HEADER_SIZE;
+            }
+        }
 
         for (;;)
         {
             if (Context->QueryDirectory.BufferEndP <
-                    Context->QueryDirectory.BufferP + FIELD_OFFSET(FUSE_PROTO_DIRENT, name) ||
+                    Context->QueryDirectory.BufferP + Context->QueryDirectory.PlusOffset +
+                        FIELD_OFFSET(FUSE_PROTO_DIRENT, name) ||
                 Context->QueryDirectory.BufferEndP <
-                    Context->QueryDirectory.BufferP + FIELD_OFFSET(FUSE_PROTO_DIRENT, name) +
-                        ((FUSE_PROTO_DIRENT *)Context->QueryDirectory.BufferP)->namelen)
+                    Context->QueryDirectory.BufferP + Context->QueryDirectory.PlusOffset +
+                        FIELD_OFFSET(FUSE_PROTO_DIRENT, name) +
+                        ((FUSE_PROTO_DIRENT *)(Context->QueryDirectory.BufferP +
+                            Context->QueryDirectory.PlusOffset))->namelen)
                 break;
 
             Context->QueryDirectory.Name.Length = Context->QueryDirectory.Name.MaximumLength = (USHORT)
-                ((FUSE_PROTO_DIRENT *)Context->QueryDirectory.BufferP)->namelen;
+                ((FUSE_PROTO_DIRENT *)(Context->QueryDirectory.BufferP +
+                    Context->QueryDirectory.PlusOffset))->namelen;
             Context->QueryDirectory.Name.Buffer =
-                ((FUSE_PROTO_DIRENT *)Context->QueryDirectory.BufferP)->name;
+                ((FUSE_PROTO_DIRENT *)(Context->QueryDirectory.BufferP +
+                    Context->QueryDirectory.PlusOffset))->name;
 
             if ((1 == Context->QueryDirectory.Name.Length &&
                 '.' == Context->QueryDirectory.Name.Buffer[0]) ||
@@ -2087,14 +3423,35 @@ static VOID FuseOpQueryDirectory_ReadDirectory(FUSE_CONTEXT *Context)
                  * best we can).
                  */
                 Context->QueryDirectory.Ino =
-                    FUSE_PROTO_UNKNOWN_INO != ((FUSE_PROTO_DIRENT *)Context->QueryDirectory.BufferP)->ino ?
-                        ((FUSE_PROTO_DIRENT *)Context->QueryDirectory.BufferP)->ino :
+                    FUSE_PROTO_UNKNOWN_INO !=
+                        ((FUSE_PROTO_DIRENT *)(Context->QueryDirectory.BufferP +
+                            Context->QueryDirectory.PlusOffset))->ino ?
+                        ((FUSE_PROTO_DIRENT *)(Context->QueryDirectory.BufferP +
+                            Context->QueryDirectory.PlusOffset))->ino :
                         Context->File->Ino;
                 coro_await (FuseProtoSendGetattr(Context));
                 if (!NT_SUCCESS(Context->InternalResponse->IoStatus.Status))
                     coro_break;
                 Context->Lookup.Attr = Context->FuseResponse->rsp.getattr.attr;
             }
+            else if (0 != Context->QueryDirectory.PlusOffset &&
+                0 != ((FUSE_PROTO_DIRENTPLUS *)Context->QueryDirectory.BufferP)->entry.nodeid)
+            {
+                /*
+                 * READDIRPLUS: the record carries the entry attributes; use them
+                 * directly and populate the entry cache, so that the LOOKUP storm
+                 * that normally follows enumeration is served from the cache. The
+                 * file system counts a lookup reference per returned entry, which
+                 * FuseCacheSetEntry records for later FORGET.
+                 */
+                PVOID CacheItem;
+                FuseCacheSetEntry(Context->Instance->Cache,
+                    Context->File->Ino, &Context->QueryDirectory.Name,
+                    &((FUSE_PROTO_DIRENTPLUS *)Context->QueryDirectory.BufferP)->entry,
+                    &CacheItem);
+                Context->Lookup.Attr =
+                    ((FUSE_PROTO_DIRENTPLUS *)Context->QueryDirectory.BufferP)->entry.attr;
+            }
             else
             {
                 Context->QueryDirectory.Ino = Context->File->Ino;
@@ -2106,7 +3463,8 @@ static VOID FuseOpQueryDirectory_ReadDirectory(FUSE_CONTEXT *Context)
             BOOLEAN Added = FuseAddDirInfo(
                 Context,
                 &Context->QueryDirectory.Name,
-                ((FUSE_PROTO_DIRENT *)Context->QueryDirectory.BufferP)->off,
+                ((FUSE_PROTO_DIRENT *)(Context->QueryDirectory.BufferP +
+                    Context->QueryDirectory.PlusOffset))->off,
                 &Context->QueryDirectory.Attr,
                 (PVOID)(UINT_PTR)Context->InternalRequest->Req.QueryDirectory.Address,
                 Context->InternalRequest->Req.QueryDirectory.Length,
@@ -2117,8 +3475,10 @@ static VOID FuseOpQueryDirectory_ReadDirectory(FUSE_CONTEXT *Context)
                 break;
 
             Context->QueryDirectory.BufferP += FSP_FSCTL_ALIGN_UP(
+                Context->QueryDirectory.PlusOffset +
                 FIELD_OFFSET(FUSE_PROTO_DIRENT, name) +
-                    ((FUSE_PROTO_DIRENT *)Context->QueryDirectory.BufferP)->namelen,
+                    ((FUSE_PROTO_DIRENT *)(Context->QueryDirectory.BufferP +
+                        Context->QueryDirectory.PlusOffset))->namelen,
                 8);
         }
 
@@ -2176,7 +3536,8 @@ static INT FuseOgQueryDirectory(FUSE_CONTEXT *Context, BOOLEAN Acquire)
     PAGED_CODE();
 
     if (Acquire)
-        return FuseOpGuardAcquireShared(Context);
+        return FuseOpGuardAcquireShared(Context,
+            FuseOpGuardStripeMaskFromFileName(Context->InternalRequest));
     else
         return FuseOpGuardReleaseShared(Context);
 }
@@ -2208,7 +3569,7 @@ static BOOLEAN FuseOpQuerySecurity(FUSE_CONTEXT *Context)
         if (!NT_SUCCESS(Context->InternalResponse->IoStatus.Status))
             coro_break;
 
-        Context->InternalResponse->IoStatus.Status = FspPosixMapPermissionsToSecurityDescriptor(
+        Context->InternalResponse->IoStatus.Status = FuseMapPermissionsToSecurityDescriptor(
             Context->FuseResponse->rsp.getattr.attr.uid,
             Context->FuseResponse->rsp.getattr.attr.gid,
             Context->FuseResponse->rsp.getattr.attr.mode,
@@ -2261,7 +3622,7 @@ static BOOLEAN FuseOpSetSecurity(FUSE_CONTEXT *Context)
         if (!NT_SUCCESS(Context->InternalResponse->IoStatus.Status))
             coro_break;
 
-        Context->InternalResponse->IoStatus.Status = FspPosixMapPermissionsToSecurityDescriptor(
+        Context->InternalResponse->IoStatus.Status = FuseMapPermissionsToSecurityDescriptor(
             Context->FuseResponse->rsp.getattr.attr.uid,
             Context->FuseResponse->rsp.getattr.attr.gid,
             Context->FuseResponse->rsp.getattr.attr.mode,
@@ -26,16 +26,23 @@ NTSTATUS FuseInstanceInit(FUSE_INSTANCE *Instance,
     FUSE_INSTANCE_TYPE InstanceType);
 VOID FuseInstanceFini(FUSE_INSTANCE *Instance);
 VOID FuseInstanceExpirationRoutine(FUSE_INSTANCE *Instance, UINT64 ExpirationTime);
+VOID FuseInstanceGetStatistics(FUSE_INSTANCE *Instance, FUSE_STATISTICS *Statistics);
+NTSTATUS FuseInstanceSetNotifyEvent(FUSE_INSTANCE *Instance, HANDLE EventHandle);
+static VOID FuseInstanceParkContext(FUSE_INSTANCE *Instance, FUSE_CONTEXT *Context);
 NTSTATUS FuseInstanceTransact(FUSE_INSTANCE *Instance,
     FUSE_PROTO_RSP *FuseResponse, ULONG InputBufferLength,
     FUSE_PROTO_REQ *FuseRequest, PULONG POutputBufferLength,
     PDEVICE_OBJECT DeviceObject, PFILE_OBJECT FileObject,
-    PIRP CancellableIrp);
+    PIRP CancellableIrp,
+    BOOLEAN Batch);
 
 #ifdef ALLOC_PRAGMA
 #pragma alloc_text(PAGE, FuseInstanceInit)
 #pragma alloc_text(PAGE, FuseInstanceFini)
 #pragma alloc_text(PAGE, FuseInstanceExpirationRoutine)
+#pragma alloc_text(PAGE, FuseInstanceGetStatistics)
+#pragma alloc_text(PAGE, FuseInstanceSetNotifyEvent)
+#pragma alloc_text(PAGE, FuseInstanceParkContext)
 #pragma alloc_text(PAGE, FuseInstanceTransact)
 #endif
 
@@ -51,18 +58,28 @@ NTSTATUS FuseInstanceInit(FUSE_INSTANCE *Instance,
     Instance->VolumeParams = VolumeParams;
     Instance->InstanceType = InstanceType;
 
-    FuseRwlockInitialize(&Instance->OpGuardLock);
+    for (ULONG Index = 0; FUSE_OPGUARD_STRIPE_COUNT > Index; Index++)
+        FuseRwlockInitialize(&Instance->OpGuardLocks[Index]);
 
-    Result = FuseIoqCreate(&Instance->Ioq);
+    Result = FuseIoqCreate(&Instance->Statistics, &Instance->Ioq);
     if (!NT_SUCCESS(Result))
         goto exit;
 
-    Result = FuseCacheCreate(0, 0/*!VolumeParams->CaseSensitiveSearch*/, &Instance->Cache);
+    /* scale the entry cache with the I/O capacity configured for this volume */
+    Result = FuseCacheCreate(VolumeParams->IrpCapacity * 16,
+        0/*!VolumeParams->CaseSensitiveSearch*/, Instance, &Instance->Cache);
     if (!NT_SUCCESS(Result))
         goto exit;
 
     FuseFileInstanceInit(Instance);
 
+    ExInitializeFastMutex(&Instance->FlightMutex);
+    InitializeListHead(&Instance->FlightList);
+
+    Result = FuseProtoForgetInit(Instance);
+    if (!NT_SUCCESS(Result))
+        goto exit;
+
     KeInitializeEvent(&Instance->InitEvent, NotificationEvent, FALSE);
     Result = FuseProtoPostInit(Instance);
     if (!NT_SUCCESS(Result))
@@ -86,13 +103,17 @@ NTSTATUS FuseInstanceInit(FUSE_INSTANCE *Instance,
 exit:
     if (!NT_SUCCESS(Result))
     {
+        if (0 != Instance->ForgetContext)
+            FuseContextDelete(Instance->ForgetContext);
+
         if (0 != Instance->Cache)
             FuseCacheDelete(Instance->Cache);
 
         if (0 != Instance->Ioq)
             FuseIoqDelete(Instance->Ioq);
 
-        FuseRwlockFinalize(&Instance->OpGuardLock);
+        for (ULONG Index = 0; FUSE_OPGUARD_STRIPE_COUNT > Index; Index++)
+            FuseRwlockFinalize(&Instance->OpGuardLocks[Index]);
 
         RtlZeroMemory(Instance, sizeof *Instance);
     }
@@ -113,17 +134,27 @@ VOID FuseInstanceFini(FUSE_INSTANCE *Instance)
      * FuseIoqDelete must precede FuseCacheDelete, because the Ioq may contain Contexts
      * that hold CacheGen references.
      *
+     * FuseIoqDelete must precede FuseProtoForgetFini, because the forget context
+     * may be in flight inside the Ioq rather than parked on the instance.
+     *
      * FuseFileInstanceFini must precede FuseCacheDelete, because some Files may hold
      * CacheItem references.
      */
 
     FuseIoqDelete(Instance->Ioq);
 
+    FuseProtoForgetFini(Instance);
+
     FuseFileInstanceFini(Instance);
 
     FuseCacheDelete(Instance->Cache);
 
-    FuseRwlockFinalize(&Instance->OpGuardLock);
+    for (ULONG Index = 0; FUSE_OPGUARD_STRIPE_COUNT > Index; Index++)
+        FuseRwlockFinalize(&Instance->OpGuardLocks[Index]);
+
+    if (0 != Instance->NotifyEvent)
+        /* after FuseIoqDelete: the ioq signals the doorbell until it is deleted */
+        ObDereferenceObject(Instance->NotifyEvent);
 }
 
 VOID FuseInstanceExpirationRoutine(FUSE_INSTANCE *Instance, UINT64 ExpirationTime)
@@ -133,17 +164,96 @@ VOID FuseInstanceExpirationRoutine(FUSE_INSTANCE *Instance, UINT64 ExpirationTim
     FuseCacheExpirationRoutine(Instance->Cache, Instance, ExpirationTime);
 }
 
+VOID FuseInstanceGetStatistics(FUSE_INSTANCE *Instance, FUSE_STATISTICS *Statistics)
+{
+    PAGED_CODE();
+
+    RtlCopyMemory(Statistics, &Instance->Statistics, sizeof *Statistics);
+    FuseCacheGetStatistics(Instance->Cache, Statistics);
+    FuseIoqGetStatistics(Instance->Ioq, Statistics);
+}
+
+NTSTATUS FuseInstanceSetNotifyEvent(FUSE_INSTANCE *Instance, HANDLE EventHandle)
+    /*
+     * Register a doorbell event for the instance. The ioq signals the event when
+     * pending work appears, which allows a shared pool of transact workers to wait
+     * on the doorbells of many instances and issue a transact only where work
+     * exists. With a doorbell registered FuseInstanceTransact never blocks: a
+     * transact that finds no work (including before INIT completes) returns with
+     * an empty output buffer and the worker goes back to waiting on its events.
+     */
+{
+    PAGED_CODE();
+
+    PKEVENT Event;
+    NTSTATUS Result;
+
+    Result = ObReferenceObjectByHandle(EventHandle, EVENT_MODIFY_STATE,
+        *ExEventObjectType, UserMode, &Event, 0);
+    if (!NT_SUCCESS(Result))
+        return Result;
+
+    if (0 != InterlockedCompareExchangePointer((PVOID *)&Instance->NotifyEvent, Event, 0))
+    {
+        ObDereferenceObject(Event);
+        return STATUS_DEVICE_BUSY;
+    }
+
+    FuseIoqSetNotifyEvent(Instance->Ioq, Event);
+
+    /* work may have been posted before registration: signal once to avoid a missed wakeup */
+    KeSetEvent(Event, EVENT_INCREMENT, FALSE);
+
+    return STATUS_SUCCESS;
+}
+
+static VOID FuseInstanceParkContext(FUSE_INSTANCE *Instance, FUSE_CONTEXT *Context)
+    /*
+     * Park a pipelined I/O context in the ioq process table instead of requeueing it.
+     * The context holds a reference on its own PipeOutstanding count; once the context
+     * is safely parked the reference is released and, if all chunks have completed in
+     * the meantime, the context is claimed back and posted for processing. After the
+     * reference is released the context may be claimed and processed by a chunk at
+     * any time and must no longer be touched.
+     */
+{
+    PAGED_CODE();
+
+    Context->Parked = FALSE;
+    FuseIoqParkProcessing(Instance->Ioq, Context);
+    if (0 == InterlockedDecrement(&Context->PipeOutstanding))
+    {
+        Context = FuseIoqEndProcessing(Instance->Ioq, (UINT64)(UINT_PTR)Context);
+        if (0 != Context)
+            FuseIoqPostPending(Instance->Ioq, Context);
+    }
+}
+
+/*
+ * FuseInstanceTransact exchanges FUSE protocol messages with the user mode file system.
+ *
+ * In the default (non-batched) mode the input buffer carries a single FUSE_PROTO_RSP
+ * and the output buffer receives a single FUSE_PROTO_REQ. In batched mode the input
+ * buffer may carry an array of FUSE_PROTO_RSP records and the output buffer is filled
+ * with as many FUSE_PROTO_REQ records as fit. In either case each record carries its
+ * own length in its len field; in batched mode records are packed at 8-byte boundaries
+ * (see FUSE_PROTO_ALIGN_SIZE).
+ */
 NTSTATUS FuseInstanceTransact(FUSE_INSTANCE *Instance,
     FUSE_PROTO_RSP *FuseResponse, ULONG InputBufferLength,
     FUSE_PROTO_REQ *FuseRequest, PULONG POutputBufferLength,
     PDEVICE_OBJECT DeviceObject, PFILE_OBJECT FileObject,
-    PIRP CancellableIrp)
+    PIRP CancellableIrp,
+    BOOLEAN Batch)
 {
     PAGED_CODE();
 
     ULONG OutputBufferLength = *POutputBufferLength;
     FSP_FSCTL_TRANSACT_REQ *InternalRequest = 0;
     FSP_FSCTL_TRANSACT_RSP InternalResponse;
+    FUSE_PROTO_RSP *NextResponse;
+    FUSE_PROTO_REQ *NextRequest;
+    ULONG ResponseLength, RequestLength, RecordLength;
     FUSE_CONTEXT *Context;
     BOOLEAN Continue;
     NTSTATUS Result;
@@ -166,143 +276,219 @@ NTSTATUS FuseInstanceTransact(FUSE_INSTANCE *Instance,
 
     if (0 != FuseResponse)
     {
-        Context = FuseIoqEndProcessing(Instance->Ioq, FuseResponse->unique);
-        if (0 == Context)
-            goto request;
-
+        NextResponse = FuseResponse;
+        ResponseLength = InputBufferLength;
+        for (;;)
+        {
+            Context = FuseIoqEndProcessing(Instance->Ioq, NextResponse->unique);
+            if (0 != Context)
+            {
 #if DBG
-        if (fuse_debug & fuse_debug_dp)
-            FuseDebugLogResponse(FuseResponse);
+                if (fuse_debug & fuse_debug_dp)
+                    FuseDebugLogResponse(NextResponse);
 #endif
+                FuseTraceResponse("FuseResponseReceived",
+                    NextResponse->unique, NextResponse->error, NextResponse->len);
+
+                Continue = FuseContextProcess(Context, NextResponse, 0, 0);
+
+                if (Continue)
+                {
+                    if (Context->Parked)
+                        FuseInstanceParkContext(Instance, Context);
+                    else
+                        FuseIoqPostPending(Instance->Ioq, Context);
+                }
+                else if (0 == Context->InternalRequest)
+                    FuseContextDelete(Context);
+                else
+                {
+                    ASSERT(FspFsctlTransactReservedKind != Context->InternalResponse->Kind);
 
-        Continue = FuseContextProcess(Context, FuseResponse, 0, 0);
+                    FuseTraceContext("FuseRequestCompleted", (UINT64)(UINT_PTR)Context,
+                        Context->InternalResponse->Kind, Context->InternalResponse->IoStatus.Status);
+                    Result = FspFsextProviderTransact(
+                        DeviceObject, FileObject, Context->InternalResponse, 0);
+                    FuseContextDelete(Context);
+                    if (!NT_SUCCESS(Result))
+                        goto exit;
+                }
+            }
 
-        if (Continue)
-            FuseIoqPostPending(Instance->Ioq, Context);
-        else if (0 == Context->InternalRequest)
-            FuseContextDelete(Context);
-        else
-        {
-            ASSERT(FspFsctlTransactReservedKind != Context->InternalResponse->Kind);
+            if (!Batch)
+                break;
 
-            Result = FspFsextProviderTransact(
-                DeviceObject, FileObject, Context->InternalResponse, 0);
-            FuseContextDelete(Context);
-            if (!NT_SUCCESS(Result))
+            RecordLength = FUSE_PROTO_ALIGN_SIZE(NextResponse->len);
+            if (RecordLength >= ResponseLength)
+                break;
+            ResponseLength -= RecordLength;
+            NextResponse = (PVOID)((PUINT8)NextResponse + RecordLength);
+            if (FUSE_PROTO_RSP_HEADER_SIZE > NextResponse->len ||
+                NextResponse->len > ResponseLength)
+            {
+                Result = STATUS_INVALID_PARAMETER;
                 goto exit;
+            }
         }
     }
 
-request:
     if (0 != FuseRequest)
     {
-        RtlZeroMemory(FuseRequest, sizeof(FUSE_PROTO_REQ));
-
-        Context = FuseIoqNextPending(Instance->Ioq);
-        if (0 == Context)
+        NextRequest = FuseRequest;
+        RequestLength = OutputBufferLength;
+        for (;;)
         {
-            UINT32 VersionMajor = Instance->VersionMajor;
-            _ReadWriteBarrier();
-                /*
-                 * Compiler barrier only.
-                 *
-                 * A full memory barrier is not needed here, because:
-                 *
-                 * - WaitForSingleObject acts on a NotificationEvent that stays signaled.
-                 * - WaitForSingleObject is a memory barrier.
-                 */
-            if (0 == VersionMajor)
+            /* zero the record header only; the len test below requires a zero len
+            when no record is staged. FuseProtoInitRequest zeroes each message body
+            through its actual length, so the full struct need not be cleared. */
+            RtlZeroMemory(NextRequest, FUSE_PROTO_REQ_HEADER_SIZE);
+
+            Context = FuseIoqNextPending(Instance->Ioq);
+            if (0 == Context)
             {
-                Result = FsRtlCancellableWaitForSingleObject(&Instance->InitEvent,
-                    0, CancellableIrp);
-                if (STATUS_TIMEOUT == Result || STATUS_THREAD_IS_TERMINATING == Result)
-                    Result = STATUS_CANCELLED;
-                if (!NT_SUCCESS(Result))
+                UINT32 VersionMajor = Instance->VersionMajor;
+                _ReadWriteBarrier();
+                    /*
+                     * Compiler barrier only.
+                     *
+                     * A full memory barrier is not needed here, because:
+                     *
+                     * - WaitForSingleObject acts on a NotificationEvent that stays signaled.
+                     * - WaitForSingleObject is a memory barrier.
+                     */
+                if (0 == VersionMajor)
+                {
+                    /* do not block with request records already batched */
+                    if (NextRequest != FuseRequest)
+                        break;
+
+                    /* with a doorbell registered transact never blocks: the worker
+                    waits on its events instead (see FuseInstanceSetNotifyEvent) */
+                    if (0 != Instance->NotifyEvent)
+                        break;
+
+                    Result = FsRtlCancellableWaitForSingleObject(&Instance->InitEvent,
+                        0, CancellableIrp);
+                    if (STATUS_TIMEOUT == Result || STATUS_THREAD_IS_TERMINATING == Result)
+                        Result = STATUS_CANCELLED;
+                    if (!NT_SUCCESS(Result))
+                        goto exit;
+                    ASSERT(STATUS_SUCCESS == Result);
+
+                    VersionMajor = Instance->VersionMajor;
+                }
+                if ((UINT32)-1 == VersionMajor)
+                {
+                    Result = STATUS_ACCESS_DENIED;
                     goto exit;
-                ASSERT(STATUS_SUCCESS == Result);
+                }
 
-                VersionMajor = Instance->VersionMajor;
+                Result = FspFsextProviderTransact(
+                    DeviceObject, FileObject, 0, &InternalRequest);
+                if (!NT_SUCCESS(Result))
+                    goto exit;
+                if (0 == InternalRequest)
+                    break;
+
+                ASSERT(FspFsctlTransactReservedKind != InternalRequest->Kind);
+
+                FuseContextCreate(&Context, Instance, InternalRequest);
+                ASSERT(0 != Context);
+
+                Continue = FALSE;
+                if (!FuseContextIsStatus(Context))
+                {
+                    FuseTraceContext("FuseRequestCreated", (UINT64)(UINT_PTR)Context,
+                        Context->InternalRequest->Kind, 0);
+                    InternalRequest = 0;
+                    Continue = FuseContextProcess(Context, 0, NextRequest, RequestLength);
+                }
             }
-            if ((UINT32)-1 == VersionMajor)
+            else
             {
-                Result = STATUS_ACCESS_DENIED;
-                goto exit;
+                ASSERT(!FuseContextIsStatus(Context));
+                Continue = FuseContextProcess(Context, 0, NextRequest, RequestLength);
             }
 
-            Result = FspFsextProviderTransact(
-                DeviceObject, FileObject, 0, &InternalRequest);
-            if (!NT_SUCCESS(Result))
-                goto exit;
-            if (0 == InternalRequest)
+            if (Continue)
             {
-                Result = STATUS_SUCCESS;
-                goto exit;
+                ASSERT(!FuseContextIsStatus(Context));
+                if (Context->Parked)
+                    FuseInstanceParkContext(Instance, Context);
+                else
+                    FuseIoqStartProcessing(Instance->Ioq, Context);
+            }
+            else if (FuseContextIsStatus(Context))
+            {
+                ASSERT(0 != InternalRequest);
+                RtlZeroMemory(&InternalResponse, sizeof InternalResponse);
+                InternalResponse.Size = sizeof InternalResponse;
+                InternalResponse.Kind = InternalRequest->Kind;
+                InternalResponse.Hint = InternalRequest->Hint;
+                InternalResponse.IoStatus.Status = FuseContextToStatus(Context);
+                Result = FspFsextProviderTransact(
+                    DeviceObject, FileObject, &InternalResponse, 0);
+                if (!NT_SUCCESS(Result))
+                    goto exit;
+            }
+            else if (0 == Context->InternalRequest)
+            {
+                switch (Context->InternalResponse->Hint)
+                {
+                case FUSE_PROTO_OPCODE_FORGET:
+                case FUSE_PROTO_OPCODE_BATCH_FORGET:
+                    if (!IsListEmpty(&Context->Forget.ForgetList))
+                        FuseIoqPostPending(Instance->Ioq, Context);
+                    else
+                        FuseProtoForgetRecycle(Instance, Context);
+                    break;
+                }
+            }
+            else
+            {
+                FuseTraceContext("FuseRequestCompleted", (UINT64)(UINT_PTR)Context,
+                    Context->InternalResponse->Kind, Context->InternalResponse->IoStatus.Status);
+                Result = FspFsextProviderTransact(
+                    DeviceObject, FileObject, Context->InternalResponse, 0);
+                FuseContextDelete(Context);
+                if (!NT_SUCCESS(Result))
+                    goto exit;
             }
 
-            ASSERT(FspFsctlTransactReservedKind != InternalRequest->Kind);
-
-            FuseContextCreate(&Context, Instance, InternalRequest);
-            ASSERT(0 != Context);
-
-            Continue = FALSE;
-            if (!FuseContextIsStatus(Context))
+            if (0 != InternalRequest)
             {
+                FuseFreeExternal(InternalRequest);
                 InternalRequest = 0;
-                Continue = FuseContextProcess(Context, 0, FuseRequest, OutputBufferLength);
             }
-        }
-        else
-        {
-            ASSERT(!FuseContextIsStatus(Context));
-            Continue = FuseContextProcess(Context, 0, FuseRequest, OutputBufferLength);
-        }
 
-        if (Continue)
-        {
-            ASSERT(!FuseContextIsStatus(Context));
-            FuseIoqStartProcessing(Instance->Ioq, Context);
-        }
-        else if (FuseContextIsStatus(Context))
-        {
-            ASSERT(0 != InternalRequest);
-            RtlZeroMemory(&InternalResponse, sizeof InternalResponse);
-            InternalResponse.Size = sizeof InternalResponse;
-            InternalResponse.Kind = InternalRequest->Kind;
-            InternalResponse.Hint = InternalRequest->Hint;
-            InternalResponse.IoStatus.Status = FuseContextToStatus(Context);
-            Result = FspFsextProviderTransact(
-                DeviceObject, FileObject, &InternalResponse, 0);
-            if (!NT_SUCCESS(Result))
-                goto exit;
-        }
-        else if (0 == Context->InternalRequest)
-        {
-            switch (Context->InternalResponse->Hint)
+            if (0 != NextRequest->len)
             {
-            case FUSE_PROTO_OPCODE_FORGET:
-            case FUSE_PROTO_OPCODE_BATCH_FORGET:
-                if (!IsListEmpty(&Context->Forget.ForgetList))
-                    FuseIoqPostPending(Instance->Ioq, Context);
-                else
-                    FuseContextDelete(Context);
-                break;
+#if DBG
+                if (fuse_debug & fuse_debug_dp)
+                    FuseDebugLogRequest(NextRequest);
+#endif
+                FuseTraceRequest("FuseRequestSent",
+                    NextRequest->unique, NextRequest->opcode, NextRequest->len);
+
+                RecordLength = Batch ?
+                    FUSE_PROTO_ALIGN_SIZE(NextRequest->len) : NextRequest->len;
+                if (RecordLength > RequestLength)
+                    RecordLength = RequestLength;
+                if (RecordLength > NextRequest->len)
+                    /* the alignment pad is not covered by the message body zeroing */
+                    RtlZeroMemory((PUINT8)NextRequest + NextRequest->len,
+                        RecordLength - NextRequest->len);
+                RequestLength -= RecordLength;
+                NextRequest = (PVOID)((PUINT8)NextRequest + RecordLength);
             }
-        }
-        else
-        {
-            Result = FspFsextProviderTransact(
-                DeviceObject, FileObject, Context->InternalResponse, 0);
-            FuseContextDelete(Context);
-            if (!NT_SUCCESS(Result))
-                goto exit;
-        }
 
-        *POutputBufferLength = FuseRequest->len;
+            if (!Batch)
+                break;
+            if (FUSE_PROTO_REQ_SIZEMIN > RequestLength)
+                break;
+        }
 
-#if DBG
-        if (fuse_debug & fuse_debug_dp)
-            FuseDebugLogRequest(FuseRequest);
-#endif
+        *POutputBufferLength = (ULONG)((PUINT8)NextRequest - (PUINT8)FuseRequest);
     }
 
     Result = STATUS_SUCCESS;
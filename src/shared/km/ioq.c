@@ -21,52 +21,166 @@
 
 #include <shared/km/shared.h>
 
-NTSTATUS FuseIoqCreate(FUSE_IOQ **PIoq);
+NTSTATUS FuseIoqCreate(FUSE_STATISTICS *Statistics, FUSE_IOQ **PIoq);
 VOID FuseIoqDelete(FUSE_IOQ *Ioq);
 VOID FuseIoqStartProcessing(FUSE_IOQ *Ioq, FUSE_CONTEXT *Context);
+VOID FuseIoqParkProcessing(FUSE_IOQ *Ioq, FUSE_CONTEXT *Context);
 FUSE_CONTEXT *FuseIoqEndProcessing(FUSE_IOQ *Ioq, UINT64 Unique);
 VOID FuseIoqPostPending(FUSE_IOQ *Ioq, FUSE_CONTEXT *Context);
 VOID FuseIoqPostPendingAndStop(FUSE_IOQ *Ioq, FUSE_CONTEXT *Context);
 FUSE_CONTEXT *FuseIoqNextPending(FUSE_IOQ *Ioq);
+VOID FuseIoqSetNotifyEvent(FUSE_IOQ *Ioq, PKEVENT Event);
+VOID FuseIoqGetStatistics(FUSE_IOQ *Ioq, FUSE_STATISTICS *Statistics);
 
 #ifdef ALLOC_PRAGMA
 #pragma alloc_text(PAGE, FuseIoqCreate)
 #pragma alloc_text(PAGE, FuseIoqDelete)
 #pragma alloc_text(PAGE, FuseIoqStartProcessing)
+#pragma alloc_text(PAGE, FuseIoqParkProcessing)
 #pragma alloc_text(PAGE, FuseIoqEndProcessing)
 #pragma alloc_text(PAGE, FuseIoqPostPending)
 #pragma alloc_text(PAGE, FuseIoqPostPendingAndStop)
 #pragma alloc_text(PAGE, FuseIoqNextPending)
+#pragma alloc_text(PAGE, FuseIoqSetNotifyEvent)
+#pragma alloc_text(PAGE, FuseIoqGetStatistics)
 #endif
 
-#define FUSE_IOQ_SIZE                   1024
+/*
+ * The ioq is sharded to avoid serializing all transact workers on a single lock.
+ * Each shard has its own lock, pending list and process hash table. A context is
+ * assigned to a shard by its pointer hash, so that FuseIoqEndProcessing can locate
+ * the owning shard from the response unique alone. FuseIoqNextPending prefers the
+ * shard of the current processor and steals work from other shards when that shard
+ * runs dry.
+ *
+ * The LastContext (stop/drain) machinery remains global: it is written with
+ * interlocked operations before any per-shard state is touched and is (re)checked
+ * under the shard lock, which preserves the original single-lock semantics.
+ *
+ * Each shard keeps one pending list per scheduling class, so that bulk data
+ * operations (READ/WRITE/QUERY_DIRECTORY, e.g. a background full-tree scan)
+ * cannot queue ahead of interactive metadata operations. Dequeue is weighted
+ * rather than strict: after FUSE_IOQ_CLASS_WEIGHT consecutive interactive
+ * deliveries a shard yields one slot to the bulk class, so bulk work always
+ * makes progress.
+ */
 
-struct _FUSE_IOQ
+#define FUSE_IOQ_SHARD_SIZE             1024
+#define FUSE_IOQ_SHARD_COUNT_MAX        16
+
+#define FUSE_IOQ_CLASS_COUNT            2
+#define FUSE_IOQ_CLASS_WEIGHT           8
+
+typedef struct _FUSE_IOQ_SHARD
 {
     FAST_MUTEX Mutex;
-    LIST_ENTRY PendingList, ProcessList;
-    FUSE_CONTEXT *LastContext;
-    ULONG ProcessBucketCount;
+    LIST_ENTRY PendingLists[FUSE_IOQ_CLASS_COUNT], ProcessList;
+    ULONG PendingBurst;                 /* consecutive class-0 deliveries */
     FUSE_CONTEXT *ProcessBuckets[];
+} FUSE_IOQ_SHARD;
+
+struct _FUSE_IOQ
+{
+    ULONG ShardCount;
+    ULONG ProcessBucketCount;
+    FUSE_CONTEXT *LastContext;
+    FUSE_STATISTICS *Statistics;
+    LONG PendingCount, ProcessCount;    /* instantaneous queue depths */
+    PKEVENT NotifyEvent;                /* doorbell: set on empty to non-empty transitions */
 };
 
-NTSTATUS FuseIoqCreate(FUSE_IOQ **PIoq)
+static inline FUSE_IOQ_SHARD *FuseIoqShard(FUSE_IOQ *Ioq, ULONG Index)
+{
+    return (FUSE_IOQ_SHARD *)((PUINT8)(Ioq + 1) + (SIZE_T)Index * FUSE_IOQ_SHARD_SIZE);
+}
+
+static inline ULONG FuseIoqShardIndex(FUSE_IOQ *Ioq, FUSE_CONTEXT *Context)
+{
+    /* divide by the bucket count so that the shard and bucket residues are independent */
+    return FuseHashMixPointer(Context) / Ioq->ProcessBucketCount % Ioq->ShardCount;
+}
+
+static inline ULONG FuseIoqPendingClass(FUSE_CONTEXT *Context)
+    /*
+     * Class 0 is interactive: metadata operations and reserved (internal)
+     * contexts, whose latency is user visible. Class 1 is bulk data, which a
+     * background scan can queue by the thousands. The originating IRP priority
+     * is not visible through the transact interface, so the request kind is
+     * the discriminator.
+     */
+{
+    if (0 == Context->InternalRequest)
+        return 0;
+
+    switch (Context->InternalRequest->Kind)
+    {
+    case FspFsctlTransactReadKind:
+    case FspFsctlTransactWriteKind:
+    case FspFsctlTransactQueryDirectoryKind:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+static inline FUSE_CONTEXT *FuseIoqReadLastContext(FUSE_IOQ *Ioq)
+{
+    return InterlockedCompareExchangePointer(&Ioq->LastContext, 0, 0);
+}
+
+static inline VOID FuseIoqNotify(FUSE_IOQ *Ioq)
+{
+    PKEVENT NotifyEvent = InterlockedCompareExchangePointer(&Ioq->NotifyEvent, 0, 0);
+    if (0 != NotifyEvent)
+        KeSetEvent(NotifyEvent, EVENT_INCREMENT, FALSE);
+}
+
+static inline VOID FuseIoqRecordProcessing(FUSE_STATISTICS *Statistics,
+    UINT32 Opcode, UINT64 Time)
+{
+    ULONG Bucket = 0;
+
+    if (FUSE_STATISTICS_OPCODE_COUNT <= Opcode)
+        Opcode = 0;
+    for (UINT64 T = Time; 1 < T && FUSE_STATISTICS_BUCKET_COUNT - 1 > Bucket; T >>= 1)
+        Bucket++;
+
+    InterlockedIncrement64((LONG64 *)&Statistics->OpcodeCounts[Opcode]);
+    InterlockedExchangeAdd64((LONG64 *)&Statistics->OpcodeTimes[Opcode], (LONG64)Time);
+    InterlockedIncrement((LONG *)&Statistics->OpcodeLatency[Opcode][Bucket]);
+}
+
+NTSTATUS FuseIoqCreate(FUSE_STATISTICS *Statistics, FUSE_IOQ **PIoq)
 {
     PAGED_CODE();
 
     *PIoq = 0;
 
     FUSE_IOQ *Ioq;
-    ULONG BucketCount = (FUSE_IOQ_SIZE - sizeof *Ioq) / sizeof Ioq->ProcessBuckets[0];
-    Ioq = FuseAllocNonPaged(FUSE_IOQ_SIZE);
+    FUSE_IOQ_SHARD *Shard;
+    ULONG ProcessorCount = KeQueryActiveProcessorCountEx(ALL_PROCESSOR_GROUPS);
+    ULONG ShardCount = 1;
+    while (ShardCount < ProcessorCount && FUSE_IOQ_SHARD_COUNT_MAX > ShardCount)
+        ShardCount <<= 1;
+    ULONG BucketCount =
+        (FUSE_IOQ_SHARD_SIZE - sizeof *Shard) / sizeof Shard->ProcessBuckets[0];
+    SIZE_T Size = sizeof *Ioq + (SIZE_T)ShardCount * FUSE_IOQ_SHARD_SIZE;
+    Ioq = FuseAllocNonPaged(Size);
     if (0 == Ioq)
         return STATUS_INSUFFICIENT_RESOURCES;
-    RtlZeroMemory(Ioq, FUSE_IOQ_SIZE);
+    RtlZeroMemory(Ioq, Size);
 
-    ExInitializeFastMutex(&Ioq->Mutex);
-    InitializeListHead(&Ioq->PendingList);
-    InitializeListHead(&Ioq->ProcessList);
+    Ioq->ShardCount = ShardCount;
     Ioq->ProcessBucketCount = BucketCount;
+    Ioq->Statistics = Statistics;
+    for (ULONG I = 0; ShardCount > I; I++)
+    {
+        Shard = FuseIoqShard(Ioq, I);
+        ExInitializeFastMutex(&Shard->Mutex);
+        for (ULONG J = 0; FUSE_IOQ_CLASS_COUNT > J; J++)
+            InitializeListHead(&Shard->PendingLists[J]);
+        InitializeListHead(&Shard->ProcessList);
+    }
 
     *PIoq = Ioq;
 
@@ -77,18 +191,66 @@ VOID FuseIoqDelete(FUSE_IOQ *Ioq)
 {
     PAGED_CODE();
 
-    for (PLIST_ENTRY Entry = Ioq->PendingList.Flink; &Ioq->PendingList != Entry;)
-    {
-        FUSE_CONTEXT *Context = CONTAINING_RECORD(Entry, FUSE_CONTEXT, ListEntry);
-        Entry = Entry->Flink;
-        FuseContextDelete(Context);
-    }
-    for (PLIST_ENTRY Entry = Ioq->ProcessList.Flink; &Ioq->ProcessList != Entry;)
+    /* mark the ioq as stopped, so that pipelined contexts that get claimed and
+    reposted by their chunks' Fini routines below are deleted rather than requeued */
+    InterlockedCompareExchangePointer(&Ioq->LastContext, (PVOID)(UINT_PTR)1, 0);
+
+    /* Delete contexts one at a time outside the shard lock: deleting a pipelined
+    chunk runs its Fini routine, which reenters the ioq to claim its parent.
+    Parents with chunks still outstanding are deferred (the chunks reference them)
+    and are reaped once their last chunk's deletion claims and reposts them. */
+    for (BOOLEAN FoundAny = TRUE; FoundAny;)
     {
-        FUSE_CONTEXT *Context = CONTAINING_RECORD(Entry, FUSE_CONTEXT, ListEntry);
-        Entry = Entry->Flink;
-        FuseContextDelete(Context);
+        FoundAny = FALSE;
+        for (ULONG I = 0; Ioq->ShardCount > I; I++)
+        {
+            FUSE_IOQ_SHARD *Shard = FuseIoqShard(Ioq, I);
+            for (;;)
+            {
+                FUSE_CONTEXT *Context = 0;
+
+                ExAcquireFastMutex(&Shard->Mutex);
+                for (ULONG J = 0; 0 == Context && FUSE_IOQ_CLASS_COUNT > J; J++)
+                    for (PLIST_ENTRY Entry = Shard->PendingLists[J].Flink;
+                        0 == Context && &Shard->PendingLists[J] != Entry; Entry = Entry->Flink)
+                    {
+                        FUSE_CONTEXT *Found = CONTAINING_RECORD(Entry, FUSE_CONTEXT, ListEntry);
+                        if (0 == InterlockedCompareExchange(&Found->PipeOutstanding, 0, 0))
+                            Context = Found;
+                    }
+                for (PLIST_ENTRY Entry = Shard->ProcessList.Flink;
+                    0 == Context && &Shard->ProcessList != Entry; Entry = Entry->Flink)
+                {
+                    FUSE_CONTEXT *Found = CONTAINING_RECORD(Entry, FUSE_CONTEXT, ListEntry);
+                    if (0 == InterlockedCompareExchange(&Found->PipeOutstanding, 0, 0))
+                        Context = Found;
+                }
+                if (0 != Context)
+                {
+                    RemoveEntryList(&Context->ListEntry);
+
+                    /* remove from the process buckets if present (pending contexts are not) */
+                    ULONG Index = FuseHashMixPointer(Context) % Ioq->ProcessBucketCount;
+                    for (FUSE_CONTEXT **PContext = &Shard->ProcessBuckets[Index];
+                        *PContext; PContext = &(*PContext)->DictNext)
+                        if (*PContext == Context)
+                        {
+                            *PContext = Context->DictNext;
+                            Context->DictNext = 0;
+                            break;
+                        }
+                }
+                ExReleaseFastMutex(&Shard->Mutex);
+
+                if (0 == Context)
+                    break;
+
+                FuseContextDelete(Context);
+                FoundAny = TRUE;
+            }
+        }
     }
+
     FuseFree(Ioq);
 }
 
@@ -96,13 +258,20 @@ VOID FuseIoqStartProcessing(FUSE_IOQ *Ioq, FUSE_CONTEXT *Context)
 {
     PAGED_CODE();
 
-    ExAcquireFastMutex(&Ioq->Mutex);
+    FUSE_IOQ_SHARD *Shard = FuseIoqShard(Ioq, FuseIoqShardIndex(Ioq, Context));
+
+    /* record before insertion: once inserted the context may be claimed at any time */
+    Context->ProcessOpcode = 0 != Context->FuseRequest ? Context->FuseRequest->opcode : 0;
+    Context->ProcessStartTime = KeQueryInterruptTime();
 
-    if (0 != Ioq->LastContext)
+    ExAcquireFastMutex(&Shard->Mutex);
+
+    FUSE_CONTEXT *LastContext = FuseIoqReadLastContext(Ioq);
+    if (0 != LastContext)
     {
-        if (Context != Ioq->LastContext)
+        if (Context != LastContext)
         {
-            ExReleaseFastMutex(&Ioq->Mutex);
+            ExReleaseFastMutex(&Shard->Mutex);
             ASSERT(0 != Context->FuseRequest);
             if (0 != Context->FuseRequest)
                 Context->FuseRequest->len = 0;
@@ -110,21 +279,56 @@ VOID FuseIoqStartProcessing(FUSE_IOQ *Ioq, FUSE_CONTEXT *Context)
             return;
         }
         else
-            Ioq->LastContext = (PVOID)(UINT_PTR)1;
+            InterlockedExchangePointer(&Ioq->LastContext, (PVOID)(UINT_PTR)1);
     }
 
-    InsertTailList(&Ioq->ProcessList, &Context->ListEntry);
+    InsertTailList(&Shard->ProcessList, &Context->ListEntry);
+
+    ULONG Index = FuseHashMixPointer(Context) % Ioq->ProcessBucketCount;
+#if DBG
+    for (FUSE_CONTEXT *ContextX = Shard->ProcessBuckets[Index]; ContextX; ContextX = ContextX->DictNext)
+        ASSERT(ContextX != Context);
+#endif
+    ASSERT(0 == Context->DictNext);
+    Context->DictNext = Shard->ProcessBuckets[Index];
+    Shard->ProcessBuckets[Index] = Context;
+
+    ExReleaseFastMutex(&Shard->Mutex);
+
+    InterlockedIncrement(&Ioq->ProcessCount);
+}
+
+VOID FuseIoqParkProcessing(FUSE_IOQ *Ioq, FUSE_CONTEXT *Context)
+    /*
+     * Park a context in the process table without an outstanding FUSE request.
+     * The context can later be claimed with FuseIoqEndProcessing using its pointer
+     * as the unique. This is used by pipelined I/O to suspend the originating
+     * context until its last chunk completes. Unlike FuseIoqStartProcessing this
+     * function inserts the context even when the ioq is stopping: a parked context
+     * counts as in-flight (FuseIoqNextPending will not deliver the last Context
+     * before it is claimed) and its chunks still reference it.
+     */
+{
+    PAGED_CODE();
+
+    FUSE_IOQ_SHARD *Shard = FuseIoqShard(Ioq, FuseIoqShardIndex(Ioq, Context));
+
+    ExAcquireFastMutex(&Shard->Mutex);
+
+    InsertTailList(&Shard->ProcessList, &Context->ListEntry);
 
     ULONG Index = FuseHashMixPointer(Context) % Ioq->ProcessBucketCount;
 #if DBG
-    for (FUSE_CONTEXT *ContextX = Ioq->ProcessBuckets[Index]; ContextX; ContextX = ContextX->DictNext)
+    for (FUSE_CONTEXT *ContextX = Shard->ProcessBuckets[Index]; ContextX; ContextX = ContextX->DictNext)
         ASSERT(ContextX != Context);
 #endif
     ASSERT(0 == Context->DictNext);
-    Context->DictNext = Ioq->ProcessBuckets[Index];
-    Ioq->ProcessBuckets[Index] = Context;
+    Context->DictNext = Shard->ProcessBuckets[Index];
+    Shard->ProcessBuckets[Index] = Context;
+
+    ExReleaseFastMutex(&Shard->Mutex);
 
-    ExReleaseFastMutex(&Ioq->Mutex);
+    InterlockedIncrement(&Ioq->ProcessCount);
 }
 
 FUSE_CONTEXT *FuseIoqEndProcessing(FUSE_IOQ *Ioq, UINT64 Unique)
@@ -133,11 +337,12 @@ FUSE_CONTEXT *FuseIoqEndProcessing(FUSE_IOQ *Ioq, UINT64 Unique)
 
     FUSE_CONTEXT *ContextHint = (PVOID)(UINT_PTR)Unique;
     FUSE_CONTEXT *Context = 0;
+    FUSE_IOQ_SHARD *Shard = FuseIoqShard(Ioq, FuseIoqShardIndex(Ioq, ContextHint));
 
-    ExAcquireFastMutex(&Ioq->Mutex);
+    ExAcquireFastMutex(&Shard->Mutex);
 
     ULONG Index = FuseHashMixPointer(ContextHint) % Ioq->ProcessBucketCount;
-    for (FUSE_CONTEXT **PContext = &Ioq->ProcessBuckets[Index]; *PContext; PContext = &(*PContext)->DictNext)
+    for (FUSE_CONTEXT **PContext = &Shard->ProcessBuckets[Index]; *PContext; PContext = &(*PContext)->DictNext)
     {
         if (*PContext == ContextHint)
         {
@@ -151,7 +356,18 @@ FUSE_CONTEXT *FuseIoqEndProcessing(FUSE_IOQ *Ioq, UINT64 Unique)
         }
     }
 
-    ExReleaseFastMutex(&Ioq->Mutex);
+    ExReleaseFastMutex(&Shard->Mutex);
+
+    if (0 != Context)
+    {
+        InterlockedDecrement(&Ioq->ProcessCount);
+        if (0 != Context->ProcessStartTime)
+        {
+            FuseIoqRecordProcessing(Ioq->Statistics, Context->ProcessOpcode,
+                KeQueryInterruptTime() - Context->ProcessStartTime);
+            Context->ProcessStartTime = 0;
+        }
+    }
 
     return Context;
 }
@@ -160,24 +376,35 @@ VOID FuseIoqPostPending(FUSE_IOQ *Ioq, FUSE_CONTEXT *Context)
 {
     PAGED_CODE();
 
-    ExAcquireFastMutex(&Ioq->Mutex);
+    FUSE_IOQ_SHARD *Shard = FuseIoqShard(Ioq, FuseIoqShardIndex(Ioq, Context));
+
+    ExAcquireFastMutex(&Shard->Mutex);
 
-    if (0 != Ioq->LastContext)
+    if (0 != FuseIoqReadLastContext(Ioq))
     {
-        ExReleaseFastMutex(&Ioq->Mutex);
+        ExReleaseFastMutex(&Shard->Mutex);
         FuseContextDelete(Context);
         return;
     }
 
-    InsertTailList(&Ioq->PendingList, &Context->ListEntry);
+    BOOLEAN WasEmpty = TRUE;
+    for (ULONG J = 0; WasEmpty && FUSE_IOQ_CLASS_COUNT > J; J++)
+        WasEmpty = IsListEmpty(&Shard->PendingLists[J]);
+    InsertTailList(&Shard->PendingLists[FuseIoqPendingClass(Context)], &Context->ListEntry);
+
+    ExReleaseFastMutex(&Shard->Mutex);
 
-    ExReleaseFastMutex(&Ioq->Mutex);
+    InterlockedIncrement(&Ioq->PendingCount);
+
+    if (WasEmpty)
+        /* ring the doorbell on the shard's empty to non-empty transition */
+        FuseIoqNotify(Ioq);
 }
 
 VOID FuseIoqPostPendingAndStop(FUSE_IOQ *Ioq, FUSE_CONTEXT *Context)
     /*
      * This function is used to post the last Context for processing (usually DESTROY).
-     * It clears the Pending list, but does not touch the Process list. The reason is
+     * It clears the Pending lists, but does not touch the Process lists. The reason is
      * that the last Context must be retrieved only after all in-flight Context's are
      * done and FuseIoqNextPending checks for this condition when the last Context has
      * been posted.
@@ -185,49 +412,130 @@ VOID FuseIoqPostPendingAndStop(FUSE_IOQ *Ioq, FUSE_CONTEXT *Context)
 {
     PAGED_CODE();
 
-    ExAcquireFastMutex(&Ioq->Mutex);
-
-    if (0 != Ioq->LastContext)
+    if (0 != InterlockedCompareExchangePointer(&Ioq->LastContext, Context, 0))
     {
-        ExReleaseFastMutex(&Ioq->Mutex);
         FuseContextDelete(Context);
         return;
     }
 
-    for (PLIST_ENTRY Entry = Ioq->PendingList.Flink; &Ioq->PendingList != Entry;)
+    for (ULONG I = 0; Ioq->ShardCount > I; I++)
     {
-        FUSE_CONTEXT *Temp = CONTAINING_RECORD(Entry, FUSE_CONTEXT, ListEntry);
-        Entry = Entry->Flink;
-        FuseContextDelete(Temp);
+        FUSE_IOQ_SHARD *Shard = FuseIoqShard(Ioq, I);
+
+        /* delete cleared contexts outside the shard lock: deleting a pipelined
+        chunk runs its Fini routine, which may reenter the ioq to claim and
+        repost its parent */
+        for (;;)
+        {
+            FUSE_CONTEXT *Temp = 0;
+
+            ExAcquireFastMutex(&Shard->Mutex);
+            for (ULONG J = 0; 0 == Temp && FUSE_IOQ_CLASS_COUNT > J; J++)
+                if (!IsListEmpty(&Shard->PendingLists[J]))
+                    Temp = CONTAINING_RECORD(RemoveHeadList(&Shard->PendingLists[J]),
+                        FUSE_CONTEXT, ListEntry);
+            ExReleaseFastMutex(&Shard->Mutex);
+
+            if (0 == Temp)
+                break;
+            InterlockedDecrement(&Ioq->PendingCount);
+            FuseContextDelete(Temp);
+        }
     }
-    InitializeListHead(&Ioq->PendingList);
 
-    InsertTailList(&Ioq->PendingList, &Context->ListEntry);
-    Ioq->LastContext = Context;
+    FUSE_IOQ_SHARD *Shard = FuseIoqShard(Ioq, FuseIoqShardIndex(Ioq, Context));
+
+    ExAcquireFastMutex(&Shard->Mutex);
+
+    InsertTailList(&Shard->PendingLists[0], &Context->ListEntry);
 
-    ExReleaseFastMutex(&Ioq->Mutex);
+    ExReleaseFastMutex(&Shard->Mutex);
+
+    InterlockedIncrement(&Ioq->PendingCount);
+
+    FuseIoqNotify(Ioq);
 }
 
 FUSE_CONTEXT *FuseIoqNextPending(FUSE_IOQ *Ioq)
 {
     PAGED_CODE();
 
-    ExAcquireFastMutex(&Ioq->Mutex);
+    FUSE_IOQ_SHARD *Shard;
+    PLIST_ENTRY Entry;
+    FUSE_CONTEXT *Context;
 
-    if (0 != Ioq->LastContext && !IsListEmpty(&Ioq->ProcessList))
+    if (0 != FuseIoqReadLastContext(Ioq))
     {
-        ExReleaseFastMutex(&Ioq->Mutex);
-        return 0;
+        /* deliver the last Context only after all in-flight Context's are done */
+        for (ULONG I = 0; Ioq->ShardCount > I; I++)
+        {
+            Shard = FuseIoqShard(Ioq, I);
+            ExAcquireFastMutex(&Shard->Mutex);
+            BOOLEAN Busy = !IsListEmpty(&Shard->ProcessList);
+            ExReleaseFastMutex(&Shard->Mutex);
+            if (Busy)
+                return 0;
+        }
     }
 
-    PLIST_ENTRY Entry = Ioq->PendingList.Flink;
-    FUSE_CONTEXT *Context = &Ioq->PendingList != Entry ?
-        CONTAINING_RECORD(Entry, FUSE_CONTEXT, ListEntry) : 0;
+    ULONG ShardIndex = KeGetCurrentProcessorNumberEx(0) % Ioq->ShardCount;
+    for (ULONG I = 0; Ioq->ShardCount > I; I++)
+    {
+        Shard = FuseIoqShard(Ioq, (ShardIndex + I) % Ioq->ShardCount);
 
-    if (0 != Context)
-        RemoveEntryList(&Context->ListEntry);
+        ExAcquireFastMutex(&Shard->Mutex);
 
-    ExReleaseFastMutex(&Ioq->Mutex);
+        /* weighted dequeue: yield one slot to the bulk class after a burst
+        of interactive deliveries, so that bulk work cannot starve */
+        ULONG FirstClass = 0;
+        if (FUSE_IOQ_CLASS_WEIGHT <= Shard->PendingBurst &&
+            !IsListEmpty(&Shard->PendingLists[1]))
+            FirstClass = 1;
 
-    return Context;
+        Context = 0;
+        for (ULONG J = 0; FUSE_IOQ_CLASS_COUNT > J && 0 == Context; J++)
+        {
+            PLIST_ENTRY Head = &Shard->PendingLists[(FirstClass + J) % FUSE_IOQ_CLASS_COUNT];
+            Entry = Head->Flink;
+            if (Head != Entry)
+            {
+                Context = CONTAINING_RECORD(Entry, FUSE_CONTEXT, ListEntry);
+                RemoveEntryList(&Context->ListEntry);
+                Shard->PendingBurst = Head == &Shard->PendingLists[0] ?
+                    Shard->PendingBurst + 1 : 0;
+            }
+        }
+
+        ExReleaseFastMutex(&Shard->Mutex);
+
+        if (0 != Context)
+        {
+            InterlockedDecrement(&Ioq->PendingCount);
+            return Context;
+        }
+    }
+
+    return 0;
+}
+
+VOID FuseIoqSetNotifyEvent(FUSE_IOQ *Ioq, PKEVENT Event)
+    /*
+     * Register the doorbell event. The ioq signals it whenever a shard's pending
+     * list transitions from empty to non-empty (and unconditionally when the last
+     * Context is posted), so that transact workers can wait on events from many
+     * instances instead of blocking inside a transact. The ioq does not own the
+     * event reference; the registrar must keep it alive until the ioq is deleted.
+     */
+{
+    PAGED_CODE();
+
+    InterlockedExchangePointer(&Ioq->NotifyEvent, Event);
+}
+
+VOID FuseIoqGetStatistics(FUSE_IOQ *Ioq, FUSE_STATISTICS *Statistics)
+{
+    PAGED_CODE();
+
+    Statistics->PendingCount = (UINT32)InterlockedCompareExchange(&Ioq->PendingCount, 0, 0);
+    Statistics->ProcessCount = (UINT32)InterlockedCompareExchange(&Ioq->ProcessCount, 0, 0);
 }
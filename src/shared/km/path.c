@@ -20,6 +20,9 @@
  */
 
 #include <shared/km/shared.h>
+#if defined(_M_X64)
+#include <emmintrin.h>
+#endif
 
 VOID FusePosixPathPrefix(PSTRING Path, PSTRING Prefix, PSTRING Remain);
 VOID FusePosixPathSuffix(PSTRING Path, PSTRING Remain, PSTRING Suffix);
@@ -29,6 +32,33 @@ VOID FusePosixPathSuffix(PSTRING Path, PSTRING Remain, PSTRING Suffix);
 #pragma alloc_text(PAGE, FusePosixPathSuffix)
 #endif
 
+static inline PSTR FusePosixPathScan(PSTR P, PSTR EndP)
+    /*
+     * Return a pointer to the first '/' in [P, EndP) or EndP if there is none.
+     * On x64 the scan compares 16 bytes per step; SSE2 is architectural
+     * baseline there and the XMM registers are usable at PASSIVE_LEVEL.
+     */
+{
+#if defined(_M_X64)
+    const __m128i Slashes = _mm_set1_epi8('/');
+    while (16 <= EndP - P)
+    {
+        __m128i Block = _mm_loadu_si128((const __m128i *)P);
+        ULONG Mask = (ULONG)_mm_movemask_epi8(_mm_cmpeq_epi8(Block, Slashes));
+        if (0 != Mask)
+        {
+            ULONG Index;
+            _BitScanForward(&Index, Mask);
+            return P + Index;
+        }
+        P += 16;
+    }
+#endif
+    while (EndP > P && '/' != *P)
+        P++;
+    return P;
+}
+
 VOID FusePosixPathPrefix(PSTRING Path, PSTRING Prefix, PSTRING Remain)
 {
     PAGED_CODE();
@@ -50,8 +80,7 @@ VOID FusePosixPathPrefix(PSTRING Path, PSTRING Prefix, PSTRING Remain)
     }
     else
     {
-        while (EndP > P && '/' != *P)
-            P++;
+        P = FusePosixPathScan(P, EndP);
 
         Prefix->Length = (USHORT)((P - PathBuf.Buffer) * sizeof *P);
         Prefix->Buffer = PathBuf.Buffer;
@@ -87,22 +116,23 @@ VOID FusePosixPathSuffix(PSTRING Path, PSTRING Remain, PSTRING Suffix)
     Suffix->Length = 0;
     Suffix->Buffer = PathBuf.Buffer;
 
-    while (EndP > P)
-        if ('/' == *P)
-        {
-            Remain->Length = (USHORT)((P - PathBuf.Buffer) * sizeof *P);
-            if (0 == Remain->Length)
-                Remain->Length = 1;
+    for (;;)
+    {
+        P = FusePosixPathScan(P, EndP);
+        if (EndP <= P)
+            break;
 
-            while (EndP > P && '/' == *P)
-                P++;
+        Remain->Length = (USHORT)((P - PathBuf.Buffer) * sizeof *P);
+        if (0 == Remain->Length)
+            Remain->Length = 1;
 
-            Suffix->Length = (USHORT)((EndP - P) * sizeof *P);
-            Suffix->Buffer = P;
-        }
-        else
+        while (EndP > P && '/' == *P)
             P++;
 
+        Suffix->Length = (USHORT)((EndP - P) * sizeof *P);
+        Suffix->Buffer = P;
+    }
+
     Remain->MaximumLength = Remain->Length;
     Suffix->MaximumLength = Suffix->Length;
 }
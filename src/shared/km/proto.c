@@ -26,8 +26,13 @@ VOID FuseProtoSendInit(FUSE_CONTEXT *Context);
 NTSTATUS FuseProtoPostDestroy(FUSE_INSTANCE *Instance);
 VOID FuseProtoSendDestroy(FUSE_CONTEXT *Context);
 VOID FuseProtoSendLookup(FUSE_CONTEXT *Context);
+NTSTATUS FuseProtoForgetInit(FUSE_INSTANCE *Instance);
+VOID FuseProtoForgetFini(FUSE_INSTANCE *Instance);
 NTSTATUS FuseProtoPostForget(FUSE_INSTANCE *Instance, PLIST_ENTRY ForgetList);
+VOID FuseProtoForgetRecycle(FUSE_INSTANCE *Instance, FUSE_CONTEXT *Context);
 static VOID FuseProtoPostForget_ContextFini(FUSE_CONTEXT *Context);
+NTSTATUS FuseProtoPostRelease(FUSE_INSTANCE *Instance, FUSE_FILE *File);
+static VOID FuseProtoPostRelease_ContextFini(FUSE_CONTEXT *Context);
 VOID FuseProtoFillForget(FUSE_CONTEXT *Context);
 VOID FuseProtoFillBatchForget(FUSE_CONTEXT *Context);
 VOID FuseProtoSendStatfs(FUSE_CONTEXT *Context);
@@ -62,8 +67,13 @@ NTSTATUS FuseNtStatusFromErrno(FUSE_INSTANCE_TYPE InstanceType, INT32 Errno);
 #pragma alloc_text(PAGE, FuseProtoPostDestroy)
 #pragma alloc_text(PAGE, FuseProtoSendDestroy)
 #pragma alloc_text(PAGE, FuseProtoSendLookup)
+#pragma alloc_text(PAGE, FuseProtoForgetInit)
+#pragma alloc_text(PAGE, FuseProtoForgetFini)
 #pragma alloc_text(PAGE, FuseProtoPostForget)
+#pragma alloc_text(PAGE, FuseProtoForgetRecycle)
 #pragma alloc_text(PAGE, FuseProtoPostForget_ContextFini)
+#pragma alloc_text(PAGE, FuseProtoPostRelease)
+#pragma alloc_text(PAGE, FuseProtoPostRelease_ContextFini)
 #pragma alloc_text(PAGE, FuseProtoFillForget)
 #pragma alloc_text(PAGE, FuseProtoFillBatchForget)
 #pragma alloc_text(PAGE, FuseProtoSendStatfs)
@@ -123,6 +133,16 @@ NTSTATUS FuseNtStatusFromErrno(FUSE_INSTANCE_TYPE InstanceType, INT32 Errno);
 static inline VOID FuseProtoInitRequest(FUSE_CONTEXT *Context,
     UINT32 len, UINT32 opcode, UINT64 nodeid)
 {
+    /* the transact layer zeroes the record header only (see FuseInstanceTransact);
+    zero the message body through len, clamped to the fixed body size: variable
+    parts beyond the fixed body (names, forget records) are written in full by
+    the callers */
+    UINT32 ZeroLength =
+        (sizeof(FUSE_PROTO_REQ) > len ? len : sizeof(FUSE_PROTO_REQ));
+    if (FUSE_PROTO_REQ_HEADER_SIZE < ZeroLength)
+        RtlZeroMemory((PUINT8)Context->FuseRequest + FUSE_PROTO_REQ_HEADER_SIZE,
+            ZeroLength - FUSE_PROTO_REQ_HEADER_SIZE);
+
     Context->FuseRequest->len = len;
     Context->FuseRequest->opcode = opcode;
     Context->FuseRequest->unique = (UINT64)(UINT_PTR)Context;
@@ -163,8 +183,12 @@ VOID FuseProtoSendInit(FUSE_CONTEXT *Context)
             FUSE_PROTO_REQ_SIZE(init), FUSE_PROTO_OPCODE_INIT, 0);
         Context->FuseRequest->req.init.major = FUSE_PROTO_VERSION;
         Context->FuseRequest->req.init.minor = FUSE_PROTO_MINOR_VERSION;
-        Context->FuseRequest->req.init.max_readahead = 0;   /* !!!: REVISIT */
-        Context->FuseRequest->req.init.flags = 0;           /* !!!: REVISIT */
+        Context->FuseRequest->req.init.max_readahead = FUSE_READAHEAD_MAX;
+        Context->FuseRequest->req.init.flags =
+            FUSE_PROTO_INIT_DO_READDIRPLUS | FUSE_PROTO_INIT_WRITEBACK_CACHE |
+            FUSE_PROTO_INIT_MAX_PAGES |
+            FUSE_PROTO_INIT_POSTOP_ATTR |
+            FUSE_PROTO_INIT_MAPDATA;
 
     FUSE_PROTO_SEND_END
 }
@@ -230,12 +254,20 @@ VOID FuseProtoSendLookup(FUSE_CONTEXT *Context)
     FUSE_PROTO_SEND_END
 }
 
-NTSTATUS FuseProtoPostForget(FUSE_INSTANCE *Instance, PLIST_ENTRY ForgetList)
+NTSTATUS FuseProtoForgetInit(FUSE_INSTANCE *Instance)
+    /*
+     * Preallocate the instance's forget context. The cache sheds items precisely
+     * when memory is scarce, so forget posting must not depend on the allocator:
+     * with the context preallocated FuseProtoPostForget cannot fail.
+     */
 {
     PAGED_CODE();
 
     FUSE_CONTEXT *Context;
 
+    ExInitializeFastMutex(&Instance->ForgetMutex);
+    InitializeListHead(&Instance->ForgetList);
+
     FuseContextCreate(&Context, Instance, 0);
     ASSERT(0 != Context);
     if (FuseContextIsStatus(Context))
@@ -243,18 +275,97 @@ NTSTATUS FuseProtoPostForget(FUSE_INSTANCE *Instance, PLIST_ENTRY ForgetList)
 
     Context->Fini = FuseProtoPostForget_ContextFini;
     Context->InternalResponse->Hint = FUSE_PROTO_OPCODE_FORGET;
+    InitializeListHead(&Context->Forget.ForgetList);
+
+    Instance->ForgetContext = Context;
+
+    return STATUS_SUCCESS;
+}
+
+VOID FuseProtoForgetFini(FUSE_INSTANCE *Instance)
+    /*
+     * Must follow FuseIoqDelete: the forget context is either parked on the
+     * instance or was deleted together with the ioq.
+     */
+{
+    PAGED_CODE();
+
+    if (0 != Instance->ForgetContext)
+        FuseContextDelete(Instance->ForgetContext);
+
+    FuseCacheDeleteForgotten(&Instance->ForgetList);
+}
+
+NTSTATUS FuseProtoPostForget(FUSE_INSTANCE *Instance, PLIST_ENTRY ForgetList)
+    /*
+     * Post FORGET's using the instance's preallocated forget context. If the
+     * context is idle it picks up the list and is posted; if it is in flight
+     * the list is staged on the instance and the context picks it up when it
+     * completes its current round (see FuseProtoForgetRecycle). Either way no
+     * allocation is performed and the post cannot fail.
+     */
+{
+    PAGED_CODE();
+
+    FUSE_CONTEXT *Context;
 
     ASSERT(ForgetList != ForgetList->Flink);
-    Context->Forget.ForgetList = *ForgetList;
-    /* fixup first/last list entry */
-    Context->Forget.ForgetList.Flink->Blink = &Context->Forget.ForgetList;
-    Context->Forget.ForgetList.Blink->Flink = &Context->Forget.ForgetList;
 
-    FuseIoqPostPending(Instance->Ioq, Context);
+    ExAcquireFastMutex(&Instance->ForgetMutex);
+
+    AppendTailList(&Instance->ForgetList, ForgetList);
+    Context = Instance->ForgetContext;
+    Instance->ForgetContext = 0;
+    if (0 != Context)
+    {
+        ASSERT(IsListEmpty(&Context->Forget.ForgetList));
+        Context->Forget.ForgetList = Instance->ForgetList;
+        /* fixup first/last list entry */
+        Context->Forget.ForgetList.Flink->Blink = &Context->Forget.ForgetList;
+        Context->Forget.ForgetList.Blink->Flink = &Context->Forget.ForgetList;
+        InitializeListHead(&Instance->ForgetList);
+    }
+
+    ExReleaseFastMutex(&Instance->ForgetMutex);
+
+    if (0 != Context)
+        FuseIoqPostPending(Instance->Ioq, Context);
 
     return STATUS_SUCCESS;
 }
 
+VOID FuseProtoForgetRecycle(FUSE_INSTANCE *Instance, FUSE_CONTEXT *Context)
+    /*
+     * The forget context has drained its list: pick up any staged forgets for
+     * another round or park the context back on the instance.
+     */
+{
+    PAGED_CODE();
+
+    ASSERT(IsListEmpty(&Context->Forget.ForgetList));
+
+    ExAcquireFastMutex(&Instance->ForgetMutex);
+
+    if (!IsListEmpty(&Instance->ForgetList))
+    {
+        Context->Forget.ForgetList = Instance->ForgetList;
+        /* fixup first/last list entry */
+        Context->Forget.ForgetList.Flink->Blink = &Context->Forget.ForgetList;
+        Context->Forget.ForgetList.Blink->Flink = &Context->Forget.ForgetList;
+        InitializeListHead(&Instance->ForgetList);
+    }
+    else
+    {
+        Instance->ForgetContext = Context;
+        Context = 0;
+    }
+
+    ExReleaseFastMutex(&Instance->ForgetMutex);
+
+    if (0 != Context)
+        FuseIoqPostPending(Instance->Ioq, Context);
+}
+
 static VOID FuseProtoPostForget_ContextFini(FUSE_CONTEXT *Context)
 {
     PAGED_CODE();
@@ -262,6 +373,38 @@ static VOID FuseProtoPostForget_ContextFini(FUSE_CONTEXT *Context)
     FuseCacheDeleteForgotten(&Context->Forget.ForgetList);
 }
 
+NTSTATUS FuseProtoPostRelease(FUSE_INSTANCE *Instance, FUSE_FILE *File)
+    /*
+     * Post a fire-and-forget RELEASE/RELEASEDIR for the file. On success the posted
+     * context takes over ownership of the file and deletes it when done.
+     */
+{
+    PAGED_CODE();
+
+    FUSE_CONTEXT *Context;
+
+    FuseContextCreate(&Context, Instance, 0);
+    ASSERT(0 != Context);
+    if (FuseContextIsStatus(Context))
+        return FuseContextToStatus(Context);
+
+    Context->Fini = FuseProtoPostRelease_ContextFini;
+    Context->InternalResponse->Hint = FUSE_PROTO_OPCODE_RELEASE;
+    Context->File = File;
+
+    FuseIoqPostPending(Instance->Ioq, Context);
+
+    return STATUS_SUCCESS;
+}
+
+static VOID FuseProtoPostRelease_ContextFini(FUSE_CONTEXT *Context)
+{
+    PAGED_CODE();
+
+    if (0 != Context->File)
+        FuseFileDelete(Context->Instance, Context->File);
+}
+
 VOID FuseProtoFillForget(FUSE_CONTEXT *Context)
     /*
      * Fill FORGET message. This message is used to forget a single inode number.
@@ -295,14 +438,21 @@ VOID FuseProtoFillBatchForget(FUSE_CONTEXT *Context)
 
     FUSE_PROTO_FORGET_ONE *StartP, *EndP, *P;
 
+    /* init first: FuseProtoInitRequest zeroes the message body through len
+    and would wipe forget records packed before it */
+    FuseProtoInitRequest(Context,
+        FUSE_PROTO_REQ_SIZE(batch_forget), FUSE_PROTO_OPCODE_BATCH_FORGET, 0);
+
+    /* pack as many forgets as the actual transact record allows (it is at least
+    FUSE_PROTO_REQ_SIZEMIN, but a batching file system may hand us far more) */
     StartP = (PVOID)((PUINT8)Context->FuseRequest + FUSE_PROTO_REQ_SIZE(batch_forget));
-    EndP = (PVOID)((PUINT8)StartP + (FUSE_PROTO_REQ_SIZEMIN - FUSE_PROTO_REQ_SIZE(batch_forget)));
+    EndP = StartP +
+        (Context->FuseRequestLength - FUSE_PROTO_REQ_SIZE(batch_forget)) / sizeof(FUSE_PROTO_FORGET_ONE);
     for (P = StartP; DEBUGTEST(90) && EndP > P && FuseCacheForgetOne(&Context->Forget.ForgetList, P); P++)
         ;
 
-    FuseProtoInitRequest(Context,
-        (UINT32)((PUINT8)P - (PUINT8)Context->FuseRequest), FUSE_PROTO_OPCODE_BATCH_FORGET, 0);
-    ASSERT(FUSE_PROTO_REQ_SIZEMIN >= Context->FuseRequest->len);
+    Context->FuseRequest->len = (UINT32)((PUINT8)P - (PUINT8)Context->FuseRequest);
+    ASSERT(Context->FuseRequestLength >= Context->FuseRequest->len);
     Context->FuseRequest->req.batch_forget.count = (ULONG)(P - StartP);
 }
 
@@ -813,7 +963,7 @@ VOID FuseProtoSendRelease(FUSE_CONTEXT *Context)
 
 VOID FuseProtoSendReaddir(FUSE_CONTEXT *Context)
     /*
-     * Send READDIR message.
+     * Send READDIR message (or READDIRPLUS when negotiated).
      *
      * Context->File->Ino
      *     inode number of related directory
@@ -830,7 +980,10 @@ VOID FuseProtoSendReaddir(FUSE_CONTEXT *Context)
     FUSE_PROTO_SEND_BEGIN
 
         FuseProtoInitRequest(Context,
-            FUSE_PROTO_REQ_SIZE(read), FUSE_PROTO_OPCODE_READDIR, Context->File->Ino);
+            FUSE_PROTO_REQ_SIZE(read),
+            FuseInstanceReaddirPlus(Context->Instance) ?
+                FUSE_PROTO_OPCODE_READDIRPLUS : FUSE_PROTO_OPCODE_READDIR,
+            Context->File->Ino);
         Context->FuseRequest->req.read.fh = Context->File->Fh;
         Context->FuseRequest->req.read.offset = Context->QueryDirectory.NextOffset;
         Context->FuseRequest->req.read.size = Context->QueryDirectory.Length;
@@ -853,6 +1006,8 @@ VOID FuseProtoSendRead(FUSE_CONTEXT *Context)
      *     offset to read
      * Context->Read.Length
      *     read buffer length
+     * Context->Read.DataUserAddress
+     *     mapped data region or 0 (see FUSE_PROTO_INIT_MAPDATA)
      */
 {
     PAGED_CODE();
@@ -860,13 +1015,22 @@ VOID FuseProtoSendRead(FUSE_CONTEXT *Context)
     FUSE_PROTO_SEND_BEGIN
 
         FuseProtoInitRequest(Context,
-            FUSE_PROTO_REQ_SIZE(read), FUSE_PROTO_OPCODE_READ, Context->File->Ino);
+            FUSE_PROTO_REQ_SIZE(read) +
+                (0 != Context->Read.DataUserAddress ? sizeof(UINT64) : 0),
+            FUSE_PROTO_OPCODE_READ, Context->File->Ino);
         Context->FuseRequest->req.read.fh = Context->File->Fh;
         Context->FuseRequest->req.read.offset = Context->Read.StartOffset + Context->Read.Offset;
         Context->FuseRequest->req.read.size = Context->Read.Length;
         Context->FuseRequest->req.read.read_flags = 0;   /* !!!: REVISIT */
         Context->FuseRequest->req.read.lock_owner = 0;   /* !!!: REVISIT */
         Context->FuseRequest->req.read.flags = Context->File->OpenFlags;
+        if (0 != Context->Read.DataUserAddress)
+        {
+            /* the file system places the data at the appended region address */
+            Context->FuseRequest->req.read.read_flags |= FUSE_PROTO_READ_MAPDATA;
+            *(UINT64 UNALIGNED *)((PUINT8)Context->FuseRequest + FUSE_PROTO_REQ_SIZE(read)) =
+                (UINT64)(UINT_PTR)Context->Read.DataUserAddress + Context->Read.Offset;
+        }
 
     FUSE_PROTO_SEND_END
 }
@@ -883,6 +1047,13 @@ VOID FuseProtoSendWrite(FUSE_CONTEXT *Context)
      *     offset to write
      * Context->Write.Length
      *     write buffer length
+     * Context->Write.DataUserAddress
+     *     mapped data region or 0 (see FUSE_PROTO_INIT_MAPDATA)
+     * Context->Write.CoalesceBuf
+     *     detached write buffer being flushed or 0 (see FuseCoalesceFlush)
+     *
+     * The payload is copied here rather than by the caller, because
+     * FuseProtoInitRequest zeroes the message body through len.
      */
 {
     PAGED_CODE();
@@ -890,7 +1061,9 @@ VOID FuseProtoSendWrite(FUSE_CONTEXT *Context)
     FUSE_PROTO_SEND_BEGIN
 
         FuseProtoInitRequest(Context,
-            FUSE_PROTO_REQ_SIZE(write) + Context->Write.Length,
+            FUSE_PROTO_REQ_SIZE(write) +
+                (0 != Context->Write.DataUserAddress ?
+                    sizeof(UINT64) : Context->Write.Length),
             FUSE_PROTO_OPCODE_WRITE, Context->File->Ino);
         Context->FuseRequest->req.write.fh = Context->File->Fh;
         Context->FuseRequest->req.write.offset = Context->Write.StartOffset + Context->Write.Offset;
@@ -898,6 +1071,31 @@ VOID FuseProtoSendWrite(FUSE_CONTEXT *Context)
         Context->FuseRequest->req.write.write_flags = 0;   /* !!!: REVISIT */
         Context->FuseRequest->req.write.lock_owner = 0;   /* !!!: REVISIT */
         Context->FuseRequest->req.write.flags = Context->File->OpenFlags;
+        if (0 != Context->Write.DataUserAddress)
+        {
+            /* the file system takes the data from the appended region address */
+            Context->FuseRequest->req.write.write_flags |= FUSE_PROTO_WRITE_MAPDATA;
+            *(UINT64 UNALIGNED *)((PUINT8)Context->FuseRequest + FUSE_PROTO_REQ_SIZE(write)) =
+                (UINT64)(UINT_PTR)Context->Write.DataUserAddress + Context->Write.Offset;
+        }
+        else if (0 != Context->Write.CoalesceBuf)
+            RtlCopyMemory(
+                (PUINT8)Context->FuseRequest + FUSE_PROTO_REQ_SIZE(write),
+                Context->Write.CoalesceBuf + Context->Write.Offset,
+                Context->Write.Length);
+        else
+        {
+            Context->InternalResponse->IoStatus.Status = FuseSafeCopyMemory(
+                (PUINT8)Context->FuseRequest + FUSE_PROTO_REQ_SIZE(write),
+                (PUINT8)(UINT_PTR)Context->InternalRequest->Req.Write.Address + Context->Write.Offset,
+                Context->Write.Length);
+            if (!NT_SUCCESS(Context->InternalResponse->IoStatus.Status))
+            {
+                /* suppress the staged record (see FuseIoqStartProcessing) */
+                Context->FuseRequest->len = 0;
+                coro_break;
+            }
+        }
 
     FUSE_PROTO_SEND_END
 }
@@ -27,7 +27,11 @@
 #define SHARED_KM_PROTO_H_INCLUDED
 
 #define FUSE_PROTO_VERSION              7
-#define FUSE_PROTO_MINOR_VERSION        29
+#define FUSE_PROTO_MINOR_VERSION        31
+
+/* request sizing in pages: the classic ceiling and the negotiable one (see MAX_PAGES) */
+#define FUSE_PROTO_MAX_PAGES_DEFAULT    32
+#define FUSE_PROTO_MAX_PAGES_MAX        256
 
 #define FUSE_PROTO_ROOT_INO             1
 
@@ -139,6 +143,22 @@ enum
     FUSE_PROTO_INIT_MAX_PAGES           = (1 << 22),
     FUSE_PROTO_INIT_CACHE_SYMLINKS      = (1 << 23),
     FUSE_PROTO_INIT_NO_OPENDIR_SUPPORT  = (1 << 24),
+    /*
+     * WinFuse-private extension (not part of the Linux FUSE protocol): the file
+     * system appends the resulting attributes (as in the GETATTR response) to
+     * WRITE responses, saving the driver a GETATTR round trip per write. The
+     * appended attributes are identified by the response length covering them.
+     */
+    FUSE_PROTO_INIT_POSTOP_ATTR         = (1 << 30),
+    /*
+     * WinFuse-private extension (not part of the Linux FUSE protocol): data for
+     * large READ/WRITE requests is passed through a region that the driver maps
+     * into the file system process, rather than through the transact buffers.
+     * A mapped request appends the region address (UINT64) to the fixed request
+     * structure; a mapped READ response carries no data and reports the
+     * transferred size in the write response size field.
+     */
+    FUSE_PROTO_INIT_MAPDATA             = (1 << 31),
 
     FUSE_PROTO_IOCTL_COMPAT             = (1 << 0),
     FUSE_PROTO_IOCTL_UNRESTRICTED       = (1 << 1),
@@ -151,12 +171,16 @@ enum
     FUSE_PROTO_POLL_SCHEDULE_NOTIFY     = (1 << 0),
 
     FUSE_PROTO_READ_LOCKOWNER           = (1 << 1),
+    /* WinFuse-private extension (see FUSE_PROTO_INIT_MAPDATA) */
+    FUSE_PROTO_READ_MAPDATA             = (1 << 31),
 
     FUSE_PROTO_RELEASE_FLUSH            = (1 << 0),
     FUSE_PROTO_RELEASE_FLOCK_UNLOCK     = (1 << 1),
 
     FUSE_PROTO_WRITE_CACHE              = (1 << 0),
     FUSE_PROTO_WRITE_LOCKOWNER          = (1 << 1),
+    /* WinFuse-private extension (see FUSE_PROTO_INIT_MAPDATA) */
+    FUSE_PROTO_WRITE_MAPDATA            = (1 << 31),
 };
 
 enum
@@ -533,6 +557,9 @@ typedef struct
 #define FUSE_PROTO_REQ_SIZEMIN          8192 // FUSE_MIN_READ_BUFFER
 #define FUSE_PROTO_REQ_SIZE(F)          RTL_SIZEOF_THROUGH_FIELD(FUSE_PROTO_REQ, req.F)
 
+/* batched transact records are packed at 8-byte boundaries */
+#define FUSE_PROTO_ALIGN_SIZE(S)        (((ULONG)(S) + 7) & ~7UL)
+
 typedef struct
 {
     UINT32 len;
@@ -593,6 +620,11 @@ typedef struct
             /* WRITE */
             UINT32 size;
             UINT32 padding;
+            /* WinFuse-private extension (see FUSE_PROTO_INIT_POSTOP_ATTR) */
+            UINT64 attr_valid;
+            UINT32 attr_valid_nsec;
+            UINT32 dummy;
+            FUSE_PROTO_ATTR attr;
         } write;
         struct
         {
@@ -31,9 +31,33 @@
 #pragma warning(disable:4200)           /* zero-sized array in struct/union */
 #pragma warning(disable:4201)           /* nameless struct/union */
 
+#include <TraceLoggingProvider.h>
+
 #include <shared/km/coro.h>
 #include <shared/km/proto.h>
 
+/* ETW/TraceLogging (see trace.c); cheap enough to remain enabled in release builds */
+TRACELOGGING_DECLARE_PROVIDER(FuseTraceProvider);
+VOID FuseTraceInitialize(VOID);
+#define FuseTraceRequest(EventName, Unique, Opcode, Length)\
+    TraceLoggingWrite(FuseTraceProvider, EventName,\
+        TraceLoggingLevel(TRACE_LEVEL_VERBOSE),\
+        TraceLoggingUInt64((Unique), "unique"),\
+        TraceLoggingUInt32((Opcode), "opcode"),\
+        TraceLoggingUInt32((Length), "len"))
+#define FuseTraceResponse(EventName, Unique, Error, Length)\
+    TraceLoggingWrite(FuseTraceProvider, EventName,\
+        TraceLoggingLevel(TRACE_LEVEL_VERBOSE),\
+        TraceLoggingUInt64((Unique), "unique"),\
+        TraceLoggingInt32((Error), "error"),\
+        TraceLoggingUInt32((Length), "len"))
+#define FuseTraceContext(EventName, Unique, Kind, Status)\
+    TraceLoggingWrite(FuseTraceProvider, EventName,\
+        TraceLoggingLevel(TRACE_LEVEL_VERBOSE),\
+        TraceLoggingUInt64((Unique), "unique"),\
+        TraceLoggingUInt32((Kind), "kind"),\
+        TraceLoggingInt32((Status), "status"))
+
 /* debug */
 #if DBG
 enum
@@ -119,10 +143,28 @@ VOID FusePosixPathSuffix(PSTRING Path, PSTRING Remain, PSTRING Suffix);
 PVOID FuseAllocatePoolMustSucceed(POOL_TYPE PoolType, SIZE_T Size, ULONG Tag);
 NTSTATUS FuseSafeCopyMemory(PVOID Dst, PVOID Src, ULONG Len);
 NTSTATUS FuseGetTokenUid(PACCESS_TOKEN Token, TOKEN_INFORMATION_CLASS InfoClass, PUINT32 PUid);
+NTSTATUS FuseGetTokenUidGid(PACCESS_TOKEN Token, PUINT32 PUid, PUINT32 PGid);
+NTSTATUS FuseMapPermissionsToSecurityDescriptor(
+    UINT32 Uid, UINT32 Gid, UINT32 Mode, PSECURITY_DESCRIPTOR *PSecurityDescriptor);
 
 /* read/write locks */
-#define FUSE_RWLOCK_USE_SEMAPHORE
+//#define FUSE_RWLOCK_USE_SEMAPHORE
 //#define FUSE_RWLOCK_USE_ERESOURCE
+#define FUSE_RWLOCK_USE_ATOMIC
+/*
+ * The ATOMIC flavor acquires and releases an uncontended lock with a single
+ * interlocked operation and falls back to cancellable dispatcher waits only
+ * under contention. The state word holds the active reader count, a writer
+ * active bit and a pending writer count; a non-zero pending count stops new
+ * readers from entering, so writers cannot starve. The gate semaphores only
+ * accumulate wakeups (they are never reset), so a signal sent between a
+ * waiter's registration and its wait is not lost; spurious wakeups merely
+ * cause a retry of the state transition.
+ */
+#define FUSE_RWLOCK_ATOMIC_READER_MASK  0x0000FFFF
+#define FUSE_RWLOCK_ATOMIC_WRITER       0x00010000
+#define FUSE_RWLOCK_ATOMIC_PENDING_ONE  0x00020000
+#define FUSE_RWLOCK_ATOMIC_PENDING_MASK 0x7FFE0000
 typedef struct _FUSE_RWLOCK
 {
 #if defined(FUSE_RWLOCK_USE_SEMAPHORE)
@@ -131,8 +173,13 @@ typedef struct _FUSE_RWLOCK
     LONG Readers;
 #elif defined(FUSE_RWLOCK_USE_ERESOURCE)
     ERESOURCE Resource;
+#elif defined(FUSE_RWLOCK_USE_ATOMIC)
+    LONG State;
+    LONG ReadWaiters;
+    KSEMAPHORE ReadGate;
+    KSEMAPHORE WriteGate;
 #else
-#error One of FUSE_RWLOCK_USE_SEMAPHORE or FUSE_RWLOCK_USE_ERESOURCE must be defined.
+#error One of FUSE_RWLOCK_USE_SEMAPHORE or FUSE_RWLOCK_USE_ERESOURCE or FUSE_RWLOCK_USE_ATOMIC must be defined.
 #endif
 } FUSE_RWLOCK;
 static inline
@@ -144,6 +191,11 @@ VOID FuseRwlockInitialize(FUSE_RWLOCK *Lock)
     Lock->Readers = 0;
 #elif defined(FUSE_RWLOCK_USE_ERESOURCE)
     ExInitializeResourceLite(&Lock->Resource);
+#elif defined(FUSE_RWLOCK_USE_ATOMIC)
+    Lock->State = 0;
+    Lock->ReadWaiters = 0;
+    KeInitializeSemaphore(&Lock->ReadGate, 0, MAXLONG);
+    KeInitializeSemaphore(&Lock->WriteGate, 0, MAXLONG);
 #endif
 }
 static inline
@@ -152,6 +204,7 @@ VOID FuseRwlockFinalize(FUSE_RWLOCK *Lock)
 #if defined(FUSE_RWLOCK_USE_SEMAPHORE)
 #elif defined(FUSE_RWLOCK_USE_ERESOURCE)
     ExDeleteResourceLite(&Lock->Resource);
+#elif defined(FUSE_RWLOCK_USE_ATOMIC)
 #endif
 }
 static inline
@@ -170,6 +223,45 @@ BOOLEAN FuseRwlockEnterWriter(FUSE_RWLOCK *Lock, PVOID Owner)
     ExAcquireResourceExclusiveLite(&Lock->Resource, TRUE);
     ExSetResourceOwnerPointer(&Lock->Resource, (PVOID)((UINT_PTR)Owner | 3));
     return TRUE;
+#elif defined(FUSE_RWLOCK_USE_ATOMIC)
+    NTSTATUS Result;
+    LONG State;
+    if (0 == InterlockedCompareExchange(&Lock->State, FUSE_RWLOCK_ATOMIC_WRITER, 0))
+        return TRUE;
+    InterlockedExchangeAdd(&Lock->State, FUSE_RWLOCK_ATOMIC_PENDING_ONE);
+    for (;;)
+    {
+        State = InterlockedCompareExchange(&Lock->State, 0, 0);
+        if (0 == (State & (FUSE_RWLOCK_ATOMIC_READER_MASK | FUSE_RWLOCK_ATOMIC_WRITER)))
+        {
+            if (State == InterlockedCompareExchange(&Lock->State,
+                    (State - FUSE_RWLOCK_ATOMIC_PENDING_ONE) | FUSE_RWLOCK_ATOMIC_WRITER, State))
+                return TRUE;
+            continue;
+        }
+        Result = FsRtlCancellableWaitForSingleObject(&Lock->WriteGate, 0, 0);
+        if (STATUS_SUCCESS != Result)
+        {
+            State = InterlockedExchangeAdd(&Lock->State, -FUSE_RWLOCK_ATOMIC_PENDING_ONE) -
+                FUSE_RWLOCK_ATOMIC_PENDING_ONE;
+            /*
+             * The wakeup we may have consumed was meant for some other waiter:
+             * pass it on to the next pending writer or, if we were the last
+             * pending writer, to any readers that our pending count stalled.
+             */
+            if (0 == (State & (FUSE_RWLOCK_ATOMIC_READER_MASK | FUSE_RWLOCK_ATOMIC_WRITER)) &&
+                0 != (State & FUSE_RWLOCK_ATOMIC_PENDING_MASK))
+                KeReleaseSemaphore(&Lock->WriteGate, 1, 1, FALSE);
+            else
+            if (0 == (State & (FUSE_RWLOCK_ATOMIC_WRITER | FUSE_RWLOCK_ATOMIC_PENDING_MASK)))
+            {
+                LONG Waiters = InterlockedCompareExchange(&Lock->ReadWaiters, 0, 0);
+                if (0 < Waiters)
+                    KeReleaseSemaphore(&Lock->ReadGate, 1, Waiters, FALSE);
+            }
+            return FALSE;
+        }
+    }
 #endif
 }
 static inline
@@ -193,6 +285,30 @@ BOOLEAN FuseRwlockEnterReader(FUSE_RWLOCK *Lock, PVOID Owner)
     ExAcquireResourceSharedLite(&Lock->Resource, TRUE);
     ExSetResourceOwnerPointer(&Lock->Resource, (PVOID)((UINT_PTR)Owner | 3));
     return TRUE;
+#elif defined(FUSE_RWLOCK_USE_ATOMIC)
+    NTSTATUS Result;
+    LONG State;
+    for (;;)
+    {
+        State = InterlockedCompareExchange(&Lock->State, 0, 0);
+        if (0 == (State & (FUSE_RWLOCK_ATOMIC_WRITER | FUSE_RWLOCK_ATOMIC_PENDING_MASK)))
+        {
+            if (State == InterlockedCompareExchange(&Lock->State, State + 1, State))
+                return TRUE;
+            continue;
+        }
+        InterlockedIncrement(&Lock->ReadWaiters);
+        State = InterlockedCompareExchange(&Lock->State, 0, 0);
+        if (0 == (State & (FUSE_RWLOCK_ATOMIC_WRITER | FUSE_RWLOCK_ATOMIC_PENDING_MASK)))
+        {
+            InterlockedDecrement(&Lock->ReadWaiters);
+            continue;
+        }
+        Result = FsRtlCancellableWaitForSingleObject(&Lock->ReadGate, 0, 0);
+        InterlockedDecrement(&Lock->ReadWaiters);
+        if (STATUS_SUCCESS != Result)
+            return FALSE;
+    }
 #endif
 }
 static inline
@@ -202,6 +318,17 @@ VOID FuseRwlockLeaveWriter(FUSE_RWLOCK *Lock, PVOID Owner)
     KeReleaseSemaphore(&Lock->WriteSem, 1, 1, FALSE);
 #elif defined(FUSE_RWLOCK_USE_ERESOURCE)
     ExReleaseResourceForThreadLite(&Lock->Resource, (ERESOURCE_THREAD)((UINT_PTR)Owner | 3));
+#elif defined(FUSE_RWLOCK_USE_ATOMIC)
+    LONG State = InterlockedAnd(&Lock->State, ~FUSE_RWLOCK_ATOMIC_WRITER) &
+        ~FUSE_RWLOCK_ATOMIC_WRITER;
+    if (0 != (State & FUSE_RWLOCK_ATOMIC_PENDING_MASK))
+        KeReleaseSemaphore(&Lock->WriteGate, 1, 1, FALSE);
+    else
+    {
+        LONG Waiters = InterlockedCompareExchange(&Lock->ReadWaiters, 0, 0);
+        if (0 < Waiters)
+            KeReleaseSemaphore(&Lock->ReadGate, 1, Waiters, FALSE);
+    }
 #endif
 }
 static inline
@@ -212,12 +339,45 @@ VOID FuseRwlockLeaveReader(FUSE_RWLOCK *Lock, PVOID Owner)
         KeReleaseSemaphore(&Lock->WriteSem, 1, 1, FALSE);
 #elif defined(FUSE_RWLOCK_USE_ERESOURCE)
     ExReleaseResourceForThreadLite(&Lock->Resource, (ERESOURCE_THREAD)((UINT_PTR)Owner | 3));
+#elif defined(FUSE_RWLOCK_USE_ATOMIC)
+    LONG State = InterlockedDecrement(&Lock->State);
+    if (0 == (State & FUSE_RWLOCK_ATOMIC_READER_MASK) &&
+        0 != (State & FUSE_RWLOCK_ATOMIC_PENDING_MASK))
+        KeReleaseSemaphore(&Lock->WriteGate, 1, 1, FALSE);
 #endif
 }
 
+/* statistics (exported via FUSE_FSCTL_STATISTICS; the struct doubles as the wire format) */
+#define FUSE_STATISTICS_OPCODE_COUNT    64
+#define FUSE_STATISTICS_BUCKET_COUNT    32
+typedef struct _FUSE_STATISTICS
+{
+    /*
+     * Per-opcode completion counts, total processing time and latency histogram.
+     * Processing time is measured from FuseIoqStartProcessing to FuseIoqEndProcessing
+     * (i.e. while a request is with the user mode file system) in 100ns units; the
+     * histogram buckets by log2 of that time, capped at the last bucket. Counters
+     * are updated with interlocked operations but snapshot without locks: they are
+     * advisory and individual fields may be mutually inconsistent.
+     */
+    UINT64 OpcodeCounts[FUSE_STATISTICS_OPCODE_COUNT];
+    UINT64 OpcodeTimes[FUSE_STATISTICS_OPCODE_COUNT];
+    UINT32 OpcodeLatency[FUSE_STATISTICS_OPCODE_COUNT][FUSE_STATISTICS_BUCKET_COUNT];
+    /* entry cache effectiveness */
+    UINT64 CacheEntryHits;
+    UINT64 CacheEntryMisses;
+    /* instantaneous queue depths */
+    UINT32 PendingCount;
+    UINT32 ProcessCount;
+    /* coroutine scheduler activity: context dispatches and suspensions */
+    UINT64 CoroResumeCount;
+    UINT64 CoroSuspendCount;
+} FUSE_STATISTICS;
+
 /* FUSE instances */
 typedef struct _FUSE_IOQ FUSE_IOQ;
 typedef struct _FUSE_CACHE FUSE_CACHE;
+#define FUSE_CACHE_PATH_COMPONENT_MAX   16
 typedef enum _FUSE_INSTANCE_TYPE
 {
     FuseInstanceWindows = 'W',
@@ -228,13 +388,23 @@ typedef struct _FUSE_INSTANCE
 {
     FSP_FSCTL_VOLUME_PARAMS *VolumeParams;
     FUSE_INSTANCE_TYPE InstanceType;
-    FUSE_RWLOCK OpGuardLock;
+    FUSE_RWLOCK OpGuardLocks[16/*FUSE_OPGUARD_STRIPE_COUNT*/];
     FUSE_IOQ *Ioq;
     FUSE_CACHE *Cache;
     KSPIN_LOCK FileListLock;
     LIST_ENTRY FileList;
+    FAST_MUTEX FlightMutex;             /* LOOKUP singleflight (see FuseLookupFlightBegin) */
+    LIST_ENTRY FlightList;
+    FAST_MUTEX ForgetMutex;             /* forget posting (see FuseProtoPostForget) */
+    LIST_ENTRY ForgetList;              /* forgets staged while the forget context is in flight */
+    struct _FUSE_CONTEXT *ForgetContext;/* preallocated forget context; 0 while in flight */
     KEVENT InitEvent;
+    PKEVENT NotifyEvent;                /* doorbell (see FuseInstanceSetNotifyEvent) */
     UINT32 VersionMajor, VersionMinor;
+    UINT32 InitFlags;
+    UINT32 MaxWrite;
+    UINT32 MaxReadahead;
+    UINT32 MaxPages;
     VOID (*ProtoSendDestroyHandler)(PVOID); PVOID ProtoSendDestroyData;
     /*
      * The following bitmap is used to remember which opcodes have returned ENOSYS.
@@ -248,17 +418,21 @@ typedef struct _FUSE_INSTANCE
      * file system.
      */
     UINT32 OpcodeENOSYS[2];
+    FUSE_STATISTICS Statistics;
 } FUSE_INSTANCE;
 NTSTATUS FuseInstanceInit(FUSE_INSTANCE *Instance,
     FSP_FSCTL_VOLUME_PARAMS *VolumeParams,
     FUSE_INSTANCE_TYPE InstanceType);
 VOID FuseInstanceFini(FUSE_INSTANCE *Instance);
 VOID FuseInstanceExpirationRoutine(FUSE_INSTANCE *Instance, UINT64 ExpirationTime);
+VOID FuseInstanceGetStatistics(FUSE_INSTANCE *Instance, FUSE_STATISTICS *Statistics);
+NTSTATUS FuseInstanceSetNotifyEvent(FUSE_INSTANCE *Instance, HANDLE EventHandle);
 NTSTATUS FuseInstanceTransact(FUSE_INSTANCE *Instance,
     FUSE_PROTO_RSP *FuseResponse, ULONG InputBufferLength,
     FUSE_PROTO_REQ *FuseRequest, PULONG POutputBufferLength,
     PDEVICE_OBJECT DeviceObject, PFILE_OBJECT FileObject,
-    PIRP CancellableIrp);
+    PIRP CancellableIrp,
+    BOOLEAN Batch);
 static inline
 BOOLEAN FuseInstanceGetOpcodeENOSYS(FUSE_INSTANCE *Instance, UINT32 Opcode)
 {
@@ -273,6 +447,29 @@ VOID FuseInstanceSetOpcodeENOSYS(FUSE_INSTANCE *Instance, UINT32 Opcode)
     ASSERT(8 * sizeof Instance->OpcodeENOSYS[0] > (Opcode & 0x1f));
     Instance->OpcodeENOSYS[Opcode >> 5] |= (1 << (Opcode & 0x1f));
 }
+static inline
+BOOLEAN FuseInstanceReaddirPlus(FUSE_INSTANCE *Instance)
+{
+    /* READDIRPLUS is available since FUSE 7.21 and must be negotiated at INIT time */
+    return 21 <= Instance->VersionMinor &&
+        0 != (Instance->InitFlags & FUSE_PROTO_INIT_DO_READDIRPLUS);
+}
+static inline
+BOOLEAN FuseInstanceWritebackCache(FUSE_INSTANCE *Instance)
+{
+    /* WRITEBACK_CACHE is available since FUSE 7.23 and must be negotiated at INIT time */
+    return 23 <= Instance->VersionMinor &&
+        0 != (Instance->InitFlags & FUSE_PROTO_INIT_WRITEBACK_CACHE);
+}
+static inline
+UINT32 FuseInstanceMaxTransfer(FUSE_INSTANCE *Instance)
+{
+    /* largest payload the file system can take in one request (see MAX_PAGES at INIT) */
+    return Instance->MaxPages * PAGE_SIZE;
+}
+
+/* maximum readahead window advertised at INIT time (see FuseReadAhead) */
+#define FUSE_READAHEAD_MAX              65536
 
 /* FUSE files */
 typedef struct _FUSE_FILE
@@ -283,7 +480,20 @@ typedef struct _FUSE_FILE
     UINT32 OpenFlags;
     UINT32 IsDirectory:1;
     UINT32 IsReparsePoint:1;
+    UINT32 DisableCache:1;
     PVOID CacheItem;
+    /* write coalescing (see FuseCoalesceWrite) */
+    FAST_MUTEX CoalesceMutex;
+    PUINT8 CoalesceBuf;
+    UINT64 CoalesceOffset;
+    UINT32 CoalesceLength;
+    UINT32 CoalesceAttrValid:1;
+    FUSE_PROTO_ATTR CoalesceAttr;
+    /* readahead (see FuseReadAhead); advisory, unsynchronized:
+    races only affect the heuristic */
+    UINT64 ReadAheadExpected;
+    UINT64 ReadAheadIssued;
+    UINT32 SequentialReads;
 } FUSE_FILE;
 VOID FuseFileInstanceInit(FUSE_INSTANCE *Instance);
 VOID FuseFileInstanceFini(FUSE_INSTANCE *Instance);
@@ -335,13 +545,28 @@ struct _FUSE_CONTEXT
     FUSE_PROTO_REQ *FuseRequest;
     FUSE_PROTO_RSP *FuseResponse;
     ULONG FuseRequestLength;
+    UINT32 DirtySize;                   /* recycling: extent dirtied by the last occupant (see context.c) */
+    /* statistics: set by FuseIoqStartProcessing, consumed by FuseIoqEndProcessing */
+    UINT64 ProcessStartTime;
+    UINT32 ProcessOpcode;
 #if DBG
     UINT32 DebugLogOpcode;
 #endif
     INT OpGuardResult;
+    UINT32 OpGuardStripeMask;           /* stripes held; set by acquire, cleared by release */
+    BOOLEAN Parked;                     /* context parked itself in the ioq; do not requeue */
     SHORT CoroState[16];
+    FUSE_OPERATION_PROC *OpProc;        /* fast resume: resolved at first dispatch (see FuseContextProcess) */
+    UINT32 CoroResumeCount, CoroSuspendCount;   /* folded into the statistics at deletion */
     UINT32 OrigUid, OrigGid, OrigPid;
     FUSE_FILE *File;
+    FUSE_CONTEXT *PipeParent;           /* pipelined I/O chunk: the originating context */
+    LONG PipeOutstanding;               /* pipelined I/O: chunks in flight (plus self reference) */
+    /* LOOKUP singleflight (see FuseLookupFlightBegin); waiters park reusing PipeOutstanding */
+    LIST_ENTRY FlightListEntry;         /* winner: entry in the instance flight list */
+    FUSE_CONTEXT *FlightWaiters;        /* winner: chain of parked identical lookups */
+    FUSE_CONTEXT *FlightNext;           /* waiter: next in the winner's chain */
+    VOID (*FlightSavedFini)(FUSE_CONTEXT *Context);
     union
     {
         FUSE_CONTEXT_LOOKUP Lookup;
@@ -358,10 +583,19 @@ struct _FUSE_CONTEXT
             UINT32 Chown:1;
             UINT32 RenameIsNonExistent:1;
             UINT32 RenameIsDirectory:1;
+            UINT32 RenameCheckAccess:1; /* rename check helper: perform the DELETE access check */
             /* 2 path operations (rename) */
             STRING OrigPath2;
             STRING Name2;
             UINT64 Ino2;
+            /* rename check results (posted by the helper context; see FuseRenameCheckStart) */
+            LONG RenameCheckDone;
+            LONG RenameCheckStatus;
+            UINT32 RenameCheckMode;
+            /* full-path resolution cache */
+            STRING Path;
+            ULONG PathItemCount;
+            PVOID PathItems[FUSE_CACHE_PATH_COMPONENT_MAX];
         } LookupPath;
         FUSE_CONTEXT_SETATTR Setattr;
         struct
@@ -371,6 +605,17 @@ struct _FUSE_CONTEXT
             UINT32 Remain;
             UINT32 Offset;
             UINT32 Length;
+            UINT32 DeferAttr:1;         /* postop-attr extension: Attr arrives with the WRITE response */
+            PMDL DataMdl;
+            PVOID DataUserAddress;
+            PEPROCESS DataProcess;
+            /* pipelined I/O (fields of the originating context; written by chunks) */
+            LONG PipeShortEnd;
+            LONG PipeStatus;
+            /* write coalescing: detached buffer being flushed */
+            PUINT8 CoalesceBuf;
+            /* readahead: data cache timeout captured at issue time */
+            UINT64 CacheTimeout;
         } Read, Write;
         struct
         {
@@ -378,6 +623,7 @@ struct _FUSE_CONTEXT
             STRING OrigName;
             UINT64 NextOffset;
             UINT32 Length;
+            UINT32 PlusOffset;          /* dirent offset within a READDIRPLUS record or 0 */
             ULONG BytesTransferred;
             PUINT8 Buffer, BufferEndP, BufferP;
         } QueryDirectory;
@@ -389,6 +635,7 @@ struct _FUSE_CONTEXT
     };
 };
 extern FUSE_OPERATION FuseOperations[];
+VOID FuseContextInitialize(VOID);
 VOID FuseContextCreate(FUSE_CONTEXT **PContext,
     FUSE_INSTANCE *Instance, FSP_FSCTL_TRANSACT_REQ *InternalRequest);
 VOID FuseContextDelete(FUSE_CONTEXT *Context);
@@ -398,63 +645,131 @@ static inline BOOLEAN FuseContextProcess(FUSE_CONTEXT *Context,
     ASSERT(0 == FuseRequest || 0 == FuseResponse);
     ASSERT(0 != FuseRequest || 0 != FuseResponse);
 
-    UINT32 Kind = 0 == Context->InternalRequest ?
-        FspFsctlTransactReservedKind : Context->InternalRequest->Kind;
-
-    if (0 == Context->FuseRequest && 0 == Context->FuseResponse &&
-        0 != FuseOperations[Kind].Guard)
+    if (0 == Context->OpProc)
     {
-        ASSERT(FuseOpGuardFalse == Context->OpGuardResult);
-        Context->OpGuardResult = FuseOperations[Kind].Guard(Context, TRUE);
-        if (FuseOpGuardCancel == Context->OpGuardResult)
+        /* first dispatch: resolve the operation proc and acquire the guard;
+        resumes call through OpProc directly without the table walk */
+        UINT32 Kind = 0 == Context->InternalRequest ?
+            FspFsctlTransactReservedKind : Context->InternalRequest->Kind;
+
+        if (0 != FuseOperations[Kind].Guard)
         {
-            Context->InternalResponse->IoStatus.Status = (UINT32)STATUS_CANCELLED;
-            return FALSE;
+            ASSERT(FuseOpGuardFalse == Context->OpGuardResult);
+            Context->OpGuardResult = FuseOperations[Kind].Guard(Context, TRUE);
+            if (FuseOpGuardCancel == Context->OpGuardResult)
+            {
+                Context->InternalResponse->IoStatus.Status = (UINT32)STATUS_CANCELLED;
+                return FALSE;
+            }
         }
+
+        Context->OpProc = FuseOperations[Kind].Proc;
     }
 
     Context->FuseRequest = FuseRequest;
     Context->FuseResponse = FuseResponse;
     Context->FuseRequestLength = FuseRequestLength;
 
-    BOOLEAN Result = FuseOperations[Kind].Proc(Context);
+    Context->CoroResumeCount++;
+
+    BOOLEAN Result = Context->OpProc(Context);
 
-    if (!Result && FuseOpGuardTrue == Context->OpGuardResult)
+    if (Result)
+        Context->CoroSuspendCount++;
+    else if (FuseOpGuardTrue == Context->OpGuardResult)
     {
+        UINT32 Kind = 0 == Context->InternalRequest ?
+            FspFsctlTransactReservedKind : Context->InternalRequest->Kind;
         FuseOperations[Kind].Guard(Context, FALSE);
         Context->OpGuardResult = FuseOpGuardFalse;
     }
 
     return Result;
 }
+/*
+ * Operation guard striping.
+ *
+ * Namespace mutating operations are guarded by an array of read/write lock
+ * stripes rather than a single instance-wide lock. The stripe for a file is
+ * chosen by its first path component, so that operations under unrelated top
+ * level directories proceed in parallel, while a rename still excludes every
+ * lookup whose path crosses the renamed entry: such a path shares its first
+ * component with the rename source or target. An operation whose request does
+ * not carry a file name acquires all stripes. Stripes are always acquired in
+ * ascending index order, which makes multi-stripe acquisition deadlock free.
+ */
+#define FUSE_OPGUARD_STRIPE_COUNT       16
+#define FUSE_OPGUARD_STRIPE_MASK_ALL    ((UINT32)((1 << FUSE_OPGUARD_STRIPE_COUNT) - 1))
 static inline
-INT FuseOpGuardResult_(BOOLEAN RwlockResult)
+UINT32 FuseOpGuardStripeMaskFromPath(PWSTR Path)
 {
-    ASSERT(
-        ( RwlockResult && FuseOpGuardTrue   == (((INT)RwlockResult - 1) | 1)) ||
-        (!RwlockResult && FuseOpGuardCancel == (((INT)RwlockResult - 1) | 1)));
-    return ((INT)RwlockResult - 1) | 1;
+    ULONG Hash = 0;
+    while (L'\\' == *Path)
+        Path++;
+    for (; 0 != *Path && L'\\' != *Path; Path++)
+        Hash = 37 * Hash + RtlUpcaseUnicodeChar(*Path);
+    return (UINT32)1 << (Hash % FUSE_OPGUARD_STRIPE_COUNT);
 }
 static inline
-INT FuseOpGuardAcquireExclusive(FUSE_CONTEXT *Context)
+UINT32 FuseOpGuardStripeMaskFromFileName(FSP_FSCTL_TRANSACT_REQ *InternalRequest)
 {
-    return FuseOpGuardResult_(FuseRwlockEnterWriter(&Context->Instance->OpGuardLock, Context));
+    if (0 == InternalRequest->FileName.Size)
+        return FUSE_OPGUARD_STRIPE_MASK_ALL;
+    return FuseOpGuardStripeMaskFromPath(
+        (PWSTR)(InternalRequest->Buffer + InternalRequest->FileName.Offset));
 }
 static inline
-INT FuseOpGuardAcquireShared(FUSE_CONTEXT *Context)
+INT FuseOpGuardAcquireExclusive(FUSE_CONTEXT *Context, UINT32 StripeMask)
 {
-    return FuseOpGuardResult_(FuseRwlockEnterReader(&Context->Instance->OpGuardLock, Context));
+    ASSERT(0 != StripeMask && 0 == Context->OpGuardStripeMask);
+    for (ULONG Index = 0; FUSE_OPGUARD_STRIPE_COUNT > Index; Index++)
+        if (StripeMask & ((UINT32)1 << Index))
+        {
+            if (!FuseRwlockEnterWriter(&Context->Instance->OpGuardLocks[Index], Context))
+            {
+                while (0 != Index--)
+                    if (StripeMask & ((UINT32)1 << Index))
+                        FuseRwlockLeaveWriter(&Context->Instance->OpGuardLocks[Index], Context);
+                return FuseOpGuardCancel;
+            }
+        }
+    Context->OpGuardStripeMask = StripeMask;
+    return FuseOpGuardTrue;
+}
+static inline
+INT FuseOpGuardAcquireShared(FUSE_CONTEXT *Context, UINT32 StripeMask)
+{
+    ASSERT(0 != StripeMask && 0 == Context->OpGuardStripeMask);
+    for (ULONG Index = 0; FUSE_OPGUARD_STRIPE_COUNT > Index; Index++)
+        if (StripeMask & ((UINT32)1 << Index))
+        {
+            if (!FuseRwlockEnterReader(&Context->Instance->OpGuardLocks[Index], Context))
+            {
+                while (0 != Index--)
+                    if (StripeMask & ((UINT32)1 << Index))
+                        FuseRwlockLeaveReader(&Context->Instance->OpGuardLocks[Index], Context);
+                return FuseOpGuardCancel;
+            }
+        }
+    Context->OpGuardStripeMask = StripeMask;
+    return FuseOpGuardTrue;
 }
 static inline
 INT FuseOpGuardReleaseExclusive(FUSE_CONTEXT *Context)
 {
-    FuseRwlockLeaveWriter(&Context->Instance->OpGuardLock, Context);
+    for (ULONG Index = 0; FUSE_OPGUARD_STRIPE_COUNT > Index; Index++)
+        if (Context->OpGuardStripeMask & ((UINT32)1 << Index))
+            FuseRwlockLeaveWriter(&Context->Instance->OpGuardLocks[Index], Context);
+    Context->OpGuardStripeMask = 0;
     return FuseOpGuardFalse;
 }
 static inline
 INT FuseOpGuardReleaseShared(FUSE_CONTEXT *Context)
 {
-    FuseRwlockLeaveReader(&Context->Instance->OpGuardLock, Context);
+    for (ULONG Index = 0; FUSE_OPGUARD_STRIPE_COUNT > Index; Index++)
+        if (Context->OpGuardStripeMask & ((UINT32)1 << Index))
+            FuseRwlockLeaveReader(&Context->Instance->OpGuardLocks[Index], Context);
+    Context->OpGuardStripeMask = 0;
     return FuseOpGuardFalse;
 }
 #define FuseContextStatus(S)            \
@@ -468,17 +783,28 @@ INT FuseOpGuardReleaseShared(FUSE_CONTEXT *Context)
 #define FuseContextWaitResponse(C)      do { coro_yield; } while (0 == (C)->FuseResponse)
 
 /* FUSE I/O queue */
-NTSTATUS FuseIoqCreate(FUSE_IOQ **PIoq);
+NTSTATUS FuseIoqCreate(FUSE_STATISTICS *Statistics, FUSE_IOQ **PIoq);
 VOID FuseIoqDelete(FUSE_IOQ *Ioq);
 VOID FuseIoqStartProcessing(FUSE_IOQ *Ioq, FUSE_CONTEXT *Context);
+VOID FuseIoqParkProcessing(FUSE_IOQ *Ioq, FUSE_CONTEXT *Context);
 FUSE_CONTEXT *FuseIoqEndProcessing(FUSE_IOQ *Ioq, UINT64 Unique);
 VOID FuseIoqPostPending(FUSE_IOQ *Ioq, FUSE_CONTEXT *Context);
 VOID FuseIoqPostPendingAndStop(FUSE_IOQ *Ioq, FUSE_CONTEXT *Context);
 FUSE_CONTEXT *FuseIoqNextPending(FUSE_IOQ *Ioq); /* does not block! */
+VOID FuseIoqSetNotifyEvent(FUSE_IOQ *Ioq, PKEVENT Event);
+VOID FuseIoqGetStatistics(FUSE_IOQ *Ioq, FUSE_STATISTICS *Statistics);
 
 /* FUSE "entry" cache */
 typedef struct _FUSE_CACHE_GEN FUSE_CACHE_GEN;
-NTSTATUS FuseCacheCreate(ULONG Capacity, BOOLEAN CaseInsensitive, FUSE_CACHE **PCache);
+
+/* full-path resolution cache */
+typedef struct _FUSE_CACHE_PATH_ATTR
+{
+    UINT64 Ino;
+    UINT32 Uid, Gid, Mode;
+} FUSE_CACHE_PATH_ATTR;
+NTSTATUS FuseCacheCreate(ULONG Capacity, BOOLEAN CaseInsensitive,
+    FUSE_INSTANCE *Instance, FUSE_CACHE **PCache);
 VOID FuseCacheDelete(FUSE_CACHE *Cache);
 VOID FuseCacheExpirationRoutine(FUSE_CACHE *Cache,
     FUSE_INSTANCE *Instance, UINT64 ExpirationTime);
@@ -488,12 +814,30 @@ BOOLEAN FuseCacheGetEntry(FUSE_CACHE *Cache, UINT64 ParentIno, PSTRING Name,
     FUSE_PROTO_ENTRY *Entry, PVOID *PItem);
 VOID FuseCacheSetEntry(FUSE_CACHE *Cache, UINT64 ParentIno, PSTRING Name,
     FUSE_PROTO_ENTRY *Entry, PVOID *PItem);
+VOID FuseCacheSetNegativeEntry(FUSE_CACHE *Cache, UINT64 ParentIno, PSTRING Name);
 VOID FuseCacheRemoveEntry(FUSE_CACHE *Cache, UINT64 ParentIno, PSTRING Name);
+BOOLEAN FuseCacheGetAttrByIno(FUSE_CACHE *Cache, UINT64 Ino, FUSE_PROTO_ATTR *Attr);
+BOOLEAN FuseCacheGetPath(FUSE_CACHE *Cache, PSTRING Path,
+    FUSE_CACHE_PATH_ATTR *Attrs, PULONG PCount,
+    FUSE_PROTO_ATTR *Attr, PVOID *PItem);
+VOID FuseCacheSetPath(FUSE_CACHE *Cache, PSTRING Path, PVOID *Items, ULONG Count);
+UINT64 FuseCacheItemTimeout(PVOID Item);
+BOOLEAN FuseCacheGetDirBuffer(FUSE_CACHE *Cache, UINT64 Ino, UINT64 Offset,
+    PVOID *PBuffer, PULONG PLength);
+VOID FuseCacheSetDirBuffer(FUSE_CACHE *Cache, UINT64 Ino, UINT64 Offset,
+    PVOID Buffer, ULONG Length, UINT64 Timeout);
+VOID FuseCacheRemoveDirBuffers(FUSE_CACHE *Cache, UINT64 Ino);
+BOOLEAN FuseCacheGetDataBuffer(FUSE_CACHE *Cache, UINT64 Ino, UINT64 Offset,
+    PVOID Buffer, ULONG Length, PULONG PBytesTransferred);
+VOID FuseCacheSetDataBuffer(FUSE_CACHE *Cache, UINT64 Ino, UINT64 Offset,
+    PVOID Buffer, ULONG Length, BOOLEAN Eof, UINT64 Timeout);
+VOID FuseCacheRemoveDataBuffers(FUSE_CACHE *Cache, UINT64 Ino);
 VOID FuseCacheReferenceItem(FUSE_CACHE *Cache, PVOID Item);
 VOID FuseCacheDereferenceItem(FUSE_CACHE *Cache, PVOID Item);
 VOID FuseCacheQuickExpireItem(FUSE_CACHE *Cache, PVOID Item);
 VOID FuseCacheDeleteForgotten(PLIST_ENTRY ForgetList);
 BOOLEAN FuseCacheForgetOne(PLIST_ENTRY ForgetList, FUSE_PROTO_FORGET_ONE *PForgetOne);
+VOID FuseCacheGetStatistics(FUSE_CACHE *Cache, FUSE_STATISTICS *Statistics);
 
 /* protocol implementation */
 NTSTATUS FuseProtoPostInit(FUSE_INSTANCE *Instance);
@@ -501,7 +845,11 @@ VOID FuseProtoSendInit(FUSE_CONTEXT *Context);
 NTSTATUS FuseProtoPostDestroy(FUSE_INSTANCE *Instance);
 VOID FuseProtoSendDestroy(FUSE_CONTEXT *Context);
 VOID FuseProtoSendLookup(FUSE_CONTEXT *Context);
+NTSTATUS FuseProtoForgetInit(FUSE_INSTANCE *Instance);
+VOID FuseProtoForgetFini(FUSE_INSTANCE *Instance);
 NTSTATUS FuseProtoPostForget(FUSE_INSTANCE *Instance, PLIST_ENTRY ForgetList);
+VOID FuseProtoForgetRecycle(FUSE_INSTANCE *Instance, FUSE_CONTEXT *Context);
+NTSTATUS FuseProtoPostRelease(FUSE_INSTANCE *Instance, FUSE_FILE *File);
 VOID FuseProtoFillForget(FUSE_CONTEXT *Context);
 VOID FuseProtoFillBatchForget(FUSE_CONTEXT *Context);
 VOID FuseProtoSendStatfs(FUSE_CONTEXT *Context);
@@ -0,0 +1,48 @@
+/**
+ * @file shared/km/trace.c
+ *
+ * @copyright 2019-2020 Bill Zissimopoulos
+ */
+/*
+ * This file is part of WinFuse.
+ *
+ * You can redistribute it and/or modify it under the terms of the GNU
+ * Affero General Public License version 3 as published by the Free
+ * Software Foundation.
+ *
+ * Licensees holding a valid commercial license may use this software
+ * in accordance with the commercial license agreement provided in
+ * conjunction with the software.  The terms and conditions of any such
+ * commercial license agreement shall govern, supersede, and render
+ * ineffective any application of the AGPLv3 license to this software,
+ * notwithstanding of any reference thereto in the software or
+ * associated repository.
+ */
+
+#include <shared/km/shared.h>
+
+VOID FuseTraceInitialize(VOID);
+
+#ifdef ALLOC_PRAGMA
+#pragma alloc_text(INIT, FuseTraceInitialize)
+#endif
+
+/*
+ * TraceLogging provider for the request lifecycle events emitted from
+ * FuseInstanceTransact (see the FuseTrace* macros in shared.h). Events pay
+ * only a provider-enabled check when no session listens, so the provider
+ * remains compiled in and registered in release builds.
+ *
+ * Provider name: WinFuse
+ * Provider GUID: 5b7bcdc5-6f26-4a1a-b2b9-3f4b8c0e9d21
+ */
+TRACELOGGING_DEFINE_PROVIDER(FuseTraceProvider, "WinFuse",
+    (0x5b7bcdc5, 0x6f26, 0x4a1a, 0xb2, 0xb9, 0x3f, 0x4b, 0x8c, 0x0e, 0x9d, 0x21));
+
+VOID FuseTraceInitialize(VOID)
+{
+    PAGED_CODE();
+
+    /* the drivers that embed this code do not unload; no unregister is needed */
+    TraceLoggingRegister(FuseTraceProvider);
+}
@@ -24,11 +24,16 @@
 PVOID FuseAllocatePoolMustSucceed(POOL_TYPE PoolType, SIZE_T Size, ULONG Tag);
 NTSTATUS FuseSafeCopyMemory(PVOID Dst, PVOID Src, ULONG Len);
 NTSTATUS FuseGetTokenUid(PACCESS_TOKEN Token, TOKEN_INFORMATION_CLASS InfoClass, PUINT32 PUid);
+NTSTATUS FuseGetTokenUidGid(PACCESS_TOKEN Token, PUINT32 PUid, PUINT32 PGid);
+NTSTATUS FuseMapPermissionsToSecurityDescriptor(
+    UINT32 Uid, UINT32 Gid, UINT32 Mode, PSECURITY_DESCRIPTOR *PSecurityDescriptor);
 
 #ifdef ALLOC_PRAGMA
 // !#pragma alloc_text(PAGE, FuseAllocatePoolMustSucceed)
 #pragma alloc_text(PAGE, FuseSafeCopyMemory)
 #pragma alloc_text(PAGE, FuseGetTokenUid)
+#pragma alloc_text(PAGE, FuseGetTokenUidGid)
+#pragma alloc_text(PAGE, FuseMapPermissionsToSecurityDescriptor)
 #endif
 
 static const LONG Delays[] =
@@ -113,3 +118,166 @@ exit:
 
     return Result;
 }
+
+/*
+ * Token uid/gid translation cache.
+ *
+ * Every inbound operation stamps the originator's uid/gid onto its context
+ * and most operations originate from a handful of processes, so the same
+ * token is translated over and over. The cache is keyed on the TokenId from
+ * TOKEN_STATISTICS, which the system never reuses (unlike the token object
+ * pointer), and an entry is valid only while the ModifiedId also matches, so
+ * any modification of the token invalidates it. A hit costs a single fixed
+ * size token query instead of two SID queries and two SID to uid mappings.
+ *
+ * A token modified between the statistics query and the uid/gid queries may
+ * be cached one modification stale; the next modification corrects it.
+ */
+#define FUSE_TOKEN_CACHE_BUCKET_COUNT   61
+typedef struct _FUSE_TOKEN_CACHE_BUCKET
+{
+    EX_PUSH_LOCK Lock;
+    LUID TokenId;
+    LUID ModifiedId;
+    UINT32 Uid, Gid;
+    BOOLEAN Valid;
+} FUSE_TOKEN_CACHE_BUCKET;
+static FUSE_TOKEN_CACHE_BUCKET FuseTokenCacheBuckets[FUSE_TOKEN_CACHE_BUCKET_COUNT];
+
+NTSTATUS FuseGetTokenUidGid(PACCESS_TOKEN Token, PUINT32 PUid, PUINT32 PGid)
+{
+    PAGED_CODE();
+
+    FUSE_TOKEN_CACHE_BUCKET *Bucket;
+    PTOKEN_STATISTICS Statistics = 0;
+    LUID TokenId, ModifiedId;
+    UINT32 Uid, Gid;
+    NTSTATUS Result;
+
+    Result = SeQueryInformationToken(Token, TokenStatistics, &Statistics);
+    if (!NT_SUCCESS(Result))
+        return Result;
+    TokenId = Statistics->TokenId;
+    ModifiedId = Statistics->ModifiedId;
+    FuseFreeExternal(Statistics);
+
+    Bucket = &FuseTokenCacheBuckets[TokenId.LowPart % FUSE_TOKEN_CACHE_BUCKET_COUNT];
+
+    ExAcquirePushLockShared(&Bucket->Lock);
+    if (Bucket->Valid &&
+        Bucket->TokenId.LowPart == TokenId.LowPart &&
+        Bucket->TokenId.HighPart == TokenId.HighPart &&
+        Bucket->ModifiedId.LowPart == ModifiedId.LowPart &&
+        Bucket->ModifiedId.HighPart == ModifiedId.HighPart)
+    {
+        *PUid = Bucket->Uid;
+        *PGid = Bucket->Gid;
+        ExReleasePushLockShared(&Bucket->Lock);
+        return STATUS_SUCCESS;
+    }
+    ExReleasePushLockShared(&Bucket->Lock);
+
+    Result = FuseGetTokenUid(Token, TokenUser, &Uid);
+    if (!NT_SUCCESS(Result))
+        return Result;
+    Result = FuseGetTokenUid(Token, TokenPrimaryGroup, &Gid);
+    if (!NT_SUCCESS(Result))
+        return Result;
+
+    ExAcquirePushLockExclusive(&Bucket->Lock);
+    Bucket->TokenId = TokenId;
+    Bucket->ModifiedId = ModifiedId;
+    Bucket->Uid = Uid;
+    Bucket->Gid = Gid;
+    Bucket->Valid = TRUE;
+    ExReleasePushLockExclusive(&Bucket->Lock);
+
+    *PUid = Uid;
+    *PGid = Gid;
+
+    return STATUS_SUCCESS;
+}
+
+/*
+ * Security descriptor memoization.
+ *
+ * A FUSE file system exposes only (uid, gid, mode) and a typical volume has
+ * a few dozen distinct triples, while mapping a triple to an NT security
+ * descriptor involves SID construction and ACL layout on every call. Cache
+ * the mapped (self-relative) descriptor per triple; a hit costs a hash probe
+ * and a descriptor copy. Descriptors are returned in ExFreePool'able
+ * allocations, so callers free them with FuseFreeExternal exactly as they
+ * free a descriptor mapped by WinFsp.
+ */
+#define FUSE_SECURITY_CACHE_BUCKET_COUNT 61
+typedef struct _FUSE_SECURITY_CACHE_BUCKET
+{
+    EX_PUSH_LOCK Lock;
+    PSECURITY_DESCRIPTOR SecurityDescriptor;    /* valid when 0 != Length */
+    ULONG Length;
+    UINT32 Uid, Gid, Mode;
+} FUSE_SECURITY_CACHE_BUCKET;
+static FUSE_SECURITY_CACHE_BUCKET FuseSecurityCacheBuckets[FUSE_SECURITY_CACHE_BUCKET_COUNT];
+
+NTSTATUS FuseMapPermissionsToSecurityDescriptor(
+    UINT32 Uid, UINT32 Gid, UINT32 Mode, PSECURITY_DESCRIPTOR *PSecurityDescriptor)
+{
+    PAGED_CODE();
+
+    FUSE_SECURITY_CACHE_BUCKET *Bucket;
+    PSECURITY_DESCRIPTOR SecurityDescriptor, OldDescriptor;
+    PVOID CachedDescriptor;
+    ULONG Length;
+    NTSTATUS Result;
+
+    *PSecurityDescriptor = 0;
+
+    Bucket = &FuseSecurityCacheBuckets[
+        (Uid * 2654435761 + Gid * 40503 + Mode) % FUSE_SECURITY_CACHE_BUCKET_COUNT];
+
+    ExAcquirePushLockShared(&Bucket->Lock);
+    if (0 != Bucket->Length &&
+        Bucket->Uid == Uid && Bucket->Gid == Gid && Bucket->Mode == Mode)
+    {
+        SecurityDescriptor = ExAllocatePoolWithTag(PagedPool, Bucket->Length, FUSE_ALLOC_TAG);
+        if (0 != SecurityDescriptor)
+            RtlCopyMemory(SecurityDescriptor, Bucket->SecurityDescriptor, Bucket->Length);
+        ExReleasePushLockShared(&Bucket->Lock);
+
+        if (0 == SecurityDescriptor)
+            return STATUS_INSUFFICIENT_RESOURCES;
+
+        *PSecurityDescriptor = SecurityDescriptor;
+
+        return STATUS_SUCCESS;
+    }
+    ExReleasePushLockShared(&Bucket->Lock);
+
+    Result = FspPosixMapPermissionsToSecurityDescriptor(Uid, Gid, Mode, &SecurityDescriptor);
+    if (!NT_SUCCESS(Result))
+        return Result;
+
+    Length = RtlLengthSecurityDescriptor(SecurityDescriptor);
+
+    CachedDescriptor = FuseAlloc(Length);
+    if (0 != CachedDescriptor)
+    {
+        RtlCopyMemory(CachedDescriptor, SecurityDescriptor, Length);
+
+        ExAcquirePushLockExclusive(&Bucket->Lock);
+        OldDescriptor = 0 != Bucket->Length ? Bucket->SecurityDescriptor : 0;
+        Bucket->SecurityDescriptor = CachedDescriptor;
+        Bucket->Length = Length;
+        Bucket->Uid = Uid;
+        Bucket->Gid = Gid;
+        Bucket->Mode = Mode;
+        ExReleasePushLockExclusive(&Bucket->Lock);
+
+        if (0 != OldDescriptor)
+            FuseFree(OldDescriptor);
+    }
+
+    *PSecurityDescriptor = SecurityDescriptor;
+
+    return STATUS_SUCCESS;
+}
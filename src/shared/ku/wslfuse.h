@@ -146,6 +146,34 @@ _Static_assert(24 == sizeof(WSLFUSE_IOCTL_LXMOUNT_ARG),
     "sizeof(WSLFUSE_IOCTL_LXMOUNT_ARG) must be 16.");
 #endif
 
+typedef union
+{
+    struct /* in */
+    {
+        FSP_FSCTL_VOLUME_PARAMS VolumeParams;
+        CHAR WinMountPoint[260];        /* empty: no Windows mount point association */
+        UINT64 LxMountId;               /* (UINT64)-1: no WSL mount id association */
+    };
+    struct /* out */
+    {
+        CHAR VolumeName[(FSP_FSCTL_VOLUME_NAME_SIZEMAX / sizeof(WCHAR)) * 3 / 2];
+        UINT64 VolumeId;
+    };
+} WSLFUSE_IOCTL_MOUNT_ARG;
+#if defined(__linux__)
+_Static_assert(776 == sizeof(WSLFUSE_IOCTL_MOUNT_ARG),
+    "sizeof(WSLFUSE_IOCTL_MOUNT_ARG) must be 776.");
+#endif
+
+typedef struct
+{
+    UINT64 LxMountId;                   /* (UINT64)-1: use this file's mount */
+} WSLFUSE_IOCTL_UNMOUNT_ARG;
+#if defined(__linux__)
+_Static_assert(8 == sizeof(WSLFUSE_IOCTL_UNMOUNT_ARG),
+    "sizeof(WSLFUSE_IOCTL_UNMOUNT_ARG) must be 8.");
+#endif
+
 /*
  * _IOWR('F', 'C', WSLFUSE_IOCTL_CREATEVOLUME_ARG)
  * sh tools/ioc.c 3 70 67 504
@@ -176,4 +204,24 @@ _Static_assert(WSLFUSE_IOCTL_LXMOUNT == _IOW('F', 'm', WSLFUSE_IOCTL_LXMOUNT_ARG
     "WSLFUSE_IOCTL_LXMOUNT");
 #endif
 
+/*
+ * _IOWR('F', 'T', WSLFUSE_IOCTL_MOUNT_ARG)
+ * sh tools/ioc.c 3 70 84 776
+ */
+#define WSLFUSE_IOCTL_MOUNT             0xc3084654
+#if defined(__linux__)
+_Static_assert(WSLFUSE_IOCTL_MOUNT == _IOWR('F', 'T', WSLFUSE_IOCTL_MOUNT_ARG),
+    "WSLFUSE_IOCTL_MOUNT");
+#endif
+
+/*
+ * _IOW('F', 't', WSLFUSE_IOCTL_UNMOUNT_ARG)
+ * sh tools/ioc.c 1 70 116 8
+ */
+#define WSLFUSE_IOCTL_UNMOUNT           0x40084674
+#if defined(__linux__)
+_Static_assert(WSLFUSE_IOCTL_UNMOUNT == _IOW('F', 't', WSLFUSE_IOCTL_UNMOUNT_ARG),
+    "WSLFUSE_IOCTL_UNMOUNT");
+#endif
+
 #endif
@@ -25,12 +25,18 @@ static NTSTATUS FuseDeviceInit(PDEVICE_OBJECT DeviceObject, FSP_FSCTL_VOLUME_PAR
 static VOID FuseDeviceFini(PDEVICE_OBJECT DeviceObject);
 static VOID FuseDeviceExpirationRoutine(PDEVICE_OBJECT DeviceObject, UINT64 ExpirationTime);
 static NTSTATUS FuseDeviceTransact(PDEVICE_OBJECT DeviceObject, PIRP Irp);
+static NTSTATUS FuseDeviceStatistics(PDEVICE_OBJECT DeviceObject, PIRP Irp);
+static NTSTATUS FuseDeviceTransactRing(PDEVICE_OBJECT DeviceObject, PIRP Irp);
+static NTSTATUS FuseDeviceNotify(PDEVICE_OBJECT DeviceObject, PIRP Irp);
 
 #ifdef ALLOC_PRAGMA
 #pragma alloc_text(PAGE, FuseDeviceInit)
 #pragma alloc_text(PAGE, FuseDeviceFini)
 #pragma alloc_text(PAGE, FuseDeviceExpirationRoutine)
 #pragma alloc_text(PAGE, FuseDeviceTransact)
+#pragma alloc_text(PAGE, FuseDeviceStatistics)
+#pragma alloc_text(PAGE, FuseDeviceTransactRing)
+#pragma alloc_text(PAGE, FuseDeviceNotify)
 #endif
 
 static NTSTATUS FuseDeviceInit(PDEVICE_OBJECT DeviceObject, FSP_FSCTL_VOLUME_PARAMS *VolumeParams)
@@ -53,11 +59,14 @@ static VOID FuseDeviceFini(PDEVICE_OBJECT DeviceObject)
 {
     PAGED_CODE();
 
-    FUSE_INSTANCE *Instance = FuseInstanceFromDeviceObject(DeviceObject);
+    FUSE_DEVICE_EXTENSION *DeviceExtension = FuseDeviceExtensionFromDeviceObject(DeviceObject);
 
     KeEnterCriticalRegion();
 
-    FuseInstanceFini(Instance);
+    if (0 != DeviceExtension->Ring)
+        FuseRingDelete(DeviceExtension->Ring);
+
+    FuseInstanceFini(&DeviceExtension->Instance);
 
     KeLeaveCriticalRegion();
 }
@@ -84,13 +93,33 @@ static NTSTATUS FuseDeviceTransact(PDEVICE_OBJECT DeviceObject, PIRP Irp)
     PIO_STACK_LOCATION IrpSp = IoGetCurrentIrpStackLocation(Irp);
     ASSERT(IRP_MJ_FILE_SYSTEM_CONTROL == IrpSp->MajorFunction);
     ASSERT(IRP_MN_USER_FS_REQUEST == IrpSp->MinorFunction);
-    ASSERT(FUSE_FSCTL_TRANSACT == IrpSp->Parameters.FileSystemControl.FsControlCode);
     ASSERT(METHOD_BUFFERED == (IrpSp->Parameters.FileSystemControl.FsControlCode & 3));
     ASSERT(IrpSp->FileObject->FsContext2 == DeviceObject);
 
+    ASSERT(FUSE_FSCTL_TRANSACT == IrpSp->Parameters.FileSystemControl.FsControlCode);
+
     FUSE_INSTANCE *Instance = FuseInstanceFromDeviceObject(DeviceObject);
     ULONG InputBufferLength = IrpSp->Parameters.FileSystemControl.InputBufferLength;
     ULONG OutputBufferLength = IrpSp->Parameters.FileSystemControl.OutputBufferLength;
+    FUSE_FSCTL_CONTROL *Control = Irp->AssociatedIrp.SystemBuffer;
+
+    if (RTL_SIZEOF_THROUGH_FIELD(FUSE_FSCTL_CONTROL, ControlCode) <= InputBufferLength &&
+        0 == Control->Zero && FUSE_FSCTL_CONTROL_MAGIC == Control->Magic)
+    {
+        /* control operation tunneled in the transact input buffer (see driver.h) */
+        switch (Control->ControlCode)
+        {
+        case FUSE_FSCTL_STATISTICS:
+            return FuseDeviceStatistics(DeviceObject, Irp);
+        case FUSE_FSCTL_TRANSACT_RING:
+            return FuseDeviceTransactRing(DeviceObject, Irp);
+        case FUSE_FSCTL_NOTIFY:
+            return FuseDeviceNotify(DeviceObject, Irp);
+        default:
+            return STATUS_INVALID_DEVICE_REQUEST;
+        }
+    }
+
     FUSE_PROTO_RSP *FuseResponse = 0 != InputBufferLength ? Irp->AssociatedIrp.SystemBuffer : 0;
     FUSE_PROTO_REQ *FuseRequest = 0 != OutputBufferLength ? Irp->AssociatedIrp.SystemBuffer : 0;
     NTSTATUS Result;
@@ -99,13 +128,83 @@ static NTSTATUS FuseDeviceTransact(PDEVICE_OBJECT DeviceObject, PIRP Irp)
         FuseResponse, InputBufferLength,
         FuseRequest, &OutputBufferLength,
         IrpSp->DeviceObject, IrpSp->FileObject,
-        Irp);
+        Irp,
+        TRUE);
 
     Irp->IoStatus.Information = OutputBufferLength;
 
     return Result;
 }
 
+static NTSTATUS FuseDeviceStatistics(PDEVICE_OBJECT DeviceObject, PIRP Irp)
+{
+    PAGED_CODE();
+
+    PIO_STACK_LOCATION IrpSp = IoGetCurrentIrpStackLocation(Irp);
+    FUSE_INSTANCE *Instance = FuseInstanceFromDeviceObject(DeviceObject);
+    ULONG OutputBufferLength = IrpSp->Parameters.FileSystemControl.OutputBufferLength;
+
+    if (sizeof(FUSE_STATISTICS) > OutputBufferLength)
+        return STATUS_BUFFER_TOO_SMALL;
+
+    FuseInstanceGetStatistics(Instance, Irp->AssociatedIrp.SystemBuffer);
+
+    Irp->IoStatus.Information = sizeof(FUSE_STATISTICS);
+
+    return STATUS_SUCCESS;
+}
+
+static NTSTATUS FuseDeviceTransactRing(PDEVICE_OBJECT DeviceObject, PIRP Irp)
+{
+    PAGED_CODE();
+
+    FUSE_DEVICE_EXTENSION *DeviceExtension = FuseDeviceExtensionFromDeviceObject(DeviceObject);
+    PIO_STACK_LOCATION IrpSp = IoGetCurrentIrpStackLocation(Irp);
+    ULONG InputBufferLength = IrpSp->Parameters.FileSystemControl.InputBufferLength;
+    FUSE_RING *Ring;
+    NTSTATUS Result;
+
+    if (0 == DeviceExtension->Ring)
+    {
+        /* first call establishes the ring; every further call pumps it */
+        if (RTL_SIZEOF_THROUGH_FIELD(FUSE_FSCTL_CONTROL, Ring) > InputBufferLength)
+            return STATUS_INVALID_PARAMETER;
+
+        Result = FuseRingCreate(&((FUSE_FSCTL_CONTROL *)Irp->AssociatedIrp.SystemBuffer)->Ring,
+            &Ring);
+        if (!NT_SUCCESS(Result))
+            return Result;
+
+        if (0 != InterlockedCompareExchangePointer((PVOID *)&DeviceExtension->Ring, Ring, 0))
+        {
+            FuseRingDelete(Ring);
+            return STATUS_DEVICE_BUSY;
+        }
+
+        return STATUS_SUCCESS;
+    }
+
+    return FuseRingTransact(DeviceExtension->Ring, &DeviceExtension->Instance,
+        IrpSp->DeviceObject, IrpSp->FileObject, Irp);
+}
+
+static NTSTATUS FuseDeviceNotify(PDEVICE_OBJECT DeviceObject, PIRP Irp)
+{
+    PAGED_CODE();
+
+    FUSE_INSTANCE *Instance = FuseInstanceFromDeviceObject(DeviceObject);
+    PIO_STACK_LOCATION IrpSp = IoGetCurrentIrpStackLocation(Irp);
+    ULONG InputBufferLength = IrpSp->Parameters.FileSystemControl.InputBufferLength;
+    FUSE_FSCTL_CONTROL *Control;
+
+    if (RTL_SIZEOF_THROUGH_FIELD(FUSE_FSCTL_CONTROL, Notify) > InputBufferLength)
+        return STATUS_INVALID_PARAMETER;
+
+    Control = Irp->AssociatedIrp.SystemBuffer;
+
+    return FuseInstanceSetNotifyEvent(Instance, (HANDLE)(UINT_PTR)Control->Notify.Event);
+}
+
 FSP_FSEXT_PROVIDER FuseProvider =
 {
     /* Version */
@@ -115,7 +214,7 @@ FSP_FSEXT_PROVIDER FuseProvider =
     FUSE_FSCTL_TRANSACT,
 
     /* DeviceExtensionSize */
-    sizeof(FUSE_INSTANCE),
+    sizeof(FUSE_DEVICE_EXTENSION),
 
     /* DeviceInit */
     FuseDeviceInit,
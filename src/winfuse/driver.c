@@ -35,5 +35,9 @@ NTSTATUS DriverEntry(
         DbgBreakPoint();
 #endif
 
+    FuseContextInitialize();
+
+    FuseTraceInitialize();
+
     return FspFsextProviderRegister(&FuseProvider);
 }
@@ -26,6 +26,71 @@
 
 #define FUSE_FSCTL_TRANSACT             \
     CTL_CODE(FILE_DEVICE_FILE_SYSTEM, 0xC00 + 'F', METHOD_BUFFERED, FILE_ANY_ACCESS)
+#define FUSE_FSCTL_STATISTICS           \
+    CTL_CODE(FILE_DEVICE_FILE_SYSTEM, 0xC00 + 'S', METHOD_BUFFERED, FILE_ANY_ACCESS)
+#define FUSE_FSCTL_TRANSACT_RING        \
+    CTL_CODE(FILE_DEVICE_FILE_SYSTEM, 0xC00 + 'R', METHOD_BUFFERED, FILE_ANY_ACCESS)
+#define FUSE_FSCTL_NOTIFY               \
+    CTL_CODE(FILE_DEVICE_FILE_SYSTEM, 0xC00 + 'N', METHOD_BUFFERED, FILE_ANY_ACCESS)
+
+/* pending work doorbell (see FuseInstanceSetNotifyEvent) */
+typedef struct _FUSE_NOTIFY_PARAMS
+{
+    UINT64 Event;                       /* file system event handle (signaled on pending work) */
+} FUSE_NOTIFY_PARAMS;
+
+/* shared-memory transact ring (see winfuse/ring.c) */
+typedef struct _FUSE_RING_PARAMS
+{
+    UINT64 Address;                     /* file system region base address (page aligned) */
+    UINT64 Length;                      /* file system region length (page aligned) */
+    UINT64 Event;                       /* file system event handle (signaled on requests) */
+} FUSE_RING_PARAMS;
+typedef struct _FUSE_RING_SHARED
+{
+    UINT32 ReqHead;                     /* request area: consumed by the file system */
+    UINT32 ReqTail;                     /* request area: produced by the driver */
+    UINT32 RspHead;                     /* response area: consumed by the driver */
+    UINT32 RspTail;                     /* response area: produced by the file system */
+    UINT32 ReqAreaOffset, ReqAreaLength;
+    UINT32 RspAreaOffset, RspAreaLength;
+} FUSE_RING_SHARED;
+typedef struct _FUSE_RING FUSE_RING;
+NTSTATUS FuseRingCreate(FUSE_RING_PARAMS *Params, FUSE_RING **PRing);
+VOID FuseRingDelete(FUSE_RING *Ring);
+NTSTATUS FuseRingTransact(FUSE_RING *Ring, FUSE_INSTANCE *Instance,
+    PDEVICE_OBJECT DeviceObject, PFILE_OBJECT FileObject, PIRP CancellableIrp);
+
+/*
+ * Control operations tunneled through FUSE_FSCTL_TRANSACT.
+ *
+ * WinFsp forwards only the provider's registered DeviceTransactCode
+ * (FUSE_FSCTL_TRANSACT) to the fsext provider, so the auxiliary control codes
+ * above cannot be delivered on their own. They are instead carried in the
+ * FUSE_FSCTL_TRANSACT input buffer, prefixed with the record below. The
+ * record cannot be mistaken for a response: a FUSE_PROTO_RSP must carry at
+ * least FUSE_PROTO_RSP_HEADER_SIZE in its leading len field (see
+ * FuseInstanceTransact), whereas a control record carries zero there.
+ */
+#define FUSE_FSCTL_CONTROL_MAGIC        0x4c544346  /* "FCTL" */
+typedef struct _FUSE_FSCTL_CONTROL
+{
+    UINT32 Zero;                        /* 0; a FUSE_PROTO_RSP carries len here */
+    UINT32 Magic;                       /* FUSE_FSCTL_CONTROL_MAGIC */
+    UINT32 ControlCode;                 /* FUSE_FSCTL_STATISTICS, etc. */
+    UINT32 Padding;
+    union
+    {
+        FUSE_NOTIFY_PARAMS Notify;      /* FUSE_FSCTL_NOTIFY */
+        FUSE_RING_PARAMS Ring;          /* FUSE_FSCTL_TRANSACT_RING */
+    };
+} FUSE_FSCTL_CONTROL;
+
+typedef struct _FUSE_DEVICE_EXTENSION
+{
+    FUSE_INSTANCE Instance;             /* must be first (see FuseInstanceFromDeviceObject) */
+    FUSE_RING *Ring;
+} FUSE_DEVICE_EXTENSION;
 
 extern FSP_FSEXT_PROVIDER FuseProvider;
 static inline
@@ -33,5 +98,10 @@ FUSE_INSTANCE *FuseInstanceFromDeviceObject(PDEVICE_OBJECT DeviceObject)
 {
     return (PVOID)((PUINT8)DeviceObject->DeviceExtension + FuseProvider.DeviceExtensionOffset);
 }
+static inline
+FUSE_DEVICE_EXTENSION *FuseDeviceExtensionFromDeviceObject(PDEVICE_OBJECT DeviceObject)
+{
+    return (PVOID)FuseInstanceFromDeviceObject(DeviceObject);
+}
 
 #endif
@@ -0,0 +1,326 @@
+/**
+ * @file winfuse/ring.c
+ *
+ * @copyright 2019-2020 Bill Zissimopoulos
+ */
+/*
+ * This file is part of WinFuse.
+ *
+ * You can redistribute it and/or modify it under the terms of the GNU
+ * Affero General Public License version 3 as published by the Free
+ * Software Foundation.
+ *
+ * Licensees holding a valid commercial license may use this software
+ * in accordance with the commercial license agreement provided in
+ * conjunction with the software.  The terms and conditions of any such
+ * commercial license agreement shall govern, supersede, and render
+ * ineffective any application of the AGPLv3 license to this software,
+ * notwithstanding of any reference thereto in the software or
+ * associated repository.
+ */
+
+#include <winfuse/driver.h>
+
+NTSTATUS FuseRingCreate(FUSE_RING_PARAMS *Params, FUSE_RING **PRing);
+VOID FuseRingDelete(FUSE_RING *Ring);
+NTSTATUS FuseRingTransact(FUSE_RING *Ring, FUSE_INSTANCE *Instance,
+    PDEVICE_OBJECT DeviceObject, PFILE_OBJECT FileObject, PIRP CancellableIrp);
+
+#ifdef ALLOC_PRAGMA
+#pragma alloc_text(PAGE, FuseRingCreate)
+#pragma alloc_text(PAGE, FuseRingDelete)
+#pragma alloc_text(PAGE, FuseRingTransact)
+#endif
+
+/*
+ * Shared-memory transact ring.
+ *
+ * The user mode file system allocates a region, creates an event and
+ * establishes the ring with a FUSE_FSCTL_TRANSACT_RING control record
+ * (tunneled through FUSE_FSCTL_TRANSACT; see driver.h) containing
+ * FUSE_RING_PARAMS. The driver locks and maps the region; the region starts
+ * with a FUSE_RING_SHARED header followed by two byte areas of equal size:
+ * the request area, where the driver packs FUSE_PROTO_REQ records, and the
+ * response area, where the file system packs FUSE_PROTO_RSP records. Records
+ * are packed at 8-byte boundaries exactly as in a batched FUSE_FSCTL_TRANSACT
+ * and never straddle the end of an area: a producer that cannot fit the next
+ * record before the end writes a zero len marker (when at least 4 bytes
+ * remain) and continues at offset 0.
+ *
+ * Each area is a single-producer/single-consumer byte ring: head and tail are
+ * byte offsets into the area and the area is empty when they are equal, so a
+ * producer always leaves at least one 8-byte unit unused. The driver owns
+ * ReqTail and RspHead; the file system owns ReqHead and RspTail.
+ *
+ * After establishment every further FUSE_FSCTL_TRANSACT_RING pumps the ring:
+ * the driver consumes complete response records published through RspTail and
+ * produces request records, advancing ReqTail. The event is signaled when the
+ * request area transitions from empty to non-empty; while the areas remain
+ * non-empty the file system threads produce responses and consume requests
+ * without any syscall, and a single pump call moves an area's worth of
+ * records in each direction.
+ *
+ * The region is writable by the file system at all times. To avoid
+ * double-fetch problems the driver copies each response span into a private
+ * staging buffer before validating and processing it and builds request
+ * records in the same staging buffer before publishing them; the ring
+ * eliminates syscalls, not copies.
+ */
+
+#define FUSE_RING_MINIMUM_LENGTH        65536
+#define FUSE_RING_MAXIMUM_LENGTH        (16 * 1024 * 1024)
+
+struct _FUSE_RING
+{
+    LONG Busy;                          /* pump serialization; see FuseRingTransact */
+    PMDL Mdl;
+    FUSE_RING_SHARED *Shared;           /* system mapping of the file system's region */
+    PKEVENT Event;
+    PUINT8 ReqArea, RspArea;
+    ULONG AreaLength;
+    ULONG ReqTail, RspHead;             /* driver owned ring indices */
+    PVOID Stage;                        /* staging buffer (one area's length) */
+};
+
+NTSTATUS FuseRingCreate(FUSE_RING_PARAMS *Params, FUSE_RING **PRing)
+{
+    PAGED_CODE();
+
+    FUSE_RING *Ring;
+    FUSE_RING_SHARED *Shared;
+    ULONG AreaLength;
+    NTSTATUS Result;
+
+    *PRing = 0;
+
+    if (FUSE_RING_MINIMUM_LENGTH > Params->Length ||
+        FUSE_RING_MAXIMUM_LENGTH < Params->Length ||
+        0 != (Params->Length & (PAGE_SIZE - 1)) ||
+        0 != (Params->Address & (PAGE_SIZE - 1)))
+        return STATUS_INVALID_PARAMETER;
+
+    Ring = FuseAlloc(sizeof *Ring);
+    if (0 == Ring)
+        return STATUS_INSUFFICIENT_RESOURCES;
+    RtlZeroMemory(Ring, sizeof *Ring);
+
+    Ring->Mdl = IoAllocateMdl((PVOID)(UINT_PTR)Params->Address, (ULONG)Params->Length,
+        FALSE, FALSE, 0);
+    if (0 == Ring->Mdl)
+    {
+        Result = STATUS_INSUFFICIENT_RESOURCES;
+        goto fail;
+    }
+    try
+    {
+        MmProbeAndLockPages(Ring->Mdl, UserMode, IoWriteAccess);
+    }
+    except (EXCEPTION_EXECUTE_HANDLER)
+    {
+        IoFreeMdl(Ring->Mdl);
+        Ring->Mdl = 0;
+        Result = GetExceptionCode();
+        goto fail;
+    }
+
+    Shared = MmGetSystemAddressForMdlSafe(Ring->Mdl, NormalPagePriority);
+    if (0 == Shared)
+    {
+        Result = STATUS_INSUFFICIENT_RESOURCES;
+        goto fail;
+    }
+
+    Result = ObReferenceObjectByHandle((HANDLE)(UINT_PTR)Params->Event, EVENT_MODIFY_STATE,
+        *ExEventObjectType, UserMode, &Ring->Event, 0);
+    if (!NT_SUCCESS(Result))
+        goto fail;
+
+    AreaLength = (ULONG)((Params->Length - sizeof(FUSE_RING_SHARED)) / 2) & ~7UL;
+
+    Ring->Stage = FuseAlloc(AreaLength);
+    if (0 == Ring->Stage)
+    {
+        Result = STATUS_INSUFFICIENT_RESOURCES;
+        goto fail;
+    }
+
+    Ring->Shared = Shared;
+    Ring->ReqArea = (PUINT8)Shared + sizeof(FUSE_RING_SHARED);
+    Ring->RspArea = Ring->ReqArea + AreaLength;
+    Ring->AreaLength = AreaLength;
+
+    RtlZeroMemory(Shared, sizeof(FUSE_RING_SHARED));
+    Shared->ReqAreaOffset = sizeof(FUSE_RING_SHARED);
+    Shared->ReqAreaLength = AreaLength;
+    Shared->RspAreaOffset = sizeof(FUSE_RING_SHARED) + AreaLength;
+    Shared->RspAreaLength = AreaLength;
+
+    *PRing = Ring;
+
+    return STATUS_SUCCESS;
+
+fail:
+    FuseRingDelete(Ring);
+
+    return Result;
+}
+
+VOID FuseRingDelete(FUSE_RING *Ring)
+{
+    PAGED_CODE();
+
+    if (0 != Ring->Stage)
+        FuseFree(Ring->Stage);
+    if (0 != Ring->Event)
+        ObDereferenceObject(Ring->Event);
+    if (0 != Ring->Mdl)
+    {
+        MmUnlockPages(Ring->Mdl);
+        IoFreeMdl(Ring->Mdl);
+    }
+    FuseFree(Ring);
+}
+
+NTSTATUS FuseRingTransact(FUSE_RING *Ring, FUSE_INSTANCE *Instance,
+    PDEVICE_OBJECT DeviceObject, PFILE_OBJECT FileObject, PIRP CancellableIrp)
+{
+    PAGED_CODE();
+
+    FUSE_RING_SHARED *Shared = Ring->Shared;
+    ULONG Head, Tail, NewTail, SpanLength, WalkLength, RecordLength, OutputLength;
+    BOOLEAN WasEmpty;
+    NTSTATUS Result;
+
+    /* a single pump thread is part of the ring protocol */
+    if (0 != InterlockedCompareExchange(&Ring->Busy, 1, 0))
+        return STATUS_DEVICE_BUSY;
+
+    /* consume responses */
+    for (;;)
+    {
+        Head = Ring->RspHead;
+        Tail = *(volatile UINT32 *)&Shared->RspTail;
+        if (Tail >= Ring->AreaLength || 0 != (Tail & 7))
+        {
+            Result = STATUS_INVALID_PARAMETER;
+            goto exit;
+        }
+        if (Head == Tail)
+            break;
+
+        SpanLength = Head < Tail ? Tail - Head : Ring->AreaLength - Head;
+
+        /*
+         * Copy the span out of the shared region before looking at it: the file
+         * system can rewrite a record at any time and must not be able to change
+         * one after it has been validated.
+         */
+        KeMemoryBarrier();
+        RtlCopyMemory(Ring->Stage, Ring->RspArea + Head, SpanLength);
+
+        /* trim the staged span at a wrap marker (zero len) */
+        WalkLength = 0;
+        while (WalkLength + sizeof(UINT32) <= SpanLength)
+        {
+            RecordLength = *(PUINT32)((PUINT8)Ring->Stage + WalkLength);
+            if (0 == RecordLength)
+                break;
+            WalkLength += FUSE_PROTO_ALIGN_SIZE(RecordLength);
+        }
+        if (WalkLength > SpanLength)
+            WalkLength = SpanLength; /* corrupt last record; rejected by transact */
+
+        if (0 != WalkLength)
+        {
+            OutputLength = 0;
+            Result = FuseInstanceTransact(Instance,
+                Ring->Stage, WalkLength,
+                0, &OutputLength,
+                DeviceObject, FileObject,
+                CancellableIrp,
+                TRUE);
+            if (!NT_SUCCESS(Result))
+                goto exit;
+        }
+
+        Head = Head < Tail ? Tail : 0;
+        Ring->RspHead = Head;
+        *(volatile UINT32 *)&Shared->RspHead = Head;
+    }
+
+    /* produce requests */
+    for (;;)
+    {
+        Head = *(volatile UINT32 *)&Shared->ReqHead;
+        Tail = Ring->ReqTail;
+        if (Head >= Ring->AreaLength || 0 != (Head & 7))
+        {
+            Result = STATUS_INVALID_PARAMETER;
+            goto exit;
+        }
+        WasEmpty = Head == Tail;
+
+        if (Head <= Tail)
+        {
+            SpanLength = Ring->AreaLength - Tail;
+            if (0 == Head && 0 != SpanLength)
+                SpanLength -= 8; /* the area must not fill up completely: full != empty */
+        }
+        else
+            SpanLength = Head - Tail - 8;
+
+        if (FUSE_PROTO_REQ_SIZEMIN > SpanLength)
+        {
+            if (Head <= Tail && 0 < Head)
+            {
+                /* wrap: mark the remainder of the area as padding and rewind */
+                if (sizeof(UINT32) <= Ring->AreaLength - Tail)
+                    *(volatile UINT32 *)(Ring->ReqArea + Tail) = 0;
+                KeMemoryBarrier();
+                Ring->ReqTail = 0;
+                *(volatile UINT32 *)&Shared->ReqTail = 0;
+                continue;
+            }
+            break;
+        }
+
+        OutputLength = SpanLength;
+        Result = FuseInstanceTransact(Instance,
+            0, 0,
+            Ring->Stage, &OutputLength,
+            DeviceObject, FileObject,
+            CancellableIrp,
+            TRUE);
+        if (!NT_SUCCESS(Result))
+            goto exit;
+
+        if (0 != OutputLength)
+        {
+            RtlCopyMemory(Ring->ReqArea + Tail, Ring->Stage, OutputLength);
+            KeMemoryBarrier();
+            NewTail = Tail + OutputLength;
+            if (Ring->AreaLength == NewTail)
+                NewTail = 0;
+            Ring->ReqTail = NewTail;
+            *(volatile UINT32 *)&Shared->ReqTail = NewTail;
+
+            /*
+             * Signal on the empty to non-empty transition. Also signal if the
+             * file system caught up to the old tail while records were being
+             * built: it may have seen an empty area and gone to sleep.
+             */
+            KeMemoryBarrier();
+            if (WasEmpty || Tail == *(volatile UINT32 *)&Shared->ReqHead)
+                KeSetEvent(Ring->Event, EVENT_INCREMENT, FALSE);
+        }
+
+        break;
+    }
+
+    Result = STATUS_SUCCESS;
+
+exit:
+    InterlockedExchange(&Ring->Busy, 0);
+
+    return Result;
+}
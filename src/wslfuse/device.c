@@ -409,6 +409,133 @@ static INT FileIoctlLxMount(
     return Error;
 }
 
+static INT FileIoctlMount(
+    FILE *File,
+    WSLFUSE_IOCTL_MOUNT_ARG *Arg)
+{
+    /*
+     * Combined mount handshake: create the WinFsp volume and optionally
+     * associate the Windows mount point and the WSL mount id in a single
+     * kernel transition. Mount-heavy workloads use this in place of the
+     * separate CREATEVOLUME/WINMOUNT/LXMOUNT ioctl sequence. An association
+     * is skipped when its input is empty ((UINT64)-1 for LxMountId), so
+     * callers that learn the Windows mount point or WSL mount id later can
+     * still perform those steps separately. On failure the file retains
+     * whatever state was already established; closing the file descriptor
+     * tears it down.
+     */
+
+    WSLFUSE_IOCTL_WINMOUNT_ARG WinMountArg;
+    WSLFUSE_IOCTL_LXMOUNT_ARG LxMountArg;
+    UINT64 LxMountId;
+    INT Error;
+
+    /* save inputs that overlap the output union */
+    RtlCopyMemory(WinMountArg.WinMountPoint, Arg->WinMountPoint,
+        sizeof WinMountArg.WinMountPoint);
+    LxMountId = Arg->LxMountId;
+
+    Error = FileIoctlCreateVolume(File, (WSLFUSE_IOCTL_CREATEVOLUME_ARG *)Arg);
+    if (0 != Error)
+        return Error;
+
+    if ('\0' != WinMountArg.WinMountPoint[0])
+    {
+        Error = FileIoctlWinMount(File, &WinMountArg);
+        if (0 != Error)
+            return Error;
+    }
+
+    if ((UINT64)-1LL != LxMountId)
+    {
+        RtlZeroMemory(&LxMountArg, sizeof LxMountArg);
+        LxMountArg.Operation = '+';
+        LxMountArg.VolumeId = Arg->VolumeId;
+        LxMountArg.LxMountId = LxMountId;
+        Error = FileIoctlLxMount(File, &LxMountArg);
+        if (0 != Error)
+            return Error;
+    }
+
+    RtlZeroMemory(Arg->WinMountPoint, sizeof Arg->WinMountPoint);
+    Arg->LxMountId = 0;
+
+    return 0;
+}
+
+static INT FileIoctlUnmount(
+    FILE *File,
+    WSLFUSE_IOCTL_UNMOUNT_ARG *Arg)
+{
+    /*
+     * Single-shot teardown: disassociate the WSL mount id and immediately
+     * release the owning file's Windows mount point and post DESTROY to the
+     * file system, without waiting for the daemon to close its file
+     * descriptor.
+     */
+
+    DEVICE *Device = File->Device;
+    MOUNT *Mount;
+    FILE *MountFile;
+    HANDLE WinMountHandle = 0;
+    INT Error;
+
+    ExAcquirePushLockExclusive(&Device->MountListLock);
+
+    if ((UINT64)-1LL == Arg->LxMountId)
+        Mount = File->Mount;
+    else
+    {
+        Mount = 0;
+        for (PLIST_ENTRY Entry = Device->MountList.Flink; &Device->MountList != Entry;)
+        {
+            MOUNT *Temp = CONTAINING_RECORD(Entry, MOUNT, ListEntry);
+            Entry = Entry->Flink;
+            if (Temp->LxMountId == Arg->LxMountId)
+            {
+                Mount = Temp;
+                break;
+            }
+        }
+    }
+
+    if (0 == Mount || (UINT64)-1LL == Mount->LxMountId)
+    {
+        Error = -ENOENT;
+        goto exit;
+    }
+
+    MountFile = Mount->File;
+
+    RemoveEntryList(&Mount->ListEntry);
+    Mount->LxMountId = (UINT64)-1LL;
+    MountDereference(Mount);
+
+    if (0 != MountFile)
+    {
+        /* a non-0 Mount->File cannot complete FileDelete while we hold the
+        MountListLock, so the file is safe to access here */
+        ExAcquirePushLockExclusive(&MountFile->VolumeLock);
+        WinMountHandle = MountFile->WinMountHandle;
+        MountFile->WinMountHandle = 0;
+        ExReleasePushLockExclusive(&MountFile->VolumeLock);
+
+        if (0 != InterlockedCompareExchangePointer(&MountFile->VolumeFileObject, 0, 0))
+            FuseProtoPostDestroy(MountFile->FuseInstance);
+                /* ignore errors */
+    }
+
+    Error = 0;
+
+exit:
+    ExReleasePushLockExclusive(&Device->MountListLock);
+
+    if (0 != WinMountHandle)
+        ZwClose(WinMountHandle);
+
+    return Error;
+}
+
 static INT FileIoctlBegin(
     ULONG Code,
     PVOID Buffer,
@@ -519,6 +646,14 @@ static INT FileIoctl(
         IoctlProc = FileIoctlLxMount;
         break;
 
+    case WSLFUSE_IOCTL_MOUNT:
+        IoctlProc = FileIoctlMount;
+        break;
+
+    case WSLFUSE_IOCTL_UNMOUNT:
+        IoctlProc = FileIoctlUnmount;
+        break;
+
     default:
         return -EINVAL;
     }
@@ -552,12 +687,18 @@ static INT FileRead(
 
     for (;;)
     {
+        /*
+         * Use batched mode: pack as many FUSE_PROTO_REQ records as fit in the
+         * reader's buffer (at 8-byte boundaries), so that a daemon under load
+         * drains the backlog with a single read(2) per batch.
+         */
         OutputBufferLength = (ULONG)Length;
         Result = FuseInstanceTransact(File->FuseInstance,
             0, 0,
             Buffer, &OutputBufferLength,
             0, VolumeFileObject,
-            0);
+            0,
+            TRUE);
         if (!NT_SUCCESS(Result))
             return STATUS_CANCELLED == Result ? -ENODEV : -EIO;
         if (0 != OutputBufferLength)
@@ -616,6 +757,15 @@ static INT FileWriteVector(
 
         if (sizeof(FUSE_PROTO_RSP) < InputBufferLength)
         {
+            /*
+             * Large responses are always staged into a private kernel buffer.
+             * Locking the caller's pages for read access does not write-protect
+             * them, so a mapped response remains mutable through the daemon's
+             * user VA while the op handlers re-read length fields from it after
+             * validation: a double-fetch hazard. The transact ring avoids it
+             * the same way (see winfuse/ring.c); like /dev/fuse writev, this
+             * path keeps one copy.
+             */
             P = FuseAlloc(InputBufferLength);
             if (0 == P)
             {
@@ -646,7 +796,8 @@ static INT FileWriteVector(
         FuseResponse, InputBufferLength,
         0, &OutputBufferLength,
         0, VolumeFileObject,
-        0);
+        0,
+        FALSE);
     if (!NT_SUCCESS(Result))
     {
         Error = STATUS_CANCELLED == Result ? -ENODEV : -EIO;
@@ -766,29 +917,51 @@ static INT DeviceDelete(
     return 0;
 }
 
+/*
+ * Open files are indexed by VolumeId in a hash table with per-bucket locking,
+ * so that volume lookup, mount/unmount and the expiration pass do not contend
+ * on a single global lock.
+ */
+#define FUSE_MISC_BUCKET_COUNT          61
+
+typedef struct _FUSE_MISC_BUCKET
+{
+    EX_PUSH_LOCK Lock;
+    LIST_ENTRY List;
+} FUSE_MISC_BUCKET;
+
 static EX_PUSH_LOCK FuseMiscLock;
-static LIST_ENTRY FuseMiscFileList;
+static FUSE_MISC_BUCKET FuseMiscFileBuckets[FUSE_MISC_BUCKET_COUNT];
 static KTIMER FuseMiscTimer;
 static KDPC FuseMiscTimerDpc;
 static WORK_QUEUE_ITEM FuseMiscTimerItem;
 static BOOLEAN FuseMiscTimerInitDone;
 
+static inline FUSE_MISC_BUCKET *FuseMiscFileBucket(UINT64 VolumeId)
+{
+    return &FuseMiscFileBuckets[VolumeId % FUSE_MISC_BUCKET_COUNT];
+}
+
 static VOID FuseMiscFileListInsert(FILE *File)
 {
-    ExAcquirePushLockExclusive(&FuseMiscLock);
+    FUSE_MISC_BUCKET *Bucket = FuseMiscFileBucket(File->VolumeId);
 
-    InsertTailList(&FuseMiscFileList, &File->ListEntry);
+    ExAcquirePushLockExclusive(&Bucket->Lock);
 
-    ExReleasePushLockExclusive(&FuseMiscLock);
+    InsertTailList(&Bucket->List, &File->ListEntry);
+
+    ExReleasePushLockExclusive(&Bucket->Lock);
 }
 
 static VOID FuseMiscFileListRemove(FILE *File)
 {
-    ExAcquirePushLockExclusive(&FuseMiscLock);
+    FUSE_MISC_BUCKET *Bucket = FuseMiscFileBucket(File->VolumeId);
+
+    ExAcquirePushLockExclusive(&Bucket->Lock);
 
     RemoveEntryList(&File->ListEntry);
 
-    ExReleasePushLockExclusive(&FuseMiscLock);
+    ExReleasePushLockExclusive(&Bucket->Lock);
 }
 
 static MOUNT *FuseMiscFileListGetMount(DEVICE *Device, UINT64 VolumeId)
@@ -798,13 +971,14 @@ static MOUNT *FuseMiscFileListGetMount(DEVICE *Device, UINT64 VolumeId)
      * acquired.
      */
 
+    FUSE_MISC_BUCKET *Bucket = FuseMiscFileBucket(VolumeId);
     FILE *File;
     MOUNT *Mount;
 
-    ExAcquirePushLockShared(&FuseMiscLock);
+    ExAcquirePushLockShared(&Bucket->Lock);
 
     Mount = 0;
-    for (PLIST_ENTRY Entry = FuseMiscFileList.Flink; &FuseMiscFileList != Entry;)
+    for (PLIST_ENTRY Entry = Bucket->List.Flink; &Bucket->List != Entry;)
     {
         File = CONTAINING_RECORD(Entry, FILE, ListEntry);
         Entry = Entry->Flink;
@@ -815,28 +989,35 @@ static MOUNT *FuseMiscFileListGetMount(DEVICE *Device, UINT64 VolumeId)
         }
     }
 
-    ExReleasePushLockShared(&FuseMiscLock);
+    ExReleasePushLockShared(&Bucket->Lock);
 
     return Mount;
 }
 
 static VOID FuseMiscExpirationRoutine(PVOID Context)
 {
+    FUSE_MISC_BUCKET *Bucket;
     UINT64 InterruptTime;
     FILE *File;
 
     InterruptTime = KeQueryInterruptTime();
 
-    ExAcquirePushLockShared(&FuseMiscLock);
-
-    for (PLIST_ENTRY Entry = FuseMiscFileList.Flink; &FuseMiscFileList != Entry;)
+    /* expire one bucket at a time: mount/unmount activity on other buckets proceeds */
+    for (ULONG Index = 0; FUSE_MISC_BUCKET_COUNT > Index; Index++)
     {
-        File = CONTAINING_RECORD(Entry, FILE, ListEntry);
-        Entry = Entry->Flink;
-        FuseInstanceExpirationRoutine(File->FuseInstance, InterruptTime);
-    }
+        Bucket = &FuseMiscFileBuckets[Index];
+
+        ExAcquirePushLockShared(&Bucket->Lock);
+
+        for (PLIST_ENTRY Entry = Bucket->List.Flink; &Bucket->List != Entry;)
+        {
+            File = CONTAINING_RECORD(Entry, FILE, ListEntry);
+            Entry = Entry->Flink;
+            FuseInstanceExpirationRoutine(File->FuseInstance, InterruptTime);
+        }
 
-    ExReleasePushLockShared(&FuseMiscLock);
+        ExReleasePushLockShared(&Bucket->Lock);
+    }
 }
 
 static VOID FuseMiscTimerDpcRoutine(PKDPC Dpc,
@@ -907,5 +1088,9 @@ exit:
 VOID FuseMiscInitialize(VOID)
 {
     ExInitializePushLock(&FuseMiscLock);
-    InitializeListHead(&FuseMiscFileList);
+    for (ULONG Index = 0; FUSE_MISC_BUCKET_COUNT > Index; Index++)
+    {
+        ExInitializePushLock(&FuseMiscFileBuckets[Index].Lock);
+        InitializeListHead(&FuseMiscFileBuckets[Index].List);
+    }
 }
@@ -36,6 +36,10 @@ NTSTATUS DriverEntry(
         DbgBreakPoint();
 #endif
 
+    FuseContextInitialize();
+
+    FuseTraceInitialize();
+
     FuseMiscInitialize();
 
     return LxldrRegisterService(DriverObject, TRUE, FuseMiscRegister);
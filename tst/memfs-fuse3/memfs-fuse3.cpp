@@ -25,6 +25,7 @@
 #include <algorithm>
 #include <memory>
 #include <mutex>
+#include <shared_mutex>
 #include <string>
 #include <unordered_map>
 #include <vector>
@@ -99,27 +100,51 @@ private:
             stat.st_atim = stat.st_mtim = stat.st_ctim = now();
         }
 
-        void resize(size_t size, bool capacity)
+        // File content is stored in fixed size chunks so that appends to large
+        // files allocate one chunk instead of reallocating and copying the
+        // whole content.
+        static constexpr size_t chunksize = 64 * 1024;
+
+        void resize(size_t size)
+        {
+            size_t newcnt = (size + chunksize - 1) / chunksize;
+            if (newcnt < chunks.size())
+                chunks.resize(newcnt);
+            else
+                while (chunks.size() < newcnt)
+                    chunks.emplace_back(new uint8_t[chunksize]());
+            if (size < static_cast<size_t>(stat.st_size) && 0 != size % chunksize)
+                // zero the tail of the last chunk so that a later grow exposes zeroes
+                std::memset(chunks.back().get() + size % chunksize, 0,
+                    chunksize - size % chunksize);
+            stat.st_size = size;
+        }
+
+        void read_data(char *buf, size_t off, size_t size)
         {
-            if (capacity)
+            for (size_t i = 0; size > i;)
             {
-                const size_t unit = 64 * 1024;
-                size_t newcap = (size + unit - 1) / unit * unit;
-                size_t oldcap = data.capacity();
-                if (newcap > oldcap)
-                    data.reserve(newcap);
-                else if (newcap < oldcap)
-                {
-                    data.resize(newcap);
-                    data.shrink_to_fit();
-                }
+                size_t n = (std::min)(chunksize - (off + i) % chunksize, size - i);
+                std::memcpy(buf + i,
+                    chunks[(off + i) / chunksize].get() + (off + i) % chunksize, n);
+                i += n;
+            }
+        }
+
+        void write_data(const char *buf, size_t off, size_t size)
+        {
+            for (size_t i = 0; size > i;)
+            {
+                size_t n = (std::min)(chunksize - (off + i) % chunksize, size - i);
+                std::memcpy(chunks[(off + i) / chunksize].get() + (off + i) % chunksize,
+                    buf + i, n);
+                i += n;
             }
-            data.resize(size);
-            stat.st_size = size;
         }
 
         struct fuse_stat stat;
-        std::vector<uint8_t> data;
+        std::shared_mutex mutex;
+        std::vector<std::unique_ptr<uint8_t[]>> chunks;
         std::unordered_map<std::string, std::shared_ptr<node_t>> childmap;
         std::unordered_map<std::string, std::vector<uint8_t>> xattrmap;
     };
@@ -146,10 +171,11 @@ private:
     static int getattr(const char *path, struct fuse_stat *stbuf, struct fuse_file_info *fi)
     {
         auto self = getself();
-        std::lock_guard<std::mutex> lock(self->_mutex);
+        std::shared_lock<std::shared_mutex> tree(self->_mutex);
         auto node = self->get_node(path, fi);
         if (!node)
             return -ENOENT;
+        std::shared_lock<std::shared_mutex> lock(node->mutex);
         *stbuf = node->stat;
         return 0;
     }
@@ -157,14 +183,15 @@ private:
     static int readlink(const char *path, char *buf, size_t size)
     {
         auto self = getself();
-        std::lock_guard<std::mutex> lock(self->_mutex);
+        std::shared_lock<std::shared_mutex> tree(self->_mutex);
         auto node = self->get_node(path);
         if (!node)
             return -ENOENT;
+        std::shared_lock<std::shared_mutex> lock(node->mutex);
         if (S_IFLNK != (node->stat.st_mode & S_IFMT))
             return EINVAL;
-        size = (std::min)(size - 1, node->data.size());
-        std::memcpy(buf, node->data.data(), size);
+        size = (std::min)(size - 1, static_cast<size_t>(node->stat.st_size));
+        node->read_data(buf, 0, size);
         buf[size] = '\0';
         return 0;
     }
@@ -172,42 +199,42 @@ private:
     static int mknod(const char *path, fuse_mode_t mode, fuse_dev_t dev)
     {
         auto self = getself();
-        std::lock_guard<std::mutex> lock(self->_mutex);
+        std::lock_guard<std::shared_mutex> tree(self->_mutex);
         return self->make_node(path, mode, dev);
     }
 
     static int mkdir(const char *path, fuse_mode_t mode)
     {
         auto self = getself();
-        std::lock_guard<std::mutex> lock(self->_mutex);
+        std::lock_guard<std::shared_mutex> tree(self->_mutex);
         return self->make_node(path, S_IFDIR | (mode & 07777), 0);
     }
 
     static int unlink(const char *path)
     {
         auto self = getself();
-        std::lock_guard<std::mutex> lock(self->_mutex);
+        std::lock_guard<std::shared_mutex> tree(self->_mutex);
         return self->remove_node(path, false);
     }
 
     static int rmdir(const char *path)
     {
         auto self = getself();
-        std::lock_guard<std::mutex> lock(self->_mutex);
+        std::lock_guard<std::shared_mutex> tree(self->_mutex);
         return self->remove_node(path, true);
     }
 
     static int symlink(const char *dstpath, const char *srcpath)
     {
         auto self = getself();
-        std::lock_guard<std::mutex> lock(self->_mutex);
+        std::lock_guard<std::shared_mutex> tree(self->_mutex);
         return self->make_node(srcpath, S_IFLNK | 00777, 0, dstpath);
     }
 
     static int rename(const char *oldpath, const char *newpath, unsigned int flags)
     {
         auto self = getself();
-        std::lock_guard<std::mutex> lock(self->_mutex);
+        std::lock_guard<std::shared_mutex> tree(self->_mutex);
         auto oldlookup = self->lookup_node(oldpath);
         auto oldprnt = std::get<0>(oldlookup);
         auto oldname = std::get<1>(oldlookup);
@@ -238,7 +265,7 @@ private:
     static int link(const char *oldpath, const char *newpath)
     {
         auto self = getself();
-        std::lock_guard<std::mutex> lock(self->_mutex);
+        std::lock_guard<std::shared_mutex> tree(self->_mutex);
         auto oldlookup = self->lookup_node(oldpath);
         auto oldnode = std::get<2>(oldlookup);
         if (!oldnode)
@@ -261,10 +288,11 @@ private:
         struct fuse_file_info *fi)
     {
         auto self = getself();
-        std::lock_guard<std::mutex> lock(self->_mutex);
+        std::shared_lock<std::shared_mutex> tree(self->_mutex);
         auto node = self->get_node(path, fi);
         if (!node)
             return -ENOENT;
+        std::lock_guard<std::shared_mutex> lock(node->mutex);
         node->stat.st_mode = (node->stat.st_mode & S_IFMT) | (mode & 07777);
         node->stat.st_ctim = now();
         return 0;
@@ -274,10 +302,11 @@ private:
         struct fuse_file_info *fi)
     {
         auto self = getself();
-        std::lock_guard<std::mutex> lock(self->_mutex);
+        std::shared_lock<std::shared_mutex> tree(self->_mutex);
         auto node = self->get_node(path, fi);
         if (!node)
             return -ENOENT;
+        std::lock_guard<std::shared_mutex> lock(node->mutex);
         if (-1 != uid)
             node->stat.st_uid = uid;
         if (-1 != gid)
@@ -290,13 +319,14 @@ private:
         struct fuse_file_info *fi)
     {
         auto self = getself();
-        std::lock_guard<std::mutex> lock(self->_mutex);
+        std::shared_lock<std::shared_mutex> tree(self->_mutex);
         auto node = self->get_node(path, fi);
         if (!node)
             return -ENOENT;
         if (SIZE_MAX < size)
             return -EFBIG;
-        node->resize(static_cast<size_t>(size), true);
+        std::lock_guard<std::shared_mutex> lock(node->mutex);
+        node->resize(static_cast<size_t>(size));
         node->stat.st_ctim = node->stat.st_mtim = now();
         return 0;
     }
@@ -304,7 +334,7 @@ private:
     static int open(const char *path, struct fuse_file_info *fi)
     {
         auto self = getself();
-        std::lock_guard<std::mutex> lock(self->_mutex);
+        std::shared_lock<std::shared_mutex> tree(self->_mutex);
         return self->open_node(path, false, fi);
     }
 
@@ -312,16 +342,25 @@ private:
         struct fuse_file_info *fi)
     {
         auto self = getself();
-        std::lock_guard<std::mutex> lock(self->_mutex);
+        std::shared_lock<std::shared_mutex> tree(self->_mutex);
         auto node = self->get_node(path, fi);
         if (!node)
             return -ENOENT;
-        fuse_off_t endoff = (std::min)(
-            off + static_cast<fuse_off_t>(size), static_cast<fuse_off_t>(node->data.size()));
-        if (off > endoff)
-            return 0;
-        std::memcpy(buf, node->data.data() + off, static_cast<int>(endoff - off));
-        node->stat.st_atim = now();
+        fuse_off_t endoff;
+        {
+            std::shared_lock<std::shared_mutex> lock(node->mutex);
+            endoff = (std::min)(
+                off + static_cast<fuse_off_t>(size), static_cast<fuse_off_t>(node->stat.st_size));
+            if (off > endoff)
+                return 0;
+            node->read_data(buf, static_cast<size_t>(off), static_cast<size_t>(endoff - off));
+        }
+        {
+            // reacquire exclusive for the atime update so that reads of the same
+            // file proceed in parallel
+            std::lock_guard<std::shared_mutex> lock(node->mutex);
+            node->stat.st_atim = now();
+        }
         return static_cast<int>(endoff - off);
     }
 
@@ -329,16 +368,17 @@ private:
         struct fuse_file_info *fi)
     {
         auto self = getself();
-        std::lock_guard<std::mutex> lock(self->_mutex);
+        std::shared_lock<std::shared_mutex> tree(self->_mutex);
         auto node = self->get_node(path, fi);
         if (!node)
             return -ENOENT;
         fuse_off_t endoff = off + static_cast<fuse_off_t>(size);
         if (SIZE_MAX < endoff)
             return -EFBIG;
-        if (node->data.size() < endoff)
-            node->resize(static_cast<size_t>(endoff), true);
-        std::memcpy(node->data.data() + off, buf, static_cast<int>(endoff - off));
+        std::lock_guard<std::shared_mutex> lock(node->mutex);
+        if (node->stat.st_size < endoff)
+            node->resize(static_cast<size_t>(endoff));
+        node->write_data(buf, static_cast<size_t>(off), static_cast<size_t>(endoff - off));
         node->stat.st_ctim = node->stat.st_mtim = now();
         return static_cast<int>(endoff - off);
     }
@@ -357,7 +397,7 @@ private:
     static int release(const char *path, struct fuse_file_info *fi)
     {
         auto self = getself();
-        std::lock_guard<std::mutex> lock(self->_mutex);
+        // dropping the shared_ptr is thread safe; no locking needed
         return self->close_node(fi);
     }
 
@@ -365,13 +405,14 @@ private:
         int flags)
     {
         auto self = getself();
-        std::lock_guard<std::mutex> lock(self->_mutex);
+        std::shared_lock<std::shared_mutex> tree(self->_mutex);
         auto node = self->get_node(path);
         if (!node)
             return -ENOENT;
         if (0 == std::strcmp("com.apple.ResourceFork", name0))
             return -ENOTSUP;
         std::string name = name0;
+        std::lock_guard<std::shared_mutex> lock(node->mutex);
         if (XATTR_CREATE == flags)
         {
             if (node->xattrmap.end() != node->xattrmap.find(name))
@@ -389,13 +430,14 @@ private:
     static int getxattr(const char *path, const char *name0, char *value, size_t size)
     {
         auto self = getself();
-        std::lock_guard<std::mutex> lock(self->_mutex);
+        std::shared_lock<std::shared_mutex> tree(self->_mutex);
         auto node = self->get_node(path);
         if (!node)
             return -ENOENT;
         if (0 == std::strcmp("com.apple.ResourceFork", name0))
             return -ENOTSUP;
         std::string name = name0;
+        std::shared_lock<std::shared_mutex> lock(node->mutex);
         auto iter = node->xattrmap.find(name);
         if (node->xattrmap.end() == iter)
             return -ENOATTR;
@@ -411,10 +453,11 @@ private:
     static int listxattr(const char *path, char *namebuf, size_t size)
     {
         auto self = getself();
-        std::lock_guard<std::mutex> lock(self->_mutex);
+        std::shared_lock<std::shared_mutex> tree(self->_mutex);
         auto node = self->get_node(path);
         if (!node)
             return -ENOENT;
+        std::shared_lock<std::shared_mutex> lock(node->mutex);
         size_t copysize = 0;
         for (auto elem : node->xattrmap)
         {
@@ -433,20 +476,21 @@ private:
     static int removexattr(const char *path, const char *name0)
     {
         auto self = getself();
-        std::lock_guard<std::mutex> lock(self->_mutex);
+        std::shared_lock<std::shared_mutex> tree(self->_mutex);
         auto node = self->get_node(path);
         if (!node)
             return -ENOENT;
         if (0 == std::strcmp("com.apple.ResourceFork", name0))
             return -ENOTSUP;
         std::string name = name0;
+        std::lock_guard<std::shared_mutex> lock(node->mutex);
         return node->xattrmap.erase(name) ? 0 : -ENOATTR;
     }
 
     static int opendir(const char *path, struct fuse_file_info *fi)
     {
         auto self = getself();
-        std::lock_guard<std::mutex> lock(self->_mutex);
+        std::shared_lock<std::shared_mutex> tree(self->_mutex);
         return self->open_node(path, true, fi);
     }
 
@@ -454,22 +498,28 @@ private:
         struct fuse_file_info *fi, enum fuse_readdir_flags)
     {
         auto self = getself();
-        std::lock_guard<std::mutex> lock(self->_mutex);
+        std::shared_lock<std::shared_mutex> tree(self->_mutex);
         auto node = self->get_node(path, fi);
         if (!node)
             return -ENOENT;
-        filler(buf, ".", &node->stat, 0, FUSE_FILL_DIR_PLUS);
+        {
+            std::shared_lock<std::shared_mutex> lock(node->mutex);
+            filler(buf, ".", &node->stat, 0, FUSE_FILL_DIR_PLUS);
+        }
         filler(buf, "..", nullptr, 0, FUSE_FILL_DIR_PLUS);
         for (auto elem : node->childmap)
+        {
+            std::shared_lock<std::shared_mutex> lock(elem.second->mutex);
             if (0 != filler(buf, elem.first.c_str(), &elem.second->stat, 0, FUSE_FILL_DIR_PLUS))
                 break;
+        }
         return 0;
     }
 
     static int releasedir(const char *path, struct fuse_file_info *fi)
     {
         auto self = getself();
-        std::lock_guard<std::mutex> lock(self->_mutex);
+        // dropping the shared_ptr is thread safe; no locking needed
         return self->close_node(fi);
     }
 
@@ -484,10 +534,11 @@ private:
         struct fuse_file_info *fi)
     {
         auto self = getself();
-        std::lock_guard<std::mutex> lock(self->_mutex);
+        std::shared_lock<std::shared_mutex> tree(self->_mutex);
         auto node = self->get_node(path, fi);
         if (!node)
             return -ENOENT;
+        std::lock_guard<std::shared_mutex> lock(node->mutex);
         if (tmsp)
         {
             node->stat.st_ctim = now();
@@ -548,8 +599,9 @@ private:
         node = std::make_shared<node_t>(++_ino, mode, context->uid, context->gid, dev);
         if (data)
         {
-            node->resize(std::strlen(data), false);
-            std::memcpy(node->data.data(), data, node->data.size());
+            size_t datasize = std::strlen(data);
+            node->resize(datasize);
+            node->write_data(data, 0, datasize);
         }
         prnt->childmap[name] = node;
         prnt->stat.st_ctim = prnt->stat.st_mtim = node->stat.st_ctim;
@@ -608,7 +660,11 @@ private:
     }
 
 private:
-    std::mutex _mutex;
+    // Locking discipline: _mutex guards the namespace (childmap contents and
+    // path lookups) and is taken shared by operations that only resolve paths
+    // and exclusive by operations that mutate the namespace; node_t::mutex
+    // guards a node's stat, data and xattrmap and is always taken after _mutex.
+    std::shared_mutex _mutex;
     fuse_ino_t _ino;
     std::shared_ptr<node_t> _root;
 };
@@ -0,0 +1,560 @@
+/**
+ * @file fuseperf.c
+ *
+ * @copyright 2019-2020 Bill Zissimopoulos
+ */
+/*
+ * This file is part of WinFuse.
+ *
+ * You can redistribute it and/or modify it under the terms of the GNU
+ * Affero General Public License version 3 as published by the Free
+ * Software Foundation.
+ *
+ * Licensees holding a valid commercial license may use this software
+ * in accordance with the commercial license agreement provided in
+ * conjunction with the software.  The terms and conditions of any such
+ * commercial license agreement shall govern, supersede, and render
+ * ineffective any application of the AGPLv3 license to this software,
+ * notwithstanding of any reference thereto in the software or
+ * associated repository.
+ */
+
+/*
+ * fuseperf: drive a mounted volume with parameterized workloads and report
+ * ops/sec and latency percentiles in machine readable (CSV) form:
+ *
+ *     workload,threads,depth,ops,secs,ops_per_sec,p50_us,p90_us,p99_us,max_us
+ *
+ * Workloads:
+ *
+ *     metadata    open/stat/close over count files
+ *     seqwr/seqrd sequential data I/O at the configured queue depth
+ *     rndwr/rndrd random data I/O at the configured queue depth
+ *     enum        full directory enumerations of a count-file directory
+ *
+ * Usage:
+ *
+ *     fuseperf -d DIR [-w WORKLOAD[,WORKLOAD...]] [-t THREADS[,THREADS...]]
+ *         [-n COUNT] [-b BLOCKSIZE] [-s FILESIZE] [-q DEPTH]
+ *
+ * DIR must reside on the volume under test. A comma separated thread list
+ * runs the same workloads at each concurrency level (scaling sweep).
+ */
+
+#include <windows.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strsafe.h>
+
+#define PERF_MAXTHREADS                 64
+#define PERF_MAXDEPTH                   64
+
+typedef struct
+{
+    PWSTR Dir;
+    ULONG Count;                        /* files (metadata, enum) or ops per thread (data I/O) */
+    ULONG BlockSize;
+    UINT64 FileSize;
+    ULONG Threads;
+    ULONG Depth;
+} PERF_PARAMS;
+
+typedef struct
+{
+    PERF_PARAMS *Params;
+    ULONG ThreadIndex;
+    int (*Workload)(void *);
+    HANDLE Thread;
+    double *Latencies;                  /* microseconds */
+    ULONG LatencyCount;
+    int Result;
+} PERF_WORKER;
+
+static UINT64 perf_frequency;
+
+static void perf_init_clock(void)
+{
+    LARGE_INTEGER Frequency;
+    QueryPerformanceFrequency(&Frequency);
+    perf_frequency = Frequency.QuadPart;
+}
+
+static UINT64 perf_clock(void)
+{
+    LARGE_INTEGER Counter;
+    QueryPerformanceCounter(&Counter);
+    return Counter.QuadPart;
+}
+
+static double perf_usec(UINT64 Start, UINT64 End)
+{
+    return (double)(End - Start) * 1000000.0 / (double)perf_frequency;
+}
+
+static int perf_latcmp(const void *x, const void *y)
+{
+    double a = *(const double *)x, b = *(const double *)y;
+    return a < b ? -1 : a > b ? +1 : 0;
+}
+
+static void perf_report(const char *Workload, PERF_PARAMS *Params,
+    double *Latencies, ULONG LatencyCount, double Seconds)
+{
+    double P50 = 0, P90 = 0, P99 = 0, Max = 0;
+
+    if (0 != LatencyCount)
+    {
+        qsort(Latencies, LatencyCount, sizeof Latencies[0], perf_latcmp);
+        P50 = Latencies[LatencyCount * 50 / 100];
+        P90 = Latencies[LatencyCount * 90 / 100 == LatencyCount ?
+            LatencyCount - 1 : LatencyCount * 90 / 100];
+        P99 = Latencies[LatencyCount * 99 / 100 == LatencyCount ?
+            LatencyCount - 1 : LatencyCount * 99 / 100];
+        Max = Latencies[LatencyCount - 1];
+    }
+
+    printf("%s,%lu,%lu,%lu,%.3f,%.0f,%.1f,%.1f,%.1f,%.1f\n",
+        Workload,
+        (unsigned long)Params->Threads, (unsigned long)Params->Depth,
+        (unsigned long)LatencyCount, Seconds,
+        0 != Seconds ? LatencyCount / Seconds : 0,
+        P50, P90, P99, Max);
+    fflush(stdout);
+}
+
+static void perf_file_name(PERF_PARAMS *Params, ULONG ThreadIndex, ULONG FileIndex,
+    PWSTR FileName, size_t FileNameSize)
+{
+    StringCbPrintfW(FileName, FileNameSize, L"%s\\fuseperf-%lu-%lu",
+        Params->Dir, (unsigned long)ThreadIndex, (unsigned long)FileIndex);
+}
+
+/* metadata: open/stat/close over count files (files created/deleted untimed) */
+
+static int perf_metadata_workload(void *Worker0)
+{
+    PERF_WORKER *Worker = Worker0;
+    PERF_PARAMS *Params = Worker->Params;
+    WCHAR FileName[MAX_PATH];
+    HANDLE Handle;
+    BY_HANDLE_FILE_INFORMATION FileInfo;
+    UINT64 Start;
+
+    for (ULONG I = 0; Params->Count > I; I++)
+    {
+        perf_file_name(Params, Worker->ThreadIndex, I, FileName, sizeof FileName);
+        Handle = CreateFileW(FileName,
+            GENERIC_WRITE, 0, 0, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, 0);
+        if (INVALID_HANDLE_VALUE == Handle)
+            return GetLastError();
+        CloseHandle(Handle);
+    }
+
+    for (ULONG I = 0; Params->Count > I; I++)
+    {
+        perf_file_name(Params, Worker->ThreadIndex, I, FileName, sizeof FileName);
+        Start = perf_clock();
+        Handle = CreateFileW(FileName,
+            FILE_READ_ATTRIBUTES, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+        if (INVALID_HANDLE_VALUE == Handle)
+            return GetLastError();
+        if (!GetFileInformationByHandle(Handle, &FileInfo))
+        {
+            CloseHandle(Handle);
+            return GetLastError();
+        }
+        CloseHandle(Handle);
+        Worker->Latencies[Worker->LatencyCount++] = perf_usec(Start, perf_clock());
+    }
+
+    for (ULONG I = 0; Params->Count > I; I++)
+    {
+        perf_file_name(Params, Worker->ThreadIndex, I, FileName, sizeof FileName);
+        DeleteFileW(FileName);
+    }
+
+    return 0;
+}
+
+/* data I/O: count block ops per thread at the configured queue depth */
+
+static int perf_data_workload(PERF_WORKER *Worker, BOOLEAN Write, BOOLEAN Random)
+{
+    PERF_PARAMS *Params = Worker->Params;
+    WCHAR FileName[MAX_PATH];
+    HANDLE Handle = INVALID_HANDLE_VALUE;
+    PUINT8 Block = 0;
+    OVERLAPPED Overlapped[PERF_MAXDEPTH];
+    HANDLE Events[PERF_MAXDEPTH];
+    UINT64 IssueTime[PERF_MAXDEPTH];
+    UINT64 BlockCount = Params->FileSize / Params->BlockSize;
+    UINT64 Offset;
+    ULONG Seed = 1 + Worker->ThreadIndex;
+    ULONG Outstanding = 0, Slot;
+    DWORD BytesTransferred, WaitResult;
+    int Result = 0;
+
+    memset(Overlapped, 0, sizeof Overlapped);
+    memset(Events, 0, sizeof Events);
+
+    Block = _aligned_malloc(Params->BlockSize, 4096);
+    if (0 == Block)
+        return ERROR_NOT_ENOUGH_MEMORY;
+    memset(Block, 0x5a, Params->BlockSize);
+
+    perf_file_name(Params, Worker->ThreadIndex, 0, FileName, sizeof FileName);
+    Handle = CreateFileW(FileName,
+        GENERIC_READ | GENERIC_WRITE, 0, 0, CREATE_ALWAYS,
+        FILE_ATTRIBUTE_NORMAL | FILE_FLAG_OVERLAPPED, 0);
+    if (INVALID_HANDLE_VALUE == Handle)
+    {
+        Result = GetLastError();
+        goto exit;
+    }
+
+    if (!Write)
+    {
+        /* reads need content; write the file untimed first */
+        for (UINT64 I = 0; BlockCount > I; I++)
+        {
+            OVERLAPPED Sync;
+            memset(&Sync, 0, sizeof Sync);
+            Sync.Offset = (DWORD)(I * Params->BlockSize);
+            Sync.OffsetHigh = (DWORD)((I * Params->BlockSize) >> 32);
+            if (!WriteFile(Handle, Block, Params->BlockSize, 0, &Sync) &&
+                ERROR_IO_PENDING != GetLastError())
+            {
+                Result = GetLastError();
+                goto exit;
+            }
+            if (!GetOverlappedResult(Handle, &Sync, &BytesTransferred, TRUE))
+            {
+                Result = GetLastError();
+                goto exit;
+            }
+        }
+    }
+
+    for (ULONG I = 0; Params->Depth > I; I++)
+    {
+        Events[I] = CreateEventW(0, TRUE, FALSE, 0);
+        if (0 == Events[I])
+        {
+            Result = GetLastError();
+            goto exit;
+        }
+    }
+
+    for (ULONG I = 0; Params->Count > I + Outstanding;)
+    {
+        if (Params->Depth > Outstanding && Params->Count > I + Outstanding)
+        {
+            Slot = 0;
+            while (0 != Overlapped[Slot].hEvent)
+                Slot++;
+
+            if (Random)
+            {
+                /* xorshift PRNG: reproducible offsets across runs */
+                Seed ^= Seed << 13; Seed ^= Seed >> 17; Seed ^= Seed << 5;
+                Offset = Seed % BlockCount * Params->BlockSize;
+            }
+            else
+                Offset = (I + Outstanding) % BlockCount * Params->BlockSize;
+
+            memset(&Overlapped[Slot], 0, sizeof Overlapped[Slot]);
+            Overlapped[Slot].Offset = (DWORD)Offset;
+            Overlapped[Slot].OffsetHigh = (DWORD)(Offset >> 32);
+            Overlapped[Slot].hEvent = Events[Slot];
+            ResetEvent(Events[Slot]);
+            IssueTime[Slot] = perf_clock();
+
+            if (!(Write ?
+                WriteFile(Handle, Block, Params->BlockSize, 0, &Overlapped[Slot]) :
+                ReadFile(Handle, Block, Params->BlockSize, 0, &Overlapped[Slot])) &&
+                ERROR_IO_PENDING != GetLastError())
+            {
+                Result = GetLastError();
+                goto exit;
+            }
+            Outstanding++;
+            continue;
+        }
+
+        WaitResult = WaitForMultipleObjects(Params->Depth, Events, FALSE, INFINITE);
+        if (WaitResult >= WAIT_OBJECT_0 + Params->Depth)
+        {
+            Result = GetLastError();
+            goto exit;
+        }
+        Slot = WaitResult - WAIT_OBJECT_0;
+        if (!GetOverlappedResult(Handle, &Overlapped[Slot], &BytesTransferred, FALSE))
+        {
+            Result = GetLastError();
+            goto exit;
+        }
+        Worker->Latencies[Worker->LatencyCount++] = perf_usec(IssueTime[Slot], perf_clock());
+        ResetEvent(Events[Slot]);
+            /* a free slot's event must not remain signaled */
+        Overlapped[Slot].hEvent = 0;
+        Outstanding--;
+        I++;
+    }
+
+    while (0 != Outstanding)
+    {
+        WaitResult = WaitForMultipleObjects(Params->Depth, Events, FALSE, INFINITE);
+        Slot = WaitResult - WAIT_OBJECT_0;
+        if (PERF_MAXDEPTH <= Slot || 0 == Overlapped[Slot].hEvent)
+            break;
+        GetOverlappedResult(Handle, &Overlapped[Slot], &BytesTransferred, TRUE);
+        Worker->Latencies[Worker->LatencyCount++] = perf_usec(IssueTime[Slot], perf_clock());
+        ResetEvent(Events[Slot]);
+        Overlapped[Slot].hEvent = 0;
+        Outstanding--;
+    }
+
+exit:
+    for (ULONG I = 0; Params->Depth > I; I++)
+        if (0 != Events[I])
+            CloseHandle(Events[I]);
+    if (INVALID_HANDLE_VALUE != Handle)
+        CloseHandle(Handle);
+    if (0 != Block)
+        _aligned_free(Block);
+    perf_file_name(Params, Worker->ThreadIndex, 0, FileName, sizeof FileName);
+    DeleteFileW(FileName);
+
+    return Result;
+}
+
+static int perf_seqwr_workload(void *Worker)
+{
+    return perf_data_workload(Worker, TRUE, FALSE);
+}
+
+static int perf_seqrd_workload(void *Worker)
+{
+    return perf_data_workload(Worker, FALSE, FALSE);
+}
+
+static int perf_rndwr_workload(void *Worker)
+{
+    return perf_data_workload(Worker, TRUE, TRUE);
+}
+
+static int perf_rndrd_workload(void *Worker)
+{
+    return perf_data_workload(Worker, FALSE, TRUE);
+}
+
+/* enum: full enumerations of a directory populated with count files */
+
+#define PERF_ENUM_PASSES                10
+
+static int perf_enum_workload(void *Worker0)
+{
+    PERF_WORKER *Worker = Worker0;
+    PERF_PARAMS *Params = Worker->Params;
+    WCHAR FileName[MAX_PATH];
+    WIN32_FIND_DATAW FindData;
+    HANDLE Handle, FindHandle;
+    UINT64 Start;
+
+    for (ULONG I = 0; Params->Count > I; I++)
+    {
+        perf_file_name(Params, Worker->ThreadIndex, I, FileName, sizeof FileName);
+        Handle = CreateFileW(FileName,
+            GENERIC_WRITE, 0, 0, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, 0);
+        if (INVALID_HANDLE_VALUE == Handle)
+            return GetLastError();
+        CloseHandle(Handle);
+    }
+
+    StringCbPrintfW(FileName, sizeof FileName, L"%s\\*", Params->Dir);
+    for (ULONG Pass = 0; PERF_ENUM_PASSES > Pass; Pass++)
+    {
+        Start = perf_clock();
+        FindHandle = FindFirstFileW(FileName, &FindData);
+        if (INVALID_HANDLE_VALUE == FindHandle)
+            return GetLastError();
+        while (FindNextFileW(FindHandle, &FindData))
+            ;
+        FindClose(FindHandle);
+        Worker->Latencies[Worker->LatencyCount++] = perf_usec(Start, perf_clock());
+    }
+
+    for (ULONG I = 0; Params->Count > I; I++)
+    {
+        perf_file_name(Params, Worker->ThreadIndex, I, FileName, sizeof FileName);
+        DeleteFileW(FileName);
+    }
+
+    return 0;
+}
+
+static DWORD WINAPI perf_thread(PVOID Worker0)
+{
+    PERF_WORKER *Worker = Worker0;
+    Worker->Result = Worker->Workload(Worker);
+    return 0;
+}
+
+static int perf_run(const char *Name, int (*Workload)(void *), PERF_PARAMS *Params,
+    ULONG LatenciesPerThread)
+{
+    PERF_WORKER Workers[PERF_MAXTHREADS];
+    double *Latencies = 0;
+    ULONG LatencyCount = 0;
+    UINT64 Start;
+    double Seconds;
+    int Result = 0;
+
+    memset(Workers, 0, sizeof Workers);
+
+    Latencies = malloc(sizeof(double) * LatenciesPerThread * Params->Threads);
+    if (0 == Latencies)
+        return ERROR_NOT_ENOUGH_MEMORY;
+
+    for (ULONG I = 0; Params->Threads > I; I++)
+    {
+        Workers[I].Params = Params;
+        Workers[I].ThreadIndex = I;
+        Workers[I].Workload = Workload;
+        Workers[I].Latencies = Latencies + (SIZE_T)LatenciesPerThread * I;
+    }
+
+    Start = perf_clock();
+    for (ULONG I = 0; Params->Threads > I; I++)
+    {
+        Workers[I].Thread = CreateThread(0, 0, perf_thread, &Workers[I], 0, 0);
+        if (0 == Workers[I].Thread)
+        {
+            Result = GetLastError();
+            Params->Threads = I;
+            break;
+        }
+    }
+    for (ULONG I = 0; Params->Threads > I; I++)
+    {
+        WaitForSingleObject(Workers[I].Thread, INFINITE);
+        CloseHandle(Workers[I].Thread);
+        if (0 == Result && 0 != Workers[I].Result)
+            Result = Workers[I].Result;
+    }
+    Seconds = perf_usec(Start, perf_clock()) / 1000000.0;
+
+    if (0 == Result)
+    {
+        /* merge the per-thread latency samples for whole-run percentiles */
+        for (ULONG I = 0; Params->Threads > I; I++)
+        {
+            memmove(Latencies + LatencyCount, Workers[I].Latencies,
+                sizeof(double) * Workers[I].LatencyCount);
+            LatencyCount += Workers[I].LatencyCount;
+        }
+        perf_report(Name, Params, Latencies, LatencyCount, Seconds);
+    }
+    else
+        fprintf(stderr, "fuseperf: %s: error %d\n", Name, Result);
+
+    free(Latencies);
+
+    return Result;
+}
+
+static int perf_usage(void)
+{
+    fprintf(stderr,
+        "usage: fuseperf -d DIR [-w WORKLOAD[,...]] [-t THREADS[,...]]\n"
+        "    [-n COUNT] [-b BLOCKSIZE] [-s FILESIZE] [-q DEPTH]\n"
+        "workloads: metadata,seqwr,seqrd,rndwr,rndrd,enum (default: all)\n");
+    return 2;
+}
+
+int wmain(int argc, wchar_t **argv)
+{
+    PERF_PARAMS Params =
+    {
+        .Count = 1000,
+        .BlockSize = 64 * 1024,
+        .FileSize = 64 * 1024 * 1024,
+        .Threads = 1,
+        .Depth = 1,
+    };
+    PWSTR Workloads = L"metadata,seqwr,seqrd,rndwr,rndrd,enum";
+    PWSTR ThreadList = L"1";
+    PWSTR P, EndP;
+    int Result = 0;
+
+    for (int I = 1; argc > I; I++)
+    {
+        if (argc <= I + 1 || L'-' != argv[I][0] || L'\0' != argv[I][2])
+            return perf_usage();
+        switch (argv[I][1])
+        {
+        case L'd':
+            Params.Dir = argv[++I];
+            break;
+        case L'w':
+            Workloads = argv[++I];
+            break;
+        case L't':
+            ThreadList = argv[++I];
+            break;
+        case L'n':
+            Params.Count = wcstoul(argv[++I], 0, 10);
+            break;
+        case L'b':
+            Params.BlockSize = wcstoul(argv[++I], 0, 10);
+            break;
+        case L's':
+            Params.FileSize = _wcstoui64(argv[++I], 0, 10);
+            break;
+        case L'q':
+            Params.Depth = wcstoul(argv[++I], 0, 10);
+            break;
+        default:
+            return perf_usage();
+        }
+    }
+
+    if (0 == Params.Dir ||
+        0 == Params.Count || 0 == Params.BlockSize ||
+        Params.BlockSize > Params.FileSize ||
+        0 == Params.Depth || PERF_MAXDEPTH < Params.Depth)
+        return perf_usage();
+
+    perf_init_clock();
+
+    printf("workload,threads,depth,ops,secs,ops_per_sec,p50_us,p90_us,p99_us,max_us\n");
+
+    for (P = ThreadList; 0 != P && 0 == Result; P = 0 != EndP && L',' == *EndP ? EndP + 1 : 0)
+    {
+        Params.Threads = wcstoul(P, &EndP, 10);
+        if (0 == Params.Threads || PERF_MAXTHREADS < Params.Threads)
+            return perf_usage();
+
+        if (0 != wcsstr(Workloads, L"metadata"))
+            Result = Result ? Result :
+                perf_run("metadata", perf_metadata_workload, &Params, Params.Count);
+        if (0 != wcsstr(Workloads, L"seqwr"))
+            Result = Result ? Result :
+                perf_run("seqwr", perf_seqwr_workload, &Params, Params.Count);
+        if (0 != wcsstr(Workloads, L"seqrd"))
+            Result = Result ? Result :
+                perf_run("seqrd", perf_seqrd_workload, &Params, Params.Count);
+        if (0 != wcsstr(Workloads, L"rndwr"))
+            Result = Result ? Result :
+                perf_run("rndwr", perf_rndwr_workload, &Params, Params.Count);
+        if (0 != wcsstr(Workloads, L"rndrd"))
+            Result = Result ? Result :
+                perf_run("rndrd", perf_rndrd_workload, &Params, Params.Count);
+        if (0 != wcsstr(Workloads, L"enum"))
+            Result = Result ? Result :
+                perf_run("enum", perf_enum_workload, &Params, PERF_ENUM_PASSES);
+    }
+
+    return Result;
+}
@@ -46,6 +46,8 @@ void path_prefix_test(void)
         "foo///bar//baz//",
         "foo",
         "/foo/bar/baz",
+        "averylongcomponentexceeding16bytes/next",
+        "/short/averylongcomponentexceeding16bytes",
     };
     PSTR opaths[] =
     {
@@ -65,6 +67,8 @@ void path_prefix_test(void)
         "foo", "bar//baz//",
         "foo", "",
         "/", "foo/bar/baz",
+        "averylongcomponentexceeding16bytes", "next",
+        "/", "short/averylongcomponentexceeding16bytes",
     };
 
     for (size_t i = 0; sizeof ipaths / sizeof ipaths[0] > i; i++)
@@ -106,6 +110,8 @@ void path_suffix_test(void)
         "foo///bar//baz//",
         "foo",
         "/foo/bar/baz",
+        "averylongcomponentexceeding16bytes/next",
+        "/short/averylongcomponentexceeding16bytes",
     };
     PSTR opaths[] =
     {
@@ -125,6 +131,8 @@ void path_suffix_test(void)
         "foo///bar//baz", "",
         "foo", "",
         "/foo/bar", "baz",
+        "averylongcomponentexceeding16bytes", "next",
+        "/short", "averylongcomponentexceeding16bytes",
     };
 
     for (size_t i = 0; sizeof ipaths / sizeof ipaths[0] > i; i++)
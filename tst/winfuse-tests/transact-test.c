@@ -27,6 +27,54 @@
 
 #define FUSE_FSCTL_TRANSACT             \
     CTL_CODE(FILE_DEVICE_FILE_SYSTEM, 0xC00 + 'F', METHOD_BUFFERED, FILE_ANY_ACCESS)
+#define FUSE_FSCTL_STATISTICS           \
+    CTL_CODE(FILE_DEVICE_FILE_SYSTEM, 0xC00 + 'S', METHOD_BUFFERED, FILE_ANY_ACCESS)
+#define FUSE_FSCTL_TRANSACT_RING        \
+    CTL_CODE(FILE_DEVICE_FILE_SYSTEM, 0xC00 + 'R', METHOD_BUFFERED, FILE_ANY_ACCESS)
+#define FUSE_FSCTL_NOTIFY               \
+    CTL_CODE(FILE_DEVICE_FILE_SYSTEM, 0xC00 + 'N', METHOD_BUFFERED, FILE_ANY_ACCESS)
+
+/* shared-memory transact ring region header (see winfuse/driver.h) */
+typedef struct
+{
+    UINT32 ReqHead;
+    UINT32 ReqTail;
+    UINT32 RspHead;
+    UINT32 RspTail;
+    UINT32 ReqAreaOffset, ReqAreaLength;
+    UINT32 RspAreaOffset, RspAreaLength;
+} FUSE_RING_SHARED;
+
+/* control operations tunneled through FUSE_FSCTL_TRANSACT (see winfuse/driver.h) */
+#define FUSE_FSCTL_CONTROL_MAGIC        0x4c544346  /* "FCTL" */
+typedef struct
+{
+    UINT32 Zero;
+    UINT32 Magic;
+    UINT32 ControlCode;
+    UINT32 Padding;
+    union
+    {
+        struct { UINT64 Event; } Notify;
+        struct { UINT64 Address, Length, Event; } Ring;
+    };
+} FUSE_FSCTL_CONTROL;
+
+/* see shared/km/shared.h */
+#define FUSE_STATISTICS_OPCODE_COUNT    64
+#define FUSE_STATISTICS_BUCKET_COUNT    32
+typedef struct
+{
+    UINT64 OpcodeCounts[FUSE_STATISTICS_OPCODE_COUNT];
+    UINT64 OpcodeTimes[FUSE_STATISTICS_OPCODE_COUNT];
+    UINT32 OpcodeLatency[FUSE_STATISTICS_OPCODE_COUNT][FUSE_STATISTICS_BUCKET_COUNT];
+    UINT64 CacheEntryHits;
+    UINT64 CacheEntryMisses;
+    UINT32 PendingCount;
+    UINT32 ProcessCount;
+    UINT64 CoroResumeCount;
+    UINT64 CoroSuspendCount;
+} FUSE_STATISTICS;
 
 static void transact_init_dotest(PWSTR DeviceName, PWSTR Prefix)
 {
@@ -99,6 +147,382 @@ static void transact_init_test(void)
     transact_init_dotest(L"WinFsp.Net", L"\\\\winfuse-tests\\share");
 }
 
+static void transact_statistics_dotest(PWSTR DeviceName, PWSTR Prefix)
+{
+    FSP_FSCTL_VOLUME_PARAMS VolumeParams = { .Version = sizeof VolumeParams };
+    HANDLE VolumeHandle;
+    WCHAR VolumeName[MAX_PATH];
+    BOOL Success;
+    NTSTATUS Result;
+
+    if (0 != Prefix && L'\\' == Prefix[0] && L'\\' == Prefix[1])
+        wcscpy_s(VolumeParams.Prefix, sizeof VolumeParams.Prefix / sizeof(WCHAR),
+            Prefix + 1);
+    VolumeParams.FsextControlCode = FUSE_FSCTL_TRANSACT;
+    Result = FspFsctlCreateVolume(DeviceName, &VolumeParams,
+        VolumeName, sizeof VolumeName, &VolumeHandle);
+    ASSERT(STATUS_SUCCESS == Result);
+    ASSERT(INVALID_HANDLE_VALUE != VolumeHandle);
+
+    FSP_FSCTL_DECLSPEC_ALIGN UINT8 RequestBuf[FUSE_PROTO_REQ_SIZEMIN];
+    FUSE_PROTO_RSP ResponseBuf;
+    FUSE_PROTO_REQ *Request = (PVOID)RequestBuf;
+    FUSE_PROTO_RSP *Response = &ResponseBuf;
+    DWORD BytesTransferred;
+
+    Success = DeviceIoControl(VolumeHandle, FUSE_FSCTL_TRANSACT,
+        0, 0, RequestBuf, sizeof RequestBuf, &BytesTransferred, 0);
+    ASSERT(Success);
+    ASSERT(FUSE_PROTO_OPCODE_INIT == Request->opcode);
+
+    memset(Response, 0, FUSE_PROTO_RSP_SIZE(init));
+    Response->len = FUSE_PROTO_RSP_SIZE(init);
+    Response->unique = Request->unique;
+    Response->rsp.init.major = Request->req.init.major;
+    Response->rsp.init.minor = Request->req.init.minor;
+
+    Success = DeviceIoControl(VolumeHandle, FUSE_FSCTL_TRANSACT,
+        Response, Response->len, 0, 0, &BytesTransferred, 0);
+    ASSERT(Success);
+
+    FUSE_FSCTL_CONTROL Control = { 0 };
+    FUSE_STATISTICS *Statistics;
+
+    Statistics = malloc(sizeof *Statistics);
+    ASSERT(0 != Statistics);
+
+    Control.Magic = FUSE_FSCTL_CONTROL_MAGIC;
+    Control.ControlCode = FUSE_FSCTL_STATISTICS;
+    Success = DeviceIoControl(VolumeHandle, FUSE_FSCTL_TRANSACT,
+        &Control, sizeof Control, Statistics, sizeof *Statistics, &BytesTransferred, 0);
+    ASSERT(Success);
+    ASSERT(sizeof *Statistics == BytesTransferred);
+
+    ASSERT(1 == Statistics->OpcodeCounts[FUSE_PROTO_OPCODE_INIT]);
+    ASSERT(0 != Statistics->CoroResumeCount);
+    ASSERT(0 == Statistics->ProcessCount);
+
+    /* undersized output buffer */
+    Success = DeviceIoControl(VolumeHandle, FUSE_FSCTL_TRANSACT,
+        &Control, sizeof Control, Statistics, sizeof *Statistics - 1, &BytesTransferred, 0);
+    ASSERT(!Success);
+
+    /* unknown control operation */
+    Control.ControlCode = 42;
+    Success = DeviceIoControl(VolumeHandle, FUSE_FSCTL_TRANSACT,
+        &Control, sizeof Control, Statistics, sizeof *Statistics, &BytesTransferred, 0);
+    ASSERT(!Success);
+
+    free(Statistics);
+
+    Success = CloseHandle(VolumeHandle);
+    ASSERT(Success);
+}
+
+static void transact_statistics_test(void)
+{
+    transact_statistics_dotest(L"WinFsp.Disk", 0);
+    transact_statistics_dotest(L"WinFsp.Net", L"\\\\winfuse-tests\\share");
+}
+
+static void transact_ring_dotest(PWSTR DeviceName, PWSTR Prefix)
+{
+    FSP_FSCTL_VOLUME_PARAMS VolumeParams = { .Version = sizeof VolumeParams };
+    HANDLE VolumeHandle;
+    WCHAR VolumeName[MAX_PATH];
+    BOOL Success;
+    NTSTATUS Result;
+
+    if (0 != Prefix && L'\\' == Prefix[0] && L'\\' == Prefix[1])
+        wcscpy_s(VolumeParams.Prefix, sizeof VolumeParams.Prefix / sizeof(WCHAR),
+            Prefix + 1);
+    VolumeParams.FsextControlCode = FUSE_FSCTL_TRANSACT;
+    Result = FspFsctlCreateVolume(DeviceName, &VolumeParams,
+        VolumeName, sizeof VolumeName, &VolumeHandle);
+    ASSERT(STATUS_SUCCESS == Result);
+    ASSERT(INVALID_HANDLE_VALUE != VolumeHandle);
+
+    SIZE_T RingLength = 65536;
+    PUINT8 Region;
+    HANDLE Event;
+    DWORD BytesTransferred;
+
+    Region = VirtualAlloc(0, RingLength, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+    ASSERT(0 != Region);
+    Event = CreateEventW(0, FALSE, FALSE, 0);
+    ASSERT(0 != Event);
+
+    FUSE_FSCTL_CONTROL Control = { 0 };
+    Control.Magic = FUSE_FSCTL_CONTROL_MAGIC;
+    Control.ControlCode = FUSE_FSCTL_TRANSACT_RING;
+    Control.Ring.Address = (UINT64)(UINT_PTR)Region;
+    Control.Ring.Length = RingLength;
+    Control.Ring.Event = (UINT64)(UINT_PTR)Event;
+
+    /* first call establishes the ring */
+    Success = DeviceIoControl(VolumeHandle, FUSE_FSCTL_TRANSACT,
+        &Control, sizeof Control, 0, 0, &BytesTransferred, 0);
+    ASSERT(Success);
+
+    FUSE_RING_SHARED *Shared = (PVOID)Region;
+    ASSERT(sizeof(FUSE_RING_SHARED) == Shared->ReqAreaOffset);
+    ASSERT(0 != Shared->ReqAreaLength);
+    ASSERT(Shared->ReqAreaLength == Shared->RspAreaLength);
+    ASSERT(Shared->ReqAreaOffset + Shared->ReqAreaLength == Shared->RspAreaOffset);
+    ASSERT(0 == Shared->ReqHead && 0 == Shared->ReqTail);
+    ASSERT(0 == Shared->RspHead && 0 == Shared->RspTail);
+
+    PUINT8 ReqArea = Region + Shared->ReqAreaOffset;
+    PUINT8 RspArea = Region + Shared->RspAreaOffset;
+
+    /* second call pumps the ring: it publishes the pending INIT request and
+    signals the event on the empty to non-empty transition */
+    Success = DeviceIoControl(VolumeHandle, FUSE_FSCTL_TRANSACT,
+        &Control, sizeof Control, 0, 0, &BytesTransferred, 0);
+    ASSERT(Success);
+
+    ASSERT(WAIT_OBJECT_0 == WaitForSingleObject(Event, 3000));
+
+    UINT32 ReqHead = *(volatile UINT32 *)&Shared->ReqHead;
+    UINT32 ReqTail = *(volatile UINT32 *)&Shared->ReqTail;
+    ASSERT(ReqHead != ReqTail);
+    MemoryBarrier();
+
+    FUSE_PROTO_REQ *Request = (PVOID)(ReqArea + ReqHead);
+    ASSERT(FUSE_PROTO_REQ_SIZE(init) == Request->len);
+    ASSERT(FUSE_PROTO_OPCODE_INIT == Request->opcode);
+    ASSERT(0 != Request->unique);
+    ASSERT(FUSE_PROTO_VERSION == Request->req.init.major);
+    ASSERT(FUSE_PROTO_MINOR_VERSION == Request->req.init.minor);
+    ASSERT(FUSE_PROTO_ALIGN_SIZE(Request->len) == ReqTail - ReqHead);
+
+    /* consume the request and produce the INIT response */
+    *(volatile UINT32 *)&Shared->ReqHead = ReqTail;
+
+    FUSE_PROTO_RSP *Response = (PVOID)(RspArea + Shared->RspTail);
+    memset(Response, 0, FUSE_PROTO_RSP_SIZE(init));
+    Response->len = FUSE_PROTO_RSP_SIZE(init);
+    Response->unique = Request->unique;
+    Response->rsp.init.major = Request->req.init.major;
+    Response->rsp.init.minor = Request->req.init.minor;
+    MemoryBarrier();
+    *(volatile UINT32 *)&Shared->RspTail = FUSE_PROTO_ALIGN_SIZE(Response->len);
+
+    /* third call consumes the response, completing INIT */
+    Success = DeviceIoControl(VolumeHandle, FUSE_FSCTL_TRANSACT,
+        &Control, sizeof Control, 0, 0, &BytesTransferred, 0);
+    ASSERT(Success);
+    ASSERT(Shared->RspHead == Shared->RspTail);
+    ASSERT(Shared->ReqHead == Shared->ReqTail);
+
+    /* the instance took the INIT handshake through the ring */
+    FUSE_STATISTICS *Statistics;
+    Statistics = malloc(sizeof *Statistics);
+    ASSERT(0 != Statistics);
+    Control.ControlCode = FUSE_FSCTL_STATISTICS;
+    Success = DeviceIoControl(VolumeHandle, FUSE_FSCTL_TRANSACT,
+        &Control, sizeof Control, Statistics, sizeof *Statistics, &BytesTransferred, 0);
+    ASSERT(Success);
+    ASSERT(1 == Statistics->OpcodeCounts[FUSE_PROTO_OPCODE_INIT]);
+    free(Statistics);
+
+    Success = CloseHandle(VolumeHandle);
+    ASSERT(Success);
+
+    Success = VirtualFree(Region, 0, MEM_RELEASE);
+    ASSERT(Success);
+    Success = CloseHandle(Event);
+    ASSERT(Success);
+}
+
+static void transact_ring_test(void)
+{
+    transact_ring_dotest(L"WinFsp.Disk", 0);
+    transact_ring_dotest(L"WinFsp.Net", L"\\\\winfuse-tests\\share");
+}
+
+static unsigned __stdcall transact_notify_dotest_thread(void *FilePath)
+{
+    FspDebugLog(__FUNCTION__ ": \"%S\"\n", FilePath);
+
+    HANDLE Handle;
+    Handle = CreateFileW(FilePath,
+        FILE_GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, 0, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS, 0);
+    if (INVALID_HANDLE_VALUE == Handle)
+        return GetLastError();
+    CloseHandle(Handle);
+    return 0;
+}
+
+static void transact_notify_dotest(PWSTR DeviceName, PWSTR Prefix)
+{
+    FSP_FSCTL_VOLUME_PARAMS VolumeParams = { .Version = sizeof VolumeParams };
+    HANDLE VolumeHandle;
+    WCHAR VolumeName[MAX_PATH];
+    WCHAR FilePath[MAX_PATH];
+    HANDLE Thread, Event;
+    DWORD ExitCode;
+    BOOL Success;
+    NTSTATUS Result;
+
+    if (0 != Prefix && L'\\' == Prefix[0] && L'\\' == Prefix[1])
+        wcscpy_s(VolumeParams.Prefix, sizeof VolumeParams.Prefix / sizeof(WCHAR),
+            Prefix + 1);
+    VolumeParams.FsextControlCode = FUSE_FSCTL_TRANSACT;
+    Result = FspFsctlCreateVolume(DeviceName, &VolumeParams,
+        VolumeName, sizeof VolumeName, &VolumeHandle);
+    ASSERT(STATUS_SUCCESS == Result);
+    ASSERT(INVALID_HANDLE_VALUE != VolumeHandle);
+
+    Event = CreateEventW(0, FALSE, FALSE, 0);
+    ASSERT(0 != Event);
+
+    FUSE_FSCTL_CONTROL Control = { 0 };
+    DWORD BytesTransferred;
+
+    Control.Magic = FUSE_FSCTL_CONTROL_MAGIC;
+    Control.ControlCode = FUSE_FSCTL_NOTIFY;
+    Control.Notify.Event = (UINT64)(UINT_PTR)Event;
+    Success = DeviceIoControl(VolumeHandle, FUSE_FSCTL_TRANSACT,
+        &Control, sizeof Control, 0, 0, &BytesTransferred, 0);
+    ASSERT(Success);
+
+    /* registration signals once and the INIT request is already pending */
+    ASSERT(WAIT_OBJECT_0 == WaitForSingleObject(Event, 3000));
+
+    /* only one doorbell per instance */
+    Success = DeviceIoControl(VolumeHandle, FUSE_FSCTL_TRANSACT,
+        &Control, sizeof Control, 0, 0, &BytesTransferred, 0);
+    ASSERT(!Success);
+
+    FSP_FSCTL_DECLSPEC_ALIGN UINT8 RequestBuf[FUSE_PROTO_REQ_SIZEMIN];
+    FUSE_PROTO_RSP ResponseBuf;
+    FUSE_PROTO_REQ *Request = (PVOID)RequestBuf;
+    FUSE_PROTO_RSP *Response = &ResponseBuf;
+
+    Success = DeviceIoControl(VolumeHandle, FUSE_FSCTL_TRANSACT,
+        0, 0, RequestBuf, sizeof RequestBuf, &BytesTransferred, 0);
+    ASSERT(Success);
+    ASSERT(FUSE_PROTO_OPCODE_INIT == Request->opcode);
+
+    /* with a doorbell registered a transact that finds no work returns an
+    empty output buffer instead of blocking for the INIT handshake */
+    Success = DeviceIoControl(VolumeHandle, FUSE_FSCTL_TRANSACT,
+        0, 0, RequestBuf, sizeof RequestBuf, &BytesTransferred, 0);
+    ASSERT(Success);
+    ASSERT(0 == BytesTransferred);
+
+    memset(Response, 0, FUSE_PROTO_RSP_SIZE(init));
+    Response->len = FUSE_PROTO_RSP_SIZE(init);
+    Response->unique = Request->unique;
+    Response->rsp.init.major = FUSE_PROTO_VERSION;
+    Response->rsp.init.minor = FUSE_PROTO_MINOR_VERSION;
+    Success = DeviceIoControl(VolumeHandle, FUSE_FSCTL_TRANSACT,
+        Response, Response->len, 0, 0, &BytesTransferred, 0);
+    ASSERT(Success);
+
+    /* generate file system activity; serving it posts pending work into the
+    (empty) ioq and each such transition rings the doorbell */
+    StringCbPrintfW(FilePath, sizeof FilePath, L"%s%s\\file0",
+        Prefix ? L"" : L"\\\\?\\GLOBALROOT", Prefix ? Prefix : VolumeName);
+    Thread = (HANDLE)_beginthreadex(0, 0, transact_notify_dotest_thread, FilePath, 0, 0);
+    ASSERT(0 != Thread);
+
+    for (BOOLEAN Loop = TRUE; Loop;)
+    {
+        do
+        {
+            Success = DeviceIoControl(VolumeHandle, FUSE_FSCTL_TRANSACT,
+                0, 0, RequestBuf, sizeof RequestBuf, &BytesTransferred, 0);
+            ASSERT(Success);
+        } while (0 == BytesTransferred);
+
+        Response->len = 0;
+        switch (Request->opcode)
+        {
+        case FUSE_PROTO_OPCODE_STATFS:
+            memset(Response, 0, FUSE_PROTO_RSP_SIZE(statfs));
+            Response->len = FUSE_PROTO_RSP_SIZE(statfs);
+            Response->unique = Request->unique;
+            Response->rsp.statfs.st.blocks = 1000;
+            Response->rsp.statfs.st.bfree = 1000;
+            Response->rsp.statfs.st.frsize = 4096;
+            break;
+
+        case FUSE_PROTO_OPCODE_GETATTR:
+            memset(Response, 0, FUSE_PROTO_RSP_SIZE(getattr));
+            Response->len = FUSE_PROTO_RSP_SIZE(getattr);
+            Response->unique = Request->unique;
+            Response->rsp.getattr.attr.ino = Request->nodeid;
+            Response->rsp.getattr.attr.mode = 0040777;
+            Response->rsp.getattr.attr.nlink = 1;
+            break;
+
+        case FUSE_PROTO_OPCODE_LOOKUP:
+            memset(Response, 0, FUSE_PROTO_RSP_SIZE(lookup));
+            Response->len = FUSE_PROTO_RSP_SIZE(lookup);
+            Response->unique = Request->unique;
+            Response->rsp.lookup.entry.nodeid = FUSE_PROTO_ROOT_INO + 1;
+            Response->rsp.lookup.entry.attr.ino = FUSE_PROTO_ROOT_INO + 1;
+            Response->rsp.lookup.entry.attr.mode = 0040777;
+            Response->rsp.lookup.entry.attr.nlink = 1;
+            break;
+
+        case FUSE_PROTO_OPCODE_FORGET:
+        case FUSE_PROTO_OPCODE_BATCH_FORGET:
+            continue;
+
+        case FUSE_PROTO_OPCODE_OPENDIR:
+        case FUSE_PROTO_OPCODE_OPEN:
+            memset(Response, 0, FUSE_PROTO_RSP_SIZE(open));
+            Response->len = FUSE_PROTO_RSP_SIZE(open);
+            Response->unique = Request->unique;
+            Response->rsp.open.fh = 100 + Request->nodeid;
+            break;
+
+        case FUSE_PROTO_OPCODE_RELEASEDIR:
+        case FUSE_PROTO_OPCODE_RELEASE:
+            memset(Response, 0, FUSE_PROTO_RSP_HEADER_SIZE);
+            Response->len = FUSE_PROTO_RSP_HEADER_SIZE;
+            Response->unique = Request->unique;
+
+            if (100 + FUSE_PROTO_ROOT_INO + 1 == Request->req.release.fh)
+                Loop = FALSE;
+            break;
+
+        default:
+            memset(Response, 0, FUSE_PROTO_RSP_HEADER_SIZE);
+            Response->len = FUSE_PROTO_RSP_HEADER_SIZE;
+            Response->unique = Request->unique;
+            Response->error = -38; /* -ENOSYS */
+            break;
+        }
+
+        Success = DeviceIoControl(VolumeHandle, FUSE_FSCTL_TRANSACT,
+            Response, Response->len, 0, 0, &BytesTransferred, 0);
+        ASSERT(Success);
+    }
+
+    /* the doorbell rang while the open was serviced */
+    ASSERT(WAIT_OBJECT_0 == WaitForSingleObject(Event, 3000));
+
+    WaitForSingleObject(Thread, INFINITE);
+    GetExitCodeThread(Thread, &ExitCode);
+    CloseHandle(Thread);
+    ASSERT(0 == ExitCode);
+
+    Success = CloseHandle(VolumeHandle);
+    ASSERT(Success);
+    Success = CloseHandle(Event);
+    ASSERT(Success);
+}
+
+static void transact_notify_test(void)
+{
+    transact_notify_dotest(L"WinFsp.Disk", 0);
+    transact_notify_dotest(L"WinFsp.Net", L"\\\\winfuse-tests\\share");
+}
+
 static HANDLE transact_open_close_dotest_VolumeHandle;
 static HANDLE transact_open_close_dotest_MainThread;
 
@@ -386,11 +810,338 @@ static void transact_open_bogus_test(void)
     transact_open_close_dotest(L"WinFsp.Net", L"\\\\winfuse-tests\\share", 'BOGU');
 }
 
+/*
+ * Transact stress test.
+ *
+ * Pumps FUSE_FSCTL_TRANSACT from multiple responder threads against a synthetic
+ * in-test file system, while an equal number of op threads generate load by
+ * opening and closing files through the FSD. This isolates driver and ioctl
+ * overhead from any real file system and reports achieved requests/sec together
+ * with the per-op latency distribution.
+ *
+ * Configuration (environment variables):
+ *     WINFUSE_STRESS_THREADS          responder/op thread pairs (default 4)
+ *     WINFUSE_STRESS_DURATION         run time in seconds (default 3)
+ *     WINFUSE_STRESS_BATCH            transact buffer size in multiples of
+ *                                     FUSE_PROTO_REQ_SIZEMIN (default 4)
+ */
+
+#define transact_stress_maxthreads      64
+#define transact_stress_maxlatcnt       100000
+
+static struct
+{
+    HANDLE VolumeHandle;
+    WCHAR VolumeName[MAX_PATH];
+    ULONG BatchSize;
+    volatile LONG Stop;
+    volatile LONG64 RequestCount;
+} transact_stress;
+
+typedef struct
+{
+    HANDLE Thread;
+    ULONG Index;
+    UINT64 OpCount;
+    ULONG LatencyCount;
+    double *Latencies;
+} TRANSACT_STRESS_OPTHREAD;
+
+static unsigned __stdcall transact_stress_responder_thread(void *Param)
+{
+    ULONG RequestBufSize = transact_stress.BatchSize * FUSE_PROTO_REQ_SIZEMIN;
+    ULONG ResponseBufSize = RequestBufSize / FUSE_PROTO_REQ_HEADER_SIZE *
+        FUSE_PROTO_ALIGN_SIZE(sizeof(FUSE_PROTO_RSP));
+    PUINT8 RequestBuf, ResponseBuf;
+    FUSE_PROTO_REQ *Request;
+    FUSE_PROTO_RSP *Response;
+    DWORD BytesTransferred, ResponseLen;
+    UINT64 RequestCount = 0, Nodeid;
+    BOOL Success;
+
+    RequestBuf = malloc(RequestBufSize);
+    ResponseBuf = malloc(ResponseBufSize);
+    ASSERT(0 != RequestBuf && 0 != ResponseBuf);
+
+    ResponseLen = 0;
+    for (;;)
+    {
+        /* send any batched responses and pull the next request batch */
+        Success = DeviceIoControl(transact_stress.VolumeHandle, FUSE_FSCTL_TRANSACT,
+            0 != ResponseLen ? ResponseBuf : 0, ResponseLen,
+            RequestBuf, RequestBufSize, &BytesTransferred, 0);
+        if (!Success)
+        {
+            ASSERT(ERROR_INVALID_HANDLE == GetLastError() || ERROR_OPERATION_ABORTED == GetLastError());
+            break;
+        }
+
+        ResponseLen = 0;
+
+        for (
+            PUINT8 P = RequestBuf, EndP = RequestBuf + BytesTransferred;
+            P + FUSE_PROTO_REQ_HEADER_SIZE <= EndP;
+            P += FUSE_PROTO_ALIGN_SIZE(Request->len))
+        {
+            Request = (PVOID)P;
+            ASSERT(FUSE_PROTO_REQ_HEADER_SIZE <= Request->len);
+            ASSERT(P + Request->len <= EndP);
+
+            RequestCount++;
+
+            Response = (PVOID)(ResponseBuf + ResponseLen);
+            switch (Request->opcode)
+            {
+            case FUSE_PROTO_OPCODE_INIT:
+                memset(Response, 0, FUSE_PROTO_RSP_SIZE(init));
+                Response->len = FUSE_PROTO_RSP_SIZE(init);
+                Response->unique = Request->unique;
+                Response->rsp.init.major = Request->req.init.major;
+                Response->rsp.init.minor = Request->req.init.minor;
+                break;
+
+            case FUSE_PROTO_OPCODE_STATFS:
+                memset(Response, 0, FUSE_PROTO_RSP_SIZE(statfs));
+                Response->len = FUSE_PROTO_RSP_SIZE(statfs);
+                Response->unique = Request->unique;
+                Response->rsp.statfs.st.blocks = 1000;
+                Response->rsp.statfs.st.bfree = 1000;
+                Response->rsp.statfs.st.frsize = 4096;
+                break;
+
+            case FUSE_PROTO_OPCODE_GETATTR:
+                memset(Response, 0, FUSE_PROTO_RSP_SIZE(getattr));
+                Response->len = FUSE_PROTO_RSP_SIZE(getattr);
+                Response->unique = Request->unique;
+                Response->rsp.getattr.attr.ino = Request->nodeid;
+                Response->rsp.getattr.attr.mode =
+                    FUSE_PROTO_ROOT_INO == Request->nodeid ? 0040777 : 0100777;
+                Response->rsp.getattr.attr.nlink = 1;
+                Response->rsp.getattr.attr.uid = Request->uid;
+                Response->rsp.getattr.attr.gid = Request->gid;
+                break;
+
+            case FUSE_PROTO_OPCODE_LOOKUP:
+                ASSERT(0 == strncmp("file", Request->req.lookup.name, 4));
+                Nodeid = FUSE_PROTO_ROOT_INO + 1 +
+                    strtoul(Request->req.lookup.name + 4, 0, 10);
+
+                memset(Response, 0, FUSE_PROTO_RSP_SIZE(lookup));
+                Response->len = FUSE_PROTO_RSP_SIZE(lookup);
+                Response->unique = Request->unique;
+                Response->rsp.lookup.entry.nodeid = Nodeid;
+                Response->rsp.lookup.entry.attr.ino = Nodeid;
+                Response->rsp.lookup.entry.attr.mode = 0100777;
+                Response->rsp.lookup.entry.attr.nlink = 1;
+                Response->rsp.lookup.entry.attr.uid = Request->uid;
+                Response->rsp.lookup.entry.attr.gid = Request->gid;
+                break;
+
+            case FUSE_PROTO_OPCODE_FORGET:
+            case FUSE_PROTO_OPCODE_BATCH_FORGET:
+                continue;
+
+            case FUSE_PROTO_OPCODE_OPENDIR:
+            case FUSE_PROTO_OPCODE_OPEN:
+                memset(Response, 0, FUSE_PROTO_RSP_SIZE(open));
+                Response->len = FUSE_PROTO_RSP_SIZE(open);
+                Response->unique = Request->unique;
+                Response->rsp.open.fh = 100 + Request->nodeid;
+                break;
+
+            case FUSE_PROTO_OPCODE_RELEASEDIR:
+            case FUSE_PROTO_OPCODE_RELEASE:
+                memset(Response, 0, FUSE_PROTO_RSP_HEADER_SIZE);
+                Response->len = FUSE_PROTO_RSP_HEADER_SIZE;
+                Response->unique = Request->unique;
+                break;
+
+            default:
+                memset(Response, 0, FUSE_PROTO_RSP_HEADER_SIZE);
+                Response->len = FUSE_PROTO_RSP_HEADER_SIZE;
+                Response->unique = Request->unique;
+                Response->error = -38; /* -ENOSYS */
+                break;
+            }
+
+            ResponseLen += FUSE_PROTO_ALIGN_SIZE(Response->len);
+            ASSERT(ResponseBufSize >= ResponseLen);
+        }
+    }
+
+    free(ResponseBuf);
+    free(RequestBuf);
+
+    InterlockedAdd64(&transact_stress.RequestCount, RequestCount);
+
+    return 0;
+}
+
+static unsigned __stdcall transact_stress_op_thread(void *Param)
+{
+    TRANSACT_STRESS_OPTHREAD *OpThread = Param;
+    WCHAR FilePath[MAX_PATH];
+    HANDLE Handle;
+    LARGE_INTEGER Frequency, T0, T1;
+
+    QueryPerformanceFrequency(&Frequency);
+
+    for (UINT64 I = 0; 0 == transact_stress.Stop; I++)
+    {
+        /* rotate over a small per-thread set of names to bound cached entries */
+        StringCbPrintfW(FilePath, sizeof FilePath, L"\\\\?\\GLOBALROOT%s\\file%lu",
+            transact_stress.VolumeName, (ULONG)(OpThread->Index * 16 + (I & 15)));
+
+        QueryPerformanceCounter(&T0);
+        Handle = CreateFileW(FilePath,
+            FILE_GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, 0, OPEN_EXISTING, 0, 0);
+        if (INVALID_HANDLE_VALUE == Handle)
+            return GetLastError();
+        CloseHandle(Handle);
+        QueryPerformanceCounter(&T1);
+
+        OpThread->OpCount++;
+        if (transact_stress_maxlatcnt > OpThread->LatencyCount)
+            OpThread->Latencies[OpThread->LatencyCount++] =
+                (T1.QuadPart - T0.QuadPart) * 1000000.0 / Frequency.QuadPart;
+    }
+
+    return 0;
+}
+
+static int transact_stress_latcmp(const void *x, const void *y)
+{
+    double a = *(const double *)x, b = *(const double *)y;
+    return a < b ? -1 : a > b ? +1 : 0;
+}
+
+static ULONG transact_stress_getenv(const char *Name, ULONG Default, ULONG Min, ULONG Max)
+{
+    const char *Value = getenv(Name);
+    ULONG Result;
+
+    if (0 == Value)
+        return Default;
+    Result = strtoul(Value, 0, 10);
+    return Min > Result ? Min : Max < Result ? Max : Result;
+}
+
+static void transact_stress_dotest(PWSTR DeviceName, PWSTR Prefix)
+{
+    FSP_FSCTL_VOLUME_PARAMS VolumeParams = { .Version = sizeof VolumeParams };
+    HANDLE VolumeHandle;
+    HANDLE ResponderThreads[transact_stress_maxthreads];
+    TRANSACT_STRESS_OPTHREAD OpThreads[transact_stress_maxthreads];
+    ULONG ThreadCount, Duration;
+    double *Latencies;
+    ULONG LatencyCount;
+    UINT64 OpCount;
+    DWORD ExitCode;
+    BOOL Success;
+    NTSTATUS Result;
+
+    ThreadCount = transact_stress_getenv("WINFUSE_STRESS_THREADS", 4,
+        1, transact_stress_maxthreads);
+    Duration = transact_stress_getenv("WINFUSE_STRESS_DURATION", 3, 1, 3600);
+    transact_stress.BatchSize = transact_stress_getenv("WINFUSE_STRESS_BATCH", 4, 1, 16);
+    transact_stress.Stop = 0;
+    transact_stress.RequestCount = 0;
+
+    if (0 != Prefix && L'\\' == Prefix[0] && L'\\' == Prefix[1])
+        wcscpy_s(VolumeParams.Prefix, sizeof VolumeParams.Prefix / sizeof(WCHAR),
+            Prefix + 1);
+    VolumeParams.FsextControlCode = FUSE_FSCTL_TRANSACT;
+    Result = FspFsctlCreateVolume(DeviceName, &VolumeParams,
+        transact_stress.VolumeName, sizeof transact_stress.VolumeName, &VolumeHandle);
+    ASSERT(STATUS_SUCCESS == Result);
+    ASSERT(INVALID_HANDLE_VALUE != VolumeHandle);
+    transact_stress.VolumeHandle = VolumeHandle;
+
+    for (ULONG I = 0; ThreadCount > I; I++)
+    {
+        ResponderThreads[I] = (HANDLE)_beginthreadex(0, 0,
+            transact_stress_responder_thread, 0, 0, 0);
+        ASSERT(0 != ResponderThreads[I]);
+    }
+
+    for (ULONG I = 0; ThreadCount > I; I++)
+    {
+        memset(&OpThreads[I], 0, sizeof OpThreads[I]);
+        OpThreads[I].Index = I;
+        OpThreads[I].Latencies = malloc(transact_stress_maxlatcnt * sizeof(double));
+        ASSERT(0 != OpThreads[I].Latencies);
+        OpThreads[I].Thread = (HANDLE)_beginthreadex(0, 0,
+            transact_stress_op_thread, &OpThreads[I], 0, 0);
+        ASSERT(0 != OpThreads[I].Thread);
+    }
+
+    Sleep(Duration * 1000);
+    InterlockedExchange(&transact_stress.Stop, 1);
+
+    OpCount = 0;
+    LatencyCount = 0;
+    for (ULONG I = 0; ThreadCount > I; I++)
+    {
+        WaitForSingleObject(OpThreads[I].Thread, INFINITE);
+        GetExitCodeThread(OpThreads[I].Thread, &ExitCode);
+        CloseHandle(OpThreads[I].Thread);
+        ASSERT(0 == ExitCode);
+        OpCount += OpThreads[I].OpCount;
+        LatencyCount += OpThreads[I].LatencyCount;
+    }
+
+    /* closing the volume aborts the responder transact loops */
+    Success = CloseHandle(VolumeHandle);
+    ASSERT(Success);
+    for (ULONG I = 0; ThreadCount > I; I++)
+    {
+        WaitForSingleObject(ResponderThreads[I], INFINITE);
+        CloseHandle(ResponderThreads[I]);
+    }
+
+    Latencies = malloc(LatencyCount * sizeof(double));
+    ASSERT(0 != Latencies);
+    LatencyCount = 0;
+    for (ULONG I = 0; ThreadCount > I; I++)
+    {
+        memcpy(Latencies + LatencyCount, OpThreads[I].Latencies,
+            OpThreads[I].LatencyCount * sizeof(double));
+        LatencyCount += OpThreads[I].LatencyCount;
+        free(OpThreads[I].Latencies);
+    }
+    qsort(Latencies, LatencyCount, sizeof Latencies[0], transact_stress_latcmp);
+
+    ASSERT(0 != OpCount);
+    ASSERT(0 != LatencyCount);
+    tlib_printf("%S: threads=%lu batch=%lu secs=%lu "
+        "ops=%llu ops_per_sec=%.0f reqs=%llu reqs_per_sec=%.0f "
+        "lat_us p50=%.1f p90=%.1f p99=%.1f max=%.1f\n",
+        DeviceName, ThreadCount, transact_stress.BatchSize, Duration,
+        (unsigned long long)OpCount, (double)OpCount / Duration,
+        (unsigned long long)transact_stress.RequestCount,
+        (double)transact_stress.RequestCount / Duration,
+        Latencies[LatencyCount / 2],
+        Latencies[LatencyCount * 9 / 10],
+        Latencies[LatencyCount * 99 / 100],
+        Latencies[LatencyCount - 1]);
+
+    free(Latencies);
+}
+
+static void transact_stress_test(void)
+{
+    transact_stress_dotest(L"WinFsp.Disk", 0);
+}
+
 void transact_tests(void)
 {
     TEST(transact_init_test);
+    TEST(transact_statistics_test);
+    TEST(transact_ring_test);
+    TEST(transact_notify_test);
     TEST(transact_open_close_test);
     TEST(transact_open_abandon_test);
     TEST(transact_open_cancel_test);
     TEST(transact_open_bogus_test);
+    TEST_OPT(transact_stress_test);
 }
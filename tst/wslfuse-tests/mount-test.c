@@ -58,6 +58,40 @@ static void mount_createvol_test(void)
     mount_createvol_dotest(L"\\\\wslfuse-tests\\share");
 }
 
+static void mount_combined_dotest(wchar_t *Prefix)
+{
+    WSLFUSE_IOCTL_MOUNT_ARG MountArg = { .VolumeParams.Version = sizeof(FSP_FSCTL_VOLUME_PARAMS)};
+    int fusefd, res;
+
+    /* skip the Windows mount point and WSL mount id associations */
+    MountArg.LxMountId = (UINT64)-1LL;
+
+    if (0 != Prefix && L'\\' == Prefix[0] && L'\\' == Prefix[1])
+    {
+        /* note that on Linux: sizeof(wchar_t) != sizeof(WCHAR) */
+        wchar_t *P = Prefix + 1;
+        WCHAR *Q = MountArg.VolumeParams.Prefix;
+        while (0 != (*Q++ = (WCHAR)*P++))
+            ;
+    }
+
+    fusefd = open("/dev/fuse", O_RDWR);
+    ASSERT(-1 != fusefd);
+
+    res = ioctl(fusefd, WSLFUSE_IOCTL_MOUNT, &MountArg);
+    ASSERT(0 == res);
+    ASSERT(0 == strncmp(MountArg.VolumeName, "\\Device\\Volume{", 15));
+
+    res = close(fusefd);
+    ASSERT(0 == res);
+}
+
+static void mount_combined_test(void)
+{
+    mount_combined_dotest(0);
+    mount_combined_dotest(L"\\\\wslfuse-tests\\share");
+}
+
 #if 0
 static void mount_unmount_test(void)
 {
@@ -126,6 +160,7 @@ static void mount_unmount_test(void)
 void mount_tests(void)
 {
     TEST(mount_createvol_test);
+    TEST(mount_combined_test);
 #if 0
     TEST(mount_unmount_test);
 #endif